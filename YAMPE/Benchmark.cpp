@@ -0,0 +1,1113 @@
+/**
+	@file 		Benchmark.cpp
+	@author		dgaffney
+	@practical
+	@brief		Timing of engine scenarios, shared by the GUI and the headless runner.
+	*/
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "Benchmark.h"
+#include "Determinism.h"
+#include "TaskGraph.h"
+#include "Particle/ConstraintTable.h"
+#include "Particle/ContactGenerators.h"
+#include "Particle/EventCradle.h"
+#include "Particle/FixedWorld.h"
+#include "Particle/ForceGeneratorRegistry.h"
+#include "Particle/ImplicitIntegrator.h"
+#include "Particle/MeshContactGenerator.h"
+#include "Particle/MortonOrder.h"
+#include "Particle/MultirateStepper.h"
+#include "Particle/NeighbourList.h"
+#include "Particle/ParallelContactGenerator.h"
+#include "Particle/ParticlePool.h"
+#include "Particle/Scene.h"
+#include "Particle/SphereNarrowPhase.h"
+#include "Particle/SpringNetwork.h"
+#include "Particle/TreeConstraintSolver.h"
+
+namespace YAMPE {
+
+using namespace P;
+
+namespace {
+
+	const float DT = 1.0f/60.0f;
+	const float RADIUS = 0.5f;
+	const float ANCHOR_HEIGHT = 10.0f;
+	const float STRING_LENGTH = 5.0f;
+
+	/// The ofApp cradle built with the generic (dynamic) engine classes.
+	struct DynamicCradle {
+		ParticleRegistry particles;
+		ForceGeneratorRegistry forceGenerators;
+		ConstraintTable constraints;
+		ParticleParticleContactGenerator ppContactGenerator;
+		ContactRegistry::Ref contacts;
+
+		DynamicCradle(unsigned n, float angle) : contacts(new ContactRegistry()) {
+			ForceGenerator::Ref gravity(new GravityForceGenerator(ofVec3f(0.0f, -9.81f, 0.0f)));
+			float x = -(n*2.0f*RADIUS)/2.0f;
+			for (unsigned k=0; k<n; ++k) {
+				ofVec3f anchor(x, ANCHOR_HEIGHT, 0.0f);
+				float theta = k==0 ? ofDegToRad(angle) : 0.0f;
+				Particle::Ref ball(new Particle());
+				ball->setPosition(anchor + STRING_LENGTH*ofVec3f(-sinf(theta), -cosf(theta), 0.0f)).setRadius(RADIUS);
+				constraints.addAnchored(ConstraintTable::EQUALITY, k, anchor, STRING_LENGTH);
+				particles.push_back(ball);
+				forceGenerators.add(ball, gravity);
+				ppContactGenerator.particles.push_back(ball);
+				x += 2.0f*RADIUS;
+			}
+		}
+
+		void step(float dt) {
+			forceGenerators.applyForce(dt);
+			for (auto && p: particles) p->integrate(dt);
+			constraints.generate(particles, contacts);
+			ppContactGenerator.generate(contacts);
+			contacts->resolve(dt);
+			contacts->clear();
+		}
+	};
+
+	/// Kinetic plus potential energy of the cradle balls, relative to the anchors.
+	double energy(const ParticleRegistry& particles) {
+		double e = 0.0;
+		for (auto && p: particles) {
+			e += 0.5*p->mass()*p->velocity.lengthSquared() + p->mass()*9.81*(p->position.y-ANCHOR_HEIGHT);
+		}
+		return e;
+	}
+
+	/**	Fixed step against event driven simulation of the same cradle over ten
+		simulated minutes, with the relative energy drift of each. At 60 Hz
+		the event driven run is only two to three times faster; its gain is
+		accuracy, which the fixed step loop barely improves by shortening its
+		step (the contacts, not the integration, lose most of the energy), so
+		it is also run at a step divided by divisions, where the event driven
+		run is far faster and still far more accurate.
+		*/
+	void runEventCradle(Benchmark& benchmark, unsigned n, unsigned divisions) {
+
+		const double DURATION = 600.0;
+		String size = toString(n) + " balls, " + toString(DURATION) + " s";
+
+		double fixedMicros[2];
+		for (unsigned pass=0; pass<2; ++pass) {
+			unsigned d = pass==0 ? 1 : divisions;
+			unsigned steps = (unsigned) (DURATION/DT)*d;
+			DynamicCradle cradle(n, 45.0f);
+			double initial = energy(cradle.particles);
+			Benchmark::Result& fixed = benchmark.run("Fixed step cradle (" + size + ", dt/" + toString(d) + ")", 1, [&]() {
+				for (unsigned k=0; k<steps; ++k) cradle.step(DT/d);
+			});
+			fixed.note = "energy drift = " + toString(100.0*(energy(cradle.particles)-initial)/std::fabs(initial)) + "%";
+			fixedMicros[pass] = fixed.microsPerIteration;
+		}
+
+		DynamicCradle cradle(n, 45.0f);
+		EventCradle events(RADIUS);
+		events.load(cradle.particles, cradle.constraints);
+		double initial = energy(cradle.particles);
+		Benchmark::Result& driven = benchmark.run("Event driven cradle (" + size + ")", 1, [&]() {
+			events.advance(DURATION);
+		});
+		double micros = std::max(driven.microsPerIteration, 1.0e-3);
+		driven.note = "energy drift = " + toString(100.0*(events.energy()-initial)/std::fabs(initial)) + "%, "
+			+ toString(events.numImpacts) + " impacts, " + toString(events.numSteps) + " steps, "
+			+ toString(fixedMicros[0]/micros) + " and " + toString(fixedMicros[1]/micros) + " times faster";
+	}
+
+	template <unsigned N>
+	void runFixedWorld(Benchmark& benchmark, unsigned steps) {
+		FixedWorld<N> world(RADIUS, STRING_LENGTH);
+		world.reset(ANCHOR_HEIGHT);
+		world.raise(0, 45.0f);
+		Benchmark::Result& result = benchmark.run("FixedWorld<" + toString(N) + "> step", steps,
+			[&world]() { world.step(DT); });
+		result.note = "KE = " + toString(world.kineticEnergy());
+	}
+
+	/// Square lattice of side x side particles with springs to the right and below.
+	void makeLattice(unsigned side, ParticleRegistry& particles, SpringNetwork& network) {
+		for (unsigned r=0; r<side; ++r) {
+			for (unsigned c=0; c<side; ++c) {
+				Particle::Ref p(new Particle());
+				p->setPosition(ofVec3f(c*1.05f, r*0.95f, 0.0f));
+				particles.push_back(p);
+			}
+		}
+		for (unsigned r=0; r<side; ++r) {
+			for (unsigned c=0; c<side; ++c) {
+				unsigned k = r*side+c;
+				if (c+1<side) network.add(k, k+1, 10.0f, 1.0f);
+				if (r+1<side) network.add(k, k+side, 10.0f, 1.0f, (k%2)==1);
+			}
+		}
+	}
+
+	void runSpringNetwork(Benchmark& benchmark, unsigned side, unsigned steps) {
+
+		ParticleRegistry particles;
+		SpringNetwork network;
+		makeLattice(side, particles, network);
+
+		// The same springs as generator pairs, one registration per end.
+		ForceGeneratorRegistry registry;
+		for (auto && s: network.springs) {
+			if (s.isBungee) {
+				registry.add(particles[s.i], ForceGenerator::Ref(new BungeeForceGenerator(particles[s.j], s.springConstant, s.restLength)));
+				registry.add(particles[s.j], ForceGenerator::Ref(new BungeeForceGenerator(particles[s.i], s.springConstant, s.restLength)));
+			} else {
+				registry.add(particles[s.i], ForceGenerator::Ref(new SpringForceGenerator(particles[s.j], s.springConstant, s.restLength)));
+				registry.add(particles[s.j], ForceGenerator::Ref(new SpringForceGenerator(particles[s.i], s.springConstant, s.restLength)));
+			}
+		}
+
+		String size = toString(network.size()) + " springs";
+		benchmark.run("ForceGeneratorRegistry (" + size + ")", steps, [&]() {
+			registry.applyForce(DT);
+		});
+		network.finalize(particles.size());
+		benchmark.run("SpringNetwork (" + size + ")", steps, [&]() {
+			network.applyForce(particles, DT);
+		});
+		ThreadPool pool;
+		benchmark.run("SpringNetwork, " + toString(pool.size()) + " threads (" + size + ")", steps, [&]() {
+			network.applyForce(particles, DT, &pool);
+		});
+		for (auto && p: particles) p->clearForce();
+	}
+
+	/// Stiff cloth hanging in the xy plane, its top row held by anchored springs.
+	void makeCloth(unsigned side, float springConstant, ParticleRegistry& particles, SpringNetwork& network) {
+		for (unsigned r=0; r<side; ++r) {
+			for (unsigned c=0; c<side; ++c) {
+				Particle::Ref p(new Particle());
+				p->setPosition(ofVec3f(c*1.0f, -(r*1.0f), 0.0f));
+				p->acceleration = ofVec3f(0.0f, -9.81f, 0.0f);
+				particles.push_back(p);
+				unsigned k = r*side+c;
+				if (r==0) network.addAnchored(k, p->position + ofVec3f(0.0f, 1.0f, 0.0f), springConstant, 1.0f);
+				if (c>0) network.add(k-1, k, springConstant, 1.0f);
+				if (r>0) network.add(k-side, k, springConstant, 1.0f);
+			}
+		}
+		network.finalize(particles.size());
+	}
+
+	/// Largest particle speed, or -1 once the simulation has blown up.
+	float maxSpeed(const ParticleRegistry& particles) {
+		float speed = 0.0f;
+		for (auto && p: particles) {
+			float s = p->velocity.length();
+			if (!std::isfinite(s) || s>1.0e6f) return -1.0f;
+			speed = std::max(speed, s);
+		}
+		return speed;
+	}
+
+	String stability(const ParticleRegistry& particles) {
+		float speed = maxSpeed(particles);
+		return speed<0.0f ? String("diverged") : "max speed = " + toString(speed);
+	}
+
+	/**	Explicit (symplectic Euler) against implicit (backward Euler) integration
+		of a stiff cloth over one second at the frame rate. Explicit integration
+		is stable only below dt ~ 2*sqrt(m/(4k)), so it is also run with substeps.
+		*/
+	void runStiffCloth(Benchmark& benchmark, unsigned side, float springConstant) {
+
+		const unsigned STEPS = 60;
+		const unsigned SUBSTEPS = (unsigned) std::ceil(DT/std::sqrt(1.0f/springConstant));
+		String size = toString(side) + "x" + toString(side) + " cloth, k = " + toString(springConstant);
+
+		{
+			ParticleRegistry particles;
+			SpringNetwork network;
+			makeCloth(side, springConstant, particles, network);
+			Benchmark::Result& result = benchmark.run("Explicit step (" + size + ")", STEPS, [&]() {
+				network.applyForce(particles, DT);
+				for (auto && p: particles) p->integrate(DT);
+			});
+			result.note = stability(particles);
+		}
+		{
+			ParticleRegistry particles;
+			SpringNetwork network;
+			makeCloth(side, springConstant, particles, network);
+			const float dt = DT/SUBSTEPS;
+			Benchmark::Result& result = benchmark.run("Explicit step, " + toString(SUBSTEPS) + " substeps (" + size + ")", STEPS, [&]() {
+				for (unsigned k=0; k<SUBSTEPS; ++k) {
+					network.applyForce(particles, dt);
+					for (auto && p: particles) p->integrate(dt);
+				}
+			});
+			result.note = stability(particles);
+		}
+		{
+			ParticleRegistry particles;
+			SpringNetwork network;
+			makeCloth(side, springConstant, particles, network);
+			ImplicitIntegrator integrator;
+			unsigned iterations = 0;
+			Benchmark::Result& result = benchmark.run("Implicit step (" + size + ")", STEPS, [&]() {
+				integrator.integrate(particles, network, DT);
+				iterations += integrator.iterationUsed;
+			});
+			result.note = stability(particles) + ", CG iterations/step = " + toString(iterations/(float) STEPS);
+		}
+	}
+
+	/// Chain of equality links, anchored at one end and released horizontally.
+	void makeChain(unsigned links, ParticleRegistry& particles, ConstraintTable& constraints) {
+		const float LINK = 0.1f;
+		for (unsigned k=0; k<links; ++k) {
+			Particle::Ref p(new Particle());
+			p->setPosition(ofVec3f((k+1)*LINK, ANCHOR_HEIGHT, 0.0f));
+			p->acceleration = ofVec3f(0.0f, -9.81f, 0.0f);
+			particles.push_back(p);
+			if (k==0) constraints.addAnchored(ConstraintTable::EQUALITY, 0, ofVec3f(0.0f, ANCHOR_HEIGHT, 0.0f), LINK);
+			else constraints.add(ConstraintTable::EQUALITY, k-1, k, LINK);
+		}
+	}
+
+	/// Largest length error over the equality rows of a table.
+	float maxLengthError(const ParticleRegistry& particles, const ConstraintTable& constraints) {
+		float error = 0.0f;
+		for (unsigned row=0; row<constraints.size(); ++row) {
+			ofVec3f b = constraints.isAnchored(row) ? constraints.anchor(row) : particles[constraints.b[row]]->position;
+			float length = (particles[constraints.a[row]]->position - b).length();
+			error = std::max(error, std::fabs(length - constraints.targetLength[row]));
+		}
+		return error;
+	}
+
+	/**	Iterative contact resolution against the direct tree solver for a long
+		hanging chain, over one second at the frame rate.
+		*/
+	void runChain(Benchmark& benchmark, unsigned links) {
+
+		const unsigned STEPS = 60;
+		String size = toString(links) + " link chain";
+		{
+			ParticleRegistry particles;
+			ConstraintTable constraints;
+			makeChain(links, particles, constraints);
+			ContactRegistry::Ref contacts(new ContactRegistry(10*links));
+			float error = 0.0f;
+			Benchmark::Result& result = benchmark.run("Iterative constraints (" + size + ")", STEPS, [&]() {
+				for (auto && p: particles) p->integrate(DT);
+				constraints.generate(particles, contacts);
+				contacts->resolve(DT);
+				contacts->clear();
+				error = std::max(error, maxLengthError(particles, constraints));
+			});
+			result.note = "max length error = " + toString(error);
+		}
+		{
+			ParticleRegistry particles;
+			ConstraintTable constraints;
+			makeChain(links, particles, constraints);
+			TreeConstraintSolver solver;
+			solver.attach(particles, constraints);
+			float error = 0.0f;
+			unsigned iterations = 0;
+			Benchmark::Result& result = benchmark.run("Tree solver (" + size + ")", STEPS, [&]() {
+				for (auto && p: particles) p->integrate(DT);
+				solver.solve(particles, constraints);
+				iterations += solver.iterationUsed;
+				error = std::max(error, maxLengthError(particles, constraints));
+			});
+			result.note = "max length error = " + toString(error)
+				+ ", Newton iterations/step = " + toString(iterations/(float) STEPS);
+		}
+	}
+
+	/**	All pairs overlap test of n balls scattered in a box: the former
+		scalar loop (a square root per pair) against SphereNarrowPhase.
+		*/
+	void runNarrowPhase(Benchmark& benchmark, unsigned n) {
+
+		const unsigned ITERATIONS = 20;
+		String size = toString(n) + " balls";
+		ParticleRegistry particles;
+		unsigned seed = 12345;
+		auto random = [&seed]() { seed = seed*1664525u + 1013904223u; return (seed>>8)/16777216.0f; };
+		float side = 2.0f*RADIUS*powf((float) n, 1.0f/3.0f);
+		for (unsigned k=0; k<n; ++k) {
+			Particle::Ref p(new Particle());
+			p->setPosition(ofVec3f(random(), random(), random())*side).setRadius(RADIUS*(0.5f+random()));
+			particles.push_back(p);
+		}
+
+		size_t scalarHits = 0;
+		float scalarSum = 0.0f;
+		Benchmark::Result& scalar = benchmark.run("Scalar sphere tests (" + size + ")", ITERATIONS, [&]() {
+			scalarHits = 0;
+			scalarSum = 0.0f;
+			for (unsigned a=0; a<n; ++a) {
+				for (unsigned b=0; b<a; ++b) {
+					ofVec3f normal = particles[a]->position - particles[b]->position;
+					float distance = normal.length();
+					if (distance<particles[a]->radius+particles[b]->radius) {
+						++scalarHits;
+						scalarSum += -distance + particles[a]->radius + particles[b]->radius;
+					}
+				}
+			}
+		});
+		scalar.note = toString(scalarHits) + " hits";
+
+		SphereNarrowPhase narrowPhase;
+		vector<SphereNarrowPhase::Pair> hits;
+		float sum = 0.0f;
+		Benchmark::Result& vectorised = benchmark.run("SphereNarrowPhase, width " + toString(SphereNarrowPhase::width()) + " (" + size + ")", ITERATIONS, [&]() {
+			narrowPhase.gather(particles);
+			hits.clear();
+			for (unsigned a=0; a<n; ++a) narrowPhase.testRange(a, 0, a, hits);
+			sum = 0.0f;
+			for (auto && pair: hits) sum += pair.penetration;
+		});
+		vectorised.note = toString(hits.size()) + " hits"
+			+ (hits.size()==scalarHits && sum==scalarSum ? ", same as scalar" : ", DIFFERS from scalar");
+	}
+
+	/**	Cradles side by side, each raised to a different angle, stepped by a
+		task graph as ofApp does in determinism mode: chunked integration and
+		contact generation, then contacts resolved island by island.
+		*/
+	struct IslandCradles {
+		static const unsigned CHUNKS = 8;
+
+		ParticleRegistry particles;
+		ForceGeneratorRegistry forceGenerators;
+		ConstraintTable constraints;
+		ParticleParticleContactGenerator ppContactGenerator;
+		ContactRegistry::Ref contacts;
+		ParallelContactGenerator generation;
+		TaskGraph graph;
+
+		IslandCradles(unsigned cradles, unsigned n, unsigned numThreads) : contacts(new ContactRegistry()), graph(numThreads) {
+			ForceGenerator::Ref gravity(new GravityForceGenerator(ofVec3f(0.0f, -9.81f, 0.0f)));
+			for (unsigned c=0; c<cradles; ++c) {
+				float x = -(n*2.0f*RADIUS)/2.0f;
+				for (unsigned k=0; k<n; ++k) {
+					ofVec3f anchor(x, ANCHOR_HEIGHT, 4.0f*RADIUS*c);
+					float theta = k==0 ? ofDegToRad(15.0f + 10.0f*(c%5)) : 0.0f;
+					Particle::Ref ball(new Particle());
+					ball->setPosition(anchor + STRING_LENGTH*ofVec3f(-sinf(theta), -cosf(theta), 0.0f)).setRadius(RADIUS);
+					constraints.addAnchored(ConstraintTable::EQUALITY, (unsigned) particles.size(), anchor, STRING_LENGTH);
+					particles.push_back(ball);
+					forceGenerators.add(ball, gravity);
+					ppContactGenerator.particles.push_back(ball);
+					x += 2.0f*RADIUS;
+				}
+			}
+
+			generation.add("Constraints", CHUNKS,
+				[this](ContactRegistry::Ref buffer, unsigned chunk, unsigned numChunks) {
+					constraints.generate(particles, buffer, chunk, numChunks);
+				},
+				[this]() { constraints.prepare(particles); });
+			generation.add("Balls", CHUNKS,
+				[this](ContactRegistry::Ref buffer, unsigned chunk, unsigned numChunks) {
+					ppContactGenerator.generate(buffer, chunk, numChunks);
+				},
+				[this]() { ppContactGenerator.prepare(); });
+
+			TaskGraph::Id forces = graph.add("Forces", 1, [this](unsigned, unsigned) {
+				forceGenerators.applyForce(DT);
+			});
+			TaskGraph::Id integrate = graph.add("Integrate", CHUNKS, [this](unsigned chunk, unsigned numChunks) {
+				size_t end = particles.size()*(chunk+1)/numChunks;
+				for (size_t k=particles.size()*chunk/numChunks; k<end; ++k) particles[k]->integrate(DT);
+			}, { forces });
+			TaskGraph::Id generated = generation.schedule(graph, contacts, { integrate });
+			TaskGraph::Id islands = graph.add("Islands", 1, [this](unsigned, unsigned) {
+				contacts->prepareIslands();
+			}, { generated });
+			TaskGraph::Id resolved = graph.add("Resolve", CHUNKS, [this](unsigned chunk, unsigned numChunks) {
+				contacts->resolveIslands(DT, chunk, numChunks);
+			}, { islands });
+			graph.add("Clear", 1, [this](unsigned, unsigned) { contacts->clear(); }, { resolved });
+		}
+	};
+
+	String hex(uint64_t value) {
+		std::ostringstream outs;
+		outs <<std::hex <<value;
+		return outs.str();
+	}
+
+	/**	The island pipeline on one thread and on several, compared by the
+		hash of the final particle states. A few cradles stay under the
+		contact registry's parallel threshold, so only many cradles show
+		what the threads gain.
+		*/
+	void runDeterminism(Benchmark& benchmark, unsigned cradles, unsigned numThreads) {
+
+		const unsigned STEPS = 600;
+		String size = toString(cradles) + " cradles";
+		uint64_t hash[2];
+		unsigned threads[2] = { 1, numThreads };
+		for (unsigned k=0; k<2; ++k) {
+			IslandCradles world(cradles, 5, threads[k]);
+			Benchmark::Result& result = benchmark.run("Island step, " + toString(threads[k]) + " threads (" + size + ")", STEPS,
+				[&world]() { world.graph.run(); });
+			hash[k] = hashState(world.particles);
+			result.note = "state hash = " + hex(hash[k]);
+		}
+		benchmark.results.back().note += hash[0]==hash[1] ? ", bitwise identical to 1 thread" : ", DIFFERS from 1 thread";
+	}
+
+	/**	Startup of a large cradle-like scene (one anchored string per ball):
+		built object by object as ofApp::reset does, against mapping the
+		compiled scene file alone and mapping plus instantiating it.
+		*/
+	void runSceneLoad(Benchmark& benchmark, unsigned n) {
+
+		const unsigned LOADS = 3;
+		const char* path = "yampe_benchmark_scene.bin";
+		String size = toString(n) + " particles";
+		ForceGenerator::Ref gravity(new GravityForceGenerator(ofVec3f(0.0f, -9.81f, 0.0f)));
+		{
+			Benchmark::Result& result = benchmark.run("Scene built per object (" + size + ")", LOADS, [&]() {
+				ParticleRegistry particles;
+				ConstraintTable constraints;
+				ForceGeneratorRegistry forceGenerators;
+				for (unsigned k=0; k<n; ++k) {
+					ofVec3f anchor((float) k, ANCHOR_HEIGHT, 0.0f);
+					Particle::Ref ball(new Particle());
+					ball->setPosition(anchor - ofVec3f(0.0f, STRING_LENGTH, 0.0f)).setRadius(RADIUS);
+					constraints.addAnchored(ConstraintTable::EQUALITY, k, anchor, STRING_LENGTH);
+					particles.push_back(ball);
+					forceGenerators.add(ball, gravity);
+				}
+			});
+			result.note = "as ofApp::reset";
+		}
+		{
+			Scene scene;
+			for (unsigned k=0; k<n; ++k) {
+				ofVec3f anchor((float) k, ANCHOR_HEIGHT, 0.0f);
+				scene.addParticle(anchor - ofVec3f(0.0f, STRING_LENGTH, 0.0f), ofVec3f::zero(), 1.0f, RADIUS);
+				scene.addAnchoredConstraint(ConstraintTable::EQUALITY, k, anchor, STRING_LENGTH);
+			}
+			if (!scene.saveBinary(path)) return;
+		}
+		{
+			size_t mapped = 0;
+			Benchmark::Result& result = benchmark.run("Scene file mapped (" + size + ")", LOADS, [&]() {
+				Scene scene;
+				if (scene.loadBinary(path)) mapped = scene.numParticles();
+			});
+			result.note = "header and index checks only, " + toString(mapped) + " particles";
+		}
+		{
+			size_t loaded = 0;
+			Benchmark::Result& result = benchmark.run("Scene loaded from binary (" + size + ")", LOADS, [&]() {
+				Scene scene;
+				ParticleRegistry particles;
+				ConstraintTable constraints;
+				ForceGeneratorRegistry forceGenerators;
+				if (scene.loadBinary(path)) scene.instantiate(particles, constraints, NULL, forceGenerators, gravity);
+				loaded = particles.size();
+			});
+			result.note = "mapped file, " + toString(loaded) + " particles instantiated";
+		}
+		std::remove(path);
+	}
+
+	/**	Dynamic scene of n live particles, each registered with gravity and
+		drag, a tenth of which are replaced every step: removed and added
+		through the registry, against the clear and rebuild ofApp::reset does.
+		*/
+	void runRegistryChurn(Benchmark& benchmark, unsigned n) {
+
+		const unsigned STEPS = 100;
+		const unsigned CHURN = n/10;
+		String size = toString(n) + " particles, " + toString(CHURN) + " replaced per step";
+		ForceGenerator::Ref gravity(new GravityForceGenerator(ofVec3f(0.0f, -9.81f, 0.0f)));
+		ForceGenerator::Ref drag(new DragForceGenerator(0.1f, 0.01f));
+
+		ParticleRegistry particles(n);
+		for (auto && p: particles) p.reset(new Particle());
+		{
+			ForceGeneratorRegistry forceGenerators;
+			Benchmark::Result& result = benchmark.run("Force registry rebuilt (" + size + ")", STEPS, [&]() {
+				forceGenerators.clear();
+				for (auto && p: particles) {
+					forceGenerators.add(p, gravity);
+					forceGenerators.add(p, drag);
+				}
+			});
+			result.note = "as ofApp::reset";
+		}
+		{
+			ForceGeneratorRegistry forceGenerators;
+			forceGenerators.reserve(2*n);
+			for (auto && p: particles) {
+				forceGenerators.add(p, gravity);
+				forceGenerators.add(p, drag);
+			}
+			unsigned next = 0;
+			Benchmark::Result& result = benchmark.run("Force registry churn (" + size + ")", STEPS, [&]() {
+				for (unsigned k=0; k<CHURN; ++k, next = (next+1)%n) {
+					// the particle object is reused, as a pool would
+					forceGenerators.removeParticle(particles[next].get());
+					forceGenerators.add(particles[next], gravity);
+					forceGenerators.add(particles[next], drag);
+				}
+			});
+			result.note = "remove and add, " + toString(forceGenerators.size()) + " registrations";
+		}
+		{
+			ForceGeneratorRegistry forceGenerators;
+			forceGenerators.reserve(2*n);
+			for (auto && p: particles) {
+				forceGenerators.add(p, gravity);
+				forceGenerators.add(p, drag);
+			}
+			unsigned next = 0;
+			size_t mostRegistered = 0;
+			Benchmark::Result& result = benchmark.run("Force registry churn, new particles (" + size + ")", STEPS, [&]() {
+				for (unsigned k=0; k<CHURN; ++k, next = (next+1)%n) {
+					// a new particle replaces the old, whose address the allocator may hand out again
+					forceGenerators.removeParticle(particles[next].get());
+					particles[next].reset(new Particle());
+					forceGenerators.add(particles[next], gravity);
+					forceGenerators.add(particles[next], drag);
+				}
+				mostRegistered = std::max(mostRegistered, forceGenerators.numRegisteredParticles());
+			});
+			result.note = "at most " + toString(mostRegistered) + " particles indexed";
+		}
+	}
+
+	/**	Effects workload: a fountain of short-lived particles filling a pool
+		of n, recycled as they expire. After warm up no step allocates.
+		*/
+	void runEmitter(Benchmark& benchmark, unsigned n) {
+
+		const unsigned WARMUP = 120;
+		const unsigned STEPS = 120;
+		ForceGeneratorRegistry forceGenerators;
+		ParticleRegistry ground;
+		ParticlePool::Ref pool(new ParticlePool(n));
+		pool->setForceGeneratorRegistry(&forceGenerators);
+		pool->addForceGenerator(ForceGenerator::Ref(new GravityForceGenerator(ofVec3f(0.0f, -9.81f, 0.0f))));
+		pool->attach(&ground);
+
+		ParticleEmitter emitter(pool);
+		emitter.rate = (float) n;
+		emitter.lifetime = 0.75f;
+		emitter.lifetimeSpread = 0.25f;
+		emitter.coneAngle = 20.0f;
+
+		auto step = [&]() {
+			pool->update(DT);
+			emitter.update(DT);
+			forceGenerators.applyForce(DT);
+			for (auto && p: pool->live()) p->integrate(DT);
+		};
+		for (unsigned k=0; k<WARMUP; ++k) step();
+		size_t spawned = pool->numSpawned();
+		Benchmark::Result& result = benchmark.run("Emitter (" + toString(n) + " particle pool)", STEPS, step);
+		result.note = toString(pool->size()) + " live, " + toString(pool->numSpawned()-spawned) + " spawned and recycled";
+	}
+
+	/**	The app's fountain on its fallback floor: n small fast spheres
+		thrown up (the top of their fall is about 3.3 m above the floor)
+		onto a two triangle quad, stepped at 60 Hz with mesh contacts, with
+		and without the swept test. Notes how many ended up below the quad,
+		which should be none with it.
+		*/
+	void runMeshDrop(Benchmark& benchmark, unsigned n, bool isSwept) {
+
+		const unsigned STEPS = 240;
+		const float HALF = 10.0f;
+		ForceGeneratorRegistry forceGenerators;
+		ForceGenerator::Ref gravity(new GravityForceGenerator(ofVec3f(0.0f, -9.81f, 0.0f)));
+		MeshContactGenerator floor;
+		floor.restitution = 0.5f;
+		floor.sweepDt = isSwept ? DT : 0.0f;
+		floor.bvh.vertices.push_back(ofVec3f(-HALF, 0.0f, -HALF));
+		floor.bvh.vertices.push_back(ofVec3f(-HALF, 0.0f, HALF));
+		floor.bvh.vertices.push_back(ofVec3f(HALF, 0.0f, HALF));
+		floor.bvh.vertices.push_back(ofVec3f(HALF, 0.0f, -HALF));
+		floor.bvh.addTriangle(0, 1, 2);			// counter clockwise from above, facing +y
+		floor.bvh.addTriangle(0, 2, 3);
+		floor.bvh.build();
+
+		std::mt19937 random(7);
+		std::uniform_real_distribution<float> across(-4.0f, 4.0f), spread(-1.0f, 1.0f);
+		for (unsigned k=0; k<n; ++k) {
+			Particle::Ref p(new Particle());
+			p->setPosition(ofVec3f(across(random), 0.5f, across(random))).setRadius(0.05f);
+			p->velocity = ofVec3f(0.0f, 8.0f+spread(random), 0.0f);
+			floor.particles.push_back(p);
+			forceGenerators.add(p, gravity);
+		}
+
+		ContactRegistry::Ref contacts(new ContactRegistry());
+		unsigned step = 0;
+		Benchmark::Result& result = benchmark.run("Mesh floor drop (" + toString(n) + " spheres, "
+				+ (isSwept ? "swept" : "positions only") + ")", STEPS, [&]() {
+			forceGenerators.applyForce(DT);
+			for (auto && p: floor.particles) p->integrate(DT);
+			floor.generate(contacts);
+			contacts->resolve(DT);
+			contacts->clear();
+			++step;
+		});
+		unsigned below = 0;
+		for (auto && p: floor.particles) {
+			if (p->position.y<0.0f) ++below;
+		}
+		result.note = toString(below) + " of " + toString(n) + " below the floor after " + toString(step) + " steps";
+	}
+
+	/**	The app's fountain: a ParticlePool attached to the mesh contacts of
+		an up facing floor quad, emitting as ofApp does, stepped at 60 Hz.
+		Notes the most live particles found below the floor (within its
+		edges) after any step, which should be none. The iteration limit
+		grows with the contacts as in ofApp, the default 100 left dozens
+		below the floor at 5000 per s.
+		*/
+	void runFountainFloor(Benchmark& benchmark, float rate) {
+
+		const unsigned STEPS = 240;
+		const float HALF = 8.0f;
+		ForceGeneratorRegistry forceGenerators;
+		MeshContactGenerator floor;
+		floor.sweepDt = DT;
+		floor.bvh.vertices.push_back(ofVec3f(-HALF, 0.0f, -HALF));
+		floor.bvh.vertices.push_back(ofVec3f(-HALF, 0.0f, HALF));
+		floor.bvh.vertices.push_back(ofVec3f(HALF, 0.0f, HALF));
+		floor.bvh.vertices.push_back(ofVec3f(HALF, 0.0f, -HALF));
+		floor.bvh.addTriangle(0, 1, 2);
+		floor.bvh.addTriangle(0, 2, 3);
+		floor.bvh.build();
+
+		ParticlePool::Ref pool(new ParticlePool(10000));
+		pool->setForceGeneratorRegistry(&forceGenerators);
+		pool->addForceGenerator(ForceGenerator::Ref(new GravityForceGenerator(ofVec3f(0.0f, -9.81f, 0.0f))));
+		pool->attach(&floor.particles);
+		ParticleEmitter fountain(pool);
+		fountain.rate = rate;
+		fountain.position = ofVec3f(0.0f, 0.5f, 2.0f);
+		fountain.velocity = ofVec3f(0.0f, 8.0f, 0.0f);
+		fountain.speedSpread = 1.0f;
+		fountain.lifetime = 3.0f;
+		fountain.lifetimeSpread = 1.0f;
+
+		ContactRegistry::Ref contacts(new ContactRegistry());
+		size_t mostBelow = 0;
+		Benchmark::Result& result = benchmark.run("Fountain on a mesh floor (" + toString(rate) + " per s)", STEPS, [&]() {
+			pool->update(DT);
+			fountain.update(DT);
+			forceGenerators.applyForce(DT);
+			for (auto && p: pool->live()) p->integrate(DT);
+			floor.generate(contacts);
+			contacts->setIterationLimit(std::max(ContactRegistry::DEFAULT_ITERATION_LIMIT, unsigned(2*contacts->size())));	// as ofApp
+			contacts->resolve(DT);
+			contacts->clear();
+			size_t below = 0;
+			for (auto && p: pool->live()) {
+				// some fly past the edge of the quad and fall freely
+				bool isOver = std::fabs(p->position.x)<HALF && std::fabs(p->position.z)<HALF;
+				if (isOver && p->position.y<0.0f) ++below;
+			}
+			mostBelow = std::max(mostBelow, below);
+		});
+		result.note = toString(pool->numSpawned()) + " spawned, at most " + toString(mostBelow) + " live below the floor";
+	}
+
+	/**	Granular pile: side^3 touching balls allocated as one block (through
+		Scene) in random order, stepped with gravity, lattice neighbour
+		contacts through SphereNarrowPhase::test and resolution. Run as
+		created and again after MortonOrder::reorder() has put registry and
+		memory in Z-order (the neighbour lists follow through rank()).
+		*/
+	void runMortonOrder(Benchmark& benchmark, unsigned side) {
+
+		const unsigned STEPS = 10;
+		const float SPACING = 2.0f*RADIUS*0.99f;
+		unsigned n = side*side*side;
+		String size = toString(n) + " balls";
+
+		vector<unsigned> cells(n);
+		for (unsigned k=0; k<n; ++k) cells[k] = k;
+		std::mt19937 random(7);
+		for (unsigned k=n-1; k>0; --k) std::swap(cells[k], cells[random()%(k+1)]);
+
+		Scene scene;
+		scene.gravity = ofVec3f(0.0f, -9.81f, 0.0f);
+		vector<unsigned> particleOf(n);			// lattice cell -> particle index
+		for (unsigned k=0; k<n; ++k) {
+			unsigned c = cells[k];
+			scene.addParticle(ofVec3f(c%side, (c/side)%side, c/(side*side))*SPACING, ofVec3f::zero(), 1.0f, RADIUS);
+			particleOf[c] = k;
+		}
+
+		for (unsigned pass=0; pass<2; ++pass) {
+			ParticleRegistry particles;
+			ConstraintTable constraints;
+			ForceGeneratorRegistry forceGenerators;
+			ForceGenerator::Ref gravity(new GravityForceGenerator(scene.gravity));
+			scene.instantiate(particles, constraints, NULL, forceGenerators, gravity);
+			vector<unsigned> index = particleOf;
+
+			MortonOrder order;
+			float disorder = order.disorder(particles);
+			if (pass==1) {
+				Benchmark::Result& result = benchmark.run("Morton reorder (" + size + ")", 1, [&]() {
+					order.reorder(particles);
+					forceGenerators.remapParticles([&order](const Particle::Ref& p) { return order.remap(p); });
+					constraints.remapParticles(order.rank());
+				});
+				for (auto && k: index) k = order.rank()[k];
+				result.note = "disorder " + toString(disorder) + " -> " + toString(order.disorder(particles));
+			}
+
+			// higher indexed face neighbours of each ball
+			vector<vector<unsigned> > candidates(n);
+			for (unsigned c=0; c<n; ++c) {
+				unsigned x = c%side, y = (c/side)%side, z = c/(side*side);
+				unsigned a = index[c];
+				if (x+1<side && index[c+1]>a) candidates[a].push_back(index[c+1]);
+				if (x>0 && index[c-1]>a) candidates[a].push_back(index[c-1]);
+				if (y+1<side && index[c+side]>a) candidates[a].push_back(index[c+side]);
+				if (y>0 && index[c-side]>a) candidates[a].push_back(index[c-side]);
+				if (z+1<side && index[c+side*side]>a) candidates[a].push_back(index[c+side*side]);
+				if (z>0 && index[c-side*side]>a) candidates[a].push_back(index[c-side*side]);
+			}
+
+			SphereNarrowPhase narrowPhase;
+			ContactRegistry::Ref contacts(new ContactRegistry(20));
+			vector<SphereNarrowPhase::Pair> hits;
+			size_t numContacts = 0;
+			auto step = [&]() {
+				forceGenerators.applyForce(DT);
+				for (auto && p: particles) p->integrate(DT);
+				narrowPhase.gather(particles);
+				hits.clear();
+				for (unsigned a=0; a<n; ++a) narrowPhase.test(a, candidates[a].data(), candidates[a].size(), hits);
+				SphereNarrowPhase::emit(particles, hits, contacts, "Granular", 0.0f);
+				numContacts = contacts->size();
+				contacts->resolve(DT);
+				contacts->clear();
+			};
+			step();		// untimed, grows the contact pool and hit list the timed steps reuse
+			Benchmark::Result& result = benchmark.run(String(pass==0 ? "Granular step, allocation order (" : "Granular step, Morton order (") + size + ")", STEPS, step);
+			result.note = toString(numContacts) + " contacts";
+			if (result.hasCounters) {
+				result.note += ", " + toString(result.counters[PerfCounters::L1D_MISSES]/n) + " L1D and "
+					+ toString(result.counters[PerfCounters::LLC_MISSES]/n) + " LLC misses per ball";
+			} else {
+				result.note += ", no miss counts (PerfCounters disabled or unavailable)";
+			}
+		}
+	}
+
+	/**	A contact spike: side^3 overlapping balls all thrown together, their
+		face neighbour contacts resolved with a generous iteration limit,
+		without a time budget and with shrinking ones, reporting what each
+		leaves unresolved. Without a budget the time is bounded only by the
+		iteration limit.
+		*/
+	void runResolveBudget(Benchmark& benchmark, unsigned side) {
+
+		const float SPACING = 2.0f*RADIUS*0.95f;
+		const double BUDGETS[] = { 0.0, 20000.0, 5000.0, 1000.0 };
+		unsigned n = side*side*side;
+		String size = toString(n) + " balls";
+
+		for (double budget: BUDGETS) {
+			ParticleRegistry particles;
+			for (unsigned k=0; k<n; ++k) {
+				ofVec3f cell((float) (k%side), (float) ((k/side)%side), (float) (k/(side*side)));
+				Particle::Ref ball(new Particle());
+				ball->setPosition(cell*SPACING).setVelocity((ofVec3f(0.5f, 0.5f, 0.5f)*(float) side - cell)*0.1f).setRadius(RADIUS);
+				particles.push_back(ball);
+			}
+			SphereNarrowPhase narrowPhase;
+			narrowPhase.gather(particles);
+			vector<SphereNarrowPhase::Pair> hits;
+			unsigned neighbours[3];
+			for (unsigned k=0; k<n; ++k) {
+				unsigned count = 0;
+				if (k%side+1<side) neighbours[count++] = k+1;
+				if ((k/side)%side+1<side) neighbours[count++] = k+side;
+				if (k/(side*side)+1<side) neighbours[count++] = k+side*side;
+				narrowPhase.test(k, neighbours, count, hits);
+			}
+			ContactRegistry::Ref contacts(new ContactRegistry(10000));
+			contacts->setTimeBudget(budget);
+			SphereNarrowPhase::emit(particles, hits, contacts, "Spike", 0.5f);
+
+			String label = budget>0.0 ? "Resolve, " + toString(budget/1000.0) + " ms budget (" : "Resolve, no budget (";
+			Benchmark::Result& result = benchmark.run(label + toString(contacts->size()) + " contacts)", 1, [&]() { contacts->resolve(DT); });
+			const ContactRegistry::Residual& residual = contacts->residual();
+			result.note = toString(residual.iterations) + " iterations, "
+				+ toString(residual.numUnresolved) + " unresolved, "
+				+ "max penetration " + toString(residual.maxPenetration) + ", "
+				+ "max closing velocity " + toString(residual.maxClosingVelocity)
+				+ (residual.isOutOfTime ? ", out of time" : "");
+		}
+	}
+
+	/**	A slowly stirred gas of n loosely packed balls, its ball contacts
+		generated each step by testing every pair and through neighbour
+		lists with a skin of half a radius, which are rebuilt only when a
+		ball has moved a quarter radius. Both see the same contacts.
+		*/
+	void runNeighbourList(Benchmark& benchmark, unsigned n) {
+
+		const unsigned STEPS = 60;
+		String size = toString(n) + " balls";
+
+		for (unsigned pass=0; pass<2; ++pass) {
+			ParticleParticleContactGenerator generator;
+			std::mt19937 random(11);
+			std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+			float side = 2.2f*RADIUS*powf((float) n, 1.0f/3.0f);
+			for (unsigned k=0; k<n; ++k) {
+				Particle::Ref ball(new Particle());
+				ofVec3f position(uniform(random), uniform(random), uniform(random));
+				ofVec3f velocity(uniform(random), uniform(random), uniform(random));
+				ball->setPosition(position*0.5f*side).setVelocity(velocity*RADIUS).setRadius(RADIUS);
+				generator.particles.push_back(ball);
+			}
+			generator.isNeighbourListEnabled = pass==1;
+			generator.neighbourList.skin = 0.5f*RADIUS;
+
+			ContactRegistry::Ref contacts(new ContactRegistry());
+			size_t numContacts = 0;
+			Benchmark::Result& result = benchmark.run(String(pass==0 ? "Ball contacts, all pairs (" : "Ball contacts, neighbour lists (") + size + ")", STEPS, [&]() {
+				for (auto && p: generator.particles) p->integrate(DT);
+				generator.generate(contacts);
+				numContacts += contacts->size();
+				contacts->clear();
+			});
+			result.note = toString(numContacts) + " contacts";
+			if (pass==1) result.note += ", " + toString(generator.neighbourList.numBuilds()) + " builds in "
+				+ toString(generator.neighbourList.numUpdates()) + " steps, last "
+				+ toString(generator.neighbourList.lastBuildMicros()) + " us";
+		}
+	}
+
+	/**	Ropes of overlapping balls, random walks tangled in the same volume,
+		their ball contacts generated by testing every pair and through
+		neighbour lists, unfiltered and with each rope in its own collision
+		group (colliding only with itself) and its links excluded.
+		*/
+	void runCollisionFilter(Benchmark& benchmark, unsigned ropes, unsigned links) {
+
+		const unsigned STEPS = 30;
+		String size = toString(ropes) + " ropes of " + toString(links) + " balls";
+
+		for (unsigned pass=0; pass<4; ++pass) {
+			bool isFiltered = (pass & 1)!=0, isListed = (pass & 2)!=0;
+			ParticleParticleContactGenerator generator;
+			std::mt19937 random(5);
+			std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+			float side = 2.2f*RADIUS*powf((float) (ropes*links), 1.0f/3.0f);
+			for (unsigned r=0; r<ropes; ++r) {
+				ofVec3f position(uniform(random), uniform(random), uniform(random));
+				position *= 0.5f*side;
+				for (unsigned k=0; k<links; ++k) {
+					Particle::Ref ball(new Particle());
+					ball->setPosition(position).setVelocity(0.1f*RADIUS*ofVec3f(uniform(random), uniform(random), uniform(random)))
+						.setRadius(RADIUS);
+					if (isFiltered) {
+						ball->setCollisionFilter(1u<<(r%32), 1u<<(r%32));
+						if (k>0) generator.filter.exclude(generator.particles.back(), ball);
+					}
+					generator.particles.push_back(ball);
+					// links overlap, the walk folds back at the walls
+					ofVec3f step(uniform(random), uniform(random), uniform(random));
+					position += 1.5f*RADIUS*step.getNormalized();
+					position.x = ofClamp(position.x, -0.5f*side, 0.5f*side);
+					position.y = ofClamp(position.y, -0.5f*side, 0.5f*side);
+					position.z = ofClamp(position.z, -0.5f*side, 0.5f*side);
+				}
+			}
+			generator.isNeighbourListEnabled = isListed;
+			generator.neighbourList.skin = 0.5f*RADIUS;
+
+			ContactRegistry::Ref contacts(new ContactRegistry());
+			size_t numContacts = 0;
+			String label = String(isListed ? "Ball contacts, neighbour lists" : "Ball contacts, all pairs")
+				+ (isFiltered ? ", filtered (" : " (") + size + ")";
+			Benchmark::Result& result = benchmark.run(label, STEPS, [&]() {
+				for (auto && p: generator.particles) p->integrate(DT);
+				generator.generate(contacts);
+				numContacts += contacts->size();
+				contacts->clear();
+			});
+			result.note = toString(numContacts/STEPS) + " contacts per step";
+			if (isFiltered) result.note += ", " + toString(generator.filter.numExclusions()) + " excluded pairs";
+			if (isListed) result.note += ", " + toString(generator.neighbourList.numPairs()) + " listed pairs";
+		}
+	}
+
+	/**	Cradles side by side with only the first two swinging, stepped at dt,
+		at dt/8 throughout and with MultirateStepper (levels up to 3, so
+		dt/8 where needed), with the largest distance of a ball from where
+		the dt/8 run put it after two seconds.
+		*/
+	void runMultirate(Benchmark& benchmark, unsigned cradles, unsigned n) {
+
+		const unsigned STEPS = 120;
+		const unsigned FINE = 8;
+
+		struct Cradles {
+			ParticleRegistry particles;
+			ForceGeneratorRegistry forceGenerators;
+			ConstraintTable constraints;
+			ParticleParticleContactGenerator ppContactGenerator;
+			ContactRegistry::Ref contacts;
+			MultirateStepper stepper;
+
+			Cradles(unsigned cradles, unsigned n) : contacts(new ContactRegistry()) {
+				ForceGenerator::Ref gravity(new GravityForceGenerator(ofVec3f(0.0f, -9.81f, 0.0f)));
+				for (unsigned c=0; c<cradles; ++c) {
+					float x = -(n*2.0f*RADIUS)/2.0f;
+					for (unsigned k=0; k<n; ++k) {
+						ofVec3f anchor(x, ANCHOR_HEIGHT, 4.0f*RADIUS*c);
+						float theta = k==0 && c<2 ? ofDegToRad(30.0f + 15.0f*c) : 0.0f;
+						Particle::Ref ball(new Particle());
+						ball->setPosition(anchor + STRING_LENGTH*ofVec3f(-sinf(theta), -cosf(theta), 0.0f)).setRadius(RADIUS);
+						constraints.addAnchored(ConstraintTable::EQUALITY, (unsigned) particles.size(), anchor, STRING_LENGTH);
+						particles.push_back(ball);
+						forceGenerators.add(ball, gravity);
+						x += 2.0f*RADIUS;
+					}
+				}
+				ppContactGenerator.particles = particles;
+
+				stepper.particles = particles;
+				stepper.forces = [this](const ParticleRegistry& due, float dt) {
+					for (auto && p: due) forceGenerators.applyForce(p, dt);
+				};
+				stepper.generate = [this](const ParticleRegistry& due, ContactRegistry::Ref buffer) {
+					constraints.generate(particles, buffer);
+					ppContactGenerator.generate(buffer, [this](const Particle* p) { return stepper.isDue(p); });
+				};
+			}
+
+			void step(float dt) {
+				forceGenerators.applyForce(dt);
+				for (auto && p: particles) p->integrate(dt);
+				constraints.generate(particles, contacts);
+				ppContactGenerator.generate(contacts);
+				contacts->resolve(dt);
+				contacts->clear();
+			}
+		};
+
+		String size = toString(cradles) + " cradles of " + toString(n);
+		Cradles coarse(cradles, n), fine(cradles, n), multirate(cradles, n);
+		benchmark.run("Cradles at dt (" + size + ")", STEPS, [&coarse]() { coarse.step(DT); });
+		benchmark.run("Cradles at dt/8 (" + size + ")", STEPS, [&fine]() {
+			for (unsigned k=0; k<FINE; ++k) fine.step(DT/FINE);
+		});
+		size_t integrations = 0, promotions = 0;
+		Benchmark::Result& result = benchmark.run("Cradles multirate (" + size + ")", STEPS, [&]() {
+			multirate.stepper.step(DT, multirate.contacts);
+			integrations += multirate.stepper.numIntegrations();
+			promotions += multirate.stepper.numPromotions();
+		});
+
+		auto error = [&fine](const Cradles& cradles) {
+			float largest = 0.0f;
+			for (size_t k=0; k<fine.particles.size(); ++k) {
+				largest = std::max(largest, cradles.particles[k]->position.distance(fine.particles[k]->position));
+			}
+			return largest;
+		};
+		result.note = toString(100.0f*integrations/(float) (STEPS*FINE*multirate.particles.size())) + "% of dt/8 integrations, "
+			+ toString(promotions) + " promotions, "
+			+ "error " + toString(error(multirate)) + " (at dt " + toString(error(coarse)) + ")";
+	}
+
+}	// namespace
+
+
+void Benchmark::runAll() {
+
+	const unsigned STEPS = 20000;
+
+	DynamicCradle cradle(5, 45.0f);
+	run("Dynamic cradle (5 balls) step", STEPS, [&cradle]() { cradle.step(DT); });
+	runFixedWorld<5>(*this, STEPS);
+
+	DynamicCradle largeCradle(20, 45.0f);
+	run("Dynamic cradle (20 balls) step", STEPS/10, [&largeCradle]() { largeCradle.step(DT); });
+	runFixedWorld<20>(*this, STEPS/10);
+
+	runEventCradle(*this, 5, 16);
+
+	runSpringNetwork(*this, 224, 20);
+
+	runStiffCloth(*this, 32, 5000.0f);
+
+	runChain(*this, 100);
+
+	runNarrowPhase(*this, 2000);
+
+	runDeterminism(*this, 32, 8);
+	runDeterminism(*this, 512, 8);
+
+	runSceneLoad(*this, 1000000);
+
+	runRegistryChurn(*this, 100000);
+
+	runEmitter(*this, 100000);
+
+	runMeshDrop(*this, 1000, false);
+	runMeshDrop(*this, 1000, true);
+
+	runFountainFloor(*this, 1000.0f);
+	runFountainFloor(*this, 5000.0f);
+
+	runMortonOrder(*this, 40);
+
+	runResolveBudget(*this, 12);
+
+	runNeighbourList(*this, 8000);
+
+	runCollisionFilter(*this, 16, 500);
+
+	runMultirate(*this, 16, 5);
+}
+
+
+const String Benchmark::toString() const {
+	std::ostringstream outs;
+	for (auto && result: results) {
+		outs <<"\n" <<result.label <<"    "
+			<<result.microsPerIteration <<" us    "
+			<<"(" <<result.iterations <<" iterations)";
+		if (result.allocations>0.0) outs <<"    " <<result.allocations <<" allocations";
+		if (!result.note.empty()) outs <<"    " <<result.note;
+		if (result.hasCounters) {
+			const double* c = result.counters;
+			outs <<"\n    per iteration: "
+				<<"IPC = " <<(c[PerfCounters::CYCLES]>0.0 ? c[PerfCounters::INSTRUCTIONS]/c[PerfCounters::CYCLES] : 0.0) <<"    "
+				<<"cycles = " <<c[PerfCounters::CYCLES] <<"    "
+				<<"L1D misses = " <<c[PerfCounters::L1D_MISSES] <<"    "
+				<<"LLC misses = " <<c[PerfCounters::LLC_MISSES] <<"    "
+				<<"branch misses = " <<c[PerfCounters::BRANCH_MISSES];
+		}
+	}
+	return outs.str();
+}
+
+}	// namespace YAMPE
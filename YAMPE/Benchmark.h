@@ -0,0 +1,82 @@
+/**
+	@file 		Benchmark.h
+	@author		dgaffney
+	@practical
+	@brief		Timing of engine scenarios, shared by the GUI and the headless runner.
+	*/
+
+#ifndef YAMPE_BENCHMARK_H
+#define YAMPE_BENCHMARK_H
+
+#include <chrono>
+#include <vector>
+
+#include "Memory.h"
+#include "PerfCounters.h"
+#include "Printable.h"
+
+namespace YAMPE {
+
+/**
+	\class Benchmark
+
+	Collects wall clock timings of engine scenarios. Each scenario is run for
+	a fixed number of iterations and reported as microseconds per iteration.
+
+	runAll() runs the standard scenarios; it is used by the "Benchmarks"
+	section of the main window and by the headless runner (main --headless).
+
+	When PerfCounters are enabled and available each result also holds the
+	hardware counts per iteration of the calling thread. Each result holds
+	the tracked allocations (see MemoryTracker) per iteration, on any thread.
+	*/
+class Benchmark : public Printable {
+
+public:
+
+	struct Result {
+		String label;
+		unsigned iterations;
+		double microsPerIteration;
+		String note;				///< optional scenario specific observation.
+		bool hasCounters;
+		double counters[PerfCounters::NUM_COUNTERS];	///< per iteration, if hasCounters.
+		double allocations;			///< tracked allocations per iteration.
+	};
+
+	std::vector<Result> results;
+
+	Benchmark(const String label="Benchmark") : Printable(label) { };
+
+	/// Times f() over the given number of iterations and records the result.
+	template <typename F>
+	Result& run(const String& label, unsigned iterations, F f) {
+		typedef std::chrono::steady_clock Clock;
+		PerfCounters::Sample begin, end;
+		bool isCounting = PerfCounters::instance().read(begin);
+		uint64_t allocations = MemoryTracker::instance().allocations();
+		Clock::time_point start = Clock::now();
+		for (unsigned k=0; k<iterations; ++k) f();
+		double micros = std::chrono::duration<double, std::micro>(Clock::now()-start).count();
+		isCounting = isCounting && PerfCounters::instance().read(end) && iterations>0;
+		allocations = MemoryTracker::instance().allocations()-allocations;
+		Result result = { label, iterations, iterations>0 ? micros/iterations : 0.0, "", isCounting, { },
+			iterations>0 ? (double) allocations/iterations : 0.0 };
+		for (unsigned c=0; c<PerfCounters::NUM_COUNTERS; ++c) {
+			result.counters[c] = isCounting ? (double) (end.value[c]-begin.value[c])/iterations : 0.0;
+		}
+		results.push_back(result);
+		return results.back();
+	}
+
+	/// Runs the standard engine scenarios.
+	void runAll();
+
+	void clear() { results.clear(); }
+
+	const String toString() const;
+};
+
+}	// namespace YAMPE
+
+#endif
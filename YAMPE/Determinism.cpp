@@ -0,0 +1,31 @@
+/**
+	@file 		Determinism.cpp
+	@author		dgaffney
+	@practical
+	@brief		Sums and state hashes that do not depend on the number of threads.
+	*/
+
+#include "Determinism.h"
+
+namespace YAMPE {
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t k=0; k<size; ++k) {
+		hash ^= bytes[k];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+
+uint64_t hashState(const ParticleRegistry& particles) {
+	uint64_t hash = hashBytes(NULL, 0);
+	for (auto && p: particles) {
+		float state[6] = { p->position.x, p->position.y, p->position.z, p->velocity.x, p->velocity.y, p->velocity.z };
+		hash = hashBytes(state, sizeof(state), hash);
+	}
+	return hash;
+}
+
+}	// namespace YAMPE
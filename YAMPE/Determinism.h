@@ -0,0 +1,87 @@
+/**
+	@file 		Determinism.h
+	@author		dgaffney
+	@practical
+	@brief		Sums and state hashes that do not depend on the number of threads.
+
+	Floating point addition is not associative, so a sum whose terms are
+	added as threads become free changes in its last bits from run to run.
+	fixedSum() always adds in the same tree, whatever runs it: the terms are
+	summed serially in blocks of REDUCTION_BLOCK consecutive indices and the
+	block sums are combined pairwise, halving the range each time. With a
+	ThreadPool the blocks are summed concurrently, into the slots of a
+	caller supplied vector, and combined in the same tree, so the result is
+	bitwise the same as the serial one.
+
+	hashState() hashes the bits of every particle position and velocity,
+	for checking that two runs (e.g. on 1 and 64 threads) stayed identical.
+	*/
+
+#ifndef YAMPE_DETERMINISM_H
+#define YAMPE_DETERMINISM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Particle.h"
+#include "ThreadPool.h"
+
+namespace YAMPE {
+
+static const size_t REDUCTION_BLOCK = 1024;
+
+namespace detail {
+
+	template <typename T, typename F>
+	T blockSum(size_t block, size_t n, F& term) {
+		size_t end = std::min(n, (block+1)*REDUCTION_BLOCK);
+		T sum = T(0);
+		for (size_t k=block*REDUCTION_BLOCK; k<end; ++k) sum += term(k);
+		return sum;
+	}
+
+	/// Pairwise sum of blocks [first, first+count).
+	template <typename T, typename F>
+	T blockTree(size_t first, size_t count, size_t n, F& term) {
+		if (count==1) return blockSum<T>(first, n, term);
+		size_t half = count/2;
+		return blockTree<T>(first, half, n, term) + blockTree<T>(first+half, count-half, n, term);
+	}
+
+	/// Pairwise sum of values [first, first+count), the same tree as blockTree.
+	template <typename T>
+	T pairwise(const T* values, size_t count) {
+		if (count==1) return values[0];
+		size_t half = count/2;
+		return pairwise(values, half) + pairwise(values+half, count-half);
+	}
+
+}	// namespace detail
+
+/// Sum of term(k) for k in [0, n), in a fixed order.
+template <typename T, typename F>
+T fixedSum(size_t n, F term) {
+	if (n==0) return T(0);
+	return detail::blockTree<T>(0, (n+REDUCTION_BLOCK-1)/REDUCTION_BLOCK, n, term);
+}
+
+/// As fixedSum(n, term) with the blocks split over a pool, partial is reused scratch.
+template <typename T, typename F>
+T fixedSum(size_t n, F term, ThreadPool& pool, std::vector<T>& partial) {
+	if (n==0) return T(0);
+	partial.resize((n+REDUCTION_BLOCK-1)/REDUCTION_BLOCK);
+	auto block = [&](unsigned k) { partial[k] = detail::blockSum<T>(k, n, term); };
+	pool.parallelFor((unsigned) partial.size(), block);
+	return detail::pairwise(partial.data(), partial.size());
+}
+
+/// FNV-1a hash of a block of memory, continuing from hash.
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash=14695981039346656037ull);
+
+/// Hash of the positions and velocities of the particles, in registry order.
+uint64_t hashState(const ParticleRegistry& particles);
+
+}	// namespace YAMPE
+
+#endif
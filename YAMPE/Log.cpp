@@ -0,0 +1,257 @@
+/**
+	@file 		Log.cpp
+	@author		dgaffney
+	@practical
+	@brief		Allocation free binary logging for use inside the simulation step.
+	*/
+
+#include <chrono>
+#include <cstring>
+
+#include "Log.h"
+
+namespace YAMPE {
+
+/// Bound on a width or precision given by a * argument.
+static const long long MAX_STAR = 1000;
+
+static uint64_t ticksMicros() {
+	return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+Log& Log::instance() {
+	static Log log;
+	return log;
+}
+
+
+Log::Log() : m_head(0), m_tail(0), m_dropped(0), m_level(LEVEL_VERBOSE),
+	m_startTicks(ticksMicros()), m_sinkRunning(false) {
+	for (unsigned k=0; k<CAPACITY; ++k) {
+		m_cells[k].sequence.store(k, std::memory_order_relaxed);
+	}
+}
+
+
+Log::~Log() {
+	stopFileSink();
+}
+
+
+uint64_t Log::timeMicros() const {
+	return ticksMicros() - m_startTicks;
+}
+
+
+bool Log::admit(Site& site, uint64_t now, uint32_t& suppressed) {
+
+	// Stamps are offset by one so that zero can mean "never written".
+	uint64_t last = site.last.load(std::memory_order_relaxed);
+	if (last!=0 && now+1 < last+site.interval) {
+		site.suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	// Only one of several racing writers wins the slot.
+	if (!site.last.compare_exchange_strong(last, now+1, std::memory_order_relaxed)) {
+		site.suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+	return true;
+}
+
+
+void Log::push(const Record& record) {
+
+	uint64_t pos = m_head.load(std::memory_order_relaxed);
+	for (;;) {
+		Cell& cell = m_cells[pos & (CAPACITY-1)];
+		uint64_t seq = cell.sequence.load(std::memory_order_acquire);
+		int64_t diff = (int64_t)seq - (int64_t)pos;
+		if (diff==0) {
+			if (m_head.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+				cell.record = record;
+				cell.sequence.store(pos+1, std::memory_order_release);
+				return;
+			}
+		} else if (diff<0) {
+			// Ring is full, drop rather than wait for a consumer.
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = m_head.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+
+bool Log::pop(Record& record) {
+
+	uint64_t pos = m_tail.load(std::memory_order_relaxed);
+	for (;;) {
+		Cell& cell = m_cells[pos & (CAPACITY-1)];
+		uint64_t seq = cell.sequence.load(std::memory_order_acquire);
+		int64_t diff = (int64_t)seq - (int64_t)(pos+1);
+		if (diff==0) {
+			if (m_tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+				record = cell.record;
+				cell.sequence.store(pos+CAPACITY, std::memory_order_release);
+				return true;
+			}
+		} else if (diff<0) {
+			return false;
+		} else {
+			pos = m_tail.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+
+// --------------------------------------------------------
+
+
+size_t Log::format(const Record& record, char* buffer, size_t size) {
+
+	static const char* LEVEL_NAMES[] = { "verbose", "notice", "warning", "error" };
+
+	if (size==0) return 0;
+	size_t n = 0;
+	int written = snprintf(buffer, size, "%8.3f [%s] ",
+		record.timeMicros*1.0e-6, LEVEL_NAMES[record.level & 3]);
+	if (written>0) n = std::min(size-1, (size_t)written);
+
+	// Walk the format, handing each conversion to snprintf with its captured argument.
+	unsigned argIndex = 0;
+	const char* f = record.format;
+	while (*f && n+1<size) {
+		if (*f!='%') {
+			buffer[n++] = *f++;
+			continue;
+		}
+		if (f[1]=='%') {
+			buffer[n++] = '%';
+			f += 2;
+			continue;
+		}
+
+		// Copy flags, width and precision, a * taking its value from the next
+		// argument as printf does; drop length modifiers as the captured
+		// value already has the widest type.
+		char spec[48];
+		size_t s = 0;
+		bool isMissing = false;
+		spec[s++] = *f++;
+		while (*f && strchr("-+ #0123456789.*", *f) && s<sizeof(spec)-16) {
+			if (*f!='*') {
+				spec[s++] = *f++;
+				continue;
+			}
+			++f;
+			if (argIndex>=record.numArgs) {
+				isMissing = true;
+				continue;
+			}
+			const Arg& star = record.args[argIndex++];
+			long long value = star.type==Arg::REAL ? (long long)star.d : star.i;
+			value = std::max(-MAX_STAR, std::min(MAX_STAR, value));
+			// a negative precision is taken as omitted (a negative width as the - flag, which printf allows here)
+			if (spec[s-1]=='.' && value<0) --s;
+			else s += snprintf(spec+s, sizeof(spec)-s, "%lld", value);
+		}
+		while (*f && strchr("hlLqjzt", *f)) ++f;
+		char conversion = *f;
+		if (conversion==0) break;
+		++f;
+
+		if (isMissing || argIndex>=record.numArgs) {
+			buffer[n++] = '?';
+			continue;
+		}
+		const Arg& arg = record.args[argIndex++];
+
+		size_t room = size-n;
+		switch (conversion) {
+			case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': {
+				if (conversion!='c') { spec[s++] = 'l'; spec[s++] = 'l'; }
+				spec[s++] = conversion;
+				spec[s] = 0;
+				long long value = arg.type==Arg::REAL ? (long long)arg.d : arg.i;
+				written = conversion=='c' ? snprintf(buffer+n, room, spec, (int)value)
+					: snprintf(buffer+n, room, spec, value);
+				break;
+			}
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+				spec[s++] = conversion;
+				spec[s] = 0;
+				double value = arg.type==Arg::REAL ? arg.d
+					: (arg.type==Arg::UINT ? (double)arg.u : (double)arg.i);
+				written = snprintf(buffer+n, room, spec, value);
+				break;
+			}
+			case 's': {
+				spec[s++] = 's';
+				spec[s] = 0;
+				written = snprintf(buffer+n, room, spec, arg.type==Arg::CSTR && arg.s ? arg.s : "(?)");
+				break;
+			}
+			default:
+				written = snprintf(buffer+n, room, "?");
+				break;
+		}
+		if (written>0) n += std::min(room-1, (size_t)written);
+	}
+
+	if (record.suppressed>0 && n+1<size) {
+		written = snprintf(buffer+n, size-n, " (+%u suppressed)", record.suppressed);
+		if (written>0) n += std::min(size-n-1, (size_t)written);
+	}
+	buffer[n] = 0;
+	return n;
+}
+
+
+// --------------------------------------------------------
+
+
+bool Log::startFileSink(const String& path, unsigned periodMillis) {
+	std::lock_guard<std::mutex> lock(m_sinkMutex);
+	if (m_sinkRunning.load()) return false;
+
+	FILE* file = fopen(path.c_str(), "a");
+	if (file==NULL) return false;
+
+	m_sinkRunning.store(true);
+	m_sinkThread = std::thread(&Log::sinkLoop, this, file, periodMillis);
+	return true;
+}
+
+
+void Log::stopFileSink() {
+	std::lock_guard<std::mutex> lock(m_sinkMutex);
+	if (!m_sinkThread.joinable()) return;
+	m_sinkRunning.store(false);
+	m_sinkThread.join();
+}
+
+
+void Log::sinkLoop(FILE* file, unsigned periodMillis) {
+	char line[512];
+	Record record;
+	for (;;) {
+		bool running = m_sinkRunning.load();
+		while (pop(record)) {
+			format(record, line, sizeof(line));
+			fputs(line, file);
+			fputc('\n', file);
+		}
+		fflush(file);
+		if (!running) break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(periodMillis));
+	}
+	fclose(file);
+}
+
+}	// namespace YAMPE
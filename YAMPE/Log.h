@@ -0,0 +1,198 @@
+/**
+	@file 		Log.h
+	@author		dgaffney
+	@practical
+	@brief		Allocation free binary logging for use inside the simulation step.
+
+	Log records are written into a fixed size lock-free ring buffer as a
+	pointer to a (static) format string plus the raw argument values. No
+	string is built on the writing side; formatting is deferred until a
+	consumer (the GUI logging window or a background file sink) drains the
+	buffer.
+
+	Each call site is rate limited: repeats of the same message within the
+	site interval are counted rather than written, and the count is reported
+	with the next record that gets through.
+
+	\code
+	YAMPE_LOG_WARNING("[ContactRegistry::resolve] Reached iteration limit (%u).", limit);
+	\endcode
+
+	Format strings follow printf conventions (a * width or precision takes
+	the next argument, as an int) and must have static storage duration
+	(string literals). The same applies to any %s argument.
+	*/
+
+#ifndef YAMPE_LOG_H
+#define YAMPE_LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "util.h"
+
+namespace YAMPE {
+
+class Log {
+
+public:
+
+	enum Level { LEVEL_VERBOSE, LEVEL_NOTICE, LEVEL_WARNING, LEVEL_ERROR };
+
+	static const unsigned MAX_ARGS = 6;				///< maximum number of arguments per record.
+	static const unsigned CAPACITY = 1024;			///< number of records in ring (power of two).
+	static const uint64_t DEFAULT_INTERVAL = 1000000;	///< default per site rate limit (microseconds).
+
+	/**
+		One captured argument. Values are stored raw and only converted to
+		text when the record is formatted.
+		*/
+	struct Arg {
+		enum Type : uint8_t { INT, UINT, REAL, CSTR };
+		Type type;
+		union {
+			long long i;
+			unsigned long long u;
+			double d;
+			const char* s;
+		};
+	};
+
+	/// A single binary log record.
+	struct Record {
+		uint64_t timeMicros;		///< time stamp relative to start of log.
+		const char* format;			///< printf style format (static storage).
+		uint32_t suppressed;		///< number of identical messages dropped by rate limit.
+		uint8_t level;
+		uint8_t numArgs;
+		Arg args[MAX_ARGS];
+	};
+
+	/**
+		Per call site state used for rate limiting/deduplication. Declared
+		as a function static by the YAMPE_LOG macros.
+		*/
+	struct Site {
+		std::atomic<uint64_t> last;			///< time of last written record (+1, zero means never).
+		std::atomic<uint32_t> suppressed;	///< records dropped since then.
+		uint64_t interval;					///< minimum time between records (microseconds).
+
+		Site(uint64_t interval=DEFAULT_INTERVAL) : last(0), suppressed(0), interval(interval) { }
+	};
+
+	static Log& instance();
+
+	/// Captures a record for the given site. Never allocates or blocks.
+	template <typename... Args>
+	void write(Site& site, Level level, const char* format, const Args&... args) {
+		static_assert(sizeof...(Args) <= MAX_ARGS, "Too many arguments for YAMPE::Log record.");
+		if (level < m_level.load(std::memory_order_relaxed)) return;
+		uint64_t now = timeMicros();
+		uint32_t suppressed = 0;
+		if (!admit(site, now, suppressed)) return;
+		Record record;
+		record.timeMicros = now;
+		record.format = format;
+		record.suppressed = suppressed;
+		record.level = (uint8_t)level;
+		record.numArgs = (uint8_t)sizeof...(Args);
+		capture(record.args, args...);
+		push(record);
+	}
+
+	/// Removes the oldest record from the ring. Returns false if empty.
+	bool pop(Record& record);
+
+	/**
+		Formats a record into the given buffer (always null terminated).
+		Returns the number of characters written.
+		*/
+	static size_t format(const Record& record, char* buffer, size_t size);
+
+	/**
+		Starts a background thread that periodically drains the ring into
+		the given file. While running, the file sink is the only consumer.
+		*/
+	bool startFileSink(const String& path, unsigned periodMillis=100);
+	void stopFileSink();
+	bool isFileSinkRunning() const { return m_sinkRunning.load(); }
+
+	void setLevel(Level level) { m_level.store(level); }
+	Level level() const { return m_level.load(); }
+
+	/// Number of records lost because the ring was full.
+	uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+	uint64_t timeMicros() const;
+
+	~Log();
+
+private:
+
+	Log();
+	Log(const Log&);
+	Log& operator=(const Log&);
+
+	/// Ring cell, the sequence number orders producers and consumers (Vyukov bounded queue).
+	struct Cell {
+		std::atomic<uint64_t> sequence;
+		Record record;
+	};
+
+	Cell m_cells[CAPACITY];
+	std::atomic<uint64_t> m_head;		///< next position to write.
+	std::atomic<uint64_t> m_tail;		///< next position to read.
+	std::atomic<uint64_t> m_dropped;
+	std::atomic<Level> m_level;
+	uint64_t m_startTicks;
+
+	std::thread m_sinkThread;
+	std::atomic<bool> m_sinkRunning;
+	std::mutex m_sinkMutex;				///< serialises start/stop of the sink (never taken by writers).
+
+	bool admit(Site& site, uint64_t now, uint32_t& suppressed);
+	void push(const Record& record);
+	void sinkLoop(FILE* file, unsigned periodMillis);
+
+	static void capture(Arg*) { }
+	template <typename T, typename... Rest>
+	static void capture(Arg* out, const T& value, const Rest&... rest) {
+		set(*out, value);
+		capture(out+1, rest...);
+	}
+
+	static void set(Arg& a, bool v) { a.type = Arg::INT; a.i = v; }
+	static void set(Arg& a, char v) { a.type = Arg::INT; a.i = v; }
+	static void set(Arg& a, int v) { a.type = Arg::INT; a.i = v; }
+	static void set(Arg& a, long v) { a.type = Arg::INT; a.i = v; }
+	static void set(Arg& a, long long v) { a.type = Arg::INT; a.i = v; }
+	static void set(Arg& a, unsigned v) { a.type = Arg::UINT; a.u = v; }
+	static void set(Arg& a, unsigned long v) { a.type = Arg::UINT; a.u = v; }
+	static void set(Arg& a, unsigned long long v) { a.type = Arg::UINT; a.u = v; }
+	static void set(Arg& a, float v) { a.type = Arg::REAL; a.d = v; }
+	static void set(Arg& a, double v) { a.type = Arg::REAL; a.d = v; }
+	static void set(Arg& a, const char* v) { a.type = Arg::CSTR; a.s = v; }
+};
+
+}	// namespace YAMPE
+
+#define YAMPE_LOG_AT(level, interval, format, ...) \
+	do { \
+		static YAMPE::Log::Site yampeLogSite_(interval); \
+		YAMPE::Log::instance().write(yampeLogSite_, level, format, ##__VA_ARGS__); \
+	} while (0)
+
+#define YAMPE_LOG(level, format, ...) \
+	YAMPE_LOG_AT(level, YAMPE::Log::DEFAULT_INTERVAL, format, ##__VA_ARGS__)
+
+#define YAMPE_LOG_VERBOSE(format, ...) YAMPE_LOG_AT(YAMPE::Log::LEVEL_VERBOSE, 0, format, ##__VA_ARGS__)
+#define YAMPE_LOG_NOTICE(format, ...) YAMPE_LOG(YAMPE::Log::LEVEL_NOTICE, format, ##__VA_ARGS__)
+#define YAMPE_LOG_WARNING(format, ...) YAMPE_LOG(YAMPE::Log::LEVEL_WARNING, format, ##__VA_ARGS__)
+#define YAMPE_LOG_ERROR(format, ...) YAMPE_LOG(YAMPE::Log::LEVEL_ERROR, format, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,273 @@
+/**
+	@file 		Memory.cpp
+	@author		dgaffney
+	@practical
+	@brief		Memory accounting per engine subsystem, through pluggable memory resources.
+	*/
+
+#include <algorithm>
+#include <sstream>
+
+#include "Log.h"
+#include "Memory.h"
+
+namespace YAMPE {
+
+namespace {
+
+	class NewDeleteResource : public MemoryResource {
+	protected:
+		void* doAllocate(size_t bytes, size_t alignment) {
+			ASSERT(alignment<=alignof(std::max_align_t), "Over-aligned allocation in NewDeleteResource");
+			(void) alignment;
+			return ::operator new(bytes);
+		}
+		void doDeallocate(void* p, size_t, size_t) { ::operator delete(p); }
+	};
+
+	/// Counts of one thread in one TrackingResource, not yet added to its shared counters.
+	struct ThreadCounts {
+		int64_t bytes;
+		uint32_t allocations, deallocations;
+	};
+
+	// trivial, so zero initialised without a guard on every access
+	thread_local ThreadCounts threadCounts[TrackingResource::MAX_RESOURCES];
+	thread_local bool isThreadRegistered = false;
+
+	std::atomic<unsigned> nextSlot(0);
+	std::atomic<TrackingResource*> resources[TrackingResource::MAX_RESOURCES];
+
+	/// Flushes the counts of a thread when it exits.
+	struct ThreadExit {
+		~ThreadExit() {
+			for (unsigned k=0; k<TrackingResource::MAX_RESOURCES; ++k) {
+				TrackingResource* resource = resources[k].load(std::memory_order_acquire);
+				if (resource!=NULL) resource->flush();
+			}
+		}
+	};
+
+	void registerThread() {
+		isThreadRegistered = true;
+		static thread_local ThreadExit flusher;
+		(void) flusher;
+	}
+
+	const char* SUBSYSTEM_LABELS[MemoryTracker::NUM_SUBSYSTEMS] = {
+		"Particles", "Particle registries", "Contacts", "Forces", "Generators", "Labels (estimate)"
+	};
+
+}
+
+
+// --------------------------------------------------------
+
+
+MemoryResource* newDeleteResource() {
+	// never destroyed, memory may be freed after static destruction has begun
+	static MemoryResource* resource = new NewDeleteResource();
+	return resource;
+}
+
+
+TrackingResource::TrackingResource(const char* label, MemoryResource* upstream) :
+	m_label(label),
+	m_slot(nextSlot.fetch_add(1, std::memory_order_relaxed)),
+	m_upstream(upstream),
+	m_budget(0),
+	m_isBudgetEnforced(false),
+	m_liveBytes(0),
+	m_peakBytes(0),
+	m_allocations(0),
+	m_deallocations(0),
+	m_overBudget(0)
+{
+	if (m_slot<MAX_RESOURCES) resources[m_slot].store(this, std::memory_order_release);
+	else m_slot = MAX_RESOURCES;
+}
+
+
+TrackingResource::~TrackingResource() {
+	// slots are not reused, other threads may still hold counts in this one
+	if (m_slot<MAX_RESOURCES) resources[m_slot].store(NULL, std::memory_order_release);
+}
+
+
+void TrackingResource::noteAllocation(size_t bytes) {
+	if (m_slot==MAX_RESOURCES) {
+		add((int64_t) bytes, 1, 0);
+		return;
+	}
+	if (!isThreadRegistered) registerThread();
+	ThreadCounts& counts = threadCounts[m_slot];
+	counts.bytes += (int64_t) bytes;
+	if (++counts.allocations>=BATCH_ALLOCATIONS || counts.bytes>=(int64_t) BATCH_BYTES) flush();
+}
+
+
+void TrackingResource::noteDeallocation(size_t bytes) {
+	if (m_slot==MAX_RESOURCES) {
+		add(-(int64_t) bytes, 0, 1);
+		return;
+	}
+	if (!isThreadRegistered) registerThread();
+	ThreadCounts& counts = threadCounts[m_slot];
+	counts.bytes -= (int64_t) bytes;
+	if (++counts.deallocations>=BATCH_ALLOCATIONS || counts.bytes<=-(int64_t) BATCH_BYTES) flush();
+}
+
+
+void TrackingResource::flush() {
+	if (m_slot==MAX_RESOURCES) return;
+	ThreadCounts& counts = threadCounts[m_slot];
+	add(counts.bytes, counts.allocations, counts.deallocations);
+	counts.bytes = 0;
+	counts.allocations = counts.deallocations = 0;
+}
+
+
+void TrackingResource::add(int64_t bytes, uint64_t allocations, uint64_t deallocations) {
+	int64_t live = m_liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	if (live>0) {
+		size_t peak = m_peakBytes.load(std::memory_order_relaxed);
+		while ((size_t) live>peak && !m_peakBytes.compare_exchange_weak(peak, (size_t) live, std::memory_order_relaxed)) { }
+	}
+	if (allocations>0) m_allocations.fetch_add(allocations, std::memory_order_relaxed);
+	if (deallocations>0) m_deallocations.fetch_add(deallocations, std::memory_order_relaxed);
+}
+
+
+size_t TrackingResource::liveBytes() const {
+	int64_t live = m_liveBytes.load(std::memory_order_relaxed);
+	if (m_slot<MAX_RESOURCES) live += threadCounts[m_slot].bytes;
+	// memory freed by a thread that flushed, allocated by one that did not
+	return live>0 ? (size_t) live : 0;
+}
+
+
+size_t TrackingResource::peakBytes() const {
+	return std::max(m_peakBytes.load(std::memory_order_relaxed), liveBytes());
+}
+
+
+uint64_t TrackingResource::allocations() const {
+	uint64_t allocations = m_allocations.load(std::memory_order_relaxed);
+	if (m_slot<MAX_RESOURCES) allocations += threadCounts[m_slot].allocations;
+	return allocations;
+}
+
+
+uint64_t TrackingResource::deallocations() const {
+	uint64_t deallocations = m_deallocations.load(std::memory_order_relaxed);
+	if (m_slot<MAX_RESOURCES) deallocations += threadCounts[m_slot].deallocations;
+	return deallocations;
+}
+
+
+void* TrackingResource::doAllocate(size_t bytes, size_t alignment) {
+	if (m_budget>0 && liveBytes()+bytes>m_budget) {
+		m_overBudget.fetch_add(1, std::memory_order_relaxed);
+		YAMPE_LOG_WARNING("%s over its memory budget of %llu bytes%s", m_label, (unsigned long long) m_budget,
+			m_isBudgetEnforced ? ", allocation refused" : "");
+		if (m_isBudgetEnforced) throw std::bad_alloc();
+	}
+	void* p = m_upstream->allocate(bytes, alignment);
+	noteAllocation(bytes);
+	return p;
+}
+
+
+void TrackingResource::doDeallocate(void* p, size_t bytes, size_t alignment) {
+	if (p==NULL) return;
+	m_upstream->deallocate(p, bytes, alignment);
+	noteDeallocation(bytes);
+}
+
+
+void TrackingResource::reset() {
+	flush();
+	m_peakBytes.store(liveBytes(), std::memory_order_relaxed);
+	m_allocations.store(0, std::memory_order_relaxed);
+	m_deallocations.store(0, std::memory_order_relaxed);
+	m_overBudget.store(0, std::memory_order_relaxed);
+}
+
+
+// --------------------------------------------------------
+
+
+MemoryTracker& MemoryTracker::instance() {
+	// never destroyed, as newDeleteResource()
+	static MemoryTracker* tracker = new MemoryTracker();
+	return *tracker;
+}
+
+
+MemoryTracker::MemoryTracker() : m_steps(0) {
+	for (unsigned k=0; k<NUM_SUBSYSTEMS; ++k) {
+		m_resources[k] = new TrackingResource(SUBSYSTEM_LABELS[k]);
+		m_stepStart[k] = m_lastStep[k] = 0;
+	}
+}
+
+
+uint64_t MemoryTracker::allocations() const {
+	uint64_t total = 0;
+	for (unsigned k=0; k<NUM_SUBSYSTEMS; ++k) total += m_resources[k]->allocations();
+	return total;
+}
+
+
+void MemoryTracker::endStep() {
+	++m_steps;
+	for (unsigned k=0; k<NUM_SUBSYSTEMS; ++k) {
+		uint64_t allocations = m_resources[k]->allocations();
+		m_lastStep[k] = allocations-m_stepStart[k];
+		m_stepStart[k] = allocations;
+	}
+}
+
+
+void MemoryTracker::report(std::vector<Report>& reports) const {
+	reports.resize(NUM_SUBSYSTEMS);
+	for (unsigned k=0; k<NUM_SUBSYSTEMS; ++k) {
+		const TrackingResource& r = *m_resources[k];
+		Report& report = reports[k];
+		report.label = r.label();
+		report.liveBytes = r.liveBytes();
+		report.peakBytes = r.peakBytes();
+		report.budget = r.budget();
+		report.allocations = r.allocations();
+		report.allocationsPerStep = m_steps>0 ? (double) m_stepStart[k]/m_steps : 0.0;
+		report.lastStepAllocations = m_lastStep[k];
+		report.overBudget = r.overBudget();
+	}
+}
+
+
+void MemoryTracker::reset() {
+	m_steps = 0;
+	for (unsigned k=0; k<NUM_SUBSYSTEMS; ++k) {
+		m_resources[k]->reset();
+		m_stepStart[k] = m_lastStep[k] = 0;
+	}
+}
+
+
+const String MemoryTracker::toString() const {
+	std::vector<Report> reports;
+	report(reports);
+	std::ostringstream outs;
+	for (auto && r: reports) {
+		outs <<"\n" <<r.label <<"    "
+			<<"live = " <<r.liveBytes <<"    "
+			<<"peak = " <<r.peakBytes <<"    "
+			<<"allocations = " <<r.allocations;
+		if (m_steps>0) outs <<"    per step = " <<r.allocationsPerStep;
+		if (r.budget>0) outs <<"    budget = " <<r.budget <<" (exceeded " <<r.overBudget <<" times)";
+	}
+	return outs.str();
+}
+
+}	// namespace YAMPE
@@ -0,0 +1,265 @@
+/**
+	@file 		Memory.h
+	@author		dgaffney
+	@practical
+	@brief		Memory accounting per engine subsystem, through pluggable memory resources.
+
+	Every subsystem allocates through its own TrackingResource, which counts
+	live bytes, the peak of live bytes and allocations, and passes the
+	requests on to an upstream MemoryResource (operator new by default). The
+	upstream can be replaced per subsystem (e.g. by an arena, or on C++17
+	by any std::pmr resource through PmrResource) and a subsystem can be
+	given a budget of live bytes, which is either reported when exceeded
+	or enforced by failing the allocation with std::bad_alloc.
+
+	MemoryResource follows std::pmr::memory_resource, which the engine
+	cannot use as long as it builds as C++14. Allocator<T, S> is a stateless
+	allocator for the standard containers that routes to the resource of
+	subsystem S; being stateless, containers with it copy, swap and compare
+	as with std::allocator, and the resource behind them can be changed
+	while they are in use (as long as memory goes back to the resource it
+	came from).
+
+	What is counted where:
+	- PARTICLES: Particle objects (class operator new, blocks included),
+	- PARTICLE_REGISTRIES: ParticleRegistry vectors,
+	- CONTACTS: Contact objects and ContactRegistry storage,
+	- FORCES: ForceGeneratorRegistry storage,
+	- GENERATORS: contact generator scratch (narrow phase columns, neighbour lists),
+	- LABELS: heap storage of Printable labels, an estimate: labels stay
+	  std::string and its allocations do not pass through a TrackingResource,
+	  so each label is counted as capacity()+1 bytes when its data lies
+	  outside the string object (see Printable).
+	The control blocks of shared pointers are not counted.
+
+	endStep() marks a step, so allocations can be reported per step:
+
+	\code
+	MemoryTracker& memory = MemoryTracker::instance();
+	memory.resource(MemoryTracker::CONTACTS).setBudget(64<<20, true);
+	...
+	memory.endStep();
+	cout <<memory.toString() <<endl;
+	\endcode
+	*/
+
+#ifndef YAMPE_MEMORY_H
+#define YAMPE_MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<memory_resource>) && __cplusplus>=201703L
+#include <memory_resource>
+#define YAMPE_HAS_PMR
+#endif
+#endif
+
+#include "util.h"
+
+namespace YAMPE {
+
+/// Source of memory, as std::pmr::memory_resource.
+class MemoryResource {
+
+public:
+
+	virtual ~MemoryResource() { }
+
+	void* allocate(size_t bytes, size_t alignment=alignof(std::max_align_t)) { return doAllocate(bytes, alignment); }
+	void deallocate(void* p, size_t bytes, size_t alignment=alignof(std::max_align_t)) { doDeallocate(p, bytes, alignment); }
+	bool isEqual(const MemoryResource& other) const { return doIsEqual(other); }
+
+protected:
+
+	virtual void* doAllocate(size_t bytes, size_t alignment) = 0;
+	virtual void doDeallocate(void* p, size_t bytes, size_t alignment) = 0;
+	virtual bool doIsEqual(const MemoryResource& other) const { return this==&other; }
+};
+
+/// operator new and delete, alignments up to alignof(max_align_t).
+MemoryResource* newDeleteResource();
+
+#if defined(YAMPE_HAS_PMR)
+/// A std::pmr resource used as a MemoryResource.
+class PmrResource : public MemoryResource {
+public:
+	explicit PmrResource(std::pmr::memory_resource* resource) : m_resource(resource) { }
+protected:
+	std::pmr::memory_resource* m_resource;
+	void* doAllocate(size_t bytes, size_t alignment) { return m_resource->allocate(bytes, alignment); }
+	void doDeallocate(void* p, size_t bytes, size_t alignment) { m_resource->deallocate(p, bytes, alignment); }
+};
+#endif
+
+/**
+	\class TrackingResource
+
+	Counts what goes through it to an upstream resource. Any thread may
+	allocate: each thread counts in its own counters, which are added to
+	the shared (atomic) ones every BATCH_BYTES bytes or BATCH_ALLOCATIONS
+	allocations, when it calls flush() or reset(), and when it exits. So
+	the hot path takes no lock and no atomic operation. A thread reading the
+	counters sees its own counts exactly and those of the other threads at
+	most a batch each behind; the peak is found at the same granularity.
+	The first MAX_RESOURCES resources batch, any more count directly in the
+	shared counters.
+	*/
+class TrackingResource : public MemoryResource {
+
+public:
+
+	static const size_t BATCH_BYTES = 16*1024;
+	static const unsigned BATCH_ALLOCATIONS = 64;
+	static const unsigned MAX_RESOURCES = 32;
+
+	explicit TrackingResource(const char* label="", MemoryResource* upstream=newDeleteResource());
+	~TrackingResource();
+
+	const char* label() const { return m_label; }
+
+	/// Resource the requests are passed to, must not change while it holds memory.
+	void setUpstream(MemoryResource* upstream) { m_upstream = upstream; }
+	MemoryResource* upstream() const { return m_upstream; }
+
+	/**	Live bytes allowed, 0 for no limit. Beyond it allocations are counted
+		and logged, and fail with std::bad_alloc if isEnforced.
+		*/
+	void setBudget(size_t bytes, bool isEnforced=false) { m_budget = bytes; m_isBudgetEnforced = isEnforced; }
+	size_t budget() const { return m_budget; }
+	bool isBudgetEnforced() const { return m_isBudgetEnforced; }
+
+	/// Counts memory that is allocated elsewhere (e.g. by a std::string) as allocated or freed here.
+	void noteAllocation(size_t bytes);
+	void noteDeallocation(size_t bytes);
+
+	/// Adds the calling thread's counts to the shared ones.
+	void flush();
+
+	// shared counters plus those of the calling thread
+	size_t liveBytes() const;
+	size_t peakBytes() const;
+	uint64_t allocations() const;
+	uint64_t deallocations() const;
+	uint64_t overBudget() const { return m_overBudget.load(std::memory_order_relaxed); }
+
+	/// Peak back to the live bytes, allocation counts to zero.
+	void reset();
+
+protected:
+
+	const char* m_label;
+	unsigned m_slot;				///< of the per thread counters, MAX_RESOURCES if none.
+	MemoryResource* m_upstream;
+	size_t m_budget;
+	bool m_isBudgetEnforced;
+
+	std::atomic<int64_t> m_liveBytes;
+	std::atomic<size_t> m_peakBytes;
+	std::atomic<uint64_t> m_allocations, m_deallocations, m_overBudget;
+
+	void* doAllocate(size_t bytes, size_t alignment);
+	void doDeallocate(void* p, size_t bytes, size_t alignment);
+
+	/// Adds counts to the shared counters.
+	void add(int64_t bytes, uint64_t allocations, uint64_t deallocations);
+};
+
+/**
+	\class MemoryTracker
+
+	The tracking resources of the engine subsystems, with per step counts.
+	*/
+class MemoryTracker {
+
+public:
+
+	enum Subsystem { PARTICLES, PARTICLE_REGISTRIES, CONTACTS, FORCES, GENERATORS, LABELS, NUM_SUBSYSTEMS };
+
+	/// One subsystem, allocations per step averaged since the last reset().
+	struct Report {
+		const char* label;
+		size_t liveBytes, peakBytes, budget;
+		uint64_t allocations;			///< since the last reset().
+		double allocationsPerStep;
+		uint64_t lastStepAllocations;	///< in the step before the last endStep().
+		uint64_t overBudget;
+	};
+
+	static MemoryTracker& instance();
+
+	TrackingResource& resource(Subsystem subsystem) { return *m_resources[subsystem]; }
+	const TrackingResource& resource(Subsystem subsystem) const { return *m_resources[subsystem]; }
+
+	/// Allocations over all subsystems since the start.
+	uint64_t allocations() const;
+
+	/// Marks the end of a step, the unit of report().
+	void endStep();
+	uint64_t steps() const { return m_steps; }
+
+	void report(std::vector<Report>& reports) const;
+	void reset();
+
+	const String toString() const;
+
+private:
+
+	TrackingResource* m_resources[NUM_SUBSYSTEMS];
+	uint64_t m_steps;
+	uint64_t m_stepStart[NUM_SUBSYSTEMS];		///< allocations at the last endStep().
+	uint64_t m_lastStep[NUM_SUBSYSTEMS];
+
+	MemoryTracker();
+	MemoryTracker(const MemoryTracker&);
+	MemoryTracker& operator=(const MemoryTracker&);
+};
+
+/// Stateless allocator for the standard containers, allocating from the resource of subsystem S.
+template <typename T, MemoryTracker::Subsystem S>
+class Allocator {
+public:
+	typedef T value_type;
+
+	template <typename U> struct rebind { typedef Allocator<U, S> other; };
+
+	Allocator() { }
+	template <typename U> Allocator(const Allocator<U, S>&) { }
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(MemoryTracker::instance().resource(S).allocate(n*sizeof(T), alignof(T)));
+	}
+	void deallocate(T* p, size_t n) {
+		MemoryTracker::instance().resource(S).deallocate(p, n*sizeof(T), alignof(T));
+	}
+
+	template <typename U> bool operator==(const Allocator<U, S>&) const { return true; }
+	template <typename U> bool operator!=(const Allocator<U, S>&) const { return false; }
+};
+
+/// Base class allocating objects (and arrays of them) from the resource of subsystem S.
+template <MemoryTracker::Subsystem S>
+struct TrackedObject {
+	static void* operator new(size_t bytes) { return MemoryTracker::instance().resource(S).allocate(bytes); }
+	static void* operator new[](size_t bytes) { return MemoryTracker::instance().resource(S).allocate(bytes); }
+	static void operator delete(void* p, size_t bytes) { MemoryTracker::instance().resource(S).deallocate(p, bytes); }
+	static void operator delete[](void* p, size_t bytes) { MemoryTracker::instance().resource(S).deallocate(p, bytes); }
+};
+
+template <typename T, MemoryTracker::Subsystem S>
+using TrackedVector = std::vector<T, Allocator<T, S> >;
+
+template <typename K, typename V, MemoryTracker::Subsystem S>
+using TrackedMap = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, Allocator<std::pair<const K, V>, S> >;
+
+}	// namespace YAMPE
+
+#endif
@@ -78,6 +78,10 @@ Particle& Particle::applyForce(const ofVec3f& force) {
 	return *this;
 }
 
+const ofVec3f& Particle::accumulatedForce() const {
+	return m_force;
+}
+
 Particle& Particle::setLabel(String label) {
 	Printable::setLabel(label);
 	return *this;
@@ -108,6 +112,12 @@ Particle& Particle::setWireColor(const ofColor wireColor) {
 	return *this;
 }
 
+Particle& Particle::setCollisionFilter(uint32_t group, uint32_t mask) {
+	collisionGroup = group;
+	collisionMask = mask;
+	return *this;
+}
+
 const String Particle::toString() const {
 	std::ostringstream outs;
 	outs<<"Position = " <<position <<"    "
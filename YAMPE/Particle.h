@@ -9,6 +9,7 @@
 #define PARTICLE_H
 
 #include "ofMain.h"
+#include "Memory.h"
 #include "Printable.h"
 
 namespace YAMPE {
@@ -19,7 +20,7 @@ namespace YAMPE {
 	A particle is a point-mass with velocity and acceleration.
 	
  */
-class Particle : public Printable {
+class Particle : public Printable, public TrackedObject<MemoryTracker::PARTICLES> {
 	
 private:
 	float m_inverseMass;		///< 1/mass of object (see notes).
@@ -35,6 +36,8 @@ public:
 	bool visible;
 	bool isForceVisible;		///< flag - display force on particle
 	ofVec3f force;				///< force at last call to integrate (for display only)
+	uint32_t collisionGroup;	///< bits of the collision groups the particle belongs to.
+	uint32_t collisionMask;		///< bits of the groups it collides with (see P::CollisionFilter).
 
 	ofVec3f position;			///< Particle position.
 	ofVec3f velocity;			///< Particle velocity (rate of change of position).
@@ -57,6 +60,8 @@ public:
 		isForceVisible(false),
 		
 		force(ofVec3f::zero()),
+		collisionGroup(1),
+		collisionMask(0xffffffffu),
 		position(ofVec3f::zero()), 
 		velocity(ofVec3f::zero()), 
 		acceleration(ofVec3f::zero())
@@ -68,6 +73,7 @@ public:
 	Particle& setRadius(float radius);
 	Particle& setBodyColor(const ofColor bodyColor);
 	Particle& setWireColor(const ofColor wireColor);
+	Particle& setCollisionFilter(uint32_t group, uint32_t mask=0xffffffffu);
 	
 	virtual const String toString() const;
 
@@ -86,11 +92,12 @@ public:
         	
 	void clearForce();
 	Particle& applyForce(const ofVec3f& force);
+	const ofVec3f& accumulatedForce() const;	///< (Sum of) forces applied since last integrate.
 	
 	virtual void draw();
 };
 
-typedef vector<Particle::Ref> ParticleRegistry;
+typedef TrackedVector<Particle::Ref, MemoryTracker::PARTICLE_REGISTRIES> ParticleRegistry;
     
 }	// namespace YAMPE
 
@@ -0,0 +1,107 @@
+/**
+	@file 		CollisionFilter.cpp
+	@author		dgaffney
+	@practical
+	@brief		Collision groups and excluded particle pairs for particle pair generation.
+	*/
+
+#include <algorithm>
+
+#include "CollisionFilter.h"
+
+namespace YAMPE { namespace P {
+
+CollisionFilter::CollisionFilter(const String label) :
+	Printable(label),
+	m_version(0),
+	m_indexedVersion(0)
+{ }
+
+
+bool CollisionFilter::hasGroups(const ParticleRegistry& particles) {
+	// with every mask bit set, only a particle in no group can miss a pair
+	for (auto && p: particles) {
+		if (p->collisionMask!=0xffffffffu || p->collisionGroup==0) return true;
+	}
+	return false;
+}
+
+
+void CollisionFilter::exclude(const Particle::Ref& a, const Particle::Ref& b) {
+	ASSERT(a!=b, "Expected two different particles in CollisionFilter::exclude");
+	if (m_exclusions.insert(std::make_pair(key(a.get(), b.get()), std::make_pair(a, b))).second) ++m_version;
+}
+
+
+void CollisionFilter::include(const Particle::Ref& a, const Particle::Ref& b) {
+	if (m_exclusions.erase(key(a.get(), b.get()))>0) ++m_version;
+}
+
+
+bool CollisionFilter::isExcluded(const Particle* a, const Particle* b) const {
+	return !m_exclusions.empty() && m_exclusions.count(key(a, b))>0;
+}
+
+
+void CollisionFilter::clear() {
+	m_exclusions.clear();
+	m_offsets.clear();
+	m_excluded.clear();
+	m_particles.clear();
+	++m_version;
+}
+
+
+void CollisionFilter::index(const ParticleRegistry& particles) {
+
+	size_t n = particles.size();
+	if (m_exclusions.empty()) {
+		m_offsets.clear();
+		m_excluded.clear();
+		return;
+	}
+	if (m_indexedVersion==m_version && m_offsets.size()==n+1) {
+		bool isSame = true;
+		for (size_t k=0; k<n && isSame; ++k) isSame = particles[k].get()==m_particles[k];
+		if (isSame) return;
+	}
+
+	m_particles.resize(n);
+	TrackedMap<const Particle*, unsigned, MemoryTracker::GENERATORS> indices;
+	indices.reserve(n);
+	for (unsigned k=0; k<n; ++k) {
+		m_particles[k] = particles[k].get();
+		indices[m_particles[k]] = k;
+	}
+
+	// each excluded pair is listed under its higher index, as the broad
+	// phases test each particle against lower indexed ones
+	m_offsets.assign(n+1, 0);
+	for (auto && exclusion: m_exclusions) {
+		auto a = indices.find(exclusion.first.first), b = indices.find(exclusion.first.second);
+		if (a==indices.end() || b==indices.end()) continue;
+		++m_offsets[std::max(a->second, b->second)+1];
+	}
+	for (size_t k=0; k<n; ++k) m_offsets[k+1] += m_offsets[k];
+	m_excluded.resize(m_offsets[n]);
+	IndexList next(m_offsets.begin(), m_offsets.end()-1);
+	for (auto && exclusion: m_exclusions) {
+		auto a = indices.find(exclusion.first.first), b = indices.find(exclusion.first.second);
+		if (a==indices.end() || b==indices.end()) continue;
+		unsigned high = std::max(a->second, b->second), low = std::min(a->second, b->second);
+		m_excluded[next[high]++] = low;
+	}
+	for (size_t k=0; k<n; ++k) std::sort(m_excluded.begin()+m_offsets[k], m_excluded.begin()+m_offsets[k+1]);
+
+	m_indexedVersion = m_version;
+}
+
+
+const String CollisionFilter::toString() const {
+	std::ostringstream outs;
+	outs <<"exclusions = " <<numExclusions() <<"    "
+		<<"indexed = " <<m_excluded.size();
+	return outs.str();
+}
+
+} } // namespace YAMPE P
@@ -0,0 +1,128 @@
+/**
+	@file 		CollisionFilter.h
+	@author		dgaffney
+	@practical
+	@brief		Collision groups and excluded particle pairs for particle pair generation.
+	*/
+
+#ifndef PARTICLE_COLLISION_FILTER_H
+#define PARTICLE_COLLISION_FILTER_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+#include "../Particle.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class CollisionFilter
+
+	Decides which particle pairs may collide at all, before any distance
+	is computed. Two rules apply, both must allow the pair:
+
+	- groups: every particle has a collisionGroup (the bits of the groups
+	  it belongs to) and a collisionMask (the groups it collides with);
+	  a and b collide only if a.group & b.mask and b.group & a.mask are
+	  both non-zero. The defaults (group 1, every mask bit) let everything
+	  collide, so e.g. giving each cradle of a scene its own group bit and
+	  mask keeps their balls apart.
+
+	- exclusions: explicit pairs that never collide, typically particles
+	  linked by a rod or spring (the links of a rope), whose spheres touch
+	  by construction.
+
+	Exclusions hold Refs to their particles, so an excluded particle lives
+	(and its address is not reused) until the exclusion is removed or the
+	filter cleared, and they follow particles whose state is moved to
+	other objects through remapParticles() (see MortonOrder). For pair
+	generation they are indexed against a ParticleRegistry (index()),
+	giving each particle the sorted list of lower indexed particles it is
+	excluded with, which the broad phases skip (see
+	ParticleParticleContactGenerator).
+	*/
+class CollisionFilter : public Printable {
+
+public:
+
+	typedef ofPtr<CollisionFilter> Ref;
+
+	CollisionFilter(const String label="CollisionFilter");
+
+	/// True if the groups of a and b allow them to collide.
+	static bool isGroupPair(const Particle& a, const Particle& b) {
+		return (a.collisionGroup & b.collisionMask)!=0 && (b.collisionGroup & a.collisionMask)!=0;
+	}
+
+	/// True if some particle could be kept from colliding by its groups.
+	static bool hasGroups(const ParticleRegistry& particles);
+
+	/// Keeps a and b from colliding, or lets them again.
+	void exclude(const Particle::Ref& a, const Particle::Ref& b);
+	void include(const Particle::Ref& a, const Particle::Ref& b);
+	bool isExcluded(const Particle* a, const Particle* b) const;
+	size_t numExclusions() const { return m_exclusions.size(); }
+
+	/// True if a and b may collide, by both rules.
+	bool canCollide(const Particle& a, const Particle& b) const { return isGroupPair(a, b) && !isExcluded(&a, &b); }
+
+	void clear();
+
+	/// Replaces the particles of every exclusion by f(particle), e.g. MortonOrder::remap().
+	template <typename F>
+	void remapParticles(F f) {
+		Exclusions remapped;
+		remapped.reserve(m_exclusions.size());
+		for (auto && exclusion: m_exclusions) {
+			Particle::Ref a = f(exclusion.second.first), b = f(exclusion.second.second);
+			remapped.insert(std::make_pair(key(a.get(), b.get()), std::make_pair(a, b)));
+		}
+		m_exclusions.swap(remapped);
+		++m_version;
+	}
+
+	/// Changes with every exclusion added, removed or remapped.
+	unsigned version() const { return m_version; }
+
+	/// Indexes the exclusions against the particles, if they or the exclusions changed.
+	void index(const ParticleRegistry& particles);
+
+	/// Particles (all lower indexed, ascending) excluded with particle a, as of the last index().
+	const unsigned* excluded(unsigned a) const { return m_offsets.empty() ? NULL : m_excluded.data() + m_offsets[a]; }
+	size_t numExcluded(unsigned a) const { return m_offsets.empty() ? 0 : m_offsets[a+1]-m_offsets[a]; }
+
+	const String toString() const;
+
+protected:
+
+	typedef std::pair<const Particle*, const Particle*> Key;	///< lower address first.
+
+	struct KeyHash {
+		size_t operator()(const Key& key) const {
+			return std::hash<const Particle*>()(key.first)*31 ^ std::hash<const Particle*>()(key.second);
+		}
+	};
+
+	typedef std::pair<Particle::Ref, Particle::Ref> Link;
+
+	typedef std::unordered_map<Key, Link, KeyHash, std::equal_to<Key>,
+		Allocator<std::pair<const Key, Link>, MemoryTracker::GENERATORS> > Exclusions;
+	Exclusions m_exclusions;
+	unsigned m_version;
+
+	typedef TrackedVector<unsigned, MemoryTracker::GENERATORS> IndexList;
+
+	IndexList m_offsets;				///< n+1 offsets into m_excluded, empty without exclusions.
+	IndexList m_excluded;
+
+	// state at the last index()
+	TrackedVector<const Particle*, MemoryTracker::GENERATORS> m_particles;
+	unsigned m_indexedVersion;
+
+	static Key key(const Particle* a, const Particle* b) { return a<b ? Key(a, b) : Key(b, a); }
+};
+
+} } // namespace YAMPE P
+
+#endif
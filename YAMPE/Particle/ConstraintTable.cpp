@@ -0,0 +1,224 @@
+/**
+	@file 		ConstraintTable.cpp
+	@author		dgaffney
+	@practical
+	@brief		Table of length constraints between particles, stored column-wise.
+	*/
+
+#include <cmath>
+
+#include "ConstraintTable.h"
+
+namespace YAMPE { namespace P {
+
+// --------------------------------------------------------
+
+unsigned ConstraintTable::add(Type type, unsigned a, unsigned b, float targetLength, float restitution) {
+	ASSERT((b & ANCHORED)==0, "Particle index too large for ConstraintTable.");
+	this->type.push_back(type);
+	this->a.push_back(a);
+	this->b.push_back(b);
+	this->targetLength.push_back(targetLength);
+	this->restitution.push_back(restitution<0.0f ? defaultRestitution(type) : restitution);
+	this->direct.push_back(0);
+	return (unsigned) size()-1;
+}
+
+
+unsigned ConstraintTable::addAnchored(Type type, unsigned a, const ofVec3f& anchor, float targetLength, float restitution) {
+	unsigned k = (unsigned) anchorX.size();
+	anchorX.push_back(anchor.x);
+	anchorY.push_back(anchor.y);
+	anchorZ.push_back(anchor.z);
+	unsigned row = add(type, a, k, targetLength, restitution);
+	this->b[row] |= ANCHORED;
+	return row;
+}
+
+
+ofVec3f ConstraintTable::anchor(unsigned row) const {
+	unsigned k = b[row] & ~ANCHORED;
+	return ofVec3f(anchorX[k], anchorY[k], anchorZ[k]);
+}
+
+
+void ConstraintTable::remapParticles(const vector<unsigned>& rank) {
+	for (size_t row=0; row<size(); ++row) {
+		a[row] = rank[a[row]];
+		if (!isAnchored((unsigned) row)) b[row] = rank[b[row]];
+	}
+}
+
+
+void ConstraintTable::clear() {
+	type.clear();
+	a.clear();
+	b.clear();
+	targetLength.clear();
+	restitution.clear();
+	direct.clear();
+	anchorX.clear();
+	anchorY.clear();
+	anchorZ.clear();
+	violations.count = 0;
+}
+
+
+// --------------------------------------------------------
+
+void ConstraintTable::prepare(const ParticleRegistry& particles) {
+
+	const size_t rows = size();
+	const size_t n = particles.size();
+	const size_t anchors = anchorX.size();
+
+	// Gather positions so that particles and anchors share one index space,
+	// anchor k lives at slot n+k.
+	m_x.resize(n+anchors);
+	m_y.resize(n+anchors);
+	m_z.resize(n+anchors);
+	for (size_t k=0; k<n; ++k) {
+		const ofVec3f& p = particles[k]->position;
+		m_x[k] = p.x;
+		m_y[k] = p.y;
+		m_z[k] = p.z;
+	}
+	std::copy(anchorX.begin(), anchorX.end(), m_x.begin()+n);
+	std::copy(anchorY.begin(), anchorY.end(), m_y.begin()+n);
+	std::copy(anchorZ.begin(), anchorZ.end(), m_z.begin()+n);
+
+	m_error.resize(rows);
+	m_inverseLength.resize(rows);
+	m_violated.resize(rows);
+}
+
+
+void ConstraintTable::evaluateRows(size_t begin, size_t end) {
+
+	// Branch free over all rows, one sqrt per row.
+	const float* x = m_x.data();
+	const float* y = m_y.data();
+	const float* z = m_z.data();
+	const uint8_t* t = type.data();
+	const unsigned* ia = a.data();
+	const unsigned* ib = b.data();
+	const float* target = targetLength.data();
+	const uint8_t* skip = direct.data();
+	float* error = m_error.data();
+	float* inverseLength = m_inverseLength.data();
+	uint8_t* violated = m_violated.data();
+	const unsigned offset = (unsigned) (m_x.size()-anchorX.size());
+
+	for (size_t i=begin; i<end; ++i) {
+		unsigned j = ia[i];
+		unsigned k = (ib[i] & ANCHORED) ? offset + (ib[i] & ~ANCHORED) : ib[i];
+		float dx = x[k]-x[j];
+		float dy = y[k]-y[j];
+		float dz = z[k]-z[j];
+		float length = std::sqrt(dx*dx + dy*dy + dz*dz);
+		float e = length - target[i];
+		error[i] = e;
+		inverseLength[i] = length>0.0f ? 1.0f/length : 0.0f;
+		violated[i] = (uint8_t) ((((t[i]==EQUALITY) & (std::fabs(e)>=EPS))
+			| ((t[i]==MAX) & (e>0.0f))
+			| ((t[i]==MIN) & (e<0.0f))) & (skip[i]==0));
+	}
+}
+
+
+ofVec3f ConstraintTable::normal(unsigned row) const {
+	const unsigned offset = (unsigned) (m_x.size()-anchorX.size());
+	unsigned j = a[row];
+	unsigned k = (b[row] & ANCHORED) ? offset + (b[row] & ~ANCHORED) : b[row];
+
+	// The contact normal depends on whether we're extending or compressing.
+	float scale = m_error[row]>0.0f ? m_inverseLength[row] : -m_inverseLength[row];
+	return ofVec3f(m_x[k]-m_x[j], m_y[k]-m_y[j], m_z[k]-m_z[j])*scale;
+}
+
+
+size_t ConstraintTable::evaluate(const ParticleRegistry& particles) {
+
+	const size_t rows = size();
+	prepare(particles);
+	evaluateRows(0, rows);
+
+	// Compact violated rows, building normals from the stored inverse length.
+	Violations& v = violations;
+	if (v.row.size()<rows) {
+		v.row.resize(rows);
+		v.normalX.resize(rows);
+		v.normalY.resize(rows);
+		v.normalZ.resize(rows);
+		v.penetration.resize(rows);
+	}
+	size_t count = 0;
+	for (size_t i=0; i<rows; ++i) {
+		if (!m_violated[i]) continue;
+		ofVec3f n = normal((unsigned) i);
+		v.row[count] = (unsigned) i;
+		v.normalX[count] = n.x;
+		v.normalY[count] = n.y;
+		v.normalZ[count] = n.z;
+		v.penetration[count] = std::fabs(m_error[i]);
+		++count;
+	}
+	v.count = count;
+	return count;
+}
+
+
+void ConstraintTable::emit(const ParticleRegistry& particles, ContactRegistry::Ref contactRegistry,
+	unsigned row, const ofVec3f& normal, float penetration) const {
+
+	Contact::Ref contact = contactRegistry->acquire("ConstraintTable");
+	contact->a = particles[a[row]];
+	contact->b = isAnchored(row) ? Particle::Ref() : particles[b[row]];
+	contact->contactNormal = normal;
+	contact->penetration = penetration;
+	contact->restitution = restitution[row];
+	contactRegistry->append(contact);
+}
+
+
+void ConstraintTable::generate(const ParticleRegistry& particles, ContactRegistry::Ref contactRegistry) {
+
+	evaluate(particles);
+
+	for (size_t k=0; k<violations.count; ++k) {
+		emit(particles, contactRegistry, violations.row[k],
+			ofVec3f(violations.normalX[k], violations.normalY[k], violations.normalZ[k]),
+			violations.penetration[k]);
+	}
+}
+
+
+void ConstraintTable::generate(const ParticleRegistry& particles, ContactRegistry::Ref contactRegistry,
+	unsigned chunk, unsigned numChunks) {
+
+	const size_t rows = size();
+	size_t begin = rows*chunk/numChunks;
+	size_t end = rows*(chunk+1)/numChunks;
+
+	evaluateRows(begin, end);
+	for (size_t i=begin; i<end; ++i) {
+		if (m_violated[i]) emit(particles, contactRegistry, (unsigned) i, normal((unsigned) i), std::fabs(m_error[i]));
+	}
+}
+
+
+const String ConstraintTable::toString() const {
+	static const char* NAMES[] = { "Equality", "Max", "Min" };
+	std::ostringstream outs;
+	for (size_t i=0; i<size(); ++i) {
+		outs <<NAMES[type[i]] <<"    "
+			<<"a = " <<a[i] <<"    ";
+		if (isAnchored((unsigned) i)) outs <<"anchor = " <<anchor((unsigned) i) <<"    ";
+		else outs <<"b = " <<b[i] <<"    ";
+		outs <<"targetLength = " <<targetLength[i] <<"    "
+			<<"restitution = " <<restitution[i] <<"\n";
+	}
+	return outs.str();
+}
+
+} }	// namespace YAMPE::P
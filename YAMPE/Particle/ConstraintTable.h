@@ -0,0 +1,119 @@
+/**
+	@file 		ConstraintTable.h
+	@author		dgaffney
+	@practical
+	@brief		Table of length constraints between particles, stored column-wise.
+	*/
+
+#ifndef PARTICLE_CONSTRAINT_TABLE_H
+#define PARTICLE_CONSTRAINT_TABLE_H
+
+#include "../Particle.h"
+#include "ContactRegistry.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class ConstraintTable
+
+	Holds any number of rod (equality), cable (max) and min length constraints,
+	either between two particles or between a particle and a fixed anchor.
+	It covers the same cases as the Constraint/AnchoredConstraint classes but
+	stores one row per constraint in struct-of-arrays form, so that all rows
+	are evaluated by a single loop over contiguous columns.
+
+	Endpoints are indices into the ParticleRegistry passed to evaluate(). For
+	anchored rows the b column holds ANCHORED|k where k indexes the anchor
+	columns.
+
+	Evaluation is split in two passes: a branch free pass computing the
+	length error and inverse length of every row (one sqrt per row), and a
+	compaction pass writing the violated rows into the violation columns.
+	*/
+class ConstraintTable : public Printable {
+
+public:
+
+	typedef ofPtr<ConstraintTable> Ref;
+
+	enum Type : uint8_t { EQUALITY, MAX, MIN };
+
+	static const unsigned ANCHORED = 0x80000000u;	///< flag in b column marking an anchored row.
+
+	// constraint columns (one entry per row)
+	vector<uint8_t> type;
+	vector<unsigned> a;
+	vector<unsigned> b;
+	vector<float> targetLength;
+	vector<float> restitution;
+	vector<uint8_t> direct;			///< non-zero for rows solved elsewhere (see TreeConstraintSolver), never violated here.
+
+	// anchor columns (one entry per anchored row)
+	vector<float> anchorX, anchorY, anchorZ;
+
+	/// Violated rows from the last call to evaluate().
+	struct Violations {
+		vector<unsigned> row;
+		vector<float> normalX, normalY, normalZ;
+		vector<float> penetration;
+		size_t count;
+
+		Violations() : count(0) { }
+	} violations;
+
+	ConstraintTable(const String label="ConstraintTable") : Printable(label) { };
+
+	/// Adds a constraint between particles a and b, returns its row.
+	unsigned add(Type type, unsigned a, unsigned b, float targetLength, float restitution=-1.0f);
+
+	/// Adds a constraint between particle a and a fixed anchor, returns its row.
+	unsigned addAnchored(Type type, unsigned a, const ofVec3f& anchor, float targetLength, float restitution=-1.0f);
+
+	size_t size() const { return type.size(); }
+	bool isAnchored(unsigned row) const { return (b[row] & ANCHORED)!=0; }
+	ofVec3f anchor(unsigned row) const;
+
+	void clear();
+
+	/// Moves particle indices to rank[index], e.g. after MortonOrder::reorder().
+	void remapParticles(const vector<unsigned>& rank);
+
+	/// Evaluates every row against the particle positions, filling violations.
+	size_t evaluate(const ParticleRegistry& particles);
+
+	/// Evaluates the table and appends a contact for each violated row.
+	void generate(const ParticleRegistry& particles, ContactRegistry::Ref contactRegistry);
+
+	/**	Gathers particle positions for chunked generation. Must be called once
+		(serially) before any of the chunks of a step are generated.
+		*/
+	void prepare(const ParticleRegistry& particles);
+
+	/**	Evaluates the rows of one chunk and appends a contact for each violated
+		row. Chunks cover disjoint row ranges so may run concurrently, each with
+		its own contact registry. The violations columns are not filled.
+		*/
+	void generate(const ParticleRegistry& particles, ContactRegistry::Ref contactRegistry,
+		unsigned chunk, unsigned numChunks);
+
+	const String toString() const;
+
+protected:
+
+	// scratch columns reused between calls
+	vector<float> m_x, m_y, m_z;			///< gathered particle then anchor positions.
+	vector<float> m_error;					///< signed length error per row.
+	vector<float> m_inverseLength;			///< 1/current length per row (0 if degenerate).
+	vector<uint8_t> m_violated;
+
+	void evaluateRows(size_t begin, size_t end);
+	ofVec3f normal(unsigned row) const;
+	void emit(const ParticleRegistry& particles, ContactRegistry::Ref contactRegistry,
+		unsigned row, const ofVec3f& normal, float penetration) const;
+
+	static float defaultRestitution(Type type) { return type==EQUALITY ? 0.0f : 1.0f; }
+};
+
+} } // namespace YAMPE P
+
+#endif
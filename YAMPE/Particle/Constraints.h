@@ -8,6 +8,10 @@
 // TODO
 // change constructors to allow for setting of parameters
 
+// NOTE
+// for large numbers of constraints use ConstraintTable which evaluates all
+// rows in one pass and does not allocate per contact.
+
 #ifndef PARTICLE_CONSTRAINTS_H
 #define PARTICLE_CONSTRAINTS_H
 
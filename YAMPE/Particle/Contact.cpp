@@ -79,11 +79,13 @@ void Contact::resolveVelocity(float dt)
     ofVec3f impulsePerIMass = contactNormal * impulse;
 	
     // Apply impulses: they are applied in the direction of the contact,
-    // and are proportional to the inverse mass
-    a->velocity += impulsePerIMass * a->inverseMass();
+    // and are proportional to the inverse mass. Particles of infinite mass
+    // are never written, so contacts sharing only such a particle can be
+    // resolved concurrently.
+    if (a->hasFiniteMass()) a->velocity += impulsePerIMass * a->inverseMass();
 
 	// Particle b goes in the opposite direction
-	if (b!=NULL) {
+	if (b!=NULL && b->hasFiniteMass()) {
 		b->velocity -= impulsePerIMass * b->inverseMass();
     }
 }
@@ -114,8 +116,8 @@ void Contact::resolveInterpenetration(float dt) {
 	}
 	
     // Apply the penetration resolution
-    a->position += aMovement;
-    if (b!=NULL) {
+    if (a->hasFiniteMass()) a->position += aMovement;
+    if (b!=NULL && b->hasFiniteMass()) {
         b->position += bMovement;
     }
 }
@@ -13,7 +13,7 @@
 namespace YAMPE { namespace P {
 
 
-class Contact: public Printable {
+class Contact: public Printable, public TrackedObject<MemoryTracker::CONTACTS> {
 
 public:
 
@@ -39,32 +39,106 @@ const String GroundContactGenerator::toString() const {
 // --------------------------------------------------------
 
 void ParticleParticleContactGenerator::generate(ContactRegistry::Ref contactRegistry) {
+	prepare();
+	generate(contactRegistry, 0, 1);
+}
+
+
+void ParticleParticleContactGenerator::prepare() {
+	narrowPhase.gather(particles);
+	filter.index(particles);
+	if (isNeighbourListEnabled) neighbourList.update(particles, &filter);
+}
+
+
+void ParticleParticleContactGenerator::generate(ContactRegistry::Ref contactRegistry, unsigned chunk, unsigned numChunks) {
+
+	static thread_local vector<SphereNarrowPhase::Pair> hits;
+	hits.clear();
+
+	if (isNeighbourListEnabled) {
+		// work follows the number of listed pairs, so chunks split those evenly
+		// (filtered pairs were left out of the lists)
+		size_t numPairs = neighbourList.numPairs();
+		unsigned begin = neighbourList.firstListAt(numPairs*chunk/numChunks);
+		unsigned end = neighbourList.firstListAt(numPairs*(chunk+1)/numChunks);
+		for (unsigned a=begin; a<end; ++a) narrowPhase.test(a, neighbourList.neighbours(a), neighbourList.numNeighbours(a), hits);
+		SphereNarrowPhase::emit(particles, hits, contactRegistry, "ParticleParticleContactGenerator");
+		return;
+	}
+
+	// Particle a is tested against the a particles before it, so the work up
+	// to a grows as a^2 and equal work chunks end at n*sqrt(chunk/numChunks).
+	size_t n = particles.size();
+	size_t begin = (size_t) (n*sqrt((double) chunk/numChunks));
+	size_t end = chunk+1==numChunks ? n : (size_t) (n*sqrt((double) (chunk+1)/numChunks));
+
+	// squared distance tests, several candidates at a time, into a compact
+	// pair list (per thread, so chunks may run concurrently); filtered
+	// candidates are masked out before the tests
+	for (size_t a=begin; a<end; ++a) {
+		narrowPhase.testRange((unsigned) a, 0, (unsigned) a, hits, filter.excluded((unsigned) a), filter.numExcluded((unsigned) a));
+	}
+	SphereNarrowPhase::emit(particles, hits, contactRegistry, "ParticleParticleContactGenerator");
+}
 
-	for(ParticleRegistry::iterator a=particles.begin(); a!=particles.end(); ++a) {
-		for(ParticleRegistry::iterator b=particles.begin(); b!=a; ++b) {
-
-			// get approach normal
-			ofVec3f normal = (*a)->position - (*b)->position;
-			float distance = normal.length();
-			
-			// if particles are closer than their radi then generate contact
-			if (distance<(*a)->radius+(*b)->radius) {
-                Contact::Ref contact(new Contact("ParticleParticleContactGenerator"));
-				contact->contactNormal = normal.normalize();
-				contact->a = *a;
-				contact->b = *b;
-				contact->penetration = -distance + (*a)->radius + (*b)->radius;
-	            contact->restitution = 1.0f;
-				contactRegistry->append(contact);
+
+
+void ParticleParticleContactGenerator::generate(ContactRegistry::Ref contactRegistry,
+		const std::function<bool(const Particle*)>& isSelected) {
+
+	prepare();
+	static thread_local vector<SphereNarrowPhase::Pair> hits;
+	hits.clear();
+
+	unsigned n = (unsigned) particles.size();
+	m_isSelected.resize(n);
+	m_selected.clear();
+	for (unsigned k=0; k<n; ++k) {
+		m_isSelected[k] = isSelected(particles[k].get()) ? 1 : 0;
+		if (m_isSelected[k]) m_selected.push_back(k);
+	}
+
+	// each pair is met under its higher index b: a selected b is tested
+	// against everything before it, any other only against the selected
+	for (unsigned b=0; b<n; ++b) {
+		m_candidates.clear();
+		if (isNeighbourListEnabled) {
+			const unsigned* neighbours = neighbourList.neighbours(b);
+			size_t count = neighbourList.numNeighbours(b);
+			if (m_isSelected[b]) {
+				narrowPhase.test(b, neighbours, count, hits);
+				continue;
 			}
+			for (size_t k=0; k<count; ++k) {
+				if (m_isSelected[neighbours[k]]) m_candidates.push_back(neighbours[k]);
+			}
+		}
+		else if (m_isSelected[b]) {
+			narrowPhase.testRange(b, 0, b, hits, filter.excluded(b), filter.numExcluded(b));
+			continue;
 		}
+		else {
+			// index lists are tested unfiltered, so the filter applies here
+			const unsigned* excluded = filter.excluded(b);
+			const unsigned* excludedEnd = excluded + filter.numExcluded(b);
+			for (unsigned a: m_selected) {
+				if (a>=b) break;
+				while (excluded<excludedEnd && *excluded<a) ++excluded;
+				if (excluded<excludedEnd && *excluded==a) continue;
+				if (CollisionFilter::isGroupPair(*particles[a], *particles[b])) m_candidates.push_back(a);
+			}
+		}
+		narrowPhase.test(b, m_candidates.data(), m_candidates.size(), hits);
 	}
+	SphereNarrowPhase::emit(particles, hits, contactRegistry, "ParticleParticleContactGenerator");
 }
 
 
-
 const String ParticleParticleContactGenerator::toString() const {
 	std::ostringstream outs;
+	if (isNeighbourListEnabled) outs <<neighbourList.toString();
+	if (filter.numExclusions()>0) outs <<(isNeighbourListEnabled ? "    " : "") <<filter.toString();
 	return outs.str();
 }
 
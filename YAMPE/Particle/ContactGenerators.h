@@ -8,9 +8,14 @@
 #ifndef PARTICLE_CONTACT_GENERATOR_H
 #define PARTICLE_CONTACT_GENERATOR_H
 
+#include <functional>
+
 #include "../Particle.h"
+#include "CollisionFilter.h"
 #include "Contact.h"
 #include "ContactRegistry.h"
+#include "NeighbourList.h"
+#include "SphereNarrowPhase.h"
 
 namespace YAMPE { namespace P {		
 	
@@ -55,13 +60,44 @@ public:
 class ParticleParticleContactGenerator: public ContactGenerator {
 public:
  	ParticleRegistry particles;
+	SphereNarrowPhase narrowPhase;		///< overlap tests, gathered by prepare().
+	NeighbourList neighbourList;		///< candidate pairs, rebuilt by prepare() as particles move.
+	bool isNeighbourListEnabled;		///< test listed neighbours rather than every pair.
+	CollisionFilter filter;				///< excluded pairs, applied with the particle groups before any overlap test.
 
 	ParticleParticleContactGenerator(const String label="ParticleParticleContactGenerator") 
-		: ContactGenerator(label) {};
+		: ContactGenerator(label), isNeighbourListEnabled(false) {};
 	
  	void generate(ContactRegistry::Ref contactRegstry);
+
+	/**	Gathers particle positions for chunked generation, indexes the
+		filter and updates the neighbour lists if enabled. Must be called
+		once (serially) before any of the chunks of a step are generated.
+		*/
+	void prepare();
+
+	/**	Generates the contacts of particles [begin,end) against all particles
+		before them (or their listed neighbours). Chunks split the pairs into
+		roughly equal amounts of work and may run concurrently, each with its
+		own registry. Contacts come out in the same order either way.
+		*/
+	void generate(ContactRegistry::Ref contactRegstry, unsigned chunk, unsigned numChunks);
+
+	/**	Generates the contacts between the particles for which isSelected
+		is true and all particles, each pair once, e.g. of the due particles
+		of a multirate substep (see MultirateStepper), which must also meet
+		the particles not due to find those they run into. The filter
+		applies as in generate().
+		*/
+	void generate(ContactRegistry::Ref contactRegstry, const std::function<bool(const Particle*)>& isSelected);
 	
 	const String toString() const;
+
+protected:
+
+	TrackedVector<uint8_t, MemoryTracker::GENERATORS> m_isSelected;
+	TrackedVector<unsigned, MemoryTracker::GENERATORS> m_selected;		///< indices of the selected particles, ascending.
+	TrackedVector<unsigned, MemoryTracker::GENERATORS> m_candidates;
 };
 
 
@@ -5,20 +5,69 @@
 	@brief	
 	*/
 
+#include <algorithm>
 #include <cfloat>
 #include "Contact.h"
 #include "ContactRegistry.h"
+#include "../Log.h"
+#include "../Trace.h"
 
 namespace YAMPE { namespace P {
 
+namespace {
+	/// Default for setParallelThreshold(), below it handing chunks to other threads costs more than it saves.
+	const size_t PARALLEL_THRESHOLD = 512;
+}
+
+const unsigned ContactRegistry::DEFAULT_ITERATION_LIMIT;
 
 ContactRegistry::ContactRegistry (unsigned iterationLimit, String label) :
-	Printable(label), m_iterationLimit(iterationLimit), registry() { }
+	Printable(label), m_iterationLimit(iterationLimit), m_iterationUsed(0), m_timeBudget(0.0), registry(), m_poolUsed(0),
+	m_parallelThreshold(PARALLEL_THRESHOLD) { }
 
 
 void ContactRegistry::resolve(float dt) {
+	YAMPE_TRACE_SCOPE("ContactRegistry::resolve");
+	Clock::time_point start = Clock::now();
+	Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(m_timeBudget));
+	bool isOutOfTime = false;
+	m_iterationUsed = resolve(registry.data(), registry.size(), dt, m_timeBudget>0.0 ? &deadline : NULL, &isOutOfTime);
+
+	measureResidual();
+	m_residual.iterations = m_iterationUsed;
+	m_residual.isOutOfTime = isOutOfTime;
+	m_residual.isLimitReached = !isOutOfTime && m_iterationUsed==m_iterationLimit && m_residual.numUnresolved>0;
+	m_residual.micros = std::chrono::duration<double, std::micro>(Clock::now()-start).count();
+	if (isOutOfTime) {
+		YAMPE_LOG_NOTICE("[ContactRegistry::resolve] Out of time after %u iterations, %u contacts unresolved.",
+			m_iterationUsed, m_residual.numUnresolved);
+	}
+}
+
+
+void ContactRegistry::measureResidual() {
+	Residual residual;
+	for (auto && contact: registry) {
+		float sepVel = contact->calculateSeparatingVelocity();
+		bool isClosing = sepVel<=-EPS;
+		bool isPenetrating = contact->penetration>=EPS;
+		if (!isClosing && !isPenetrating) continue;
+		++residual.numUnresolved;
+		if (isPenetrating) {
+			residual.maxPenetration = std::max(residual.maxPenetration, contact->penetration);
+			residual.totalPenetration += contact->penetration;
+		}
+		if (isClosing) residual.maxClosingVelocity = std::max(residual.maxClosingVelocity, -sepVel);
+	}
+	m_residual = residual;
+}
+
 
-	for (m_iterationUsed=0; m_iterationUsed < m_iterationLimit; ++m_iterationUsed) {
+unsigned ContactRegistry::resolve(const Contact::Ref* contacts, size_t count, float dt,
+		const Clock::time_point* deadline, bool* isOutOfTime) {
+
+	unsigned iteration;
+	for (iteration=0; iteration < m_iterationLimit; ++iteration) {
 
         // Find the contact with the largest closing velocity.
 		//
@@ -27,7 +76,8 @@ void ContactRegistry::resolve(float dt) {
 		// is negative (ie moving closer) or have (+ive) penetration.
         float max = FLT_MAX;
         Contact::Ref maxContact;
-        for (auto && contact: registry) {
+        for (size_t k=0; k<count; ++k) {
+            const Contact::Ref& contact = contacts[k];
             float sepVel = contact->calculateSeparatingVelocity();
             if (sepVel < max && (sepVel < 0 || contact->penetration > 0)) {
                 max = sepVel;
@@ -36,7 +86,7 @@ void ContactRegistry::resolve(float dt) {
         }
 		
 		// Exit algorithm if we do not have any contacts worth resolving.
-		if (maxContact==NULL || (max>-EPS && maxContact->penetration<EPS)) return;
+		if (maxContact==NULL || (max>-EPS && maxContact->penetration<EPS)) return iteration;
 		
         // Resolve this contact.
         maxContact->resolve(dt);
@@ -49,7 +99,8 @@ void ContactRegistry::resolve(float dt) {
 		// hence the contact penetration accordinaly.
 		ofVec3f aMovement = maxContact->aMovement;
 		ofVec3f bMovement = maxContact->bMovement;
-        for (auto && contact: registry) {
+        for (size_t k=0; k<count; ++k) {
+            const Contact::Ref& contact = contacts[k];
 			if (contact->a == maxContact->a) {
 				contact->penetration -= aMovement.dot(contact->contactNormal);
 			} else if (contact->a == maxContact->b) {
@@ -63,6 +114,13 @@ void ContactRegistry::resolve(float dt) {
 				}		
 			}
 		}
+
+		// Anytime: the contacts resolved so far were the worst ones.
+		if (deadline && Clock::now()>=*deadline) {
+			if (isOutOfTime) *isOutOfTime = true;
+			return iteration+1;
+		}
+
 		// debugPrintf ("DEBUG iter=%d contact %s aMovememt=(%f,%f,%f), bMovement=(%f,%f,%f) max=%f, pen=%f\n",
 		// 	m_iterationUsed, maxContact->label().c_str(),
 		// 	aMovement.x, aMovement.y, aMovement.z,
@@ -73,8 +131,91 @@ void ContactRegistry::resolve(float dt) {
     }
 
 	// Reached iteration limit => may still have unresolved contacts.
-	ofLog(OF_LOG_WARNING, "[ContactRegistry::resolve] Reached iteration limit (%d).\n",
+	YAMPE_LOG_WARNING("[ContactRegistry::resolve] Reached iteration limit (%u).",
 		m_iterationLimit);
+	return iteration;
+}
+
+
+size_t ContactRegistry::prepareIslands() {
+
+	YAMPE_TRACE_SCOPE("ContactRegistry::prepareIslands");
+	size_t n = registry.size();
+
+	// Union-find over contacts, joining contacts that move the same particle.
+	// Roots are always the lowest contact index of their set.
+	auto find = [this](unsigned k) {
+		while (m_parent[k]!=k) k = m_parent[k] = m_parent[m_parent[k]];
+		return k;
+	};
+	m_parent.resize(n);
+	for (unsigned k=0; k<n; ++k) m_parent[k] = k;
+
+	// contacts moving the same particle end up next to each other
+	m_ends.clear();
+	for (unsigned k=0; k<n; ++k) {
+		const Particle* ends[2] = { registry[k]->a.get(), registry[k]->b.get() };
+		for (const Particle* end: ends) {
+			if (end!=NULL && end->hasFiniteMass()) m_ends.push_back(std::make_pair(end, k));
+		}
+	}
+	std::sort(m_ends.begin(), m_ends.end());
+	for (size_t e=1; e<m_ends.size(); ++e) {
+		if (m_ends[e].first!=m_ends[e-1].first) continue;
+		unsigned a = find(m_ends[e-1].second), b = find(m_ends[e].second);
+		if (a<b) m_parent[b] = a;
+		else if (b<a) m_parent[a] = b;
+	}
+
+	// Islands numbered in order of their root, then contacts placed by island.
+	m_island.resize(n);
+	unsigned numIslands = 0;
+	for (unsigned k=0; k<n; ++k) {
+		unsigned root = find(k);
+		m_island[k] = root==k ? numIslands++ : m_island[root];
+	}
+	m_islandOffsets.assign(numIslands+1, 0);
+	for (unsigned k=0; k<n; ++k) ++m_islandOffsets[m_island[k]+1];
+	for (unsigned i=0; i<numIslands; ++i) m_islandOffsets[i+1] += m_islandOffsets[i];
+	m_parent.assign(m_islandOffsets.begin(), m_islandOffsets.end()-1);	// now the fill position of each island
+	m_islandContacts.resize(n);
+	for (unsigned k=0; k<n; ++k) m_islandContacts[m_parent[m_island[k]]++] = registry[k];
+	m_islandIterations.assign(numIslands, 0);
+	return numIslands;
+}
+
+
+void ContactRegistry::resolveIslands(float dt, unsigned chunk, unsigned numChunks) {
+	if (registry.size()<m_parallelThreshold) {
+		if (chunk>0) return;
+		numChunks = 1;
+	}
+	YAMPE_TRACE_SCOPE_ARG("ContactRegistry::resolveIslands", chunk);
+	size_t n = numIslands();
+	size_t end = n*(chunk+1)/numChunks;
+	for (size_t i=n*chunk/numChunks; i<end; ++i) {
+		unsigned first = m_islandOffsets[i];
+		m_islandIterations[i] = resolve(&m_islandContacts[first], m_islandOffsets[i+1]-first, dt);
+	}
+}
+
+
+unsigned ContactRegistry::islandIterationsUsed() const {
+	unsigned used = 0;
+	for (auto && iterations: m_islandIterations) used = std::max(used, iterations);
+	return used;
+}
+
+
+Contact::Ref ContactRegistry::acquire(const char* label) {
+	if (m_poolUsed==m_pool.size()) {
+		m_pool.push_back(Contact::Ref(new Contact(label)));
+	}
+	Contact::Ref contact = m_pool[m_poolUsed++];
+	if (contact->label()!=label) contact->setLabel(label);
+	contact->aMovement = ofVec3f::zero();
+	contact->bMovement = ofVec3f::zero();
+	return contact;
 }
 
 
@@ -83,8 +224,16 @@ void ContactRegistry::append(Contact::Ref contact) {
 }
 
 
+void ContactRegistry::append(const ContactRegistry& other) {
+	registry.insert(registry.end(), other.registry.begin(), other.registry.end());
+}
+
+
 void ContactRegistry::clear() {
 	registry.clear();
+	m_islandContacts.clear();
+	m_islandOffsets.clear();
+	m_poolUsed = 0;
 }
 
 
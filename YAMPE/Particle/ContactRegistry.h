@@ -8,6 +8,9 @@
 #ifndef PARTICLE_CONTACT_REGISTRY_H
 #define PARTICLE_CONTACT_REGISTRY_H
 
+#include <chrono>
+#include <utility>
+
 #include "Contact.h"
 
 namespace YAMPE { namespace P {
@@ -15,17 +18,64 @@ namespace YAMPE { namespace P {
 
 class ContactRegistry: public Printable {
 
+public:
+
+	/**	What resolve() left behind. Contacts count as unresolved on the same
+		terms resolve() uses to stop: still closing or still penetrating.
+		*/
+	struct Residual {
+		unsigned iterations;
+		bool isLimitReached;			///< stopped by the iteration limit.
+		bool isOutOfTime;				///< stopped by the time budget.
+		unsigned numUnresolved;
+		float maxPenetration;
+		float totalPenetration;
+		float maxClosingVelocity;		///< largest -separating velocity, 0 if nothing closes.
+		double micros;					///< time taken by resolve().
+
+		Residual() : iterations(0), isLimitReached(false), isOutOfTime(false), numUnresolved(0),
+			maxPenetration(0.0f), totalPenetration(0.0f), maxClosingVelocity(0.0f), micros(0.0) { }
+	};
+
 protected:
+	typedef std::chrono::steady_clock Clock;
+
 	unsigned m_iterationLimit;		///< number of iterations allowed.
 	unsigned m_iterationUsed;		///< number of iterations used.
+	double m_timeBudget;			///< microseconds allowed per resolve(), 0 for no limit.
+	Residual m_residual;			///< from the last resolve().
 
-	typedef vector<Contact::Ref> Registry;
+	typedef TrackedVector<Contact::Ref, MemoryTracker::CONTACTS> Registry;
 	Registry registry;
+
+	Registry m_pool;				///< contacts recycled by acquire() between calls to clear().
+	size_t m_poolUsed;				///< number of pooled contacts handed out since last clear().
+
+	// islands from the last call to prepareIslands()
+	Registry m_islandContacts;		///< contacts grouped by island, each group in registry order.
+	TrackedVector<unsigned, MemoryTracker::CONTACTS> m_islandOffsets;	///< start of each island in m_islandContacts, plus the end.
+	TrackedVector<unsigned, MemoryTracker::CONTACTS> m_islandIterations;	///< iterations used by each island.
+	TrackedVector<unsigned, MemoryTracker::CONTACTS> m_parent;		///< union-find over contacts, the root is the lowest index.
+	TrackedVector<unsigned, MemoryTracker::CONTACTS> m_island;		///< island of each contact.
+	TrackedVector<std::pair<const Particle*, unsigned>, MemoryTracker::CONTACTS> m_ends;	///< (movable particle, contact) pairs, sorted.
+	size_t m_parallelThreshold;		///< fewest contacts resolveIslands() spreads over chunks.
+
+	/**	Resolves contacts[0..count) as resolve() does, returns the iterations
+		used. Stops after the first iteration ending past deadline (if not
+		NULL), setting isOutOfTime.
+		*/
+	unsigned resolve(const Contact::Ref* contacts, size_t count, float dt,
+		const Clock::time_point* deadline=NULL, bool* isOutOfTime=NULL);
+
+	/// Measures what is left unresolved into m_residual.
+	void measureResidual();
 		
 public:
 	typedef ofPtr<ContactRegistry> Ref;
 
-	ContactRegistry(unsigned iterationLimit=100, String label="ContactRegistry");
+	static const unsigned DEFAULT_ITERATION_LIMIT = 100;
+
+	ContactRegistry(unsigned iterationLimit=DEFAULT_ITERATION_LIMIT, String label="ContactRegistry");
 	
 	const String toString() const;
 
@@ -34,10 +84,66 @@ public:
 	}		
 	unsigned iterationLimit() { return m_iterationLimit; }	
 	unsigned iterationUsed() { return m_iterationUsed; }
+
+	/**	Limits the wall clock time of resolve() to about micros (0 for no
+		limit). Each iteration resolves the worst contact left, so whenever
+		the budget runs out the most severe contacts have been dealt with;
+		the iteration under way is finished, so a step may overrun by one
+		iteration. resolveIslands() ignores the budget, as stopping on time
+		would make its result depend on the machine.
+		*/
+	void setTimeBudget(double micros) { m_timeBudget = micros; }
+	double timeBudget() const { return m_timeBudget; }
+
+	/// Penetration and velocity error left by the last resolve().
+	const Residual& residual() const { return m_residual; }
 	
+	/**	Returns a contact owned by the registry for the caller to fill in and
+		append. Contacts are recycled after clear() so steady state generation
+		does not allocate.
+		*/
+	Contact::Ref acquire(const char* label);
+
 	void append(Contact::Ref contact);
+	void append(const ContactRegistry& other);		///< appends all contacts of other, in order.
+	size_t size() const { return registry.size(); }
+	const Contact::Ref& contact(size_t k) const { return registry[k]; }
+
+	/// Replaces the particles of every contact by f(particle), e.g. MortonOrder::remap().
+	template <typename F>
+	void remapParticles(F f) {
+		for (auto && contact: registry) {
+			contact->a = f(contact->a);
+			if (contact->b) contact->b = f(contact->b);
+		}
+	}
 	void resolve(float dt);
 	void clear();
+
+	/**	Splits the contacts into islands, sets of contacts connected through
+		shared particles of finite mass. Islands are numbered in order of
+		their first contact and keep the registry order of their contacts,
+		so the split depends only on the contacts and their order. Must be
+		called (serially) after the last contact of the step is appended.
+		Returns the number of islands.
+		*/
+	size_t prepareIslands();
+
+	/**	Resolves the islands of one chunk, each as resolve() would resolve
+		it alone (with its own iteration limit). Islands share no movable
+		particle, so chunks may run concurrently and the result is the same
+		for any number of chunks or threads. With fewer contacts than the
+		parallel threshold chunk 0 resolves every island and the others
+		return at once, as a few contacts are resolved faster than chunks
+		are handed to other threads.
+		*/
+	void resolveIslands(float dt, unsigned chunk, unsigned numChunks);
+
+	void setParallelThreshold(size_t contacts) { m_parallelThreshold = contacts; }
+	size_t parallelThreshold() const { return m_parallelThreshold; }
+
+	size_t numIslands() const { return m_islandOffsets.empty() ? 0 : m_islandOffsets.size()-1; }
+	unsigned islandIterationsUsed() const;		///< largest number of iterations used by an island.
 };
 
 } } // namespace YAMPE P
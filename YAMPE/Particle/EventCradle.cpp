@@ -0,0 +1,358 @@
+/**
+	@file 		EventCradle.cpp
+	@author		dgaffney
+	@practical
+	@brief		Event driven simulation of a cradle of balls on strings.
+	*/
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "EventCradle.h"
+#include "../Trace.h"
+
+namespace YAMPE { namespace P {
+
+namespace {
+
+	const double CONTACT_TOLERANCE = 1.0e-9;	///< gap below which balls touch.
+	const double VELOCITY_TOLERANCE = 1.0e-12;	///< closing speed below which touching balls rest.
+	const unsigned ROOT_ITERATIONS = 60;
+
+	// Dormand-Prince 5(4) tableau.
+	const double A[7][6] = {
+		{ 0.0 },
+		{ 1.0/5.0 },
+		{ 3.0/40.0, 9.0/40.0 },
+		{ 44.0/45.0, -56.0/15.0, 32.0/9.0 },
+		{ 19372.0/6561.0, -25360.0/2187.0, 64448.0/6561.0, -212.0/729.0 },
+		{ 9017.0/3168.0, -355.0/33.0, 46732.0/5247.0, 49.0/176.0, -5103.0/18656.0 },
+		{ 35.0/384.0, 0.0, 500.0/1113.0, 125.0/192.0, -2187.0/6784.0, 11.0/84.0 }
+	};
+	const double B[7] = { 35.0/384.0, 0.0, 500.0/1113.0, 125.0/192.0, -2187.0/6784.0, 11.0/84.0, 0.0 };
+	const double E[7] = { 71.0/57600.0, 0.0, -71.0/16695.0, 71.0/1920.0, -17253.0/339200.0, 22.0/525.0, -1.0/40.0 };
+
+	/// Double precision point, positions are compared far below float resolution.
+	struct Point {
+		double x, y, z;
+	};
+
+	Point position(const EventCradle::Ball& ball, double theta) {
+		Point p = { ball.anchor.x + ball.length*std::sin(theta), ball.anchor.y - ball.length*std::cos(theta), (double) ball.anchor.z };
+		return p;
+	}
+
+}	// namespace
+
+
+EventCradle::EventCradle(float radius, float restitution, const String label) :
+	Printable(label), gravity(9.81), radius(radius), restitution(restitution),
+	tolerance(1.0e-10), maxStep(0.1), time(0.0), numImpacts(0), numSteps(0), m_step(0.001) { }
+
+
+void EventCradle::reset(unsigned n, float anchorHeight, float stringLength, float spacing) {
+	balls.resize(n);
+	float x = -(n*(2.0f*radius + spacing))/2.0f;
+	for (unsigned k=0; k<n; ++k) {
+		Ball& ball = balls[k];
+		ball.particle = k;
+		ball.anchor = ofVec3f(x, anchorHeight, 0.0f);
+		ball.length = stringLength;
+		ball.theta = ball.omega = 0.0;
+		ball.inverseMass = 1.0f;
+		x += 2.0f*radius + spacing;
+	}
+	time = 0.0;
+	numImpacts = numSteps = 0;
+}
+
+
+void EventCradle::raise(unsigned k, float angle) {
+	balls[k].theta = -ofDegToRad(angle);
+	balls[k].omega = 0.0;
+}
+
+
+void EventCradle::load(const ParticleRegistry& particles, const ConstraintTable& table, float gravity) {
+	this->gravity = gravity;
+	balls.clear();
+	for (unsigned row=0; row<table.size(); ++row) {
+		if (table.type[row]!=ConstraintTable::EQUALITY || !table.isAnchored(row)) continue;
+		const Particle::Ref& p = particles[table.a[row]];
+		Ball ball;
+		ball.particle = table.a[row];
+		ball.anchor = table.anchor(row);
+		ball.length = table.targetLength[row];
+		ofVec3f d = p->position - ball.anchor;
+		ball.theta = std::atan2((double) d.x, (double) -d.y);
+		ball.omega = (p->velocity.x*std::cos(ball.theta) + p->velocity.y*std::sin(ball.theta))/ball.length;
+		ball.inverseMass = p->inverseMass();
+		balls.push_back(ball);
+	}
+
+	// only neighbours along the cradle are tested for impacts
+	std::stable_sort(balls.begin(), balls.end(),
+		[](const Ball& a, const Ball& b) { return a.anchor.x<b.anchor.x; });
+	time = 0.0;
+	numImpacts = numSteps = 0;
+}
+
+
+void EventCradle::store(ParticleRegistry& particles) const {
+	for (unsigned k=0; k<balls.size(); ++k) {
+		Particle::Ref& p = particles[balls[k].particle];
+		p->position = position(k);
+		p->velocity = velocity(k);
+	}
+}
+
+
+ofVec3f EventCradle::position(unsigned k) const {
+	Point p = YAMPE::P::position(balls[k], balls[k].theta);
+	return ofVec3f((float) p.x, (float) p.y, (float) p.z);
+}
+
+
+ofVec3f EventCradle::velocity(unsigned k) const {
+	const Ball& ball = balls[k];
+	double speed = ball.length*ball.omega;
+	return ofVec3f((float) (speed*std::cos(ball.theta)), (float) (speed*std::sin(ball.theta)), 0.0f);
+}
+
+
+double EventCradle::kineticEnergy() const {
+	double e = 0.0;
+	for (auto && ball: balls) {
+		if (ball.inverseMass>0.0f) e += 0.5*ball.length*ball.length*ball.omega*ball.omega/ball.inverseMass;
+	}
+	return e;
+}
+
+
+double EventCradle::energy() const {
+	double e = kineticEnergy();
+	for (auto && ball: balls) {
+		if (ball.inverseMass>0.0f) e -= gravity*ball.length*std::cos(ball.theta)/ball.inverseMass;
+	}
+	return e;
+}
+
+
+// --------------------------------------------------------
+
+void EventCradle::pack(vector<double>& y) const {
+	y.resize(2*balls.size());
+	for (size_t k=0; k<balls.size(); ++k) {
+		y[2*k] = balls[k].theta;
+		y[2*k+1] = balls[k].omega;
+	}
+}
+
+
+void EventCradle::unpack(const vector<double>& y) {
+	for (size_t k=0; k<balls.size(); ++k) {
+		balls[k].theta = y[2*k];
+		balls[k].omega = y[2*k+1];
+	}
+}
+
+
+void EventCradle::derivative(const vector<double>& y, vector<double>& dy) const {
+	dy.resize(y.size());
+	for (size_t k=0; k<balls.size(); ++k) {
+		dy[2*k] = y[2*k+1];
+		dy[2*k+1] = balls[k].inverseMass>0.0f ? -gravity/balls[k].length*std::sin(y[2*k]) : 0.0;
+	}
+}
+
+
+double EventCradle::integrate(const vector<double>& y, double h, vector<double>& out) {
+
+	// One Dormand-Prince step, returns the scaled estimate of the local error.
+	const size_t n = y.size();
+	for (unsigned s=0; s<STAGES; ++s) {
+		m_stage = y;
+		for (unsigned j=0; j<s; ++j) {
+			if (A[s][j]==0.0) continue;
+			for (size_t i=0; i<n; ++i) m_stage[i] += h*A[s][j]*m_k[j][i];
+		}
+		derivative(m_stage, m_k[s]);
+	}
+
+	out.resize(n);
+	double error = 0.0;
+	for (size_t i=0; i<n; ++i) {
+		double sum = 0.0, estimate = 0.0;
+		for (unsigned s=0; s<STAGES; ++s) {
+			sum += B[s]*m_k[s][i];
+			estimate += E[s]*m_k[s][i];
+		}
+		out[i] = y[i] + h*sum;
+		error = std::max(error, std::fabs(h*estimate)/(1.0 + std::fabs(y[i])));
+	}
+	return error;
+}
+
+
+double EventCradle::gap(const vector<double>& y, unsigned k) const {
+	Point a = YAMPE::P::position(balls[k], y[2*k]);
+	Point b = YAMPE::P::position(balls[k+1], y[2*k+2]);
+	double dx = b.x-a.x, dy = b.y-a.y, dz = b.z-a.z;
+	return std::sqrt(dx*dx + dy*dy + dz*dz) - 2.0*radius;
+}
+
+
+double EventCradle::closingStep(const vector<double>& y) const {
+
+	// The gap of a pair shrinks by at most c t + a t^2/2 in time t, with c its
+	// closing speed and a a bound on its acceleration (gravity and the
+	// centripetal terms of both balls, and the turning of the line between
+	// them), so a pair apart cannot touch in a step shorter than the root of
+	// c h + a h^2/2 = gap. Pairs already touching are left to the end of step check.
+	double step = DBL_MAX;
+	for (unsigned k=0; k+1<balls.size(); ++k) {
+		double g = gap(y, k);
+		if (g<=CONTACT_TOLERANCE) continue;
+		const Ball& a = balls[k];
+		const Ball& b = balls[k+1];
+		Point pa = YAMPE::P::position(a, y[2*k]);
+		Point pb = YAMPE::P::position(b, y[2*k+2]);
+		double nx = pb.x-pa.x, ny = pb.y-pa.y, nz = pb.z-pa.z;
+		double length = std::sqrt(nx*nx + ny*ny + nz*nz);
+		double sa = a.length*y[2*k+1], sb = b.length*y[2*k+3];
+		double vx = sb*std::cos(y[2*k+2]) - sa*std::cos(y[2*k]);
+		double vy = sb*std::sin(y[2*k+2]) - sa*std::sin(y[2*k]);
+		double closing = std::max(0.0, -(nx*vx + ny*vy)/length);
+		double accel = 2.0*gravity + sa*sa/a.length + sb*sb/b.length + (vx*vx + vy*vy)/length;
+		step = std::min(step, 2.0*g/(closing + std::sqrt(closing*closing + 2.0*accel*g)));
+	}
+	return step;
+}
+
+
+double EventCradle::impactTime(unsigned k, double h) {
+
+	// Illinois method on the gap of pair k over [0, h] from m_y.
+	double a = 0.0, fa = gap(m_y, k);
+	double b = h, fb = gap(m_next, k);
+	for (unsigned iteration=0; iteration<ROOT_ITERATIONS; ++iteration) {
+		double c = fb!=fa ? b - fb*(b-a)/(fb-fa) : 0.5*(a+b);		// the secant is flat, bisect
+		integrate(m_y, c, m_trial);
+		double fc = gap(m_trial, k);
+		if (std::fabs(fc)<CONTACT_TOLERANCE) return c;
+		if (fc*fb<0.0) {
+			a = b;
+			fa = fb;
+		} else {
+			fa *= 0.5;
+		}
+		b = c;
+		fb = fc;
+	}
+	return b;
+}
+
+
+void EventCradle::resolveImpacts() {
+
+	const unsigned limit = 100*(unsigned) balls.size();
+	for (unsigned iteration=0; iteration<limit; ++iteration) {
+
+		// Touching pair with the largest closing velocity first.
+		double max = -VELOCITY_TOLERANCE;
+		unsigned pair = ~0u;
+		double impulseScale = 0.0;
+		double tangentA = 0.0, tangentB = 0.0;
+		for (unsigned k=0; k+1<balls.size(); ++k) {
+			const Ball& a = balls[k];
+			const Ball& b = balls[k+1];
+			Point pa = YAMPE::P::position(a, a.theta);
+			Point pb = YAMPE::P::position(b, b.theta);
+			double nx = pb.x-pa.x, ny = pb.y-pa.y, nz = pb.z-pa.z;
+			double length = std::sqrt(nx*nx + ny*ny + nz*nz);
+			if (length - 2.0*radius>CONTACT_TOLERANCE || length<=0.0) continue;
+			nx /= length;
+			ny /= length;
+
+			// Components of the normal along each ball's direction of swing.
+			double ta = nx*std::cos(a.theta) + ny*std::sin(a.theta);
+			double tb = nx*std::cos(b.theta) + ny*std::sin(b.theta);
+			double sepVel = b.length*b.omega*tb - a.length*a.omega*ta;
+			if (sepVel>=max) continue;
+			double w = a.inverseMass*ta*ta + b.inverseMass*tb*tb;
+			if (w<=0.0) continue;
+			max = sepVel;
+			pair = k;
+			impulseScale = 1.0/w;
+			tangentA = ta;
+			tangentB = tb;
+		}
+		if (pair==~0u) return;
+
+		double impulse = -(1.0 + restitution)*max*impulseScale;
+		Ball& a = balls[pair];
+		Ball& b = balls[pair+1];
+		a.omega -= a.inverseMass*impulse*tangentA/a.length;
+		b.omega += b.inverseMass*impulse*tangentB/b.length;
+		++numImpacts;
+	}
+}
+
+
+void EventCradle::advance(double duration) {
+
+	YAMPE_TRACE_SCOPE("EventCradle::advance");
+	const double end = time + duration;
+	const unsigned pairs = balls.size()>1 ? (unsigned) balls.size()-1 : 0;
+	pack(m_y);
+	double closing = closingStep(m_y);
+
+	while (end-time>1.0e-12) {
+		double h = std::min(std::min(m_step, maxStep), std::min(end-time, closing));
+		double error = integrate(m_y, h, m_next);
+		if (error>tolerance) {
+			m_step = h*std::max(0.2, 0.9*std::pow(tolerance/error, 0.2));
+			continue;
+		}
+
+		// Earliest impact in the step, pairs already overlapping at its start are ignored.
+		double first = h;
+		bool isImpact = false;
+		for (unsigned k=0; k<pairs; ++k) {
+			if (gap(m_next, k)>=-CONTACT_TOLERANCE || gap(m_y, k)<-CONTACT_TOLERANCE) continue;
+			double t = impactTime(k, h);
+			if (t<first) first = t;
+			isImpact = true;
+		}
+		if (isImpact) integrate(m_y, first, m_next);
+
+		m_y.swap(m_next);
+		time += first;
+		++numSteps;
+
+		if (isImpact) {
+			YAMPE_TRACE_SCOPE("EventCradle impact");
+			unpack(m_y);
+			resolveImpacts();
+			pack(m_y);
+		} else {
+			m_step = h*std::min(5.0, 0.9*std::pow(tolerance/std::max(error, 1.0e-300), 0.2));
+		}
+		closing = closingStep(m_y);
+	}
+	unpack(m_y);
+}
+
+
+const String EventCradle::toString() const {
+	std::ostringstream outs;
+	outs <<"balls = " <<balls.size() <<"    "
+		<<"time = " <<time <<"    "
+		<<"impacts = " <<numImpacts <<"    "
+		<<"steps = " <<numSteps <<"    "
+		<<"energy = " <<energy();
+	return outs.str();
+}
+
+} }	// namespace YAMPE::P
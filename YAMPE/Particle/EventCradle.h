@@ -0,0 +1,118 @@
+/**
+	@file 		EventCradle.h
+	@author		dgaffney
+	@practical
+	@brief		Event driven simulation of a cradle of balls on strings.
+	*/
+
+#ifndef PARTICLE_EVENT_CRADLE_H
+#define PARTICLE_EVENT_CRADLE_H
+
+#include "ConstraintTable.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class EventCradle
+
+	Alternative to fixed step integration for balls hanging on strings that
+	swing in the xy plane and collide only with their neighbours (a Newton's
+	cradle), intended for long simulated times.
+
+	Between impacts each ball is an exact pendulum, theta'' = -g/L sin theta,
+	integrated in double precision by an adaptive Dormand-Prince 5(4)
+	Runge-Kutta method. A step is never longer than the time any pair of
+	neighbours apart at its start needs to touch, going by its closing speed
+	and a bound on its acceleration, so no impact can happen and be undone
+	within a step. After every accepted step the gap between each pair of
+	neighbours is checked; the time of the earliest impact in the step is
+	found by root finding (Illinois method, bisecting where that stalls) on
+	the gap, re-integrating from the start of the step.
+
+	At an impact the contacts are resolved as ContactRegistry::resolve does:
+	repeatedly the touching pair with the largest closing velocity gets the
+	impulse giving separating velocity -restitution times the closing one,
+	until no touching pair is closing, so impulses travel along a row of
+	touching balls. The string takes the radial part of every impulse (an
+	equality constraint, restitution zero), so only the tangential part
+	changes a ball's swing.
+
+	Strings never slacken and there is no damping.
+	*/
+class EventCradle : public Printable {
+
+public:
+
+	typedef ofPtr<EventCradle> Ref;
+
+	struct Ball {
+		unsigned particle;			///< index in the registry used by load()/store().
+		ofVec3f anchor;
+		double length;
+		double theta;				///< angle from the downward vertical, positive towards +x.
+		double omega;				///< d theta / dt.
+		float inverseMass;
+	};
+
+	vector<Ball> balls;				///< in order along the cradle, neighbours may collide.
+
+	double gravity;					///< magnitude, acting along -y.
+	float radius;
+	float restitution;				///< ball-ball restitution (Contact::restitution).
+	double tolerance;				///< local error tolerance of the integrator.
+	double maxStep;					///< longest step, bounds how far apart impacts are seen.
+
+	double time;					///< simulated time.
+	unsigned numImpacts;			///< impacts (impulse exchanges) so far.
+	unsigned numSteps;				///< accepted integrator steps so far.
+
+	EventCradle(float radius=0.5f, float restitution=1.0f, const String label="EventCradle");
+
+	/// Builds a resting cradle like FixedWorld::reset.
+	void reset(unsigned n, float anchorHeight, float stringLength, float spacing=0.0f);
+
+	/// Swings ball k out to the given angle (degrees) from the vertical, on the -x side.
+	void raise(unsigned k, float angle);
+
+	/**	One ball per anchored equality row of the table, taking anchor and
+		string length from the row and the state from the particle. The part
+		of the state outside the swing plane is ignored. The balls are put in
+		order of their anchors along x, whatever the order of the rows.
+		*/
+	void load(const ParticleRegistry& particles, const ConstraintTable& table, float gravity=9.81f);
+
+	/// Writes positions and velocities back to the particles of load().
+	void store(ParticleRegistry& particles) const;
+
+	/// Advances the simulation by duration, handling every impact on the way.
+	void advance(double duration);
+
+	ofVec3f position(unsigned k) const;
+	ofVec3f velocity(unsigned k) const;
+	double kineticEnergy() const;
+	double energy() const;			///< kinetic plus potential (relative to the anchors).
+
+	const String toString() const;
+
+protected:
+
+	static const unsigned STAGES = 7;
+
+	double m_step;					///< step size carried between calls.
+	vector<double> m_y, m_next, m_trial;
+	vector<double> m_k[STAGES];
+	vector<double> m_stage;
+
+	void pack(vector<double>& y) const;
+	void unpack(const vector<double>& y);
+	void derivative(const vector<double>& y, vector<double>& dy) const;
+	double integrate(const vector<double>& y, double h, vector<double>& out);
+	double gap(const vector<double>& y, unsigned k) const;
+	double closingStep(const vector<double>& y) const;
+	double impactTime(unsigned k, double h);
+	void resolveImpacts();
+};
+
+} } // namespace YAMPE P
+
+#endif
@@ -0,0 +1,247 @@
+/**
+	@file 		FixedWorld.h
+	@author		dgaffney
+	@practical
+	@brief		Compile time specialised world for a cradle of N balls.
+	*/
+
+#ifndef PARTICLE_FIXED_WORLD_H
+#define PARTICLE_FIXED_WORLD_H
+
+#include <array>
+#include <cfloat>
+#include <cmath>
+
+#include "../Particle.h"
+#include "ContactRegistry.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class FixedWorld
+
+	A cradle with a topology known at compile time: N balls, each hanging from
+	its own anchor by an inextensible string, one uniform gravity field and
+	contacts only between neighbouring balls (k, k+1).
+
+	All state lives in std::array members and the three "generators" (gravity,
+	strings and neighbour contacts) are plain inline member functions, so a
+	step has no allocation, no indirection and no virtual dispatch and the
+	loops over N can be unrolled by the compiler.
+
+	The contact resolution follows ContactRegistry::resolve (largest closing
+	velocity first, with penetration book keeping after each resolution) with
+	the same iteration limit, ContactRegistry::DEFAULT_ITERATION_LIMIT. ofApp
+	allows two iterations per contact above that, which a cradle of up to 50
+	balls never reaches, so a FixedWorld stepped with the same dt tracks the
+	generic pipeline of ofApp::update.
+	*/
+template <unsigned N>
+class FixedWorld {
+
+public:
+
+	static const unsigned NUM_BALLS = N;
+	static const unsigned MAX_CONTACTS = 2*N-1;		///< N strings plus N-1 neighbour pairs.
+	static const unsigned NO_PARTICLE = ~0u;
+
+	/// Compact contact record, b is NO_PARTICLE for a string (anchor) contact.
+	struct Contact {
+		unsigned a, b;
+		ofVec3f contactNormal;
+		float penetration;
+		float restitution;
+	};
+
+	std::array<ofVec3f, N> position;
+	std::array<ofVec3f, N> velocity;
+	std::array<ofVec3f, N> anchor;
+	std::array<float, N> inverseMass;
+
+	ofVec3f gravity;
+	float radius;
+	float stringLength;
+	float restitution;				///< ball-ball restitution, strings always use zero.
+	unsigned iterationLimit;
+
+	std::array<Contact, MAX_CONTACTS> contacts;
+	unsigned numContacts;
+	unsigned iterationUsed;
+
+	FixedWorld(float radius=0.5f, float stringLength=5.0f, const ofVec3f& gravity=ofVec3f(0.0f, -9.81f, 0.0f)) :
+		gravity(gravity), radius(radius), stringLength(stringLength), restitution(1.0f),
+		iterationLimit(ContactRegistry::DEFAULT_ITERATION_LIMIT), numContacts(0), iterationUsed(0) {
+		for (unsigned k=0; k<N; ++k) {
+			position[k] = velocity[k] = anchor[k] = ofVec3f::zero();
+			inverseMass[k] = 1.0f;
+		}
+	}
+
+	/**
+		Lays out a resting cradle: anchors spaced along x at height anchorHeight,
+		balls hanging straight down with the given spacing between them.
+		*/
+	void reset(float anchorHeight, float spacing=0.0f) {
+		float x = -(N*(2.0f*radius + spacing))/2.0f;
+		for (unsigned k=0; k<N; ++k) {
+			anchor[k] = ofVec3f(x, anchorHeight, 0.0f);
+			position[k] = ofVec3f(x, anchorHeight-stringLength, 0.0f);
+			velocity[k] = ofVec3f::zero();
+			x += 2.0f*radius + spacing;
+		}
+	}
+
+	/// Swings ball k out to the given angle (degrees) from the vertical, on the -x side.
+	void raise(unsigned k, float angle) {
+		float theta = ofDegToRad(angle);
+		position[k] = anchor[k] + stringLength*ofVec3f(-sinf(theta), -cosf(theta), 0.0f);
+		velocity[k] = ofVec3f::zero();
+	}
+
+	/// Copies state to/from the first N particles of a registry.
+	void load(const ParticleRegistry& particles) {
+		for (unsigned k=0; k<N && k<particles.size(); ++k) {
+			position[k] = particles[k]->position;
+			velocity[k] = particles[k]->velocity;
+			inverseMass[k] = particles[k]->inverseMass();
+		}
+	}
+	void store(ParticleRegistry& particles) const {
+		for (unsigned k=0; k<N && k<particles.size(); ++k) {
+			particles[k]->position = position[k];
+			particles[k]->velocity = velocity[k];
+		}
+	}
+
+	void step(float dt) {
+		integrate(dt);
+		numContacts = 0;
+		generateStrings();
+		generateNeighbours();
+		resolve();
+	}
+
+	float kineticEnergy() const {
+		float e = 0.0f;
+		for (unsigned k=0; k<N; ++k) {
+			if (inverseMass[k]>0.0f) e += 0.5f*velocity[k].lengthSquared()/inverseMass[k];
+		}
+		return e;
+	}
+
+protected:
+
+	/// Gravity plus symplectic Euler, matching Particle::integrate with unit damping.
+	inline void integrate(float dt) {
+		for (unsigned k=0; k<N; ++k) {
+			if (inverseMass[k]<=0.0f) continue;
+			velocity[k] += dt*gravity;
+			position[k] += dt*velocity[k];
+		}
+	}
+
+	/// Equality constraint from each ball to its anchor.
+	inline void generateStrings() {
+		for (unsigned k=0; k<N; ++k) {
+			ofVec3f d = anchor[k] - position[k];
+			float length = d.length();
+			float error = length - stringLength;
+			if (std::fabs(error)<EPS || length<=0.0f) continue;
+			Contact& c = contacts[numContacts++];
+			c.a = k;
+			c.b = NO_PARTICLE;
+			c.contactNormal = d*((error>0.0f ? 1.0f : -1.0f)/length);
+			c.penetration = std::fabs(error);
+			c.restitution = 0.0f;
+		}
+	}
+
+	/// Sphere contacts between adjacent balls only.
+	inline void generateNeighbours() {
+		const float limit = 2.0f*radius;
+		for (unsigned k=1; k<N; ++k) {
+			ofVec3f d = position[k] - position[k-1];
+			float length2 = d.lengthSquared();
+			if (length2>=limit*limit) continue;
+			float length = std::sqrt(length2);
+			Contact& c = contacts[numContacts++];
+			c.a = k;
+			c.b = k-1;
+			c.contactNormal = length>0.0f ? d/length : ofVec3f(1.0f, 0.0f, 0.0f);
+			c.penetration = limit - length;
+			c.restitution = restitution;
+		}
+	}
+
+	inline float separatingVelocity(const Contact& c) const {
+		ofVec3f relative = velocity[c.a];
+		if (c.b!=NO_PARTICLE) relative -= velocity[c.b];
+		return relative.dot(c.contactNormal);
+	}
+
+	inline float totalInverseMass(const Contact& c) const {
+		return inverseMass[c.a] + (c.b!=NO_PARTICLE ? inverseMass[c.b] : 0.0f);
+	}
+
+	void resolve() {
+		for (iterationUsed=0; iterationUsed<iterationLimit; ++iterationUsed) {
+
+			// Contact with the largest closing velocity first.
+			float max = FLT_MAX;
+			unsigned index = NO_PARTICLE;
+			for (unsigned k=0; k<numContacts; ++k) {
+				float sepVel = separatingVelocity(contacts[k]);
+				if (sepVel<max && (sepVel<0.0f || contacts[k].penetration>0.0f)) {
+					max = sepVel;
+					index = k;
+				}
+			}
+			if (index==NO_PARTICLE || (max>-EPS && contacts[index].penetration<EPS)) return;
+
+			Contact& c = contacts[index];
+			float inverseMassSum = totalInverseMass(c);
+			if (inverseMassSum<=0.0f) {
+				c.penetration = 0.0f;
+				continue;
+			}
+
+			// Velocity.
+			if (max<0.0f) {
+				float impulse = (-max*c.restitution - max)/inverseMassSum;
+				ofVec3f impulsePerIMass = c.contactNormal*impulse;
+				velocity[c.a] += impulsePerIMass*inverseMass[c.a];
+				if (c.b!=NO_PARTICLE) velocity[c.b] -= impulsePerIMass*inverseMass[c.b];
+			}
+
+			// Interpenetration.
+			ofVec3f aMovement = ofVec3f::zero();
+			ofVec3f bMovement = ofVec3f::zero();
+			if (c.penetration>0.0f) {
+				ofVec3f movePerIMass = c.contactNormal*(c.penetration/inverseMassSum);
+				aMovement = movePerIMass*inverseMass[c.a];
+				position[c.a] += aMovement;
+				if (c.b!=NO_PARTICLE) {
+					bMovement = -movePerIMass*inverseMass[c.b];
+					position[c.b] += bMovement;
+				}
+			}
+
+			// Update penetrations of contacts sharing the moved balls.
+			const unsigned a = c.a;
+			const unsigned b = c.b;
+			for (unsigned k=0; k<numContacts; ++k) {
+				Contact& other = contacts[k];
+				if (other.a==a) other.penetration -= aMovement.dot(other.contactNormal);
+				else if (other.a==b) other.penetration -= bMovement.dot(other.contactNormal);
+				if (other.b!=NO_PARTICLE) {
+					if (other.b==a) other.penetration += aMovement.dot(other.contactNormal);
+					else if (other.b==b) other.penetration += bMovement.dot(other.contactNormal);
+				}
+			}
+		}
+	}
+};
+
+} } // namespace YAMPE P
+
+#endif
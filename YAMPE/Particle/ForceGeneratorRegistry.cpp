@@ -5,9 +5,97 @@
 	@brief		Implementation of registry class to store current force generators between particles.
 	*/
 
+#include <algorithm>
+#include <cstdint>
+
 #include "ForceGeneratorRegistry.h"
 
 namespace YAMPE { namespace P {
+
+const ForceGeneratorRegistry::Handle ForceGeneratorRegistry::INVALID;
+const unsigned ForceGeneratorRegistry::NONE;
+
+namespace {
+	/// Entry of a free slot.
+	const unsigned FREE = ~0u;
+}
+
+
+// --------------------------------------------------------
+
+
+size_t ForceGeneratorRegistry::ListIndex::home(const void* key) const {
+	// Fibonacci hashing, the low bits of an address are mostly alignment
+	uint64_t h = (uint64_t) (uintptr_t) key * 0x9E3779B97F4A7C15ull;
+	return (size_t) (h>>32) & (m_table.size()-1);
+}
+
+ForceGeneratorRegistry::List* ForceGeneratorRegistry::ListIndex::find(const void* key) {
+	if (m_size==0) return NULL;
+	size_t mask = m_table.size()-1;
+	for (size_t k=home(key); m_table[k].key!=NULL; k=(k+1)&mask) {
+		if (m_table[k].key==key) return &m_table[k];
+	}
+	return NULL;
+}
+
+ForceGeneratorRegistry::List& ForceGeneratorRegistry::ListIndex::insert(const void* key) {
+	if (2*(m_size+1)>m_table.size()) rehash(std::max<size_t>(16, 2*m_table.size()));
+	size_t mask = m_table.size()-1, k = home(key);
+	for (; m_table[k].key!=NULL; k=(k+1)&mask) {
+		if (m_table[k].key==key) return m_table[k];
+	}
+	List& list = m_table[k];
+	list.key = key;
+	list.first = list.last = NONE;
+	list.count = 0;
+	++m_size;
+	return list;
+}
+
+void ForceGeneratorRegistry::ListIndex::erase(const void* key) {
+	List* list = find(key);
+	if (list==NULL) return;
+	size_t mask = m_table.size()-1, hole = list-m_table.data();
+	// move back each later list of the probe run that may fill the hole
+	for (size_t k=(hole+1)&mask; m_table[k].key!=NULL; k=(k+1)&mask) {
+		if (((k-home(m_table[k].key))&mask)>=((k-hole)&mask)) {
+			m_table[hole] = m_table[k];
+			hole = k;
+		}
+	}
+	m_table[hole].key = NULL;
+	--m_size;
+}
+
+void ForceGeneratorRegistry::ListIndex::reserve(size_t n) {
+	size_t capacity = 16;
+	while (capacity<2*n) capacity *= 2;
+	if (capacity>m_table.size()) rehash(capacity);
+}
+
+void ForceGeneratorRegistry::ListIndex::clear() {
+	if (m_size==0) return;
+	for (auto && list: m_table) list.key = NULL;
+	m_size = 0;
+}
+
+void ForceGeneratorRegistry::ListIndex::rehash(size_t capacity) {
+	TrackedVector<List, MemoryTracker::FORCES> old(capacity);
+	old.swap(m_table);
+	for (auto && list: m_table) list.key = NULL;
+	size_t mask = capacity-1;
+	for (auto && list: old) {
+		if (list.key==NULL) continue;
+		size_t k = home(list.key);
+		while (m_table[k].key!=NULL) k = (k+1)&mask;
+		m_table[k] = list;
+	}
+}
+
+
+// --------------------------------------------------------
+
 		
 void ForceGeneratorRegistry::applyForce(float dt) {
     for (auto && it: registry) {
@@ -15,9 +103,134 @@ void ForceGeneratorRegistry::applyForce(float dt) {
     }
 }
 
-void ForceGeneratorRegistry::add(Particle::Ref particle, ForceGenerator::Ref  forceGenerator) {
-	ForceGeneratorRegistry::Entry entry(particle, forceGenerator);
-	registry.push_back(entry);
+unsigned ForceGeneratorRegistry::takeSlot(unsigned k) {
+	if (m_freeSlots.empty()) {
+		Slot fresh = { k, 0 };
+		m_slots.push_back(fresh);
+		return (unsigned) m_slots.size()-1;
+	}
+	unsigned slot = m_freeSlots.back();
+	m_freeSlots.pop_back();
+	m_slots[slot].entry = k;
+	return slot;
+}
+
+ForceGeneratorRegistry::Handle ForceGeneratorRegistry::add(Particle::Ref particle, ForceGenerator::Ref  forceGenerator) {
+	unsigned k = (unsigned) registry.size();
+	unsigned slot = takeSlot(k);
+	registry.emplace_back(particle, forceGenerator);
+	registry.back().slot = slot;
+	link(m_byParticle, particle.get(), k, &Entry::nextOfParticle, &Entry::previousOfParticle);
+	link(m_byGenerator, forceGenerator.get(), k, &Entry::nextOfGenerator, &Entry::previousOfGenerator);
+	return Handle(slot, m_slots[slot].generation);
+}
+
+void ForceGeneratorRegistry::add(const Particle::Ref* particles, size_t count, const ForceGenerator::Ref& forceGenerator) {
+	size_t first = registry.size();
+	registry.reserve(first+count);
+	m_slots.reserve(m_slots.size()+count-std::min(count, m_freeSlots.size()));
+	m_byParticle.reserve(m_byParticle.size()+count);
+	for (size_t i=0; i<count; ++i) {
+		unsigned k = (unsigned) (first+i);
+		unsigned slot = takeSlot(k);
+		registry.emplace_back(particles[i], forceGenerator);
+		registry.back().slot = slot;
+		link(m_byParticle, particles[i].get(), k, &Entry::nextOfParticle, &Entry::previousOfParticle);
+		link(m_byGenerator, forceGenerator.get(), k, &Entry::nextOfGenerator, &Entry::previousOfGenerator);
+	}
+}
+
+void ForceGeneratorRegistry::link(ListIndex& index, const void* key, unsigned k, unsigned Entry::*next, unsigned Entry::*previous) {
+	List& list = index.insert(key);
+	registry[k].*next = NONE;
+	registry[k].*previous = list.last;
+	if (list.last!=NONE) registry[list.last].*next = k;
+	else list.first = k;
+	list.last = k;
+	++list.count;
+}
+
+void ForceGeneratorRegistry::unlink(ListIndex& index, const void* key, unsigned k, unsigned Entry::*next, unsigned Entry::*previous) {
+	List* list = index.find(key);
+	const Entry& entry = registry[k];
+	if (entry.*previous!=NONE) registry[entry.*previous].*next = entry.*next;
+	else list->first = entry.*next;
+	if (entry.*next!=NONE) registry[entry.*next].*previous = entry.*previous;
+	else list->last = entry.*previous;
+	if (--list->count==0) index.erase(key);
+}
+
+void ForceGeneratorRegistry::relink(ListIndex& index, const void* key, unsigned k, unsigned Entry::*next, unsigned Entry::*previous) {
+	const Entry& entry = registry[k];
+	List* list = entry.*previous==NONE || entry.*next==NONE ? index.find(key) : NULL;
+	if (entry.*previous!=NONE) registry[entry.*previous].*next = k;
+	else list->first = k;
+	if (entry.*next!=NONE) registry[entry.*next].*previous = k;
+	else list->last = k;
+}
+
+void ForceGeneratorRegistry::erase(unsigned k) {
+	Entry& entry = registry[k];
+	unlink(m_byParticle, entry.particle.get(), k, &Entry::nextOfParticle, &Entry::previousOfParticle);
+	unlink(m_byGenerator, entry.forceGenerator.get(), k, &Entry::nextOfGenerator, &Entry::previousOfGenerator);
+
+	Slot& slot = m_slots[entry.slot];
+	slot.entry = FREE;
+	++slot.generation;
+	m_freeSlots.push_back(entry.slot);
+
+	unsigned last = (unsigned) registry.size()-1;
+	if (k!=last) {
+		registry[k] = std::move(registry[last]);
+		Entry& moved = registry[k];
+		m_slots[moved.slot].entry = k;
+		relink(m_byParticle, moved.particle.get(), k, &Entry::nextOfParticle, &Entry::previousOfParticle);
+		relink(m_byGenerator, moved.forceGenerator.get(), k, &Entry::nextOfGenerator, &Entry::previousOfGenerator);
+	}
+	registry.pop_back();
+}
+
+bool ForceGeneratorRegistry::remove(Handle handle) {
+	if (!contains(handle)) return false;
+	erase(m_slots[handle.slot].entry);
+	return true;
+}
+
+void ForceGeneratorRegistry::remove(Particle::Ref particle, ForceGenerator::Ref forceGenerator) {
+	const List* byParticle = m_byParticle.find(particle.get());
+	const List* byGenerator = m_byGenerator.find(forceGenerator.get());
+	if (byParticle==NULL || byGenerator==NULL) return;
+	// search the shorter of the two lists
+	unsigned first = FREE;
+	if (byParticle->count<=byGenerator->count) {
+		for (unsigned k=byParticle->first; k!=NONE; k=registry[k].nextOfParticle) {
+			if (registry[k].forceGenerator==forceGenerator) first = std::min(first, k);
+		}
+	} else {
+		for (unsigned k=byGenerator->first; k!=NONE; k=registry[k].nextOfGenerator) {
+			if (registry[k].particle==particle) first = std::min(first, k);
+		}
+	}
+	if (first!=FREE) erase(first);
+}
+
+size_t ForceGeneratorRegistry::removeParticle(const Particle* particle) {
+	size_t count = 0;
+	// the list goes with its last entry
+	for (const List* list = m_byParticle.find(particle); list!=NULL; list = m_byParticle.find(particle), ++count) erase(list->last);
+	return count;
+}
+
+size_t ForceGeneratorRegistry::removeGenerator(const ForceGenerator* forceGenerator) {
+	size_t count = 0;
+	for (const List* list = m_byGenerator.find(forceGenerator); list!=NULL; list = m_byGenerator.find(forceGenerator), ++count) erase(list->last);
+	return count;
+}
+
+void ForceGeneratorRegistry::reserve(size_t n) {
+	registry.reserve(n);
+	m_slots.reserve(n);
+	m_byParticle.reserve(n);
 }
 
 const String ForceGeneratorRegistry::toString() const {
@@ -32,7 +245,15 @@ const String ForceGeneratorRegistry::toString() const {
 }
 
 void ForceGeneratorRegistry::clear() {
+	// slots are kept, with a new generation, so outstanding handles stay invalid
+	for (auto && entry: registry) {
+		++m_slots[entry.slot].generation;
+		m_slots[entry.slot].entry = FREE;
+		m_freeSlots.push_back(entry.slot);
+	}
     registry.clear();
+	m_byParticle.clear();
+	m_byGenerator.clear();
 }
 
 } }	// namespace YAMPE::P
@@ -13,8 +13,48 @@
 
 namespace YAMPE { namespace P {
 		
+/**
+	\class ForceGeneratorRegistry
+
+	Registrations are kept densely packed in one vector, so applyForce()
+	walks contiguous memory, and removal moves the last registration into
+	the freed place (swap-erase). Since that changes positions, add()
+	returns a Handle naming the registration through a slot table; slots
+	are recycled with a new generation, so a stale handle is detected
+	rather than removing someone else's registration.
+
+	The registrations of each particle and of each force generator are
+	also linked into a list through the entries themselves, so all the
+	generators of a particle or all the particles of a generator are found
+	without a scan, and remove(particle, generator), removeParticle() and
+	removeGenerator() cost only as much as the registrations they touch.
+	The lists are found by address in a flat open addressed table, which
+	drops a list with its last registration: the table holds only
+	particles and generators that are registered, however many come and
+	go, a particle created at a freed address starts with no registrations,
+	and registering a particle again (as ParticlePool recycles them)
+	allocates nothing once the table has grown to the live count.
+
+	The order applyForce() visits registrations in is the order of add()
+	until the first removal, and after that depends only on the sequence of
+	calls, not on addresses.
+	*/
 class ForceGeneratorRegistry : public Printable {
 
+public:
+
+	/// Names one registration, valid until it is removed.
+	struct Handle {
+		unsigned slot;
+		unsigned generation;
+
+		Handle(unsigned slot=~0u, unsigned generation=0) : slot(slot), generation(generation) { }
+		bool operator==(const Handle& other) const { return slot==other.slot && generation==other.generation; }
+		bool operator!=(const Handle& other) const { return !(*this==other); }
+	};
+
+	static const Handle INVALID;
+
 protected:
 		
 	/** Private sturcture to keep track of one force generator and the 
@@ -23,14 +63,82 @@ protected:
 	struct Entry {
 		Particle::Ref particle;
 		ForceGenerator::Ref forceGenerator;
+		unsigned slot;					///< slot naming this entry.
+		unsigned nextOfParticle;		///< next entry of the particle, or NONE.
+		unsigned previousOfParticle;
+		unsigned nextOfGenerator;		///< next entry of the generator, or NONE.
+		unsigned previousOfGenerator;
 		
-		Entry(Particle::Ref particle, ForceGenerator::Ref forceGenerator) :
-			particle(particle), forceGenerator(forceGenerator) { }
+		Entry(const Particle::Ref& particle, const ForceGenerator::Ref& forceGenerator) :
+			particle(particle), forceGenerator(forceGenerator), slot(0),
+			nextOfParticle(NONE), previousOfParticle(NONE), nextOfGenerator(NONE), previousOfGenerator(NONE) { }
+	};
+
+	static const unsigned NONE = ~0u;
+
+	/// Entries of one particle or generator, first to last registered.
+	struct List {
+		const void* key;				///< particle or generator, NULL in an empty table slot.
+		unsigned first;
+		unsigned last;
+		unsigned count;
+	};
+
+	/** Lists by address, open addressed with linear probing and at most
+		half full. Erasing shifts later entries of the probe sequence back,
+		so there are no tombstones and an erased key costs nothing after.
+		*/
+	class ListIndex {
+	public:
+		ListIndex() : m_size(0) { }
+		List* find(const void* key);
+		const List* find(const void* key) const { return const_cast<ListIndex*>(this)->find(key); }
+		/// The list of key, added empty if there is none.
+		List& insert(const void* key);
+		void erase(const void* key);
+		void reserve(size_t n);
+		/// Empties the table, keeping its capacity.
+		void clear();
+		size_t size() const { return m_size; }
+		size_t capacity() const { return m_table.size(); }
+	protected:
+		TrackedVector<List, MemoryTracker::FORCES> m_table;
+		size_t m_size;
+		size_t home(const void* key) const;
+		void rehash(size_t capacity);
+	};
+
+	/// Where a handle's entry currently is.
+	struct Slot {
+		unsigned entry;
+		unsigned generation;
 	};
 		
 	/// Holds the list of registrations.
-	typedef std::vector<Entry> Registry;
+	typedef TrackedVector<Entry, MemoryTracker::FORCES> Registry;
 	Registry registry;
+
+	typedef TrackedVector<unsigned, MemoryTracker::FORCES> IndexList;
+
+	TrackedVector<Slot, MemoryTracker::FORCES> m_slots;
+	IndexList m_freeSlots;			///< slots of removed entries, reused by add().
+
+	/// Entries of each particle and of each generator.
+	ListIndex m_byParticle;
+	ListIndex m_byGenerator;
+
+	/// Takes a free slot (or a new one) for entry k.
+	unsigned takeSlot(unsigned k);
+
+	/// Removes entry k, moving the last entry into its place.
+	void erase(unsigned k);
+
+	/// Appends entry k to the list of key, or takes it out, dropping the list when empty.
+	void link(ListIndex& index, const void* key, unsigned k, unsigned Entry::*next, unsigned Entry::*previous);
+	void unlink(ListIndex& index, const void* key, unsigned k, unsigned Entry::*next, unsigned Entry::*previous);
+
+	/// Points the neighbours of entry k, just moved there, at it.
+	void relink(ListIndex& index, const void* key, unsigned k, unsigned Entry::*next, unsigned Entry::*previous);
 		
 public:
 	ForceGeneratorRegistry(String label="ForceGeneratorRegistry") : Printable(label), registry() { } ;
@@ -38,25 +146,104 @@ public:
     typedef ofPtr<ForceGeneratorRegistry> Ref;
     
 	/// Registers the given force generator and particle pair.
-	void add(Particle::Ref particle, ForceGenerator::Ref forceGenerator);
+	Handle add(Particle::Ref particle, ForceGenerator::Ref forceGenerator);
+
+	/**	Registers the force generator with count particles, as count calls
+		of add() would but copying each Ref once and growing the registry
+		once (e.g. Scene::instantiate()). Handles are not returned, a
+		registration made this way is removed by particle or generator.
+		*/
+	void add(const Particle::Ref* particles, size_t count, const ForceGenerator::Ref& forceGenerator);
+
+	/// Removes the registration named by handle, returns false if it was already removed.
+	bool remove(Handle handle);
 		
-	/**	Removes the given registered pair from the registry.
+	/**	Removes the given registered pair from the registry (the first
+		registration, should the pair be registered more than once).
 		Method has no effect if the pair is not registered.
 		*/
 	void remove(Particle::Ref particle, ForceGenerator::Ref forceGenerator);
+
+	/// Removes every registration of the particle, returns the number removed.
+	size_t removeParticle(const Particle* particle);
+
+	/// Removes every registration of the force generator, returns the number removed.
+	size_t removeGenerator(const ForceGenerator* forceGenerator);
+
+	bool contains(Handle handle) const {
+		return handle.slot<m_slots.size() && m_slots[handle.slot].generation==handle.generation;
+	}
+
+	/// Calls f(forceGenerator, handle) for each generator registered with the particle.
+	template <typename F>
+	void forEachGenerator(const Particle* particle, F f) const {
+		const List* list = m_byParticle.find(particle);
+		if (list==NULL) return;
+		for (unsigned k=list->first; k!=NONE; k=registry[k].nextOfParticle) f(registry[k].forceGenerator, handleOf(k));
+	}
+
+	/// Calls f(particle, handle) for each particle registered with the force generator.
+	template <typename F>
+	void forEachParticle(const ForceGenerator* forceGenerator, F f) const {
+		const List* list = m_byGenerator.find(forceGenerator);
+		if (list==NULL) return;
+		for (unsigned k=list->first; k!=NONE; k=registry[k].nextOfGenerator) f(registry[k].particle, handleOf(k));
+	}
+
+	size_t numGenerators(const Particle* particle) const {
+		const List* list = m_byParticle.find(particle);
+		return list==NULL ? 0 : list->count;
+	}
+
+	size_t numParticles(const ForceGenerator* forceGenerator) const {
+		const List* list = m_byGenerator.find(forceGenerator);
+		return list==NULL ? 0 : list->count;
+	}
+
+	size_t size() const { return registry.size(); }
+
+	/// Number of particles and of force generators with registrations.
+	size_t numRegisteredParticles() const { return m_byParticle.size(); }
+	size_t numRegisteredGenerators() const { return m_byGenerator.size(); }
+
+	/// Replaces the particle of every registration by f(particle), e.g. MortonOrder::remap().
+	template <typename F>
+	void remapParticles(F f) {
+		m_byParticle.clear();
+		for (unsigned k=0; k<registry.size(); ++k) {
+			Entry& entry = registry[k];
+			entry.particle = f(entry.particle);
+			link(m_byParticle, entry.particle.get(), k, &Entry::nextOfParticle, &Entry::previousOfParticle);
+		}
+	}
+
+	/// Reserves room for n registrations, to add many without reallocating.
+	void reserve(size_t n);
 		
 	/**	Clears all registrations from the registry. This will
 		not delete the particles or the force generators
 		themselves, just the records of their connection.
+		Outstanding handles become invalid.
 		*/
 	void clear();
 		
 	/// Calls all force generators to apply forces to associated particles 
 	void applyForce(float dt);
+
+	/// Calls the force generators registered with one particle, e.g. for MultirateStepper.
+	void applyForce(const Particle::Ref& particle, float dt) const {
+		const List* list = m_byParticle.find(particle.get());
+		if (list==NULL) return;
+		for (unsigned k=list->first; k!=NONE; k=registry[k].nextOfParticle) registry[k].forceGenerator->applyForce(registry[k].particle, dt);
+	}
 	
 	const String toString() const;
+
+protected:
+
+	Handle handleOf(unsigned k) const { return Handle(registry[k].slot, m_slots[registry[k].slot].generation); }
 };
 
 } }	// namespace YAMPE::P
 
-#endif
\ No newline at end of file
+#endif
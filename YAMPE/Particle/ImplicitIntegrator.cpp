@@ -0,0 +1,187 @@
+/**
+	@file 		ImplicitIntegrator.cpp
+	@author		dgaffney
+	@practical
+	@brief		Backward Euler integration of particles joined by stiff springs.
+	*/
+
+#include <cmath>
+
+#include "ImplicitIntegrator.h"
+#include "../Determinism.h"
+#include "../Trace.h"
+
+namespace YAMPE { namespace P {
+
+ImplicitIntegrator::ImplicitIntegrator(unsigned maxIterations, float tolerance, const String label) :
+	Printable(label), maxIterations(maxIterations), tolerance(tolerance), iterationUsed(0), residual(0.0f) { }
+
+
+void ImplicitIntegrator::linearise(const ParticleRegistry& particles, const SpringNetwork& springs) {
+
+	const size_t n = particles.size();
+	m_mass.resize(n);
+	m_velocity.resize(n);
+	for (size_t k=0; k<n; ++k) {
+		const Particle::Ref& p = particles[k];
+		m_mass[k] = p->hasFiniteMass() ? p->mass() : 0.0f;
+		m_velocity[k] = p->velocity;
+	}
+
+	const size_t m = springs.size();
+	m_i.resize(m);
+	m_j.resize(m);
+	m_u.resize(m);
+	m_alpha.resize(m);
+	m_beta.resize(m);
+	for (size_t k=0; k<m; ++k) {
+		const SpringNetwork::Spring& s = springs.springs[k];
+		bool anchored = springs.isAnchored(s);
+		const ofVec3f& other = anchored ? springs.anchors[s.j & ~SpringNetwork::ANCHORED] : particles[s.j]->position;
+		ofVec3f d = particles[s.i]->position - other;
+		float length = d.length();
+		float stretch = length - s.restLength;
+
+		m_i[k] = s.i;
+		m_j[k] = anchored ? NONE : s.j;
+		m_u[k] = length>0.0f ? d/length : ofVec3f::zero();
+		if (length<=0.0f || (s.isBungee && stretch<=0.0f)) {
+			m_alpha[k] = m_beta[k] = 0.0f;
+		} else {
+			// Axial stiffness k, transverse k*(1-restLength/L) dropped when compressed.
+			m_alpha[k] = s.springConstant;
+			m_beta[k] = s.springConstant*std::max(0.0f, 1.0f - s.restLength/length);
+		}
+	}
+}
+
+
+void ImplicitIntegrator::stiffness(const vector<ofVec3f>& y, vector<ofVec3f>& out) const {
+
+	// out = sum over springs of S*(y_i - y_j), i.e. -K y.
+	std::fill(out.begin(), out.end(), ofVec3f::zero());
+	for (size_t k=0; k<m_i.size(); ++k) {
+		unsigned i = m_i[k], j = m_j[k];
+		ofVec3f d = j==NONE ? y[i] : y[i]-y[j];
+		ofVec3f w = d*m_beta[k] + m_u[k]*((m_alpha[k]-m_beta[k])*m_u[k].dot(d));
+		out[i] += w;
+		if (j!=NONE) out[j] -= w;
+	}
+}
+
+
+void ImplicitIntegrator::multiply(const vector<ofVec3f>& y, vector<ofVec3f>& out, float dt2) const {
+
+	// out = (M - dt^2 K) y, rows of fixed particles are zeroed.
+	stiffness(y, out);
+	for (size_t k=0; k<y.size(); ++k) {
+		out[k] = m_mass[k]>0.0f ? y[k]*m_mass[k] + out[k]*dt2 : ofVec3f::zero();
+	}
+}
+
+
+float ImplicitIntegrator::dot(const vector<ofVec3f>& a, const vector<ofVec3f>& b) const {
+	// fixed reduction tree, the same result if the CG loop is ever split over threads
+	return (float) fixedSum<double>(a.size(), [&a, &b](size_t k) { return (double) a[k].dot(b[k]); });
+}
+
+
+void ImplicitIntegrator::integrate(ParticleRegistry& particles, SpringNetwork& springs, float dt) {
+
+	ASSERT(dt > 0.0f, "Expected a non-zero time step in ImplicitIntegrator::integrate");
+	YAMPE_TRACE_SCOPE("ImplicitIntegrator::integrate");
+
+	const size_t n = particles.size();
+	const float dt2 = dt*dt;
+
+	springs.applyForce(particles, dt);
+	linearise(particles, springs);
+
+	m_b.resize(n);
+	m_r.resize(n);
+	m_z.resize(n);
+	m_p.resize(n);
+	m_Ap.resize(n);
+	m_diagonal.assign(n, ofVec3f::zero());
+	if (m_deltaV.size()!=n) m_deltaV.assign(n, ofVec3f::zero());
+
+	// Right hand side dt*(f + M a) - dt^2*S v, with f holding all applied forces.
+	stiffness(m_velocity, m_b);
+	for (size_t k=0; k<n; ++k) {
+		const Particle::Ref& p = particles[k];
+		if (m_mass[k]>0.0f) {
+			m_b[k] = (p->accumulatedForce() + p->acceleration*m_mass[k])*dt - m_b[k]*dt2;
+		} else {
+			m_b[k] = ofVec3f::zero();
+			m_deltaV[k] = ofVec3f::zero();
+		}
+	}
+
+	// Jacobi preconditioner, the diagonal of M + dt^2 S.
+	for (size_t k=0; k<m_i.size(); ++k) {
+		ofVec3f u2 = m_u[k]*m_u[k];
+		ofVec3f d = ofVec3f(m_beta[k], m_beta[k], m_beta[k]) + u2*(m_alpha[k]-m_beta[k]);
+		m_diagonal[m_i[k]] += d;
+		if (m_j[k]!=NONE) m_diagonal[m_j[k]] += d;
+	}
+	for (size_t k=0; k<n; ++k) {
+		if (m_mass[k]>0.0f) {
+			ofVec3f& d = m_diagonal[k];
+			d = ofVec3f(1.0f/(m_mass[k]+dt2*d.x), 1.0f/(m_mass[k]+dt2*d.y), 1.0f/(m_mass[k]+dt2*d.z));
+		} else {
+			m_diagonal[k] = ofVec3f::zero();
+		}
+	}
+
+	// Preconditioned conjugate gradients, warm started from the last solution.
+	float bNorm = std::sqrt(dot(m_b, m_b));
+	multiply(m_deltaV, m_Ap, dt2);
+	for (size_t k=0; k<n; ++k) {
+		m_r[k] = m_b[k] - m_Ap[k];
+		m_z[k] = m_r[k]*m_diagonal[k];
+		m_p[k] = m_z[k];
+	}
+	float rz = dot(m_r, m_z);
+	residual = bNorm>0.0f ? std::sqrt(dot(m_r, m_r))/bNorm : 0.0f;
+
+	for (iterationUsed=0; iterationUsed<maxIterations && residual>tolerance; ++iterationUsed) {
+		multiply(m_p, m_Ap, dt2);
+		float pAp = dot(m_p, m_Ap);
+		if (pAp<=0.0f) break;
+		float alpha = rz/pAp;
+		for (size_t k=0; k<n; ++k) {
+			m_deltaV[k] += m_p[k]*alpha;
+			m_r[k] -= m_Ap[k]*alpha;
+			m_z[k] = m_r[k]*m_diagonal[k];
+		}
+		float rzNext = dot(m_r, m_z);
+		float beta = rzNext/rz;
+		rz = rzNext;
+		for (size_t k=0; k<n; ++k) m_p[k] = m_z[k] + m_p[k]*beta;
+		residual = std::sqrt(dot(m_r, m_r))/bNorm;
+	}
+
+	// Update as Particle::integrate does, with the implicit velocity change.
+	for (size_t k=0; k<n; ++k) {
+		Particle::Ref& p = particles[k];
+		if (m_mass[k]>0.0f) {
+			p->velocity += m_deltaV[k];
+			p->velocity *= pow(p->damping(), dt);
+			p->position += dt*p->velocity;
+		}
+		p->force = p->accumulatedForce();
+		p->clearForce();
+	}
+}
+
+
+const String ImplicitIntegrator::toString() const {
+	std::ostringstream outs;
+	outs <<"maxIterations = " <<maxIterations <<"    "
+		<<"tolerance = " <<tolerance <<"    "
+		<<"iterationUsed = " <<iterationUsed <<"    "
+		<<"residual = " <<residual;
+	return outs.str();
+}
+
+} }	// namespace YAMPE::P
@@ -0,0 +1,81 @@
+/**
+	@file 		ImplicitIntegrator.h
+	@author		dgaffney
+	@practical
+	@brief		Backward Euler integration of particles joined by stiff springs.
+	*/
+
+#ifndef PARTICLE_IMPLICIT_INTEGRATOR_H
+#define PARTICLE_IMPLICIT_INTEGRATOR_H
+
+#include "SpringNetwork.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class ImplicitIntegrator
+
+	Alternative to calling Particle::integrate on each particle when the
+	particles are joined by stiff springs. The spring forces of a
+	SpringNetwork are linearised about the current positions and one step
+	of backward Euler is taken (Baraff and Witkin, Large Steps in Cloth
+	Simulation):
+
+		(M - dt^2 K) dv = dt (f + dt K v)
+
+	where K is the spring force Jacobian. Every other force already applied
+	to the particles (e.g. by a ForceGeneratorRegistry) is taken explicitly.
+
+	The system is solved by Jacobi preconditioned conjugate gradients without
+	assembling a matrix: K y is evaluated spring by spring. Each solve starts
+	from the previous step's dv, which is usually close. Compressed springs
+	keep only their axial stiffness so that the system stays positive definite.
+
+	Particles with infinite mass are not moved.
+	*/
+class ImplicitIntegrator : public Printable {
+
+public:
+
+	typedef ofPtr<ImplicitIntegrator> Ref;
+
+	unsigned maxIterations;			///< conjugate gradient iteration limit.
+	float tolerance;				///< relative residual at which CG stops.
+
+	unsigned iterationUsed;			///< iterations used by the last step.
+	float residual;					///< relative residual after the last step.
+
+	ImplicitIntegrator(unsigned maxIterations=100, float tolerance=1.0e-5f,
+		const String label="ImplicitIntegrator");
+
+	/**	Applies the spring forces of the network and advances all particles
+		by dt, clearing their forces (as Particle::integrate does).
+		*/
+	void integrate(ParticleRegistry& particles, SpringNetwork& springs, float dt);
+
+	const String toString() const;
+
+protected:
+
+	static const unsigned NONE = ~0u;
+
+	// per particle
+	vector<float> m_mass;				///< zero for particles that are not moved.
+	vector<ofVec3f> m_velocity;
+	vector<ofVec3f> m_deltaV;			///< solution, kept to warm start the next step.
+	vector<ofVec3f> m_b, m_r, m_z, m_p, m_Ap, m_diagonal;
+
+	// per spring, stiffness S = beta*I + (alpha-beta)*u*u^T
+	vector<unsigned> m_i, m_j;
+	vector<ofVec3f> m_u;
+	vector<float> m_alpha, m_beta;
+
+	void linearise(const ParticleRegistry& particles, const SpringNetwork& springs);
+	void multiply(const vector<ofVec3f>& y, vector<ofVec3f>& out, float dt2) const;
+	void stiffness(const vector<ofVec3f>& y, vector<ofVec3f>& out) const;
+	float dot(const vector<ofVec3f>& a, const vector<ofVec3f>& b) const;
+};
+
+} } // namespace YAMPE P
+
+#endif
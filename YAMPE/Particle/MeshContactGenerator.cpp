@@ -0,0 +1,432 @@
+/**
+	@file 		MeshContactGenerator.cpp
+	@author		dgaffney
+	@practical
+	@brief		Contacts between particles and static triangle mesh scenery.
+	*/
+
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+
+#include "MeshContactGenerator.h"
+
+namespace YAMPE { namespace P {
+
+namespace {
+
+	inline ofVec3f minimum(const ofVec3f& a, const ofVec3f& b) {
+		return ofVec3f(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+	}
+
+	inline ofVec3f maximum(const ofVec3f& a, const ofVec3f& b) {
+		return ofVec3f(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+	}
+
+	inline float halfArea(const ofVec3f& lower, const ofVec3f& upper) {
+		ofVec3f d = upper - lower;
+		return d.x*d.y + d.y*d.z + d.z*d.x;
+	}
+
+	/// Accumulates bounds, starts empty.
+	struct Box {
+		ofVec3f lower, upper;
+		unsigned count;
+
+		Box() : lower(FLT_MAX, FLT_MAX, FLT_MAX), upper(-FLT_MAX, -FLT_MAX, -FLT_MAX), count(0) { }
+		void grow(const ofVec3f& p) { lower = minimum(lower, p); upper = maximum(upper, p); }
+		void grow(const Box& b) { lower = minimum(lower, b.lower); upper = maximum(upper, b.upper); count += b.count; }
+		float area() const { return count>0 ? halfArea(lower, upper) : 0.0f; }
+	};
+
+}	// namespace
+
+
+// --------------------------------------------------------
+
+
+void TriangleBVH::clear() {
+	vertices.clear();
+	triangles.clear();
+	normals.clear();
+	order.clear();
+	nodes.clear();
+}
+
+
+void TriangleBVH::addTriangle(unsigned a, unsigned b, unsigned c) {
+
+	// Skip degenerate triangles (e.g. the joins of triangle strips).
+	const ofVec3f& pa = vertices[a];
+	if ((vertices[b]-pa).getCrossed(vertices[c]-pa).lengthSquared()<=0.0f) return;
+	triangles.push_back(a);
+	triangles.push_back(b);
+	triangles.push_back(c);
+}
+
+
+void TriangleBVH::build() {
+
+	const unsigned n = (unsigned) numTriangles();
+	order.resize(n);
+	m_centroids.resize(n);
+	normals.resize(n);
+	for (unsigned t=0; t<n; ++t) {
+		const ofVec3f& a = vertices[triangles[3*t]];
+		const ofVec3f& b = vertices[triangles[3*t+1]];
+		const ofVec3f& c = vertices[triangles[3*t+2]];
+		order[t] = t;
+		m_centroids[t] = (a+b+c)/3.0f;
+		normals[t] = (b-a).getCrossed(c-a).normalized();
+	}
+
+	nodes.clear();
+	if (n>0) {
+		nodes.reserve(2*n/MAX_LEAF_SIZE+1);
+		buildNode(0, n, 0);
+	}
+	m_centroids.clear();
+}
+
+
+void TriangleBVH::bounds(unsigned first, unsigned count, ofVec3f& lower, ofVec3f& upper) const {
+	Box box;
+	for (unsigned k=first; k<first+count; ++k) {
+		unsigned t = order[k];
+		box.grow(vertices[triangles[3*t]]);
+		box.grow(vertices[triangles[3*t+1]]);
+		box.grow(vertices[triangles[3*t+2]]);
+	}
+	lower = box.lower;
+	upper = box.upper;
+}
+
+
+unsigned TriangleBVH::buildNode(unsigned first, unsigned count, unsigned depth) {
+
+	unsigned index = (unsigned) nodes.size();
+	nodes.push_back(Node());
+	Node node;
+	bounds(first, count, node.lower, node.upper);
+	node.right = 0;
+	node.first = first;
+	node.count = count;
+
+	// Bin centroids along each axis and pick the split with the lowest SAH cost.
+	Box centroidBox;
+	for (unsigned k=first; k<first+count; ++k) centroidBox.grow(m_centroids[order[k]]);
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	unsigned bestBin = 0;
+	if (count>MAX_LEAF_SIZE && depth<64) {
+		for (int axis=0; axis<3; ++axis) {
+			float lo = centroidBox.lower[axis];
+			float extent = centroidBox.upper[axis] - lo;
+			if (extent<=0.0f) continue;
+
+			Box bins[NUM_BINS];
+			for (unsigned k=first; k<first+count; ++k) {
+				unsigned t = order[k];
+				unsigned bin = std::min(NUM_BINS-1, (unsigned) (NUM_BINS*(m_centroids[t][axis]-lo)/extent));
+				bins[bin].grow(vertices[triangles[3*t]]);
+				bins[bin].grow(vertices[triangles[3*t+1]]);
+				bins[bin].grow(vertices[triangles[3*t+2]]);
+				bins[bin].count++;
+			}
+
+			// Sweep from the right to get suffix areas, then from the left.
+			float rightArea[NUM_BINS];
+			unsigned rightCount[NUM_BINS];
+			Box right;
+			for (unsigned b=NUM_BINS-1; b>0; --b) {
+				right.grow(bins[b]);
+				rightArea[b] = right.area();
+				rightCount[b] = right.count;
+			}
+			Box left;
+			for (unsigned b=1; b<NUM_BINS; ++b) {
+				left.grow(bins[b-1]);
+				if (left.count==0 || rightCount[b]==0) continue;
+				float cost = left.area()*left.count + rightArea[b]*rightCount[b];
+				if (cost<bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+	}
+
+	// Split only if cheaper than testing every triangle in a leaf.
+	float leafCost = halfArea(node.lower, node.upper)*count;
+	if (bestAxis<0 || bestCost>=leafCost) {
+		nodes[index] = node;
+		return index;
+	}
+
+	float lo = centroidBox.lower[bestAxis];
+	float extent = centroidBox.upper[bestAxis] - lo;
+	unsigned* begin = &order[first];
+	unsigned* middle = std::partition(begin, begin+count, [&](unsigned t) {
+		return std::min(NUM_BINS-1, (unsigned) (NUM_BINS*(m_centroids[t][bestAxis]-lo)/extent)) < bestBin;
+	});
+	unsigned leftCount = (unsigned) (middle-begin);
+
+	node.count = 0;
+	nodes[index] = node;
+	buildNode(first, leftCount, depth+1);
+	unsigned right = buildNode(first+leftCount, count-leftCount, depth+1);
+	nodes[index].right = right;
+	return index;
+}
+
+
+unsigned TriangleBVH::depth() const {
+	if (nodes.empty()) return 0;
+	unsigned maxDepth = 0;
+	vector<std::pair<unsigned, unsigned> > stack(1, std::make_pair(0u, 1u));
+	while (!stack.empty()) {
+		std::pair<unsigned, unsigned> top = stack.back();
+		stack.pop_back();
+		maxDepth = std::max(maxDepth, top.second);
+		if (nodes[top.first].count==0) {
+			stack.push_back(std::make_pair(top.first+1, top.second+1));
+			stack.push_back(std::make_pair(nodes[top.first].right, top.second+1));
+		}
+	}
+	return maxDepth;
+}
+
+
+bool TriangleBVH::overlaps(const Node& node, const ofVec3f& centre, float radius) {
+	float d2 = 0.0f;
+	for (int k=0; k<3; ++k) {
+		float v = centre[k];
+		if (v<node.lower[k]) d2 += (node.lower[k]-v)*(node.lower[k]-v);
+		else if (v>node.upper[k]) d2 += (v-node.upper[k])*(v-node.upper[k]);
+	}
+	return d2<=radius*radius;
+}
+
+
+ofVec3f TriangleBVH::closestPoint(unsigned t, const ofVec3f& p) const {
+
+	const ofVec3f& a = vertices[triangles[3*t]];
+	const ofVec3f& b = vertices[triangles[3*t+1]];
+	const ofVec3f& c = vertices[triangles[3*t+2]];
+
+	ofVec3f ab = b-a, ac = c-a, ap = p-a;
+	float d1 = ab.dot(ap), d2 = ac.dot(ap);
+	if (d1<=0.0f && d2<=0.0f) return a;
+
+	ofVec3f bp = p-b;
+	float d3 = ab.dot(bp), d4 = ac.dot(bp);
+	if (d3>=0.0f && d4<=d3) return b;
+
+	float vc = d1*d4 - d3*d2;
+	if (vc<=0.0f && d1>=0.0f && d3<=0.0f) return a + ab*(d1/(d1-d3));
+
+	ofVec3f cp = p-c;
+	float d5 = ab.dot(cp), d6 = ac.dot(cp);
+	if (d6>=0.0f && d5<=d6) return c;
+
+	float vb = d5*d2 - d1*d6;
+	if (vb<=0.0f && d2>=0.0f && d6<=0.0f) return a + ac*(d2/(d2-d6));
+
+	float va = d3*d6 - d5*d4;
+	if (va<=0.0f && (d4-d3)>=0.0f && (d5-d6)>=0.0f) return b + (c-b)*((d4-d3)/((d4-d3)+(d5-d6)));
+
+	float denominator = 1.0f/(va+vb+vc);
+	return a + ab*(vb*denominator) + ac*(vc*denominator);
+}
+
+
+// --------------------------------------------------------
+
+
+const float MeshContactGenerator::MERGE_COSINE = 0.9f;
+
+
+void MeshContactGenerator::setMesh(const ofMesh& mesh, const ofMatrix4x4& transform) {
+
+	bvh.clear();
+	for (auto && v: mesh.getVertices()) bvh.vertices.push_back(ofVec3f(v)*transform);
+
+	unsigned n = (unsigned) (mesh.hasIndices() ? mesh.getNumIndices() : mesh.getNumVertices());
+	auto index = [&mesh](unsigned k) { return mesh.hasIndices() ? (unsigned) mesh.getIndex(k) : k; };
+
+	switch (mesh.getMode()) {
+		case OF_PRIMITIVE_TRIANGLES:
+			for (unsigned k=0; k+2<n; k+=3) bvh.addTriangle(index(k), index(k+1), index(k+2));
+			break;
+		case OF_PRIMITIVE_TRIANGLE_STRIP:
+			for (unsigned k=0; k+2<n; ++k) {
+				if (k%2==0) bvh.addTriangle(index(k), index(k+1), index(k+2));
+				else bvh.addTriangle(index(k+1), index(k), index(k+2));
+			}
+			break;
+		default:
+			ofLog(OF_LOG_WARNING, "[MeshContactGenerator::setMesh] Unsupported primitive mode, mesh ignored.\n");
+			break;
+	}
+	bvh.build();
+}
+
+
+bool MeshContactGenerator::loadObj(const String& path, const ofMatrix4x4& transform) {
+
+	std::ifstream in(path.c_str());
+	if (!in) return false;
+
+	// parsed aside, so a bad file leaves the scenery as it was
+	TriangleBVH parsed;
+	String line;
+	vector<unsigned> face;
+	while (std::getline(in, line)) {
+		std::istringstream tokens(line);
+		String tag;
+		tokens >>tag;
+		if (tag=="v") {
+			ofVec3f v;
+			if (!(tokens >>v.x >>v.y >>v.z)) return false;
+			parsed.vertices.push_back(v*transform);
+		} else if (tag=="f") {
+			// Faces are v, v/vt, v//vn or v/vt/vn with 1 based (or negative relative) indices.
+			face.clear();
+			String vertex;
+			while (tokens >>vertex) {
+				int k = atoi(vertex.c_str());
+				if (k<0) k += (int) parsed.vertices.size()+1;
+				if (k<1 || k>(int) parsed.vertices.size()) return false;
+				face.push_back((unsigned) k-1);
+			}
+			for (size_t k=1; k+1<face.size(); ++k) parsed.addTriangle(face[0], face[k], face[k+1]);
+		}
+	}
+	if (in.bad()) return false;
+	parsed.build();
+	bvh = std::move(parsed);
+	return true;
+}
+
+
+// --------------------------------------------------------
+
+
+void MeshContactGenerator::generate(ContactRegistry::Ref contactRegistry) {
+	generateRange(contactRegistry, 0, particles.size());
+}
+
+
+void MeshContactGenerator::generate(ContactRegistry::Ref contactRegistry, unsigned chunk, unsigned numChunks) {
+	size_t n = particles.size();
+	generateRange(contactRegistry, n*chunk/numChunks, n*(chunk+1)/numChunks);
+}
+
+
+bool MeshContactGenerator::touches(unsigned t, const ofVec3f& centre, const ofVec3f& previous, float radius, Hit& hit) const {
+
+	// signed distances of the centre from the face plane, now and before the step
+	const ofVec3f& normal = bvh.normals[t];
+	const ofVec3f& vertex = bvh.vertices[bvh.triangles[3*t]];
+	float now = (centre-vertex).dot(normal);
+	float before = (previous-vertex).dot(normal);
+	hit.triangle = t;
+
+	// Crossed the face from the front during the step, however deep it is now.
+	if (before>=0.0f && now<0.0f) {
+		ofVec3f crossing = previous + (centre-previous)*(before/(before-now));
+		if ((bvh.closestPoint(t, crossing)-crossing).lengthSquared()<radius*radius) {
+			hit.normal = normal;
+			hit.penetration = radius - now;
+			return true;
+		}
+	}
+
+	ofVec3f closest = bvh.closestPoint(t, centre);
+	ofVec3f d = centre - closest;
+	float distance2 = d.lengthSquared();
+	if (distance2>=radius*radius) return false;
+
+	float distance = std::sqrt(distance2);
+	if (now<0.0f && (d - now*normal).lengthSquared()<=EPS*EPS) {
+		// Centre behind the face (over its interior), out through the front.
+		hit.normal = normal;
+		hit.penetration = radius - now;
+	} else if (distance>EPS) {
+		// In front of the face, or beside an edge or vertex.
+		hit.normal = d/distance;
+		hit.penetration = radius - distance;
+	} else {
+		// Centre on the surface, push out along the face normal.
+		hit.normal = normal;
+		hit.penetration = radius;
+	}
+	return true;
+}
+
+
+void MeshContactGenerator::generateRange(ContactRegistry::Ref contactRegistry, size_t begin, size_t end) const {
+
+	if (bvh.nodes.empty()) return;
+
+	// per thread scratch, so repeated steps do not allocate
+	static thread_local vector<unsigned> stack;
+	static thread_local vector<Hit> hits;
+
+	const TriangleBVH::Node& root = bvh.nodes[0];
+	for (size_t k=begin; k<end; ++k) {
+		const Particle::Ref& p = particles[k];
+		const ofVec3f& centre = p->position;
+		const float radius = p->radius;
+
+		// the motion of the step, bounded by a sphere
+		ofVec3f previous = centre - sweepDt*p->velocity;
+		ofVec3f middle = 0.5f*(centre+previous);
+		float reach = radius + 0.5f*(centre-previous).length();
+
+		// Most particles are nowhere near the scenery.
+		ofVec3f lower = root.lower - ofVec3f(reach, reach, reach);
+		ofVec3f upper = root.upper + ofVec3f(reach, reach, reach);
+		if (middle.x<lower.x || middle.y<lower.y || middle.z<lower.z
+			|| middle.x>upper.x || middle.y>upper.y || middle.z>upper.z) continue;
+
+		hits.clear();
+		bvh.query(middle, reach, stack, [&](unsigned t) {
+			Hit hit;
+			if (!touches(t, centre, previous, radius, hit)) return;
+
+			// Merge with a near parallel hit (neighbouring triangles of one surface).
+			for (auto && other: hits) {
+				if (other.normal.dot(hit.normal)>MERGE_COSINE) {
+					if (hit.penetration>other.penetration) other = hit;
+					return;
+				}
+			}
+			hits.push_back(hit);
+		});
+
+		for (auto && hit: hits) {
+			Contact::Ref contact = contactRegistry->acquire("MeshContactGenerator");
+			contact->contactNormal = hit.normal;
+			contact->a = p;
+			contact->b = Particle::Ref();
+			contact->penetration = hit.penetration;
+			contact->restitution = restitution;
+			contactRegistry->append(contact);
+		}
+	}
+}
+
+
+const String MeshContactGenerator::toString() const {
+	std::ostringstream outs;
+	outs <<"triangles = " <<bvh.numTriangles() <<"    "
+		<<"nodes = " <<bvh.nodes.size() <<"    "
+		<<"depth = " <<bvh.depth() <<"    "
+		<<"restitution = " <<restitution;
+	return outs.str();
+}
+
+} }	// namespace YAMPE::P
@@ -0,0 +1,154 @@
+/**
+	@file 		MeshContactGenerator.h
+	@author		dgaffney
+	@practical
+	@brief		Contacts between particles and static triangle mesh scenery.
+	*/
+
+#ifndef PARTICLE_MESH_CONTACT_GENERATOR_H
+#define PARTICLE_MESH_CONTACT_GENERATOR_H
+
+#include "ContactGenerators.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class TriangleBVH
+
+	Bounding volume hierarchy over a static triangle soup, built top down with
+	the surface area heuristic (binned). Nodes are stored depth first in one
+	array; an interior node's left child follows it directly and the right
+	child is at index right.
+	*/
+class TriangleBVH {
+
+public:
+
+	struct Node {
+		ofVec3f lower, upper;		///< node bounds.
+		unsigned right;				///< interior: index of right child.
+		unsigned first;				///< leaf: first entry in triangle order.
+		unsigned count;				///< leaf: number of triangles, zero for interior nodes.
+	};
+
+	static const unsigned MAX_LEAF_SIZE = 4;
+	static const unsigned NUM_BINS = 12;
+
+	vector<ofVec3f> vertices;
+	vector<unsigned> triangles;		///< three vertex indices per triangle.
+	vector<ofVec3f> normals;		///< unit face normal per triangle.
+	vector<unsigned> order;			///< triangle indices in leaf order.
+	vector<Node> nodes;
+
+	void clear();
+	void build();
+
+	/// Appends the triangle of vertices a, b and c, unless it is degenerate.
+	void addTriangle(unsigned a, unsigned b, unsigned c);
+
+	size_t numTriangles() const { return triangles.size()/3; }
+	unsigned depth() const;
+
+	/**
+		Calls visit(triangle) for every triangle whose leaf bounds overlap the
+		sphere. The stack is supplied by the caller so repeated queries do not
+		allocate.
+		*/
+	template <typename F>
+	void query(const ofVec3f& centre, float radius, vector<unsigned>& stack, F visit) const {
+		if (nodes.empty()) return;
+		stack.clear();
+		stack.push_back(0);
+		while (!stack.empty()) {
+			unsigned index = stack.back();
+			stack.pop_back();
+			const Node& node = nodes[index];
+			if (!overlaps(node, centre, radius)) continue;
+			if (node.count>0) {
+				for (unsigned k=node.first; k<node.first+node.count; ++k) visit(order[k]);
+			} else {
+				stack.push_back(node.right);
+				stack.push_back(index+1);
+			}
+		}
+	}
+
+	/// Closest point on triangle t to p (Ericson, Real-Time Collision Detection 5.1.5).
+	ofVec3f closestPoint(unsigned t, const ofVec3f& p) const;
+
+protected:
+
+	static bool overlaps(const Node& node, const ofVec3f& centre, float radius);
+	unsigned buildNode(unsigned first, unsigned count, unsigned depth);
+	void bounds(unsigned first, unsigned count, ofVec3f& lower, ofVec3f& upper) const;
+
+	vector<ofVec3f> m_centroids;
+};
+
+
+// --------------------------------------------------------
+
+
+/**
+	\class MeshContactGenerator
+
+	Generates contacts between the registered particles and a static triangle
+	mesh, e.g. a cradle frame or an uneven floor. Candidate triangles come
+	from a TriangleBVH and each is tested exactly (sphere against closest
+	point on triangle). Contacts of one particle whose normals are within
+	about 25 degrees (e.g. from neighbouring triangles of a floor) are merged,
+	keeping the deepest.
+
+	Faces are one sided: the front is the side the vertices wind counter
+	clockwise around (the face normal, as in OBJ files). A particle whose
+	centre is behind a face, over its interior, is penetrating it and is
+	pushed out through the front by the whole depth. With sweepDt set,
+	each particle's motion over the step (back along its velocity) is
+	tested too, so one that crossed a face within the step gets that
+	contact however far it went, rather than tunnelling.
+	*/
+class MeshContactGenerator : public ContactGenerator {
+
+public:
+
+	typedef ofPtr<MeshContactGenerator> Ref;
+
+	static const float MERGE_COSINE;	///< hits with normals closer than this are merged.
+
+	ParticleRegistry particles;
+	TriangleBVH bvh;
+	float restitution;
+	float sweepDt;						///< at least the step the particles were last integrated with, 0 to test positions only.
+
+	MeshContactGenerator(const String label="MeshContactGenerator")
+		: ContactGenerator(label), restitution(1.0f), sweepDt(0.0f) {};
+
+	/// Replaces the scenery by the triangles of the mesh, transformed to world space.
+	void setMesh(const ofMesh& mesh, const ofMatrix4x4& transform=ofMatrix4x4());
+
+	/// Replaces the scenery by the faces of a Wavefront OBJ file. Returns false on failure, keeping the scenery.
+	bool loadObj(const String& path, const ofMatrix4x4& transform=ofMatrix4x4());
+
+	void generate(ContactRegistry::Ref contactRegistry);
+
+	/// Generates the contacts of one chunk of the particles (see ParallelContactGenerator).
+	void generate(ContactRegistry::Ref contactRegistry, unsigned chunk, unsigned numChunks);
+
+	const String toString() const;
+
+protected:
+
+	struct Hit {
+		unsigned triangle;
+		ofVec3f normal;
+		float penetration;
+	};
+
+	/// Tests a particle, now at centre and at previous before the step, against triangle t.
+	bool touches(unsigned t, const ofVec3f& centre, const ofVec3f& previous, float radius, Hit& hit) const;
+	void generateRange(ContactRegistry::Ref contactRegistry, size_t begin, size_t end) const;
+};
+
+} } // namespace YAMPE P
+
+#endif
@@ -0,0 +1,155 @@
+/**
+	@file 		MortonOrder.cpp
+	@author		dgaffney
+	@practical
+	@brief		Periodic re-sorting of particle storage along a Z-order (Morton) curve.
+	*/
+
+#include <algorithm>
+#include <functional>
+
+#include "MortonOrder.h"
+
+namespace YAMPE { namespace P {
+
+namespace {
+
+	/// Default checkInterval, disorder grows over many steps so a few steps late costs little.
+	const unsigned CHECK_INTERVAL = 8;
+
+	/// Spreads the low 10 bits of v to every third bit.
+	inline uint32_t spread(uint32_t v) {
+		v &= 0x3ff;
+		v = (v | (v<<16)) & 0x030000ff;
+		v = (v | (v<<8)) & 0x0300f00f;
+		v = (v | (v<<4)) & 0x030c30c3;
+		v = (v | (v<<2)) & 0x09249249;
+		return v;
+	}
+
+	inline bool byAddress(const Particle::Ref& a, const Particle::Ref& b) {
+		return std::less<const Particle*>()(a.get(), b.get());
+	}
+
+}
+
+
+MortonOrder::MortonOrder(unsigned interval, float threshold, const String label) :
+	Printable(label),
+	interval(interval),
+	threshold(threshold),
+	checkInterval(CHECK_INTERVAL),
+	m_steps(0),
+	m_numReorders(0),
+	m_lastDisorder(0.0f)
+{ }
+
+
+uint32_t MortonOrder::code(unsigned x, unsigned y, unsigned z) {
+	return spread(x) | (spread(y)<<1) | (spread(z)<<2);
+}
+
+
+void MortonOrder::computeKeys(const ParticleRegistry& particles) {
+	size_t n = particles.size();
+	m_keys.resize(n);
+	if (n==0) return;
+
+	ofVec3f lower = particles[0]->position, upper = lower;
+	for (auto && p: particles) {
+		lower.set(std::min(lower.x, p->position.x), std::min(lower.y, p->position.y), std::min(lower.z, p->position.z));
+		upper.set(std::max(upper.x, p->position.x), std::max(upper.y, p->position.y), std::max(upper.z, p->position.z));
+	}
+	// one scale for all axes, so cells are cubes
+	float extent = std::max(upper.x-lower.x, std::max(upper.y-lower.y, upper.z-lower.z));
+	float scale = extent>0.0f ? 1023.0f/extent : 0.0f;
+
+	for (size_t k=0; k<n; ++k) {
+		ofVec3f q = (particles[k]->position-lower)*scale;
+		uint32_t c = code((unsigned) q.x, (unsigned) q.y, (unsigned) q.z);
+		m_keys[k] = (uint64_t(c)<<32) | k;
+	}
+}
+
+
+float MortonOrder::disorder(const ParticleRegistry& particles) {
+	computeKeys(particles);
+	if (m_keys.size()<2) return 0.0f;
+	size_t count = 0;
+	for (size_t k=1; k<m_keys.size(); ++k) {
+		if ((m_keys[k]>>32) < (m_keys[k-1]>>32)) ++count;
+	}
+	return (float) count/(float) (m_keys.size()-1);
+}
+
+
+bool MortonOrder::isDue(const ParticleRegistry& particles) {
+	++m_steps;
+	if (interval>0 && m_steps>=interval) return true;
+	if (threshold>1.0f || (checkInterval>1 && m_steps%checkInterval!=0)) return false;
+	m_lastDisorder = disorder(particles);
+	return m_lastDisorder>=threshold;
+}
+
+
+void MortonOrder::reorder(ParticleRegistry& particles) {
+
+	size_t n = particles.size();
+	m_steps = 0;
+	++m_numReorders;
+
+	// new order by code, ties in the old order
+	computeKeys(particles);
+	std::sort(m_keys.begin(), m_keys.end());
+	m_rank.resize(n);
+	for (size_t k=0; k<n; ++k) m_rank[(unsigned) m_keys[k]] = (unsigned) k;
+
+	// the objects in address order, and which particle each held
+	m_slots = particles;
+	std::sort(m_slots.begin(), m_slots.end(), byAddress);
+	m_slotIndex.resize(n);
+	for (size_t k=0; k<n; ++k) {
+		size_t slot = std::lower_bound(m_slots.begin(), m_slots.end(), particles[k], byAddress) - m_slots.begin();
+		m_slotIndex[slot] = (unsigned) k;
+	}
+
+	// particle of new index k (old index m_keys[k]) moves into slot k
+	m_scratch.resize(n);
+	for (size_t k=0; k<n; ++k) m_scratch[k] = *particles[(unsigned) m_keys[k]];
+	for (size_t k=0; k<n; ++k) *m_slots[k] = m_scratch[k];
+	particles = m_slots;
+	m_lastDisorder = 0.0f;
+}
+
+
+Particle::Ref MortonOrder::remap(const Particle::Ref& particle) const {
+	if (!particle) return particle;
+	auto it = std::lower_bound(m_slots.begin(), m_slots.end(), particle, byAddress);
+	if (it==m_slots.end() || it->get()!=particle.get()) return particle;
+	return m_slots[m_rank[m_slotIndex[it-m_slots.begin()]]];
+}
+
+
+void MortonOrder::remap(ParticleRegistry& particles) const {
+	for (auto && p: particles) p = remap(p);
+}
+
+
+void MortonOrder::clear() {
+	m_slots.clear();
+	m_slotIndex.clear();
+	m_rank.clear();
+	m_steps = 0;
+}
+
+
+const String MortonOrder::toString() const {
+	std::ostringstream outs;
+	outs <<"interval = " <<interval <<"    "
+		<<"threshold = " <<threshold <<"    "
+		<<"reorders = " <<m_numReorders <<"    "
+		<<"disorder = " <<m_lastDisorder;
+	return outs.str();
+}
+
+} } // namespace YAMPE P
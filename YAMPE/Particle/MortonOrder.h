@@ -0,0 +1,109 @@
+/**
+	@file 		MortonOrder.h
+	@author		dgaffney
+	@practical
+	@brief		Periodic re-sorting of particle storage along a Z-order (Morton) curve.
+	*/
+
+#ifndef PARTICLE_MORTON_ORDER_H
+#define PARTICLE_MORTON_ORDER_H
+
+#include "../Particle.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class MortonOrder
+
+	Keeps particles that are close in space close in memory and in index.
+	reorder() sorts the particles by the Morton code of their position
+	(10 bits per axis over the bounding cube) and moves their state so that
+	the k-th particle in that order lives in the k-th lowest addressed
+	particle object, which registry[k] then refers to. For particles
+	allocated as one block (Scene) the registry and the memory are then
+	both in Z-order, otherwise memory follows as far as the allocation
+	order allows.
+
+	Particles of a ParticlePool must not be reordered: the pool keeps
+	state per particle object (lifetime left, positions in its live list
+	and attached registries) that would stay behind when the particle's
+	state moves to another object. Keep them in a registry of their own,
+	as ofApp keeps the fountain out of the scene's particles.
+
+	As the state moves between objects, everything naming a particle has
+	to follow it:
+	- index columns, through rank() (old index -> new index), e.g.
+	  ConstraintTable::remapParticles() and SpringNetwork::remapParticles(),
+	- Refs, through remap(), e.g. ForceGeneratorRegistry::remapParticles(),
+	  ContactRegistry::remapParticles(), CollisionFilter::remapParticles()
+	  and the particle lists of contact generators (remap(ParticleRegistry&)).
+	Refs held inside force generators (e.g. the other end of a
+	SpringForceGenerator) are not reachable and must not name reordered
+	particles.
+
+	isDue() counts steps and says when to reorder: every interval steps, or
+	when disorder() - the fraction of neighbouring registry entries whose
+	codes are out of order, 0 after a reorder and about one half for a
+	random order - has reached threshold. Measuring disorder costs a pass
+	over all particles, so it is measured only every checkInterval steps.
+	*/
+class MortonOrder : public Printable {
+
+public:
+
+	typedef ofPtr<MortonOrder> Ref;
+
+	unsigned interval;				///< steps between reorders, 0 for none on count alone.
+	float threshold;				///< disorder that triggers a reorder, above 1 for never.
+	unsigned checkInterval;			///< steps between disorder measurements, 1 (or 0) for every step.
+
+	MortonOrder(unsigned interval=0, float threshold=0.1f, const String label="MortonOrder");
+
+	/// Morton code of a point with coordinates in [0, 1024).
+	static uint32_t code(unsigned x, unsigned y, unsigned z);
+
+	/// Fraction of neighbouring particles out of Morton order.
+	float disorder(const ParticleRegistry& particles);
+
+	/// Counts a step, returns true if the particles should be reordered now.
+	bool isDue(const ParticleRegistry& particles);
+
+	/// Sorts the particles into Morton order, see the class notes for what must be remapped.
+	void reorder(ParticleRegistry& particles);
+
+	/// New index of each old index, from the last reorder.
+	const vector<unsigned>& rank() const { return m_rank; }
+
+	/// Object holding, since the last reorder, the particle that particle held; unknown particles are returned as is.
+	Particle::Ref remap(const Particle::Ref& particle) const;
+
+	/// Remaps every entry of a particle list.
+	void remap(ParticleRegistry& particles) const;
+
+	/// Releases the particles held since the last reorder (e.g. when the registry is rebuilt).
+	void clear();
+
+	unsigned numReorders() const { return m_numReorders; }
+	float lastDisorder() const { return m_lastDisorder; }
+
+	const String toString() const;
+
+protected:
+
+	unsigned m_steps;				///< steps since the last reorder.
+	unsigned m_numReorders;
+	float m_lastDisorder;
+
+	vector<uint64_t> m_keys;		///< code<<32 | index.
+	vector<unsigned> m_rank;
+	ParticleRegistry m_slots;		///< particle objects in address order.
+	vector<unsigned> m_slotIndex;	///< index, before the last reorder, of the particle each slot held.
+	vector<Particle> m_scratch;
+
+	/// Fills m_keys with the codes of the particles, unsorted.
+	void computeKeys(const ParticleRegistry& particles);
+};
+
+} } // namespace YAMPE P
+
+#endif
@@ -0,0 +1,281 @@
+/**
+	@file 		MultirateStepper.cpp
+	@author		dgaffney
+	@practical
+	@brief		Multirate time stepping: particles substepped at power-of-two levels by activity.
+	*/
+
+#include <algorithm>
+
+#include "../Trace.h"
+#include "MultirateStepper.h"
+
+namespace YAMPE { namespace P {
+
+MultirateStepper::MultirateStepper(unsigned maxLevel, const String label) :
+	Printable(label),
+	maxLevel(maxLevel),
+	contactLevel(maxLevel),
+	maxTravel(0.05f),
+	activeSpeed(0.05f),
+	holdSteps(4),
+	m_stamp(0),
+	m_deepestLevel(0),
+	m_now(0),
+	m_numIntegrations(0),
+	m_numPromotions(0),
+	m_generated(new ContactRegistry())
+{ }
+
+
+void MultirateStepper::clear() {
+	m_state.clear();
+	m_activePairs.clear();
+	for (unsigned k=0; k<=MAX_LEVEL; ++k) {
+		m_levels[k].clear();
+		m_levelStates[k].clear();
+	}
+	m_due.clear();
+	m_promoted.clear();
+	m_deepestLevel = m_now = 0;
+	m_numIntegrations = m_numPromotions = 0;
+}
+
+
+MultirateStepper::State* MultirateStepper::state(const Particle* particle) {
+	auto it = m_state.find(particle);
+	return it==m_state.end() || it->second.stamp!=m_stamp ? NULL : &it->second;
+}
+
+
+const MultirateStepper::State* MultirateStepper::state(const Particle* particle) const {
+	auto it = m_state.find(particle);
+	return it==m_state.end() || it->second.stamp!=m_stamp ? NULL : &it->second;
+}
+
+
+unsigned MultirateStepper::level(const Particle* particle) const {
+	const State* s = state(particle);
+	return s==NULL ? 0 : s->level;
+}
+
+
+bool MultirateStepper::isDue(const Particle* particle) const {
+	const State* s = state(particle);
+	return s==NULL ? m_now==numSubsteps() : s->synced==m_now;
+}
+
+
+unsigned MultirateStepper::find(unsigned k) {
+	while (m_parent[k]!=k) {
+		m_parent[k] = m_parent[m_parent[k]];
+		k = m_parent[k];
+	}
+	return k;
+}
+
+
+void MultirateStepper::classify(float dt) {
+
+	unsigned finest = std::min(maxLevel, MAX_LEVEL);
+	unsigned touched = std::min(contactLevel, finest);
+	++m_stamp;
+
+	// velocity, and the level held from previous steps
+	size_t n = particles.size();
+	m_parent.resize(n);
+	m_states.resize(n);
+	for (size_t k=0; k<n; ++k) {
+		const Particle& p = *particles[k];
+		State& state = m_state[&p];
+		state.index = (unsigned) k;
+		state.stamp = m_stamp;
+		m_states[k] = &state;
+		m_parent[k] = (unsigned) k;
+
+		unsigned level = state.level;
+		if (state.hold>0) --state.hold;
+		else if (level>0) {
+			--level;
+			state.hold = (uint8_t) std::min(holdSteps, 255u);
+		}
+		float travel = p.velocity.length()*dt/(maxTravel*(p.radius>0.0f ? p.radius : 1.0f));
+		unsigned moving = 0;
+		while (travel>1.0f && moving<finest) {
+			travel *= 0.5f;
+			++moving;
+		}
+		if (moving>level) {
+			level = moving;
+			state.hold = (uint8_t) std::min(holdSteps, 255u);
+		}
+		state.level = (uint8_t) std::min(level, finest);
+	}
+
+	// forget particles no longer stepped
+	if (m_state.size()>n) {
+		for (auto it = m_state.begin(); it!=m_state.end(); ) {
+			if (it->second.stamp!=m_stamp) it = m_state.erase(it);
+			else ++it;
+		}
+	}
+
+	// islands of active contacts go to (at least) contactLevel, all at the
+	// level of their finest member; m_islandLevel holds level+1, 0 if inactive
+	m_activeIndices.clear();
+	for (auto && pair: m_activePairs) {
+		auto a = m_state.find(pair.first), b = m_state.find(pair.second);
+		if (a==m_state.end() || b==m_state.end()) continue;
+		unsigned ra = find(a->second.index), rb = find(b->second.index);
+		if (ra!=rb) m_parent[std::max(ra, rb)] = std::min(ra, rb);
+		m_activeIndices.push_back(a->second.index);
+	}
+	m_activePairs.clear();
+	m_islandLevel.assign(n, 0);
+	for (unsigned k: m_activeIndices) m_islandLevel[find(k)] = (uint8_t) (touched+1);
+	if (!m_activeIndices.empty()) {
+		for (unsigned k=0; k<n; ++k) {
+			uint8_t& island = m_islandLevel[find(k)];
+			if (island>0) island = std::max(island, (uint8_t) (m_states[k]->level+1));
+		}
+		for (unsigned k=0; k<n; ++k) {
+			uint8_t island = m_islandLevel[find(k)];
+			if (island==0 || island-1u<=m_states[k]->level) continue;
+			m_states[k]->level = (uint8_t) (island-1);
+			m_states[k]->hold = (uint8_t) std::min(holdSteps, 255u);
+		}
+	}
+
+	for (unsigned k=0; k<=MAX_LEVEL; ++k) {
+		m_levels[k].clear();
+		m_levelStates[k].clear();
+	}
+	m_deepestLevel = 0;
+	for (size_t k=0; k<n; ++k) {
+		State& state = *m_states[k];
+		state.synced = 0;
+		state.position = (unsigned) m_levels[state.level].size();
+		m_levels[state.level].push_back(particles[k]);
+		m_levelStates[state.level].push_back(&state);
+		m_deepestLevel = std::max(m_deepestLevel, (unsigned) state.level);
+	}
+}
+
+
+void MultirateStepper::promote(const Particle::Ref& particle, State& state, unsigned level, float h) {
+
+	// catch up from the particle's last step
+	float behind = (m_now-state.synced)*h;
+	m_promoted.assign(1, particle);
+	if (forces) forces(m_promoted, behind);
+	particle->integrate(behind);
+	++m_numIntegrations;
+	++m_numPromotions;
+	state.synced = m_now;
+
+	// swap-erase from the old level
+	ParticleRegistry& from = m_levels[state.level];
+	vector<State*>& fromStates = m_levelStates[state.level];
+	from[state.position] = from.back();
+	fromStates[state.position] = fromStates.back();
+	fromStates[state.position]->position = state.position;
+	from.pop_back();
+	fromStates.pop_back();
+
+	state.level = (uint8_t) level;
+	state.hold = (uint8_t) std::min(holdSteps, 255u);
+	state.position = (unsigned) m_levels[level].size();
+	m_levels[level].push_back(particle);
+	m_levelStates[level].push_back(&state);
+}
+
+
+void MultirateStepper::step(float dt, ContactRegistry::Ref contacts) {
+
+	YAMPE_TRACE_SCOPE("MultirateStepper::step");
+	classify(dt);
+
+	unsigned numSubsteps = 1u<<m_deepestLevel;
+	float h = dt/(float) numSubsteps;
+	m_numIntegrations = m_numPromotions = 0;
+	for (m_now=1; m_now<=numSubsteps; ++m_now) {
+
+		// levels k due when m_now is a multiple of 2^(M-k)
+		unsigned zeros = 0;
+		while (zeros<m_deepestLevel && ((m_now>>zeros) & 1)==0) ++zeros;
+		unsigned dueLevel = m_deepestLevel-zeros;
+
+		m_due.clear();
+		for (unsigned k=dueLevel; k<=m_deepestLevel; ++k) {
+			const ParticleRegistry& level = m_levels[k];
+			if (level.empty()) continue;
+			float dtLevel = dt/(float) (1u<<k);
+			if (forces) forces(level, dtLevel);
+			for (auto && p: level) p->integrate(dtLevel);
+			for (auto && state: m_levelStates[k]) state->synced = m_now;
+			m_numIntegrations += level.size();
+			m_due.insert(m_due.end(), level.begin(), level.end());
+		}
+		if (!generate) continue;
+
+		// stepped particles behind, touching a due one, are promoted to its
+		// level and the contacts generated again with them
+		generate(m_due, m_generated);
+		size_t numDue = m_due.size();
+		for (size_t k=0; k<m_generated->size(); ++k) {
+			const Contact::Ref& contact = m_generated->contact(k);
+			if (!contact->b) continue;
+			State* a = state(contact->a.get());
+			State* b = state(contact->b.get());
+			if (a==NULL || b==NULL || (a->synced==m_now)==(b->synced==m_now)) continue;
+			if (a->synced==m_now) {
+				promote(contact->b, *b, a->level, h);
+				m_due.push_back(contact->b);
+			}
+			else {
+				promote(contact->a, *a, b->level, h);
+				m_due.push_back(contact->a);
+			}
+		}
+		if (m_due.size()>numDue) {
+			m_generated->clear();
+			generate(m_due, m_generated);
+		}
+
+		// contacts of due particles, closing ones between two stepped
+		// particles mark their islands active for the next step
+		for (size_t k=0; k<m_generated->size(); ++k) {
+			const Contact::Ref& contact = m_generated->contact(k);
+			if (!isDue(contact->a.get()) && (!contact->b || !isDue(contact->b.get()))) continue;
+			contacts->append(contact);
+			if (contact->b && contact->calculateSeparatingVelocity()<-activeSpeed
+					&& state(contact->a.get())!=NULL && state(contact->b.get())!=NULL) {
+				m_activePairs.push_back(std::make_pair(contact->a.get(), contact->b.get()));
+			}
+		}
+		contacts->resolve(dt/(float) (1u<<dueLevel));
+		if (resolved) resolved(*contacts);
+		contacts->clear();
+		m_generated->clear();
+	}
+	m_now = numSubsteps;
+}
+
+
+float MultirateStepper::work() const {
+	size_t uniform = particles.size()*numSubsteps();
+	return uniform>0 ? (float) m_numIntegrations/(float) uniform : 0.0f;
+}
+
+
+const String MultirateStepper::toString() const {
+	std::ostringstream outs;
+	outs <<"levels = ";
+	for (unsigned k=0; k<=m_deepestLevel; ++k) outs <<(k>0 ? "/" : "") <<numAtLevel(k);
+	outs <<"    "
+		<<"substeps = " <<numSubsteps() <<"    "
+		<<"work = " <<work();
+	return outs.str();
+}
+
+} } // namespace YAMPE P
@@ -0,0 +1,157 @@
+/**
+	@file 		MultirateStepper.h
+	@author		dgaffney
+	@practical
+	@brief		Multirate time stepping: particles substepped at power-of-two levels by activity.
+	*/
+
+#ifndef PARTICLE_MULTIRATE_STEPPER_H
+#define PARTICLE_MULTIRATE_STEPPER_H
+
+#include <functional>
+#include <unordered_map>
+
+#include "ContactRegistry.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class MultirateStepper
+
+	Steps particles with different timesteps: a particle at level k takes
+	steps of dt/2^k, and every level meets again at the end of the coarse
+	step dt. A coarse step of deepest level M is run as 2^M substeps of
+	h = dt/2^M; a level is due at the end of each of its own steps (level k
+	after substep s if s+1 is a multiple of 2^(M-k)), when its particles
+	get their forces, are integrated by dt/2^k, and their contacts (those
+	with at least one due particle) are resolved. At the end of the last
+	substep every level is due.
+
+	Levels are assigned at the start of each coarse step by
+	- velocity: the level at which the particle moves at most maxTravel
+	  radii per step,
+	- contact activity: both particles of a particle-particle contact that
+	  was closing faster than activeSpeed in the previous step, and every
+	  particle of the island such contacts connect them to, go to at least
+	  contactLevel,
+	and a particle drops back only one level per holdSteps coarse steps,
+	so the substeps of an impact continue while it settles.
+
+	A particle that is not due but touches a due one (a resting ball hit
+	mid-step) is promoted: integrated up to the current time and moved to
+	the due particle's level for the rest of the step, after which the
+	contacts of the substep are generated again. So in a cradle the impact
+	chain runs at the fine rate as it reaches each ball, while the other
+	balls swing at the coarse rate.
+
+	Forces and contacts come from the caller: forces(particles, dt) is
+	called for each due level (and for promoted particles), and
+	generate(due, contacts) with the due particles at the end of each
+	substep. It must generate the contacts of the due particles with the
+	stepped particles that are not due, as those are what promotions are
+	found from (see ParticleParticleContactGenerator::generate() with a
+	selection); it may generate more, contacts of no due particle are
+	dropped. Particles the stepper does not step (not in particles) are
+	taken as level 0. Force generators should only depend on the particle
+	they act on: a spring to a coarser particle sees it as of its last step.
+
+	If set, resolved(contacts) is called once each substep's contacts are
+	resolved, before they are cleared. Every particle is due in the last
+	substep, so its call sees all the contacts at the end of the step (e.g.
+	for StateViews::publishContacts()).
+	*/
+class MultirateStepper : public Printable {
+
+public:
+
+	typedef ofPtr<MultirateStepper> Ref;
+
+	typedef std::function<void(const ParticleRegistry& particles, float dt)> ForceFunction;
+	typedef std::function<void(const ParticleRegistry& due, ContactRegistry::Ref contacts)> GenerateFunction;
+	typedef std::function<void(const ContactRegistry& contacts)> ResolvedFunction;
+
+	static const unsigned MAX_LEVEL = 7;
+
+	ParticleRegistry particles;			///< the particles stepped.
+	ForceFunction forces;
+	GenerateFunction generate;
+	ResolvedFunction resolved;
+
+	unsigned maxLevel;					///< finest level used, steps of dt/2^maxLevel.
+	unsigned contactLevel;				///< lowest level of particles in active contact.
+	float maxTravel;					///< largest step, in radii, before a particle goes a level finer.
+	float activeSpeed;					///< closing speed making a contact active.
+	unsigned holdSteps;					///< coarse steps before a particle drops a level.
+
+	MultirateStepper(unsigned maxLevel=3, const String label="MultirateStepper");
+
+	/// Advances all particles by dt, resolving contacts into (and clearing) contacts.
+	void step(float dt, ContactRegistry::Ref contacts);
+
+	/// Forgets levels and contact activity, e.g. after the particles are replaced.
+	void clear();
+
+	/// Level of a particle in the current step, 0 if not stepped.
+	unsigned level(const Particle* particle) const;
+
+	/// True if the particle is due at the end of the current substep.
+	bool isDue(const Particle* particle) const;
+
+	unsigned deepestLevel() const { return m_deepestLevel; }
+	size_t numAtLevel(unsigned level) const { return m_levels[level].size(); }
+	unsigned numSubsteps() const { return 1u<<m_deepestLevel; }
+
+	/// Particle integrations in the last step, and as a fraction of stepping all at the deepest level.
+	size_t numIntegrations() const { return m_numIntegrations; }
+	float work() const;
+
+	/// Particles promoted during the last step.
+	size_t numPromotions() const { return m_numPromotions; }
+
+	const String toString() const;
+
+protected:
+
+	struct State {
+		uint8_t level;
+		uint8_t hold;				///< coarse steps left before dropping a level.
+		unsigned index;				///< in particles, this step.
+		unsigned stamp;				///< step of the last classification.
+		unsigned synced;			///< substeps of this step the particle has been advanced through.
+		unsigned position;			///< in m_levels[level].
+	};
+
+	std::unordered_map<const Particle*, State> m_state;
+	unsigned m_stamp;
+
+	ParticleRegistry m_levels[MAX_LEVEL+1];
+	vector<State*> m_levelStates[MAX_LEVEL+1];	///< state of each entry of m_levels.
+	ParticleRegistry m_due;
+	ParticleRegistry m_promoted;
+	unsigned m_deepestLevel;
+	unsigned m_now;						///< substeps ended, this step.
+	size_t m_numIntegrations, m_numPromotions;
+
+	vector<std::pair<const Particle*, const Particle*> > m_activePairs;	///< closing contacts of this step.
+	vector<State*> m_states;			///< state of each particle, this step.
+	vector<unsigned> m_activeIndices;	///< a particle of each active pair.
+	vector<unsigned> m_parent;			///< union-find over particles.
+	vector<uint8_t> m_islandLevel;
+	ContactRegistry::Ref m_generated;
+
+	/// Assigns levels from velocities and the last step's active contacts.
+	void classify(float dt);
+
+	/// State of a particle stepped this step, NULL if not stepped.
+	State* state(const Particle* particle);
+	const State* state(const Particle* particle) const;
+
+	/// Advances a particle that is behind to the end of the current substep, at level.
+	void promote(const Particle::Ref& particle, State& state, unsigned level, float h);
+
+	unsigned find(unsigned k);
+};
+
+} } // namespace YAMPE P
+
+#endif
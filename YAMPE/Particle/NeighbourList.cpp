@@ -0,0 +1,176 @@
+/**
+	@file 		NeighbourList.cpp
+	@author		dgaffney
+	@practical
+	@brief		Cached (Verlet) neighbour lists with a skin margin for particle pair generation.
+	*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "../Trace.h"
+#include "CollisionFilter.h"
+#include "NeighbourList.h"
+
+namespace YAMPE { namespace P {
+
+namespace {
+
+	const int64_t CELL_BIAS = 1<<20;		///< cell coordinates are stored biased, 21 bits each.
+
+	inline uint64_t cellKey(int64_t x, int64_t y, int64_t z) {
+		return (uint64_t(x+CELL_BIAS) & 0x1fffff) | (uint64_t(y+CELL_BIAS) & 0x1fffff)<<21 | (uint64_t(z+CELL_BIAS) & 0x1fffff)<<42;
+	}
+
+}
+
+
+NeighbourList::NeighbourList(float skin, const String label) :
+	Printable(label),
+	skin(skin),
+	m_isValid(false),
+	m_builtSkin(0.0f),
+	m_filter(NULL),
+	m_filterVersion(0),
+	m_numUpdates(0),
+	m_numBuilds(0),
+	m_lastBuildMicros(0.0)
+{ }
+
+
+bool NeighbourList::isStale(const ParticleRegistry& particles, const CollisionFilter* filter) const {
+	if (!m_isValid || particles.size()!=m_particles.size() || skin!=m_builtSkin) return true;
+	if (filter!=m_filter || (filter!=NULL && filter->version()!=m_filterVersion)) return true;
+	float limit = 0.25f*skin*skin;			// (skin/2)^2
+	for (size_t k=0; k<particles.size(); ++k) {
+		const Particle* p = particles[k].get();
+		if (p!=m_particles[k] || p->radius>m_radius[k]) return true;
+		if (p->collisionGroup!=m_group[k] || p->collisionMask!=m_mask[k]) return true;
+		float dx = p->position.x-m_x[k], dy = p->position.y-m_y[k], dz = p->position.z-m_z[k];
+		if (dx*dx + dy*dy + dz*dz > limit) return true;
+	}
+	return false;
+}
+
+
+unsigned NeighbourList::firstListAt(size_t pair) const {
+	if (m_offsets.size()<2) return 0;
+	// the last offset (the total) is left out so the result is at most n
+	return (unsigned) (std::lower_bound(m_offsets.begin(), m_offsets.end()-1, pair)-m_offsets.begin());
+}
+
+
+bool NeighbourList::update(const ParticleRegistry& particles, const CollisionFilter* filter) {
+	++m_numUpdates;
+	if (!isStale(particles, filter)) return false;
+	build(particles, filter);
+	return true;
+}
+
+
+void NeighbourList::build(const ParticleRegistry& particles, const CollisionFilter* filter) {
+
+	YAMPE_TRACE_SCOPE("NeighbourList::build");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	size_t n = particles.size();
+	m_particles.resize(n);
+	m_x.resize(n);
+	m_y.resize(n);
+	m_z.resize(n);
+	m_radius.resize(n);
+	m_group.resize(n);
+	m_mask.resize(n);
+	float maxRadius = 0.0f;
+	bool hasGroups = false;
+	for (size_t k=0; k<n; ++k) {
+		const Particle& p = *particles[k];
+		m_particles[k] = &p;
+		m_x[k] = p.position.x;
+		m_y[k] = p.position.y;
+		m_z[k] = p.position.z;
+		m_radius[k] = p.radius;
+		m_group[k] = p.collisionGroup;
+		m_mask[k] = p.collisionMask;
+		maxRadius = std::max(maxRadius, p.radius);
+		hasGroups = hasGroups || p.collisionMask!=0xffffffffu || p.collisionGroup==0;
+	}
+
+	// cells no smaller than the largest interaction distance, so only the
+	// 27 cells around a particle can hold its neighbours
+	float cell = std::max(2.0f*maxRadius + skin, 1.0e-6f);
+	float inverseCell = 1.0f/cell;
+	m_cells.resize(n);
+	for (size_t k=0; k<n; ++k) {
+		int64_t x = (int64_t) std::floor(m_x[k]*inverseCell);
+		int64_t y = (int64_t) std::floor(m_y[k]*inverseCell);
+		int64_t z = (int64_t) std::floor(m_z[k]*inverseCell);
+		m_cells[k] = cellKey(x, y, z);
+	}
+	// 63 bit keys leave no room for the index, so indices are sorted by key
+	// (ties by index, so each cell lists its particles in ascending order)
+	m_order.resize(n);
+	for (unsigned k=0; k<n; ++k) m_order[k] = k;
+	std::sort(m_order.begin(), m_order.end(), [this](unsigned a, unsigned b) {
+		return m_cells[a]<m_cells[b] || (m_cells[a]==m_cells[b] && a<b);
+	});
+	m_sortedCells.resize(n);
+	for (size_t k=0; k<n; ++k) m_sortedCells[k] = m_cells[m_order[k]];
+
+	m_offsets.assign(n+1, 0);
+	m_neighbours.clear();
+	IndexList& list = m_list;
+	for (unsigned a=0; a<n; ++a) {
+		list.clear();
+		int64_t x = (int64_t) std::floor(m_x[a]*inverseCell);
+		int64_t y = (int64_t) std::floor(m_y[a]*inverseCell);
+		int64_t z = (int64_t) std::floor(m_z[a]*inverseCell);
+		for (int64_t dz=-1; dz<=1; ++dz) {
+			for (int64_t dy=-1; dy<=1; ++dy) {
+				for (int64_t dx=-1; dx<=1; ++dx) {
+					uint64_t key = cellKey(x+dx, y+dy, z+dz);
+					size_t k = std::lower_bound(m_sortedCells.begin(), m_sortedCells.end(), key)-m_sortedCells.begin();
+					for (; k<n && m_sortedCells[k]==key; ++k) {
+						unsigned b = m_order[k];
+						if (b>=a) break;			// indices ascend within a cell
+						if (hasGroups && ((m_group[a] & m_mask[b])==0 || (m_group[b] & m_mask[a])==0)) continue;
+						float ex = m_x[a]-m_x[b], ey = m_y[a]-m_y[b], ez = m_z[a]-m_z[b];
+						float reach = m_radius[a] + m_radius[b] + skin;
+						if (ex*ex + ey*ey + ez*ez < reach*reach) list.push_back(b);
+					}
+				}
+			}
+		}
+		std::sort(list.begin(), list.end());
+		if (filter!=NULL && filter->numExcluded(a)>0) {
+			// both ascending, so a merge drops the excluded neighbours
+			const unsigned* excluded = filter->excluded(a);
+			const unsigned* excludedEnd = excluded + filter->numExcluded(a);
+			for (auto && b: list) {
+				while (excluded<excludedEnd && *excluded<b) ++excluded;
+				if (excluded==excludedEnd || *excluded!=b) m_neighbours.push_back(b);
+			}
+		}
+		else m_neighbours.insert(m_neighbours.end(), list.begin(), list.end());
+		m_offsets[a+1] = (unsigned) m_neighbours.size();
+	}
+
+	m_builtSkin = skin;
+	m_filter = filter;
+	m_filterVersion = filter!=NULL ? filter->version() : 0;
+	m_isValid = true;
+	++m_numBuilds;
+	m_lastBuildMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now()-start).count();
+}
+
+
+const String NeighbourList::toString() const {
+	std::ostringstream outs;
+	outs <<"skin = " <<skin <<"    "
+		<<"pairs = " <<numPairs() <<"    "
+		<<"builds = " <<m_numBuilds <<"/" <<m_numUpdates;
+	return outs.str();
+}
+
+} } // namespace YAMPE P
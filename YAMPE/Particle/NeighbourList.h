@@ -0,0 +1,110 @@
+/**
+	@file 		NeighbourList.h
+	@author		dgaffney
+	@practical
+	@brief		Cached (Verlet) neighbour lists with a skin margin for particle pair generation.
+	*/
+
+#ifndef PARTICLE_NEIGHBOUR_LIST_H
+#define PARTICLE_NEIGHBOUR_LIST_H
+
+#include <cstdint>
+
+#include "../Particle.h"
+
+namespace YAMPE { namespace P {
+
+class CollisionFilter;
+
+/**
+	\class NeighbourList
+
+	For each particle a, the particles b < a whose spheres, grown by skin,
+	overlap it: |pa-pb| < ra+rb+skin. Two particles that have each moved
+	less than skin/2 since the lists were built have closed by less than
+	skin, so every pair overlapping now is still listed and the lists can
+	be reused for contact generation until some particle has moved further
+	(the standard Verlet list of molecular dynamics).
+
+	update() checks, once per step, the displacement of every particle
+	since the last build, and rebuilds if one exceeds skin/2 or if the
+	particles were changed (added, removed, reordered or given a larger
+	radius). Builds bin the particles in a uniform grid of cells at least
+	as large as the largest interaction distance, so cost O(n log n).
+
+	Lists are kept in CSR form with each list in ascending order, so
+	pairs come out in the same order as a brute force loop over b < a.
+
+	Given a CollisionFilter, pairs it keeps apart (by groups or as
+	excluded pairs) are left out of the lists, so contact generation
+	never tests them; lists are rebuilt when a particle's groups or the
+	exclusions change. The filter must be indexed (CollisionFilter::index())
+	against the same particles before update().
+	*/
+class NeighbourList : public Printable {
+
+public:
+
+	typedef ofPtr<NeighbourList> Ref;
+
+	float skin;						///< margin added to every radius sum.
+
+	NeighbourList(float skin=0.1f, const String label="NeighbourList");
+
+	/// Rebuilds the lists if needed, returns true if they were rebuilt.
+	bool update(const ParticleRegistry& particles, const CollisionFilter* filter=NULL);
+
+	/// Forces a rebuild at the next update().
+	void invalidate() { m_isValid = false; }
+
+	/// Neighbours (all lower indexed) of particle a.
+	const unsigned* neighbours(unsigned a) const { return m_neighbours.data() + m_offsets[a]; }
+	size_t numNeighbours(unsigned a) const { return m_offsets[a+1]-m_offsets[a]; }
+	size_t numPairs() const { return m_neighbours.size(); }
+
+	/// First particle whose list starts at or after the given pair, for splitting pairs into chunks.
+	unsigned firstListAt(size_t pair) const;
+
+	// rebuild statistics
+	unsigned numUpdates() const { return m_numUpdates; }
+	unsigned numBuilds() const { return m_numBuilds; }
+	float rebuildRate() const { return m_numUpdates>0 ? (float) m_numBuilds/(float) m_numUpdates : 0.0f; }
+	double lastBuildMicros() const { return m_lastBuildMicros; }
+	void resetStatistics() { m_numUpdates = m_numBuilds = 0; }
+
+	const String toString() const;
+
+protected:
+
+	bool m_isValid;
+	typedef TrackedVector<unsigned, MemoryTracker::GENERATORS> IndexList;
+
+	IndexList m_offsets;				///< n+1 offsets into m_neighbours.
+	IndexList m_neighbours;
+
+	// state at the last build
+	TrackedVector<const Particle*, MemoryTracker::GENERATORS> m_particles;
+	TrackedVector<float, MemoryTracker::GENERATORS> m_x, m_y, m_z, m_radius;
+	TrackedVector<uint32_t, MemoryTracker::GENERATORS> m_group, m_mask;
+	float m_builtSkin;
+	const CollisionFilter* m_filter;
+	unsigned m_filterVersion;
+
+	// build scratch
+	TrackedVector<uint64_t, MemoryTracker::GENERATORS> m_cells;	///< cell key of each particle.
+	IndexList m_order;					///< particle indices by cell key.
+	TrackedVector<uint64_t, MemoryTracker::GENERATORS> m_sortedCells;
+	IndexList m_list;
+
+	unsigned m_numUpdates, m_numBuilds;
+	double m_lastBuildMicros;
+
+	/// True if the particles moved too far or changed since the last build.
+	bool isStale(const ParticleRegistry& particles, const CollisionFilter* filter) const;
+
+	void build(const ParticleRegistry& particles, const CollisionFilter* filter);
+};
+
+} } // namespace YAMPE P
+
+#endif
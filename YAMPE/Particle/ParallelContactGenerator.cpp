@@ -0,0 +1,100 @@
+/**
+	@file 		ParallelContactGenerator.cpp
+	@author		dgaffney
+	@practical
+	@brief		Runs several contact generators (or chunks of them) concurrently.
+	*/
+
+#include "ParallelContactGenerator.h"
+#include "../Trace.h"
+
+namespace YAMPE { namespace P {
+
+void ParallelContactGenerator::add(const String& label, unsigned numChunks, ChunkFunction generate,
+	PrepareFunction prepare) {
+
+	ASSERT(numChunks>0, "Expected at least one chunk per task.");
+	Task task = { label, numChunks, generate, prepare, Trace::instance().intern(label) };
+	m_tasks.push_back(task);
+	for (unsigned k=0; k<numChunks; ++k) {
+		Slot slot = { (unsigned) m_tasks.size()-1, k, ContactRegistry::Ref(new ContactRegistry()) };
+		m_slots.push_back(slot);
+	}
+}
+
+
+void ParallelContactGenerator::add(ContactGenerator::Ref generator) {
+	add(generator->label(), 1, [generator](ContactRegistry::Ref buffer, unsigned, unsigned) {
+		generator->generate(buffer);
+	});
+}
+
+
+void ParallelContactGenerator::clear() {
+	m_tasks.clear();
+	m_slots.clear();
+}
+
+
+void ParallelContactGenerator::generate(ContactRegistry::Ref contactRegistry) {
+
+	for (auto && task: m_tasks) {
+		if (task.prepare) task.prepare();
+	}
+
+	auto chunk = [this](unsigned index) {
+		Slot& slot = m_slots[index];
+		const Task& task = m_tasks[slot.task];
+		Trace::Scope scope(task.traceName, slot.chunk);
+		slot.buffer->clear();
+		task.generate(slot.buffer, slot.chunk, task.numChunks);
+	};
+	if (m_pool!=NULL) {
+		m_pool->parallelFor((unsigned) m_slots.size(), chunk);
+	} else {
+		for (unsigned k=0; k<m_slots.size(); ++k) chunk(k);
+	}
+
+	// Fixed merge order keeps the output independent of scheduling.
+	for (auto && slot: m_slots) contactRegistry->append(*slot.buffer);
+}
+
+
+TaskGraph::Id ParallelContactGenerator::schedule(TaskGraph& graph, ContactRegistry::Ref contactRegistry,
+	std::initializer_list<TaskGraph::Id> after) {
+
+	TaskGraph::Id prepare = graph.add(label() + " prepare", 1, [this](unsigned, unsigned) {
+		for (auto && task: m_tasks) {
+			if (task.prepare) task.prepare();
+		}
+	}, after);
+
+	vector<TaskGraph::Id> generators;
+	unsigned first = 0;
+	for (unsigned k=0; k<m_tasks.size(); ++k) {
+		generators.push_back(graph.add(m_tasks[k].label, m_tasks[k].numChunks, [this, first](unsigned chunk, unsigned) {
+			Slot& slot = m_slots[first+chunk];
+			const Task& task = m_tasks[slot.task];
+			slot.buffer->clear();
+			task.generate(slot.buffer, slot.chunk, task.numChunks);
+		}, { prepare }));
+		first += m_tasks[k].numChunks;
+	}
+
+	TaskGraph::Id merge = graph.add(label() + " merge", 1, [this, contactRegistry](unsigned, unsigned) {
+		for (auto && slot: m_slots) contactRegistry->append(*slot.buffer);
+	}, { prepare });
+	for (auto && generator: generators) graph.addDependency(merge, generator);
+	return merge;
+}
+
+
+const String ParallelContactGenerator::toString() const {
+	std::ostringstream outs;
+	for (auto && task: m_tasks) {
+		outs <<task.label <<"    " <<"chunks = " <<task.numChunks <<"\n";
+	}
+	return outs.str();
+}
+
+} }	// namespace YAMPE::P
@@ -0,0 +1,101 @@
+/**
+	@file 		ParallelContactGenerator.h
+	@author		dgaffney
+	@practical
+	@brief		Runs several contact generators (or chunks of them) concurrently.
+	*/
+
+#ifndef PARTICLE_PARALLEL_CONTACT_GENERATOR_H
+#define PARTICLE_PARALLEL_CONTACT_GENERATOR_H
+
+#include <functional>
+
+#include "../TaskGraph.h"
+#include "../ThreadPool.h"
+#include "ContactGenerators.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class ParallelContactGenerator
+
+	Composite contact generator. Each registered task is split into a fixed
+	number of chunks and every chunk writes into its own contact buffer, so
+	chunks can run on any thread without synchronisation. Once all chunks are
+	done the buffers are appended to the target registry in task then chunk
+	order.
+
+	The number of chunks is set when a task is added, not derived from the
+	number of threads, so the contacts (and their order) are the same however
+	many threads the pool has.
+
+	Contacts handed over from the buffers are recycled by the next call to
+	generate(), so the target registry must be cleared between steps.
+
+	Instead of calling generate() the same work can be scheduled as part of
+	a TaskGraph (see schedule()), so that it overlaps with other tasks.
+	*/
+class ParallelContactGenerator : public ContactGenerator {
+
+public:
+
+	typedef ofPtr<ParallelContactGenerator> Ref;
+
+	typedef std::function<void()> PrepareFunction;
+	typedef std::function<void(ContactRegistry::Ref buffer, unsigned chunk, unsigned numChunks)> ChunkFunction;
+
+	/// A NULL pool runs every chunk on the calling thread.
+	ParallelContactGenerator(ThreadPool* pool=NULL, const String label="ParallelContactGenerator")
+		: ContactGenerator(label), m_pool(pool) {};
+
+	void setThreadPool(ThreadPool* pool) { m_pool = pool; }
+
+	/**	Adds a task of numChunks chunks. The optional prepare function is called
+		serially, in task order, before any chunk of the step runs.
+		*/
+	void add(const String& label, unsigned numChunks, ChunkFunction generate,
+		PrepareFunction prepare=PrepareFunction());
+
+	/// Adds an existing generator as a single chunk task.
+	void add(ContactGenerator::Ref generator);
+
+	void clear();
+
+	void generate(ContactRegistry::Ref contactRegistry);
+
+	/**	Adds the work of one generate() call to a task graph, after the given
+		tasks: a task running the prepare functions, one graph task per
+		generator task (with the same chunks) and a final task merging the
+		buffers into contactRegistry, whose id is returned. Must be scheduled
+		again whenever tasks are added or cleared.
+		*/
+	TaskGraph::Id schedule(TaskGraph& graph, ContactRegistry::Ref contactRegistry,
+		std::initializer_list<TaskGraph::Id> after=std::initializer_list<TaskGraph::Id>());
+
+	const String toString() const;
+
+protected:
+
+	struct Task {
+		String label;
+		unsigned numChunks;
+		ChunkFunction generate;
+		PrepareFunction prepare;
+		uint32_t traceName;
+	};
+
+	/// One unit of parallel work with its private output buffer.
+	struct Slot {
+		unsigned task;
+		unsigned chunk;
+		ContactRegistry::Ref buffer;
+	};
+
+	ThreadPool* m_pool;
+	vector<Task> m_tasks;
+	vector<Slot> m_slots;
+};
+
+} } // namespace YAMPE P
+
+#endif
@@ -0,0 +1,233 @@
+/**
+	@file 		ParticlePool.cpp
+	@author		dgaffney
+	@practical
+	@brief		Fixed capacity particle storage with lifetimes, and an emitter spawning into it.
+	*/
+
+#include <algorithm>
+#include <functional>
+
+#include "ParticlePool.h"
+
+namespace YAMPE { namespace P {
+
+ParticlePool::ParticlePool(size_t capacity, const String label) :
+	Printable(label),
+	m_block(new Particle[capacity>0 ? capacity : 1], std::default_delete<Particle[]>()),
+	m_remaining(capacity, 0.0f),
+	m_livePosition(capacity, NONE),
+	m_forceGenerators(NULL),
+	m_numSpawned(0),
+	m_numRetired(0)
+{
+	m_refs.reserve(capacity);
+	m_free.reserve(capacity);
+	m_live.reserve(capacity);
+	m_liveSlots.reserve(capacity);
+	for (size_t k=0; k<capacity; ++k) {
+		m_refs.push_back(Particle::Ref(m_block, m_block.get()+k));
+		m_free.push_back((unsigned) (capacity-1-k));		// slot 0 first
+	}
+}
+
+
+void ParticlePool::attach(ParticleRegistry* registry) {
+	m_registries.push_back(registry);
+	m_registryPosition.push_back(vector<unsigned>(capacity(), NONE));
+	for (size_t k=0; k<m_live.size(); ++k) {
+		m_registryPosition.back()[m_liveSlots[k]] = (unsigned) registry->size();
+		registry->push_back(m_live[k]);
+	}
+}
+
+
+unsigned ParticlePool::slotOf(const Particle* particle) const {
+	const Particle* first = m_block.get();
+	std::less<const Particle*> less;
+	if (less(particle, first) || !less(particle, first+capacity())) return NONE;
+	return (unsigned) (particle-first);
+}
+
+
+Particle::Ref ParticlePool::spawn(float lifetime) {
+	if (m_free.empty()) return Particle::Ref();
+
+	unsigned slot = m_free.back();
+	m_free.pop_back();
+	const Particle::Ref& particle = m_refs[slot];
+	*particle = Particle();
+	m_remaining[slot] = lifetime;
+
+	m_livePosition[slot] = (unsigned) m_live.size();
+	m_live.push_back(particle);
+	m_liveSlots.push_back(slot);
+
+	for (size_t r=0; r<m_registries.size(); ++r) {
+		m_registryPosition[r][slot] = (unsigned) m_registries[r]->size();
+		m_registries[r]->push_back(particle);
+	}
+	if (m_forceGenerators) {
+		for (auto && generator: m_generators) m_forceGenerators->add(particle, generator);
+	}
+
+	++m_numSpawned;
+	return particle;
+}
+
+
+void ParticlePool::retire(const Particle* particle) {
+	unsigned slot = slotOf(particle);
+	if (slot!=NONE && m_livePosition[slot]!=NONE) retireSlot(slot);
+}
+
+
+void ParticlePool::retireSlot(unsigned slot) {
+	const Particle* particle = m_refs[slot].get();
+
+	if (m_forceGenerators) m_forceGenerators->removeParticle(particle);
+
+	for (size_t r=0; r<m_registries.size(); ++r) {
+		ParticleRegistry& registry = *m_registries[r];
+		vector<unsigned>& position = m_registryPosition[r];
+		size_t k = position[slot];
+		if (k>=registry.size() || registry[k].get()!=particle) {
+			// moved behind the pool's back (see attach()), correct but linear in the registry
+			k = 0;
+			while (k<registry.size() && registry[k].get()!=particle) ++k;
+		}
+		position[slot] = NONE;
+		if (k==registry.size()) continue;
+		if (k+1<registry.size()) {
+			registry[k] = registry.back();
+			unsigned moved = slotOf(registry[k].get());
+			if (moved!=NONE) position[moved] = (unsigned) k;
+		}
+		registry.pop_back();
+	}
+
+	unsigned k = m_livePosition[slot];
+	m_live[k] = m_live.back();
+	m_liveSlots[k] = m_liveSlots.back();
+	m_livePosition[m_liveSlots[k]] = k;
+	m_live.pop_back();
+	m_liveSlots.pop_back();
+	m_livePosition[slot] = NONE;
+
+	m_free.push_back(slot);
+	++m_numRetired;
+}
+
+
+void ParticlePool::update(float dt) {
+	// backwards, so the particle swapped into a retired place was already aged
+	for (size_t k=m_live.size(); k-->0; ) {
+		unsigned slot = m_liveSlots[k];
+		m_remaining[slot] -= dt;
+		if (m_remaining[slot]<=0.0f) retireSlot(slot);
+	}
+}
+
+
+void ParticlePool::clear() {
+	while (!m_liveSlots.empty()) retireSlot(m_liveSlots.back());
+}
+
+
+const String ParticlePool::toString() const {
+	std::ostringstream outs;
+	outs <<"live = " <<size() <<"    "
+		<<"capacity = " <<capacity() <<"    "
+		<<"spawned = " <<m_numSpawned <<"    "
+		<<"retired = " <<m_numRetired;
+	return outs.str();
+}
+
+
+// --------------------------------------------------------
+
+
+ParticleEmitter::ParticleEmitter(ParticlePool::Ref pool, const String label) :
+	Printable(label),
+	rate(100.0f),
+	position(ofVec3f::zero()),
+	positionSpread(ofVec3f::zero()),
+	velocity(ofVec3f(0.0f, 5.0f, 0.0f)),
+	velocityDistribution(CONE),
+	velocitySpread(ofVec3f::zero()),
+	coneAngle(15.0f),
+	speedSpread(0.0f),
+	lifetime(2.0f),
+	lifetimeSpread(0.0f),
+	radius(0.05f),
+	inverseMass(1.0f),
+	color(ofColor::white),
+	isEnabled(true),
+	m_pool(pool),
+	m_accumulator(0.0f),
+	m_random(1)
+{ }
+
+
+float ParticleEmitter::uniform() {
+	// 24 bits, the same on every standard library
+	return (float) (m_random()>>8) * (2.0f/16777216.0f) - 1.0f;
+}
+
+
+ofVec3f ParticleEmitter::sampleVelocity() {
+	if (velocityDistribution==BOX) {
+		return velocity + ofVec3f(uniform()*velocitySpread.x, uniform()*velocitySpread.y, uniform()*velocitySpread.z);
+	}
+
+	float speed = velocity.length();
+	if (speed<=0.0f) return ofVec3f::zero();
+	ofVec3f axis = velocity/speed;
+
+	// uniform over the cap: cos of the polar angle uniform in [cos(coneAngle), 1]
+	float cosMax = cosf(ofDegToRad(coneAngle));
+	float cosTheta = 1.0f - (0.5f*(uniform()+1.0f))*(1.0f-cosMax);
+	float sinTheta = sqrtf(std::max(0.0f, 1.0f-cosTheta*cosTheta));
+	float phi = ofDegToRad(180.0f*uniform());
+
+	// any two unit vectors perpendicular to the axis
+	ofVec3f u = fabsf(axis.x)<0.9f ? axis.getCrossed(ofVec3f(1.0f, 0.0f, 0.0f)) : axis.getCrossed(ofVec3f(0.0f, 1.0f, 0.0f));
+	u.normalize();
+	ofVec3f v = axis.getCrossed(u);
+
+	ofVec3f direction = axis*cosTheta + (u*cosf(phi) + v*sinf(phi))*sinTheta;
+	return direction*(speed + uniform()*speedSpread);
+}
+
+
+unsigned ParticleEmitter::update(float dt) {
+	if (!isEnabled) return 0;
+
+	m_accumulator += rate*dt;
+	unsigned count = (unsigned) m_accumulator;
+	m_accumulator -= (float) count;
+
+	unsigned spawned = 0;
+	for (; spawned<count; ++spawned) {
+		Particle::Ref particle = m_pool->spawn(std::max(0.0f, lifetime + uniform()*lifetimeSpread));
+		if (!particle) break;
+		ofVec3f offset(uniform()*positionSpread.x, uniform()*positionSpread.y, uniform()*positionSpread.z);
+		particle->setPosition(position + offset)
+			.setVelocity(sampleVelocity())
+			.setRadius(radius)
+			.setBodyColor(color)
+			.setInverseMass(inverseMass);
+	}
+	return spawned;
+}
+
+
+const String ParticleEmitter::toString() const {
+	std::ostringstream outs;
+	outs <<"rate = " <<rate <<"    "
+		<<"lifetime = " <<lifetime <<"    "
+		<<"pool = " <<m_pool->size() <<"/" <<m_pool->capacity();
+	return outs.str();
+}
+
+} } // namespace YAMPE P
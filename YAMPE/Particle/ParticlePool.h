@@ -0,0 +1,183 @@
+/**
+	@file 		ParticlePool.h
+	@author		dgaffney
+	@practical
+	@brief		Fixed capacity particle storage with lifetimes, and an emitter spawning into it.
+	*/
+
+#ifndef PARTICLE_PARTICLE_POOL_H
+#define PARTICLE_PARTICLE_POOL_H
+
+#include <cmath>
+#include <random>
+
+#include "ForceGeneratorRegistry.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class ParticlePool
+
+	Holds capacity particles in one block, allocated once (as Scene does),
+	with a Ref per slot made up front, so spawning and retiring particles
+	never touches the heap. Free slots are kept on a free list, most
+	recently retired first.
+
+	Every spawned particle is added to the live list, to each attached
+	ParticleRegistry (e.g. the particles of a contact generator) and
+	registered in the attached ForceGeneratorRegistry with the pool's force
+	generators. Retiring it undoes all of that: it is removed from the
+	registries by swap-erase, at the position the pool remembers for it,
+	and all its force registrations are removed.
+
+	A particle spawned with a lifetime is retired by update() once that
+	much simulated time has passed, without one lives until retired.
+	*/
+class ParticlePool : public Printable {
+
+public:
+
+	typedef ofPtr<ParticlePool> Ref;
+
+	ParticlePool(size_t capacity, const String label="ParticlePool");
+
+	/// Registry spawned particles are registered in, with every generator of addForceGenerator().
+	void setForceGeneratorRegistry(ForceGeneratorRegistry* forceGenerators) { m_forceGenerators = forceGenerators; }
+	void addForceGenerator(ForceGenerator::Ref forceGenerator) { m_generators.push_back(forceGenerator); }
+
+	/**	Spawned particles are also appended to registry (which must outlive
+		the pool's use of it). Others may append to the registry, or clear
+		it once the pool is cleared, but should not move or remove the
+		pool's particles: the pool then no longer finds a particle where it
+		put it, and retiring it searches the whole registry, costing time
+		proportional to its size rather than constant. For the same reason
+		pooled particles must not be reordered by MortonOrder.
+		*/
+	void attach(ParticleRegistry* registry);
+
+	/**	Takes a free particle, reset to a default Particle, and registers it.
+		Returns NULL if the pool is exhausted.
+		*/
+	Particle::Ref spawn(float lifetime=INFINITY);
+
+	/// Unregisters the particle and frees its slot, no effect if it is not live in this pool.
+	void retire(const Particle* particle);
+
+	/// Ages the live particles, retiring those whose lifetime has run out.
+	void update(float dt);
+
+	/// Retires every live particle.
+	void clear();
+
+	/// The live particles, in no particular order.
+	const ParticleRegistry& live() const { return m_live; }
+
+	size_t size() const { return m_live.size(); }
+	size_t capacity() const { return m_refs.size(); }
+	size_t available() const { return m_free.size(); }
+	size_t numSpawned() const { return m_numSpawned; }
+	size_t numRetired() const { return m_numRetired; }
+
+	const String toString() const;
+
+protected:
+
+	static const unsigned NONE = ~0u;
+
+	ofPtr<Particle> m_block;				///< all the particles, owned by every Ref.
+	ParticleRegistry m_refs;				///< Ref of each slot.
+	vector<unsigned> m_free;				///< free slots.
+	vector<float> m_remaining;				///< lifetime left, per slot.
+
+	ParticleRegistry m_live;
+	vector<unsigned> m_liveSlots;			///< slot of each live particle.
+	vector<unsigned> m_livePosition;		///< position in m_live, per slot.
+
+	ForceGeneratorRegistry* m_forceGenerators;
+	vector<ForceGenerator::Ref> m_generators;
+
+	vector<ParticleRegistry*> m_registries;
+	vector<vector<unsigned> > m_registryPosition;	///< position in each attached registry, per slot.
+
+	size_t m_numSpawned, m_numRetired;
+
+	/// Slot of the particle, NONE if it is not one of the pool's.
+	unsigned slotOf(const Particle* particle) const;
+
+	void retireSlot(unsigned slot);
+
+	ParticlePool(const ParticlePool&);
+	ParticlePool& operator=(const ParticlePool&);
+};
+
+
+// --------------------------------------------------------
+
+
+/**
+	\class ParticleEmitter
+
+	Spawns rate particles per second from a pool, fractions carried over
+	from step to step. Each particle starts at position plus a uniform
+	offset in [-positionSpread, positionSpread] per axis, with a lifetime
+	uniform in lifetime +/- lifetimeSpread, and a velocity drawn from
+	velocityDistribution:
+	- BOX: velocity plus a uniform offset in [-velocitySpread, velocitySpread] per axis,
+	- CONE: a direction within coneAngle (degrees) of velocity, uniform over
+	  the spherical cap, with speed |velocity| +/- speedSpread.
+
+	Random numbers come from the emitter's own generator (see seed()), so
+	an emitter repeats exactly from the same seed.
+	*/
+class ParticleEmitter : public Printable {
+
+public:
+
+	typedef ofPtr<ParticleEmitter> Ref;
+
+	enum Distribution { BOX, CONE };
+
+	float rate;						///< particles per second.
+	ofVec3f position;
+	ofVec3f positionSpread;
+	ofVec3f velocity;
+	Distribution velocityDistribution;
+	ofVec3f velocitySpread;			///< BOX only.
+	float coneAngle;				///< CONE only, degrees.
+	float speedSpread;				///< CONE only.
+	float lifetime;
+	float lifetimeSpread;
+	float radius;
+	float inverseMass;
+	ofColor color;
+	bool isEnabled;
+
+	ParticleEmitter(ParticlePool::Ref pool, const String label="ParticleEmitter");
+
+	void seed(unsigned seed) { m_random.seed(seed); }
+
+	/**	Spawns this step's share of new particles, returns the number
+		spawned, which falls short while the pool is exhausted. Ageing is
+		left to the pool's update(), as several emitters may share a pool.
+		*/
+	unsigned update(float dt);
+
+	ParticlePool::Ref pool() const { return m_pool; }
+
+	const String toString() const;
+
+protected:
+
+	ParticlePool::Ref m_pool;
+	float m_accumulator;			///< particles owed, carried between steps.
+	std::mt19937 m_random;
+
+	/// Uniform in [-1, 1].
+	float uniform();
+
+	ofVec3f sampleVelocity();
+};
+
+} } // namespace YAMPE P
+
+#endif
@@ -0,0 +1,526 @@
+/**
+	@file 		Scene.cpp
+	@author		dgaffney
+	@practical
+	@brief		Scene description, authored as XML and compiled to a mappable binary form.
+	*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ofxXmlSettings.h"
+
+#include "../Log.h"
+#include "Scene.h"
+
+namespace YAMPE { namespace P {
+
+// --------------------------------------------------------
+// binary layout
+
+namespace {
+
+	static_assert(sizeof(unsigned)==sizeof(uint32_t), "Scene columns assume 32 bit unsigned.");
+	static_assert(sizeof(SpringNetwork::Spring)==20, "Scene files store SpringNetwork::Spring records as is.");
+
+	const char MAGIC[8] = { 'Y', 'A', 'M', 'P', 'E', 'S', 'C', 'N' };
+	const uint32_t VERSION = 1;
+	const uint32_t ENDIAN_MARK = 0x01020304u;	///< reads differently on a machine of the other byte order.
+	const uint64_t ALIGNMENT = 64;
+
+	enum Block {
+		POSITION, VELOCITY, INVERSE_MASS, RADIUS, DAMPING, COLOR, FLAGS,
+		TYPE, A, B, TARGET_LENGTH, RESTITUTION, ANCHOR_X, ANCHOR_Y, ANCHOR_Z,
+		SPRINGS, SPRING_ANCHOR,
+		NUM_BLOCKS
+	};
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder;
+		float gravity[3];
+		uint32_t numBlocks;
+		uint64_t numParticles, numConstraints, numAnchors, numSprings, numSpringAnchors;
+		uint64_t offset[NUM_BLOCKS];		///< from the start of the file, multiple of ALIGNMENT.
+		uint64_t size[NUM_BLOCKS];			///< in bytes.
+	};
+
+	/**	True if each count of the header is no more elements than the file
+		could hold, so blockSizes() cannot overflow on a crafted header.
+		*/
+	bool areCountsBounded(const Header& header, uint64_t size) {
+		return header.numParticles<=size/(3*sizeof(float))
+			&& header.numConstraints<=size/sizeof(uint32_t)
+			&& header.numAnchors<=size/sizeof(float)
+			&& header.numSprings<=size/sizeof(SpringNetwork::Spring)
+			&& header.numSpringAnchors<=size/(3*sizeof(float));
+	}
+
+	/// Size in bytes of every block for the given counts.
+	void blockSizes(const Scene::Columns& c, uint64_t size[NUM_BLOCKS]) {
+		uint64_t n = c.numParticles, m = c.numConstraints, k = c.numAnchors;
+		size[POSITION] = size[VELOCITY] = 3*n*sizeof(float);
+		size[INVERSE_MASS] = size[RADIUS] = size[DAMPING] = n*sizeof(float);
+		size[COLOR] = n*sizeof(uint32_t);
+		size[FLAGS] = n*sizeof(uint8_t);
+		size[TYPE] = m*sizeof(uint8_t);
+		size[A] = size[B] = m*sizeof(uint32_t);
+		size[TARGET_LENGTH] = size[RESTITUTION] = m*sizeof(float);
+		size[ANCHOR_X] = size[ANCHOR_Y] = size[ANCHOR_Z] = k*sizeof(float);
+		size[SPRINGS] = c.numSprings*sizeof(SpringNetwork::Spring);
+		size[SPRING_ANCHOR] = 3*c.numSpringAnchors*sizeof(float);
+	}
+
+	void blockPointers(const Scene::Columns& c, const void* block[NUM_BLOCKS]) {
+		block[POSITION] = c.position;
+		block[VELOCITY] = c.velocity;
+		block[INVERSE_MASS] = c.inverseMass;
+		block[RADIUS] = c.radius;
+		block[DAMPING] = c.damping;
+		block[COLOR] = c.color;
+		block[FLAGS] = c.flags;
+		block[TYPE] = c.type;
+		block[A] = c.a;
+		block[B] = c.b;
+		block[TARGET_LENGTH] = c.targetLength;
+		block[RESTITUTION] = c.restitution;
+		block[ANCHOR_X] = c.anchorX;
+		block[ANCHOR_Y] = c.anchorY;
+		block[ANCHOR_Z] = c.anchorZ;
+		block[SPRINGS] = c.springs;
+		block[SPRING_ANCHOR] = c.springAnchor;
+	}
+
+	void setBlockPointers(Scene::Columns& c, const char* base, const Header& header) {
+		const uint64_t* offset = header.offset;
+		c.position = (const float*) (base+offset[POSITION]);
+		c.velocity = (const float*) (base+offset[VELOCITY]);
+		c.inverseMass = (const float*) (base+offset[INVERSE_MASS]);
+		c.radius = (const float*) (base+offset[RADIUS]);
+		c.damping = (const float*) (base+offset[DAMPING]);
+		c.color = (const uint32_t*) (base+offset[COLOR]);
+		c.flags = (const uint8_t*) (base+offset[FLAGS]);
+		c.type = (const uint8_t*) (base+offset[TYPE]);
+		c.a = (const uint32_t*) (base+offset[A]);
+		c.b = (const uint32_t*) (base+offset[B]);
+		c.targetLength = (const float*) (base+offset[TARGET_LENGTH]);
+		c.restitution = (const float*) (base+offset[RESTITUTION]);
+		c.anchorX = (const float*) (base+offset[ANCHOR_X]);
+		c.anchorY = (const float*) (base+offset[ANCHOR_Y]);
+		c.anchorZ = (const float*) (base+offset[ANCHOR_Z]);
+		c.springs = (const SpringNetwork::Spring*) (base+offset[SPRINGS]);
+		c.springAnchor = (const float*) (base+offset[SPRING_ANCHOR]);
+	}
+
+	/// Checks that every index refers to a particle or anchor of the scene.
+	bool isConsistent(const Scene::Columns& c) {
+		uint32_t bad = 0;
+		for (size_t k=0; k<c.numConstraints; ++k) {
+			uint32_t b = c.b[k], anchored = b & ConstraintTable::ANCHORED;
+			bad |= (uint32_t) (c.type[k]>ConstraintTable::MIN);
+			bad |= (uint32_t) (c.a[k]>=c.numParticles);
+			bad |= (uint32_t) ((b & ~ConstraintTable::ANCHORED)>=(anchored ? c.numAnchors : c.numParticles));
+		}
+		for (size_t k=0; k<c.numSprings; ++k) {
+			uint32_t j = c.springs[k].j, anchored = j & SpringNetwork::ANCHORED;
+			bad |= (uint32_t) (c.springs[k].i>=c.numParticles);
+			bad |= (uint32_t) ((j & ~SpringNetwork::ANCHORED)>=(anchored ? c.numSpringAnchors : c.numParticles));
+		}
+		return bad==0;
+	}
+
+}
+
+
+// --------------------------------------------------------
+
+Scene::Scene(const String label) :
+	Printable(label),
+	gravity(0.0f, -9.81f, 0.0f),
+	m_mapping(NULL),
+	m_mappingSize(0)
+{
+	update();
+}
+
+
+Scene::~Scene() {
+	unmap();
+}
+
+
+unsigned Scene::addParticle(const ofVec3f& position, const ofVec3f& velocity,
+		float inverseMass, float radius, uint8_t flags, float damping, uint32_t color) {
+	ASSERT(!isMapped(), "Mapped scenes are read only.");
+	m_position.insert(m_position.end(), { position.x, position.y, position.z });
+	m_velocity.insert(m_velocity.end(), { velocity.x, velocity.y, velocity.z });
+	m_inverseMass.push_back(inverseMass);
+	m_radius.push_back(radius);
+	m_damping.push_back(damping);
+	m_color.push_back(color);
+	m_flags.push_back(flags);
+	update();
+	return (unsigned) m_inverseMass.size()-1;
+}
+
+
+unsigned Scene::addConstraint(ConstraintTable::Type type, unsigned a, unsigned b, float targetLength, float restitution) {
+	ASSERT(!isMapped(), "Mapped scenes are read only.");
+	unsigned row = m_constraints.add(type, a, b, targetLength, restitution);
+	update();
+	return row;
+}
+
+
+unsigned Scene::addAnchoredConstraint(ConstraintTable::Type type, unsigned a, const ofVec3f& anchor, float targetLength, float restitution) {
+	ASSERT(!isMapped(), "Mapped scenes are read only.");
+	unsigned row = m_constraints.addAnchored(type, a, anchor, targetLength, restitution);
+	update();
+	return row;
+}
+
+
+unsigned Scene::addSpring(unsigned i, unsigned j, float springConstant, float restLength, bool isBungee) {
+	ASSERT(!isMapped(), "Mapped scenes are read only.");
+	SpringNetwork::Spring spring = { i, j, springConstant, restLength, isBungee ? 1u : 0u };
+	m_springs.push_back(spring);
+	update();
+	return (unsigned) m_springs.size()-1;
+}
+
+
+unsigned Scene::addAnchoredSpring(unsigned i, const ofVec3f& anchor, float springConstant, float restLength, bool isBungee) {
+	ASSERT(!isMapped(), "Mapped scenes are read only.");
+	unsigned k = (unsigned) m_springAnchor.size()/3;
+	m_springAnchor.insert(m_springAnchor.end(), { anchor.x, anchor.y, anchor.z });
+	return addSpring(i, k | SpringNetwork::ANCHORED, springConstant, restLength, isBungee);
+}
+
+
+void Scene::clear() {
+	unmap();
+	m_position.clear();
+	m_velocity.clear();
+	m_inverseMass.clear();
+	m_radius.clear();
+	m_damping.clear();
+	m_color.clear();
+	m_flags.clear();
+	m_constraints.clear();
+	m_springs.clear();
+	m_springAnchor.clear();
+	update();
+}
+
+
+void Scene::update() {
+	Columns& c = m_columns;
+	c.numParticles = m_inverseMass.size();
+	c.numConstraints = m_constraints.size();
+	c.numAnchors = m_constraints.anchorX.size();
+	c.numSprings = m_springs.size();
+	c.numSpringAnchors = m_springAnchor.size()/3;
+	c.position = m_position.data();
+	c.velocity = m_velocity.data();
+	c.inverseMass = m_inverseMass.data();
+	c.radius = m_radius.data();
+	c.damping = m_damping.data();
+	c.color = m_color.data();
+	c.flags = m_flags.data();
+	c.type = m_constraints.type.data();
+	c.a = m_constraints.a.data();
+	c.b = m_constraints.b.data();
+	c.targetLength = m_constraints.targetLength.data();
+	c.restitution = m_constraints.restitution.data();
+	c.anchorX = m_constraints.anchorX.data();
+	c.anchorY = m_constraints.anchorY.data();
+	c.anchorZ = m_constraints.anchorZ.data();
+	c.springs = m_springs.data();
+	c.springAnchor = m_springAnchor.data();
+}
+
+
+void Scene::unmap() {
+#ifndef _WIN32
+	if (m_mapping!=NULL) munmap(m_mapping, m_mappingSize);
+#endif
+	m_mapping = NULL;
+	m_mappingSize = 0;
+	vector<uint64_t>().swap(m_file);
+}
+
+
+// --------------------------------------------------------
+// authored form
+
+bool Scene::loadXml(const String& path) {
+
+	ofxXmlSettings xml;
+	if (!xml.loadFile(path) || !xml.pushTag("scene")) return false;
+	clear();
+
+	if (xml.getNumTags("gravity")>0) {
+		gravity.set(xml.getAttribute("gravity", "x", 0.0, 0),
+			xml.getAttribute("gravity", "y", -9.81, 0),
+			xml.getAttribute("gravity", "z", 0.0, 0));
+	}
+
+	for (int k=0; k<xml.getNumTags("particle"); ++k) {
+		double mass = xml.getAttribute("particle", "mass", 1.0, k);
+		uint8_t flags = 0;
+		if (xml.getAttribute("particle", "gravity", 1, k)!=0) flags |= GRAVITY;
+		if (xml.getAttribute("particle", "contacts", 1, k)!=0) flags |= CONTACTS;
+		String color = xml.getAttribute("particle", "color", String("000000"), k);
+		addParticle(
+			ofVec3f(xml.getAttribute("particle", "x", 0.0, k), xml.getAttribute("particle", "y", 0.0, k), xml.getAttribute("particle", "z", 0.0, k)),
+			ofVec3f(xml.getAttribute("particle", "vx", 0.0, k), xml.getAttribute("particle", "vy", 0.0, k), xml.getAttribute("particle", "vz", 0.0, k)),
+			mass>0.0 ? (float) (1.0/mass) : 0.0f,
+			(float) xml.getAttribute("particle", "radius", 0.1, k),
+			flags,
+			(float) xml.getAttribute("particle", "damping", 1.0, k),
+			(uint32_t) strtoul(color.c_str(), NULL, 16));
+	}
+
+	for (int k=0; k<xml.getNumTags("constraint"); ++k) {
+		String name = xml.getAttribute("constraint", "type", String("equality"), k);
+		ConstraintTable::Type type = name=="max" ? ConstraintTable::MAX : name=="min" ? ConstraintTable::MIN : ConstraintTable::EQUALITY;
+		unsigned a = (unsigned) xml.getAttribute("constraint", "a", 0, k);
+		float length = (float) xml.getAttribute("constraint", "length", 1.0, k);
+		float restitution = (float) xml.getAttribute("constraint", "restitution", -1.0, k);
+		if (xml.attributeExists("constraint", "b", k)) {
+			addConstraint(type, a, (unsigned) xml.getAttribute("constraint", "b", 0, k), length, restitution);
+		} else {
+			ofVec3f anchor(xml.getAttribute("constraint", "ax", 0.0, k), xml.getAttribute("constraint", "ay", 0.0, k), xml.getAttribute("constraint", "az", 0.0, k));
+			addAnchoredConstraint(type, a, anchor, length, restitution);
+		}
+	}
+
+	for (int k=0; k<xml.getNumTags("spring"); ++k) {
+		unsigned i = (unsigned) xml.getAttribute("spring", "i", 0, k);
+		float springConstant = (float) xml.getAttribute("spring", "k", 1.0, k);
+		float length = (float) xml.getAttribute("spring", "length", 1.0, k);
+		bool isBungee = xml.getAttribute("spring", "bungee", 0, k)!=0;
+		if (xml.attributeExists("spring", "j", k)) {
+			addSpring(i, (unsigned) xml.getAttribute("spring", "j", 0, k), springConstant, length, isBungee);
+		} else {
+			ofVec3f anchor(xml.getAttribute("spring", "ax", 0.0, k), xml.getAttribute("spring", "ay", 0.0, k), xml.getAttribute("spring", "az", 0.0, k));
+			addAnchoredSpring(i, anchor, springConstant, length, isBungee);
+		}
+	}
+
+	xml.popTag();
+	if (!isConsistent(m_columns)) {
+		YAMPE_LOG_WARNING("[Scene::loadXml] Scene refers to a missing particle or anchor, scene ignored.");
+		clear();
+		return false;
+	}
+	return true;
+}
+
+
+// --------------------------------------------------------
+// compiled form
+
+bool Scene::saveBinary(const String& path) const {
+
+	const Columns& c = m_columns;
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.byteOrder = ENDIAN_MARK;
+	header.gravity[0] = gravity.x;
+	header.gravity[1] = gravity.y;
+	header.gravity[2] = gravity.z;
+	header.numBlocks = NUM_BLOCKS;
+	header.numParticles = c.numParticles;
+	header.numConstraints = c.numConstraints;
+	header.numAnchors = c.numAnchors;
+	header.numSprings = c.numSprings;
+	header.numSpringAnchors = c.numSpringAnchors;
+
+	const void* block[NUM_BLOCKS];
+	blockPointers(c, block);
+	blockSizes(c, header.size);
+	uint64_t offset = sizeof(Header);
+	for (unsigned k=0; k<NUM_BLOCKS; ++k) {
+		offset = (offset+ALIGNMENT-1)/ALIGNMENT*ALIGNMENT;
+		header.offset[k] = offset;
+		offset += header.size[k];
+	}
+
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out) return false;
+	out.write((const char*) &header, sizeof(header));
+	static const char padding[ALIGNMENT] = { 0 };
+	uint64_t position = sizeof(Header);
+	for (unsigned k=0; k<NUM_BLOCKS; ++k) {
+		out.write(padding, (std::streamsize) (header.offset[k]-position));
+		if (header.size[k]>0) out.write((const char*) block[k], (std::streamsize) header.size[k]);
+		position = header.offset[k]+header.size[k];
+	}
+	return (bool) out;
+}
+
+
+bool Scene::loadBinary(const String& path) {
+
+	clear();
+
+	const char* base = NULL;
+	size_t size = 0;
+#ifndef _WIN32
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd<0) return false;
+	struct stat info;
+	if (fstat(fd, &info)==0 && (size_t) info.st_size>=sizeof(Header)) {
+		void* mapping = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping!=MAP_FAILED) {
+			madvise(mapping, (size_t) info.st_size, MADV_SEQUENTIAL);
+			m_mapping = mapping;
+			m_mappingSize = (size_t) info.st_size;
+			base = (const char*) mapping;
+			size = m_mappingSize;
+		}
+	}
+	close(fd);
+#else
+	std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+	if (!in) return false;
+	size = (size_t) in.tellg();
+	if (size>=sizeof(Header)) {
+		m_file.resize((size+sizeof(uint64_t)-1)/sizeof(uint64_t));
+		in.seekg(0);
+		if (in.read((char*) m_file.data(), (std::streamsize) size)) base = (const char*) m_file.data();
+	}
+#endif
+	if (base==NULL) {
+		unmap();
+		return false;
+	}
+
+	// header and block bounds, then indices
+	Header header;
+	memcpy(&header, base, sizeof(header));
+	bool isValid = memcmp(header.magic, MAGIC, sizeof(MAGIC))==0
+		&& header.version==VERSION && header.byteOrder==ENDIAN_MARK && header.numBlocks==NUM_BLOCKS
+		&& areCountsBounded(header, size);
+	Columns& c = m_columns;
+	if (isValid) {
+		c.numParticles = (size_t) header.numParticles;
+		c.numConstraints = (size_t) header.numConstraints;
+		c.numAnchors = (size_t) header.numAnchors;
+		c.numSprings = (size_t) header.numSprings;
+		c.numSpringAnchors = (size_t) header.numSpringAnchors;
+		uint64_t expected[NUM_BLOCKS];
+		blockSizes(c, expected);
+		for (unsigned k=0; k<NUM_BLOCKS; ++k) {
+			isValid = isValid && header.size[k]==expected[k] && header.offset[k]%ALIGNMENT==0
+				&& header.offset[k]<=size && header.size[k]<=size-header.offset[k];
+		}
+	}
+	if (isValid) {
+		setBlockPointers(c, base, header);
+		isValid = isConsistent(c);
+	}
+	if (!isValid) {
+		YAMPE_LOG_WARNING("[Scene::loadBinary] Malformed or incompatible scene file, scene ignored.");
+		clear();
+		return false;
+	}
+
+	gravity.set(header.gravity[0], header.gravity[1], header.gravity[2]);
+	return true;
+}
+
+
+// --------------------------------------------------------
+
+void Scene::instantiate(ParticleRegistry& particles, ConstraintTable& constraints, SpringNetwork* springs,
+		ForceGeneratorRegistry& forceGenerators, ForceGenerator::Ref gravityGenerator) const {
+
+	const Columns& c = m_columns;
+	unsigned base = (unsigned) particles.size();
+
+	// particles, one allocation shared by all the Refs
+	if (c.numParticles>0) {
+		Particle::Ref block(new Particle[c.numParticles], std::default_delete<Particle[]>());
+		particles.reserve(particles.size()+c.numParticles);
+		for (size_t k=0; k<c.numParticles; ++k) {
+			Particle& p = block.get()[k];
+			p.position.set(c.position[3*k], c.position[3*k+1], c.position[3*k+2]);
+			p.velocity.set(c.velocity[3*k], c.velocity[3*k+1], c.velocity[3*k+2]);
+			p.setInverseMass(c.inverseMass[k]).setDamping(c.damping[k]);
+			p.radius = c.radius[k];
+			p.bodyColor = ofColor((c.color[k]>>16) & 0xff, (c.color[k]>>8) & 0xff, c.color[k] & 0xff);
+			particles.push_back(Particle::Ref(block, &p));
+		}
+	}
+
+	// gravity, registered a run of flagged particles at a time
+	if (gravityGenerator) {
+		const Particle::Ref* added = particles.data()+base;
+		for (size_t k=0; k<c.numParticles; ) {
+			size_t end = k;
+			while (end<c.numParticles && (c.flags[end] & GRAVITY)) ++end;
+			forceGenerators.add(added+k, end-k, gravityGenerator);
+			for (k = end; k<c.numParticles && !(c.flags[k] & GRAVITY); ++k) { }
+		}
+	}
+
+	// constraint columns, indices moved past the existing rows
+	size_t row = constraints.size();
+	unsigned anchorBase = (unsigned) constraints.anchorX.size();
+	constraints.type.insert(constraints.type.end(), c.type, c.type+c.numConstraints);
+	constraints.a.insert(constraints.a.end(), c.a, c.a+c.numConstraints);
+	constraints.b.insert(constraints.b.end(), c.b, c.b+c.numConstraints);
+	constraints.targetLength.insert(constraints.targetLength.end(), c.targetLength, c.targetLength+c.numConstraints);
+	constraints.restitution.insert(constraints.restitution.end(), c.restitution, c.restitution+c.numConstraints);
+	constraints.direct.resize(constraints.size(), 0);
+	constraints.anchorX.insert(constraints.anchorX.end(), c.anchorX, c.anchorX+c.numAnchors);
+	constraints.anchorY.insert(constraints.anchorY.end(), c.anchorY, c.anchorY+c.numAnchors);
+	constraints.anchorZ.insert(constraints.anchorZ.end(), c.anchorZ, c.anchorZ+c.numAnchors);
+	if (base>0 || anchorBase>0) {
+		for (size_t k=row; k<constraints.size(); ++k) {
+			constraints.a[k] += base;
+			constraints.b[k] += constraints.isAnchored((unsigned) k) ? anchorBase : base;
+		}
+	}
+
+	// springs
+	if (springs!=NULL) {
+		springs->springs.reserve(springs->size()+c.numSprings);
+		for (size_t k=0; k<c.numSprings; ++k) {
+			const SpringNetwork::Spring& s = c.springs[k];
+			if (s.j & SpringNetwork::ANCHORED) {
+				const float* anchor = c.springAnchor+3*(s.j & ~SpringNetwork::ANCHORED);
+				springs->addAnchored(base+s.i, ofVec3f(anchor[0], anchor[1], anchor[2]), s.springConstant, s.restLength, s.isBungee!=0);
+			} else {
+				springs->add(base+s.i, base+s.j, s.springConstant, s.restLength, s.isBungee!=0);
+			}
+		}
+	}
+}
+
+
+const String Scene::toString() const {
+	std::ostringstream outs;
+	outs <<"particles = " <<m_columns.numParticles <<"    "
+		<<"constraints = " <<m_columns.numConstraints <<"    "
+		<<"springs = " <<m_columns.numSprings <<"    "
+		<<"gravity = " <<gravity;
+	if (isMapped()) outs <<"    (mapped)";
+	return outs.str();
+}
+
+} } // namespace YAMPE P
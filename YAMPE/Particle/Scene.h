@@ -0,0 +1,157 @@
+/**
+	@file 		Scene.h
+	@author		dgaffney
+	@practical
+	@brief		Scene description, authored as XML and compiled to a mappable binary form.
+	*/
+
+#ifndef PARTICLE_SCENE_H
+#define PARTICLE_SCENE_H
+
+#include "ConstraintTable.h"
+#include "ForceGeneratorRegistry.h"
+#include "SpringNetwork.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class Scene
+
+	Particles, length constraints, springs and gravity of a simulation, held
+	column-wise like ConstraintTable so that a scene is instantiated by bulk
+	copies rather than one call per object.
+
+	A scene is authored as XML (loadXml):
+
+	\code
+	<scene>
+		<gravity x="0" y="-9.81" z="0"/>
+		<particle x="0" y="5" z="0" vx="0" vy="0" vz="0" mass="1" radius="0.5"
+			damping="1" color="ff0000" gravity="1" contacts="1"/>
+		<constraint type="equality" a="0" ax="0" ay="10" az="0" length="5"/>
+		<constraint type="max" a="0" b="1" length="2" restitution="0.5"/>
+		<spring i="0" j="1" k="50" length="1" bungee="0"/>
+		<spring i="1" ax="0" ay="10" az="0" k="50" length="1"/>
+	</scene>
+	\endcode
+
+	Every attribute is optional, a particle with mass 0 has infinite mass, a
+	constraint or spring without b/j is anchored at (ax, ay, az) and a
+	constraint without restitution takes the ConstraintTable default.
+
+	saveBinary() compiles a scene to a file holding a fixed header followed
+	by one 64 byte aligned block per column, in native (little endian) byte
+	order. loadBinary() maps the file (reads it whole on Windows) and points
+	the columns straight at the blocks after checking that they fit the file,
+	so loading costs nothing per object. The mapping stays open until the
+	scene is cleared or loads another file.
+
+	instantiate() appends the scene to a ParticleRegistry, ConstraintTable,
+	SpringNetwork and ForceGeneratorRegistry. Particles are allocated as one
+	block shared by all their Refs and registered with gravity in bulk.
+	*/
+class Scene : public Printable {
+
+public:
+
+	typedef ofPtr<Scene> Ref;
+
+	enum Flag : uint8_t {
+		GRAVITY = 1,				///< registered with the gravity generator.
+		CONTACTS = 2				///< collides with other balls and the scenery.
+	};
+
+	/// Read only view of the columns, into the scene's own vectors or a mapped file.
+	struct Columns {
+		size_t numParticles, numConstraints, numAnchors, numSprings, numSpringAnchors;
+
+		// one entry per particle (positions and velocities as x, y, z triples)
+		const float* position;
+		const float* velocity;
+		const float* inverseMass;
+		const float* radius;
+		const float* damping;
+		const uint32_t* color;				///< 0xRRGGBB.
+		const uint8_t* flags;
+
+		// ConstraintTable columns, b holds ConstraintTable::ANCHORED|k for anchored rows
+		const uint8_t* type;
+		const uint32_t* a;
+		const uint32_t* b;
+		const float* targetLength;
+		const float* restitution;
+		const float* anchorX;
+		const float* anchorY;
+		const float* anchorZ;
+
+		// SpringNetwork records, j holds SpringNetwork::ANCHORED|k for anchored springs
+		const SpringNetwork::Spring* springs;
+		const float* springAnchor;			///< x, y, z triples.
+	};
+
+	ofVec3f gravity;
+
+	Scene(const String label="Scene");
+	~Scene();
+
+	/// Appends a particle, returns its index.
+	unsigned addParticle(const ofVec3f& position, const ofVec3f& velocity=ofVec3f::zero(),
+		float inverseMass=1.0f, float radius=0.1f, uint8_t flags=GRAVITY|CONTACTS,
+		float damping=1.0f, uint32_t color=0);
+	unsigned addConstraint(ConstraintTable::Type type, unsigned a, unsigned b, float targetLength, float restitution=-1.0f);
+	unsigned addAnchoredConstraint(ConstraintTable::Type type, unsigned a, const ofVec3f& anchor, float targetLength, float restitution=-1.0f);
+	unsigned addSpring(unsigned i, unsigned j, float springConstant, float restLength, bool isBungee=false);
+	unsigned addAnchoredSpring(unsigned i, const ofVec3f& anchor, float springConstant, float restLength, bool isBungee=false);
+
+	/// Removes everything, releasing a mapped file.
+	void clear();
+
+	const Columns& columns() const { return m_columns; }
+	size_t numParticles() const { return m_columns.numParticles; }
+	bool isMapped() const { return m_mapping!=NULL || !m_file.empty(); }
+
+	/// Replaces the scene by an authored XML file, returns false on failure.
+	bool loadXml(const String& path);
+
+	/// Writes the compiled binary form, returns false on failure.
+	bool saveBinary(const String& path) const;
+
+	/// Replaces the scene by a compiled binary file, returns false if missing or malformed.
+	bool loadBinary(const String& path);
+
+	/**	Appends the scene to the given containers. Particle indices in the
+		constraints and springs are offset by the registry's size on entry.
+		Particles flagged GRAVITY are registered with gravityGenerator (if
+		not NULL) and springs are skipped if springs is NULL.
+		*/
+	void instantiate(ParticleRegistry& particles, ConstraintTable& constraints, SpringNetwork* springs,
+		ForceGeneratorRegistry& forceGenerators, ForceGenerator::Ref gravityGenerator) const;
+
+	const String toString() const;
+
+protected:
+
+	// authored columns, used while nothing is mapped
+	vector<float> m_position, m_velocity, m_inverseMass, m_radius, m_damping;
+	vector<uint32_t> m_color;
+	vector<uint8_t> m_flags;
+	ConstraintTable m_constraints;
+	vector<SpringNetwork::Spring> m_springs;
+	vector<float> m_springAnchor;
+
+	Columns m_columns;
+
+	void* m_mapping;				///< mapped file (POSIX).
+	size_t m_mappingSize;
+	vector<uint64_t> m_file;		///< file contents where mapping is unavailable, 8 byte aligned.
+
+	void unmap();
+	void update();					///< points the columns at the authored vectors.
+
+	Scene(const Scene&);
+	Scene& operator=(const Scene&);
+};
+
+} } // namespace YAMPE P
+
+#endif
@@ -0,0 +1,270 @@
+/**
+	@file 		SphereNarrowPhase.cpp
+	@author		dgaffney
+	@practical
+	@brief		Vectorised sphere-sphere overlap tests producing a compact pair list.
+	*/
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define YAMPE_NARROW_PHASE_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#include <emmintrin.h>
+#define YAMPE_NARROW_PHASE_SSE
+#endif
+
+#include "CollisionFilter.h"
+#include "SphereNarrowPhase.h"
+
+namespace YAMPE { namespace P {
+
+namespace {
+
+	/// Widens the squared radius sum so the prefilter never rejects a pair the exact test accepts.
+	const float SLACK = 1.0f + 1.0e-5f;
+
+#if defined(YAMPE_NARROW_PHASE_AVX)
+	/// Lane mask of the 8 candidates whose squared distance to a is below the (widened) squared radius sum.
+	inline int overlaps(__m256 ax, __m256 ay, __m256 az, __m256 ar, __m256 x, __m256 y, __m256 z, __m256 radius) {
+		__m256 dx = _mm256_sub_ps(ax, x), dy = _mm256_sub_ps(ay, y), dz = _mm256_sub_ps(az, z);
+		__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+		__m256 r = _mm256_add_ps(ar, radius);
+		return _mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(_mm256_mul_ps(r, r), _mm256_set1_ps(SLACK)), _CMP_LT_OQ));
+	}
+
+#if defined(__AVX2__)
+	/// The values at 8 scattered indices.
+	inline __m256 gatherLanes(const float* values, const unsigned* c) {
+		return _mm256_i32gather_ps(values, _mm256_loadu_si256((const __m256i*) c), 4);
+	}
+#endif
+#endif
+
+#if defined(YAMPE_NARROW_PHASE_AVX) || defined(YAMPE_NARROW_PHASE_SSE)
+	/// Lane mask of the 4 candidates whose squared distance to a is below the (widened) squared radius sum.
+	inline int overlaps(__m128 ax, __m128 ay, __m128 az, __m128 ar, __m128 x, __m128 y, __m128 z, __m128 radius) {
+		__m128 dx = _mm_sub_ps(ax, x), dy = _mm_sub_ps(ay, y), dz = _mm_sub_ps(az, z);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 r = _mm_add_ps(ar, radius);
+		return _mm_movemask_ps(_mm_cmplt_ps(d2, _mm_mul_ps(_mm_mul_ps(r, r), _mm_set1_ps(SLACK))));
+	}
+
+	/// Lane mask of the 4 candidates whose groups match those of a.
+	inline int groupLanes(__m128i group, __m128i mask, const uint32_t* groups, const uint32_t* masks) {
+		__m128i zero = _mm_setzero_si128();
+		__m128i g = _mm_loadu_si128((const __m128i*) groups), m = _mm_loadu_si128((const __m128i*) masks);
+		__m128i unmatched = _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(group, m), zero), _mm_cmpeq_epi32(_mm_and_si128(g, mask), zero));
+		return ~_mm_movemask_ps(_mm_castsi128_ps(unmatched)) & 0xf;
+	}
+#endif
+
+}
+
+
+unsigned SphereNarrowPhase::width() {
+#if defined(YAMPE_NARROW_PHASE_AVX) || defined(YAMPE_NARROW_PHASE_SSE)
+	return 8;
+#else
+	return 1;
+#endif
+}
+
+
+void SphereNarrowPhase::gather(const ParticleRegistry& particles) {
+	size_t n = particles.size();
+	m_x.resize(n);
+	m_y.resize(n);
+	m_z.resize(n);
+	m_radius.resize(n);
+	for (size_t k=0; k<n; ++k) {
+		const Particle& p = *particles[k];
+		m_x[k] = p.position.x;
+		m_y[k] = p.position.y;
+		m_z[k] = p.position.z;
+		m_radius[k] = p.radius;
+	}
+	m_hasGroups = CollisionFilter::hasGroups(particles);
+	m_group.resize(m_hasGroups ? n : 0);
+	m_mask.resize(m_hasGroups ? n : 0);
+	m_runEnd.resize(m_hasGroups ? n : 0);
+	for (size_t k=0; k<m_group.size(); ++k) {
+		m_group[k] = particles[k]->collisionGroup;
+		m_mask[k] = particles[k]->collisionMask;
+	}
+	// particles of an object are usually added together, so their groups come in runs
+	for (size_t k=m_group.size(); k-->0;) {
+		bool isSame = k+1<n && m_group[k+1]==m_group[k] && m_mask[k+1]==m_mask[k];
+		m_runEnd[k] = isSame ? m_runEnd[k+1] : (unsigned) k+1;
+	}
+}
+
+
+int SphereNarrowPhase::allowed(unsigned a, unsigned b, const unsigned*& excluded, const unsigned* excludedEnd) const {
+	int lanes = 0xff;
+	if (m_hasGroups) {
+#if defined(YAMPE_NARROW_PHASE_AVX) || defined(YAMPE_NARROW_PHASE_SSE)
+		__m128i group = _mm_set1_epi32((int) m_group[a]), mask = _mm_set1_epi32((int) m_mask[a]);
+		lanes = groupLanes(group, mask, &m_group[b], &m_mask[b]) | groupLanes(group, mask, &m_group[b+4], &m_mask[b+4])<<4;
+#else
+		lanes = 0;
+		for (unsigned lane=0; lane<8; ++lane) {
+			if ((m_group[a] & m_mask[b+lane])!=0 && (m_group[b+lane] & m_mask[a])!=0) lanes |= 1<<lane;
+		}
+#endif
+	}
+	for (; excluded<excludedEnd && *excluded<b+8; ++excluded) {
+		if (*excluded>=b) lanes &= ~(1<<(*excluded-b));
+	}
+	return lanes;
+}
+
+
+void SphereNarrowPhase::hit(unsigned a, unsigned b, vector<Pair>& hits) const {
+	float dx = m_x[a]-m_x[b], dy = m_y[a]-m_y[b], dz = m_z[a]-m_z[b];
+	float distance = sqrtf(dx*dx + dy*dy + dz*dz);
+	if (!(distance<m_radius[a]+m_radius[b])) return;
+	if (distance>0.0f) {
+		dx /= distance;
+		dy /= distance;
+		dz /= distance;
+	}
+	Pair pair = { a, b, dx, dy, dz, -distance + m_radius[a] + m_radius[b] };
+	hits.push_back(pair);
+}
+
+
+void SphereNarrowPhase::testRange(unsigned a, unsigned begin, unsigned end, vector<Pair>& hits,
+		const unsigned* excluded, size_t numExcluded) const {
+
+	unsigned b = begin;
+	const unsigned* excludedEnd = excluded+numExcluded;
+	bool isFiltered = m_hasGroups || numExcluded>0;
+
+#if defined(YAMPE_NARROW_PHASE_AVX)
+	__m256 ax = _mm256_set1_ps(m_x[a]), ay = _mm256_set1_ps(m_y[a]), az = _mm256_set1_ps(m_z[a]);
+	__m256 ar = _mm256_set1_ps(m_radius[a]);
+	while (b+8<=end) {
+		// candidates of unmatched groups are skipped a run at a time, other
+		// filtered ones masked out of their block
+		if (m_hasGroups && !isGroupPair(a, b)) {
+			b = m_runEnd[b];
+			continue;
+		}
+		int lanes = isFiltered ? allowed(a, b, excluded, excludedEnd) : 0xff;
+		if (lanes!=0) {
+			int mask = overlaps(ax, ay, az, ar, _mm256_loadu_ps(&m_x[b]), _mm256_loadu_ps(&m_y[b]), _mm256_loadu_ps(&m_z[b]), _mm256_loadu_ps(&m_radius[b])) & lanes;
+			for (unsigned lane=0; mask!=0; ++lane, mask >>= 1) {
+				if (mask & 1) hit(a, b+lane, hits);
+			}
+		}
+		b += 8;
+	}
+#elif defined(YAMPE_NARROW_PHASE_SSE)
+	__m128 ax = _mm_set1_ps(m_x[a]), ay = _mm_set1_ps(m_y[a]), az = _mm_set1_ps(m_z[a]);
+	__m128 ar = _mm_set1_ps(m_radius[a]);
+	while (b+8<=end) {
+		// candidates of unmatched groups are skipped a run at a time, other
+		// filtered ones masked out of their block
+		if (m_hasGroups && !isGroupPair(a, b)) {
+			b = m_runEnd[b];
+			continue;
+		}
+		int lanes = isFiltered ? allowed(a, b, excluded, excludedEnd) : 0xff;
+		if (lanes!=0) {
+			int mask = (overlaps(ax, ay, az, ar, _mm_loadu_ps(&m_x[b]), _mm_loadu_ps(&m_y[b]), _mm_loadu_ps(&m_z[b]), _mm_loadu_ps(&m_radius[b]))
+				| overlaps(ax, ay, az, ar, _mm_loadu_ps(&m_x[b+4]), _mm_loadu_ps(&m_y[b+4]), _mm_loadu_ps(&m_z[b+4]), _mm_loadu_ps(&m_radius[b+4]))<<4) & lanes;
+			for (unsigned lane=0; mask!=0; ++lane, mask >>= 1) {
+				if (mask & 1) hit(a, b+lane, hits);
+			}
+		}
+		b += 8;
+	}
+#endif
+
+	// remainder (or everything without SIMD), same filters and prefilter
+	float xa = m_x[a], ya = m_y[a], za = m_z[a], ra = m_radius[a];
+	for (; b<end; ++b) {
+		if (isFiltered) {
+			while (excluded<excludedEnd && *excluded<b) ++excluded;
+			if (excluded<excludedEnd && *excluded==b) continue;
+			if (m_hasGroups && !isGroupPair(a, b)) {
+				b = m_runEnd[b]-1;
+				continue;
+			}
+		}
+		float dx = xa-m_x[b], dy = ya-m_y[b], dz = za-m_z[b], r = ra+m_radius[b];
+		if (dx*dx + dy*dy + dz*dz < r*r*SLACK) hit(a, b, hits);
+	}
+}
+
+
+void SphereNarrowPhase::test(unsigned a, const unsigned* candidates, size_t count, vector<Pair>& hits) const {
+
+	size_t k = 0;
+
+	// candidates are scattered, so lanes are gathered by AVX2, else loaded one
+	// by one into two SSE vectors (filling an AVX one that way is slower)
+#if defined(YAMPE_NARROW_PHASE_AVX) && defined(__AVX2__)
+	__m256 ax = _mm256_set1_ps(m_x[a]), ay = _mm256_set1_ps(m_y[a]), az = _mm256_set1_ps(m_z[a]);
+	__m256 ar = _mm256_set1_ps(m_radius[a]);
+	for (; k+8<=count; k+=8) {
+		const unsigned* c = candidates+k;
+		int mask = overlaps(ax, ay, az, ar, gatherLanes(m_x.data(), c), gatherLanes(m_y.data(), c), gatherLanes(m_z.data(), c), gatherLanes(m_radius.data(), c));
+		for (unsigned lane=0; mask!=0; ++lane, mask >>= 1) {
+			if (mask & 1) hit(a, c[lane], hits);
+		}
+	}
+#elif defined(YAMPE_NARROW_PHASE_AVX) || defined(YAMPE_NARROW_PHASE_SSE)
+	__m128 ax = _mm_set1_ps(m_x[a]), ay = _mm_set1_ps(m_y[a]), az = _mm_set1_ps(m_z[a]);
+	__m128 ar = _mm_set1_ps(m_radius[a]);
+	for (; k+8<=count; k+=8) {
+		const unsigned* c = candidates+k;
+		int mask = overlaps(ax, ay, az, ar,
+				_mm_setr_ps(m_x[c[0]], m_x[c[1]], m_x[c[2]], m_x[c[3]]),
+				_mm_setr_ps(m_y[c[0]], m_y[c[1]], m_y[c[2]], m_y[c[3]]),
+				_mm_setr_ps(m_z[c[0]], m_z[c[1]], m_z[c[2]], m_z[c[3]]),
+				_mm_setr_ps(m_radius[c[0]], m_radius[c[1]], m_radius[c[2]], m_radius[c[3]]))
+			| overlaps(ax, ay, az, ar,
+				_mm_setr_ps(m_x[c[4]], m_x[c[5]], m_x[c[6]], m_x[c[7]]),
+				_mm_setr_ps(m_y[c[4]], m_y[c[5]], m_y[c[6]], m_y[c[7]]),
+				_mm_setr_ps(m_z[c[4]], m_z[c[5]], m_z[c[6]], m_z[c[7]]),
+				_mm_setr_ps(m_radius[c[4]], m_radius[c[5]], m_radius[c[6]], m_radius[c[7]]))<<4;
+		for (unsigned lane=0; mask!=0; ++lane, mask >>= 1) {
+			if (mask & 1) hit(a, c[lane], hits);
+		}
+	}
+#endif
+
+	float xa = m_x[a], ya = m_y[a], za = m_z[a], ra = m_radius[a];
+	for (; k<count; ++k) {
+		unsigned b = candidates[k];
+		float dx = xa-m_x[b], dy = ya-m_y[b], dz = za-m_z[b], r = ra+m_radius[b];
+		if (dx*dx + dy*dy + dz*dz < r*r*SLACK) hit(a, b, hits);
+	}
+}
+
+
+void SphereNarrowPhase::emit(const ParticleRegistry& particles, const vector<Pair>& hits,
+		ContactRegistry::Ref contactRegistry, const char* label, float restitution) {
+	for (auto && pair: hits) {
+		Contact::Ref contact = contactRegistry->acquire(label);
+		contact->contactNormal = ofVec3f(pair.normalX, pair.normalY, pair.normalZ);
+		contact->a = particles[pair.a];
+		contact->b = particles[pair.b];
+		contact->penetration = pair.penetration;
+		contact->restitution = restitution;
+		contactRegistry->append(contact);
+	}
+}
+
+
+const String SphereNarrowPhase::toString() const {
+	std::ostringstream outs;
+	outs <<"spheres = " <<size() <<"    "
+		<<"width = " <<width();
+	return outs.str();
+}
+
+} } // namespace YAMPE P
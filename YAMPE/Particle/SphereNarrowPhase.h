@@ -0,0 +1,105 @@
+/**
+	@file 		SphereNarrowPhase.h
+	@author		dgaffney
+	@practical
+	@brief		Vectorised sphere-sphere overlap tests producing a compact pair list.
+	*/
+
+#ifndef PARTICLE_SPHERE_NARROW_PHASE_H
+#define PARTICLE_SPHERE_NARROW_PHASE_H
+
+#include "../Particle.h"
+#include "ContactRegistry.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class SphereNarrowPhase
+
+	Tests one particle (sphere) against many candidates at a time. Positions
+	and radii are gathered once per step into columns (gather()); each test
+	then compares squared distances against squared radius sums for width()
+	candidates at a time (8, as one AVX or two SSE2 vectors, or 1 without
+	either), and only the overlapping pairs get a square root and a
+	normalised normal. Listed candidates are tested 8 at a time as well,
+	loaded by an AVX2 gather where available, else one by one.
+
+	Candidates come either as a contiguous index range (brute force, see
+	ParticleParticleContactGenerator) or as an index list from a broad
+	phase. Hits are appended to a compact list of Pair records in candidate
+	order; emit() turns them into contacts.
+
+	A range is the whole broad phase of a brute force loop, so testRange()
+	also applies the collision filter (see CollisionFilter): when some
+	particle has collision groups, the candidates whose groups do not
+	match are skipped before the distance test (whole runs of consecutive
+	particles with the same groups at a time), and so are the listed
+	excluded candidates. Index lists are expected to come
+	filtered from their broad phase.
+
+	The hit test, normal and penetration are computed as the scalar code in
+	ParticleParticleContactGenerator did (distance = |a-b| < ra+rb), the
+	squared test being only a slightly conservative prefilter, so contacts
+	are bitwise the same as before.
+	*/
+class SphereNarrowPhase : public Printable {
+
+public:
+
+	typedef ofPtr<SphereNarrowPhase> Ref;
+
+	/// One overlapping pair, the normal points from b to a.
+	struct Pair {
+		unsigned a, b;
+		float normalX, normalY, normalZ;
+		float penetration;
+	};
+
+	SphereNarrowPhase(const String label="SphereNarrowPhase") : Printable(label), m_hasGroups(false) { };
+
+	/// Candidates of a contiguous range tested at a time by this build.
+	static unsigned width();
+
+	/// Copies positions and radii into the columns, once per step before any test.
+	void gather(const ParticleRegistry& particles);
+
+	/**	Tests particle a against particles [begin, end), appending hits, but
+		for candidates of unmatched groups and the numExcluded (ascending)
+		excluded ones.
+		*/
+	void testRange(unsigned a, unsigned begin, unsigned end, vector<Pair>& hits,
+		const unsigned* excluded=NULL, size_t numExcluded=0) const;
+
+	/// Tests particle a against the count listed candidates, appending hits.
+	void test(unsigned a, const unsigned* candidates, size_t count, vector<Pair>& hits) const;
+
+	/// Appends a contact per hit, with the given restitution.
+	static void emit(const ParticleRegistry& particles, const vector<Pair>& hits,
+		ContactRegistry::Ref contactRegistry, const char* label, float restitution=1.0f);
+
+	size_t size() const { return m_radius.size(); }
+
+	/// True if the last gather() found particles with collision groups.
+	bool hasGroups() const { return m_hasGroups; }
+
+	const String toString() const;
+
+protected:
+
+	TrackedVector<float, MemoryTracker::GENERATORS> m_x, m_y, m_z, m_radius;
+	TrackedVector<uint32_t, MemoryTracker::GENERATORS> m_group, m_mask;	///< gathered only if m_hasGroups.
+	TrackedVector<unsigned, MemoryTracker::GENERATORS> m_runEnd;		///< end of the run of equal groups from each particle.
+	bool m_hasGroups;
+
+	bool isGroupPair(unsigned a, unsigned b) const { return (m_group[a] & m_mask[b])!=0 && (m_group[b] & m_mask[a])!=0; }
+
+	/// Lanes of the 8 candidates from b that may collide with a, by groups and exclusions.
+	int allowed(unsigned a, unsigned b, const unsigned*& excluded, const unsigned* excludedEnd) const;
+
+	/// Exact test of one candidate, appends a hit if the spheres overlap.
+	void hit(unsigned a, unsigned b, vector<Pair>& hits) const;
+};
+
+} } // namespace YAMPE P
+
+#endif
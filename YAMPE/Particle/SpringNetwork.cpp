@@ -0,0 +1,157 @@
+/**
+	@file 		SpringNetwork.cpp
+	@author		dgaffney
+	@practical
+	@brief		Network of two sided springs (ropes, cloth, soft lattices).
+	*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "SpringNetwork.h"
+#include "../Trace.h"
+
+namespace YAMPE { namespace P {
+
+unsigned SpringNetwork::add(unsigned i, unsigned j, float springConstant, float restLength, bool isBungee) {
+	ASSERT((i & ANCHORED)==0 && (j & ANCHORED)==0, "Particle index too large for SpringNetwork.");
+	Spring spring = { i, j, springConstant, restLength, isBungee ? 1u : 0u };
+	springs.push_back(spring);
+	m_isFinal = false;
+	return (unsigned) springs.size()-1;
+}
+
+
+unsigned SpringNetwork::addAnchored(unsigned i, const ofVec3f& anchor, float springConstant, float restLength, bool isBungee) {
+	unsigned row = add(i, (unsigned) anchors.size(), springConstant, restLength, isBungee);
+	springs[row].j |= ANCHORED;
+	anchors.push_back(anchor);
+	return row;
+}
+
+
+void SpringNetwork::clear() {
+	springs.clear();
+	anchors.clear();
+	m_isFinal = false;
+}
+
+
+void SpringNetwork::remapParticles(const vector<unsigned>& rank) {
+	for (auto && s: springs) {
+		s.i = rank[s.i];
+		if (!isAnchored(s)) s.j = rank[s.j];
+	}
+	m_isFinal = false;
+}
+
+
+void SpringNetwork::finalize(size_t numParticles) {
+
+	// Locality - springs of neighbouring particles end up next to each other.
+	std::stable_sort(springs.begin(), springs.end(), [this](const Spring& a, const Spring& b) {
+		unsigned aj = isAnchored(a) ? ANCHORED : a.j;
+		unsigned bj = isAnchored(b) ? ANCHORED : b.j;
+		unsigned aFirst = std::min(a.i, aj), bFirst = std::min(b.i, bj);
+		if (aFirst!=bFirst) return aFirst<bFirst;
+		return std::max(a.i, aj)<std::max(b.i, bj);
+	});
+
+	// CSR adjacency: counts, prefix sum, fill (in spring order).
+	m_offsets.assign(numParticles+1, 0);
+	for (auto && s: springs) {
+		m_offsets[s.i+1]++;
+		if (!isAnchored(s)) m_offsets[s.j+1]++;
+	}
+	for (size_t k=0; k<numParticles; ++k) m_offsets[k+1] += m_offsets[k];
+
+	m_incident.resize(m_offsets[numParticles]);
+	vector<unsigned> fill(m_offsets.begin(), m_offsets.end()-1);
+	for (unsigned k=0; k<springs.size(); ++k) {
+		const Spring& s = springs[k];
+		m_incident[fill[s.i]++] = k;
+		if (!isAnchored(s)) m_incident[fill[s.j]++] = k | ANCHORED;
+	}
+
+	m_springForce.resize(springs.size());
+	m_isFinal = true;
+}
+
+
+void SpringNetwork::evaluate(size_t begin, size_t end) {
+
+	const ofVec3f* p = m_positions.data();
+	const unsigned offset = (unsigned) (m_positions.size()-anchors.size());
+	for (size_t k=begin; k<end; ++k) {
+		const Spring& s = springs[k];
+		unsigned j = (s.j & ANCHORED) ? offset + (s.j & ~ANCHORED) : s.j;
+		ofVec3f d = p[s.i] - p[j];
+		float length = d.length();
+		float stretch = length - s.restLength;
+		bool isSlack = s.isBungee && stretch<=0.0f;
+		m_springForce[k] = (length>0.0f && !isSlack) ? d*(-s.springConstant*stretch/length) : ofVec3f::zero();
+	}
+}
+
+
+void SpringNetwork::scatter(ParticleRegistry& particles, size_t begin, size_t end) {
+
+	for (size_t i=begin; i<end; ++i) {
+		unsigned first = m_offsets[i], last = m_offsets[i+1];
+		if (first==last) continue;
+		ofVec3f total = ofVec3f::zero();
+		for (unsigned k=first; k<last; ++k) {
+			unsigned s = m_incident[k];
+			if (s & ANCHORED) total -= m_springForce[s & ~ANCHORED];
+			else total += m_springForce[s];
+		}
+		particles[i]->applyForce(total);
+	}
+}
+
+
+void SpringNetwork::applyForce(ParticleRegistry& particles, float dt, ThreadPool* pool) {
+	(void) dt;
+	YAMPE_TRACE_SCOPE("SpringNetwork::applyForce");
+
+	const size_t n = particles.size();
+	if (!m_isFinal || m_offsets.size()!=n+1) finalize(n);
+
+	m_positions.resize(n+anchors.size());
+	for (size_t k=0; k<n; ++k) m_positions[k] = particles[k]->position;
+	std::copy(anchors.begin(), anchors.end(), m_positions.begin()+n);
+
+	const size_t numSprings = springs.size();
+	auto evaluateChunk = [this, numSprings](unsigned chunk) {
+		evaluate(chunk*CHUNK_SIZE, std::min(numSprings, (size_t) (chunk+1)*CHUNK_SIZE));
+	};
+	auto scatterChunk = [this, &particles, n](unsigned chunk) {
+		scatter(particles, chunk*CHUNK_SIZE, std::min(n, (size_t) (chunk+1)*CHUNK_SIZE));
+	};
+	unsigned springChunks = (unsigned) ((numSprings+CHUNK_SIZE-1)/CHUNK_SIZE);
+	unsigned particleChunks = (unsigned) ((n+CHUNK_SIZE-1)/CHUNK_SIZE);
+
+	if (pool!=NULL) {
+		pool->parallelFor(springChunks, evaluateChunk);
+		pool->parallelFor(particleChunks, scatterChunk);
+	} else {
+		for (unsigned k=0; k<springChunks; ++k) evaluateChunk(k);
+		for (unsigned k=0; k<particleChunks; ++k) scatterChunk(k);
+	}
+}
+
+
+const String SpringNetwork::toString() const {
+	size_t bungees = 0, anchored = 0;
+	for (auto && s: springs) {
+		bungees += s.isBungee;
+		anchored += isAnchored(s);
+	}
+	std::ostringstream outs;
+	outs <<"springs = " <<springs.size() <<"    "
+		<<"bungees = " <<bungees <<"    "
+		<<"anchored = " <<anchored;
+	return outs.str();
+}
+
+} }	// namespace YAMPE::P
@@ -0,0 +1,94 @@
+/**
+	@file 		SpringNetwork.h
+	@author		dgaffney
+	@practical
+	@brief		Network of two sided springs (ropes, cloth, soft lattices).
+	*/
+
+#ifndef PARTICLE_SPRING_NETWORK_H
+#define PARTICLE_SPRING_NETWORK_H
+
+#include "../Particle.h"
+#include "../ThreadPool.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class SpringNetwork
+
+	Holds any number of springs and bungees between pairs of particles (or a
+	particle and a fixed anchor) as contiguous records. Unlike registering a
+	SpringForceGenerator for each end, every spring is evaluated once and
+	equal and opposite forces are applied to both ends.
+
+	The force on end i is -k*(L-restLength)*(pi-pj)/L; a bungee only pulls,
+	i.e. raises no force when L <= restLength.
+
+	applyForce() works in three passes:
+	- gather particle (and anchor) positions into one index space,
+	- evaluate every spring into its own force slot,
+	- sum the slots incident on each particle through a CSR adjacency
+	  (particle -> signed spring list) and apply the total.
+	Each pass writes only to its own output, so passes 2 and 3 are split
+	over a ThreadPool without conflicts, and the per particle sums are always
+	taken in the same order.
+
+	Particles are referenced by index in the ParticleRegistry given to
+	applyForce(). finalize() (called lazily) sorts springs by their first
+	particle for locality and builds the adjacency.
+	*/
+class SpringNetwork : public Printable {
+
+public:
+
+	typedef ofPtr<SpringNetwork> Ref;
+
+	static const unsigned ANCHORED = 0x80000000u;	///< flag in j marking an anchored spring.
+	static const unsigned CHUNK_SIZE = 4096;		///< springs/particles per parallel chunk.
+
+	struct Spring {
+		unsigned i, j;
+		float springConstant;
+		float restLength;
+		uint32_t isBungee;
+	};
+
+	vector<Spring> springs;
+	vector<ofVec3f> anchors;
+
+	SpringNetwork(const String label="SpringNetwork") : Printable(label), m_isFinal(false) { };
+
+	/// Adds a spring, returns its index (until finalize() reorders the springs).
+	unsigned add(unsigned i, unsigned j, float springConstant, float restLength, bool isBungee=false);
+	unsigned addAnchored(unsigned i, const ofVec3f& anchor, float springConstant, float restLength, bool isBungee=false);
+
+	size_t size() const { return springs.size(); }
+	bool isAnchored(const Spring& s) const { return (s.j & ANCHORED)!=0; }
+	void clear();
+
+	/// Moves particle indices to rank[index], e.g. after MortonOrder::reorder().
+	void remapParticles(const vector<unsigned>& rank);
+
+	/// Sorts the springs for locality and builds the particle adjacency.
+	void finalize(size_t numParticles);
+
+	/// Adds the spring forces to the particles. A NULL pool runs serially.
+	void applyForce(ParticleRegistry& particles, float dt, ThreadPool* pool=NULL);
+
+	const String toString() const;
+
+protected:
+
+	bool m_isFinal;
+	vector<ofVec3f> m_positions;		///< gathered particle then anchor positions.
+	vector<ofVec3f> m_springForce;		///< force on end i of each spring.
+	vector<unsigned> m_offsets;			///< CSR row offsets, one row per particle.
+	vector<unsigned> m_incident;		///< spring index, top bit set when the particle is end j.
+
+	void evaluate(size_t begin, size_t end);
+	void scatter(ParticleRegistry& particles, size_t begin, size_t end);
+};
+
+} } // namespace YAMPE P
+
+#endif
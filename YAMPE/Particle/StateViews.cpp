@@ -0,0 +1,219 @@
+/**
+	@file 		StateViews.cpp
+	@author		dgaffney
+	@practical
+	@brief		Publication of the engine state as read-only strided views (see yampe_state.h).
+	*/
+
+#include "StateViews.h"
+
+namespace YAMPE { namespace P {
+
+namespace {
+	std::atomic<StateViews*> currentViews(NULL);
+
+	inline ptrdiff_t offset(const Particle& particle, const void* field) {
+		return static_cast<const char*>(field) - reinterpret_cast<const char*>(&particle);
+	}
+}
+
+
+StateViews::StateViews(const String label) :
+	Printable(label),
+	m_isStepping(false),
+	m_version(0),
+	m_numParticles(0),
+	m_isRegular(false),
+	m_base(NULL),
+	m_stride(0),
+	m_positionOffset(0), m_velocityOffset(0), m_forceOffset(0), m_radiusOffset(0),
+	m_isIndexed(false)
+{ }
+
+
+void StateViews::setCurrent(StateViews* views) {
+	currentViews.store(views, std::memory_order_release);
+}
+
+
+StateViews* StateViews::current() {
+	return currentViews.load(std::memory_order_acquire);
+}
+
+
+bool StateViews::analyse(const ParticleRegistry& particles) {
+	m_isIndexed = false;
+	size_t n = particles.size();
+	if (n==0) {
+		m_base = NULL;
+		m_stride = sizeof(Particle);
+		return true;
+	}
+	const Particle& first = *particles[0];
+	m_base = reinterpret_cast<const char*>(&first);
+	m_stride = n>1 ? reinterpret_cast<const char*>(particles[1].get()) - m_base : (ptrdiff_t) sizeof(Particle);
+	m_positionOffset = offset(first, &first.position);
+	m_velocityOffset = offset(first, &first.velocity);
+	m_forceOffset = offset(first, &first.force);
+	m_radiusOffset = offset(first, &first.radius);
+	if (m_stride<(ptrdiff_t) sizeof(Particle)) return false;
+	for (size_t k=2; k<n; ++k) {
+		if (reinterpret_cast<const char*>(particles[k].get())!=m_base+k*m_stride) return false;
+	}
+	return true;
+}
+
+
+int32_t StateViews::indexOf(const Particle* particle, const ParticleRegistry& particles) {
+	if (m_isRegular) {
+		ptrdiff_t delta = reinterpret_cast<const char*>(particle) - m_base;
+		if (m_base==NULL || delta<0 || delta%m_stride!=0 || (size_t) (delta/m_stride)>=particles.size()) return -2;
+		return (int32_t) (delta/m_stride);
+	}
+	if (!m_isIndexed) {
+		m_index.clear();
+		for (size_t k=0; k<particles.size(); ++k) m_index[particles[k].get()] = (int32_t) k;
+		m_isIndexed = true;
+	}
+	auto it = m_index.find(particle);
+	return it==m_index.end() ? -2 : it->second;
+}
+
+
+void StateViews::publishContacts(const ContactRegistry& contacts, const ParticleRegistry& particles) {
+	m_isRegular = analyse(particles);
+	size_t n = contacts.size();
+	m_contactA.resize(n);
+	m_contactB.resize(n);
+	m_contactNormal.resize(3*n);
+	m_contactPenetration.resize(n);
+	for (size_t k=0; k<n; ++k) {
+		const Contact& contact = *contacts.contact(k);
+		m_contactA[k] = indexOf(contact.a.get(), particles);
+		m_contactB[k] = contact.b ? indexOf(contact.b.get(), particles) : -1;
+		m_contactNormal[3*k] = contact.contactNormal.x;
+		m_contactNormal[3*k+1] = contact.contactNormal.y;
+		m_contactNormal[3*k+2] = contact.contactNormal.z;
+		m_contactPenetration[k] = contact.penetration;
+	}
+}
+
+
+void StateViews::publish(const ParticleRegistry& particles) {
+	size_t n = particles.size();
+	m_numParticles = n;
+	m_isRegular = analyse(particles);
+	if (!m_isRegular) {
+		m_position.resize(3*n);
+		m_velocity.resize(3*n);
+		m_force.resize(3*n);
+		m_radius.resize(n);
+		for (size_t k=0; k<n; ++k) {
+			const Particle& p = *particles[k];
+			m_position[3*k] = p.position.x; m_position[3*k+1] = p.position.y; m_position[3*k+2] = p.position.z;
+			m_velocity[3*k] = p.velocity.x; m_velocity[3*k+1] = p.velocity.y; m_velocity[3*k+2] = p.velocity.z;
+			m_force[3*k] = p.force.x; m_force[3*k+1] = p.force.y; m_force[3*k+2] = p.force.z;
+			m_radius[k] = p.radius;
+		}
+	}
+	m_version.fetch_add(1, std::memory_order_acq_rel);
+	m_isStepping.store(false, std::memory_order_release);
+}
+
+
+int StateViews::view(int field, yampe_view& view) const {
+	if (field<0 || field>=YAMPE_NUM_FIELDS) return YAMPE_ERROR_FIELD;
+	if (m_isStepping.load(std::memory_order_acquire)) return YAMPE_ERROR_STEPPING;
+	if (version()==0) return YAMPE_ERROR_NONE;
+
+	view.count = m_numParticles;
+	view.dtype = YAMPE_FLOAT32;
+	switch (field) {
+	case YAMPE_POSITION:
+	case YAMPE_VELOCITY:
+	case YAMPE_FORCE:
+	case YAMPE_RADIUS: {
+		view.components = field==YAMPE_RADIUS ? 1 : 3;
+		if (m_isRegular) {
+			ptrdiff_t offsets[] = { m_positionOffset, m_velocityOffset, m_forceOffset, m_radiusOffset };
+			view.data = m_base==NULL ? NULL : m_base+offsets[field];
+			view.stride = m_stride;
+		} else {
+			const vector<float>* columns[] = { &m_position, &m_velocity, &m_force, &m_radius };
+			view.data = columns[field]->data();
+			view.stride = view.components*sizeof(float);
+		}
+		break;
+	}
+	case YAMPE_CONTACT_A:
+	case YAMPE_CONTACT_B:
+		view.data = field==YAMPE_CONTACT_A ? m_contactA.data() : m_contactB.data();
+		view.count = m_contactA.size();
+		view.stride = sizeof(int32_t);
+		view.dtype = YAMPE_INT32;
+		view.components = 1;
+		break;
+	case YAMPE_CONTACT_NORMAL:
+		view.data = m_contactNormal.data();
+		view.count = m_contactA.size();
+		view.stride = 3*sizeof(float);
+		view.components = 3;
+		break;
+	case YAMPE_CONTACT_PENETRATION:
+		view.data = m_contactPenetration.data();
+		view.count = m_contactA.size();
+		view.stride = sizeof(float);
+		view.components = 1;
+		break;
+	}
+	return YAMPE_OK;
+}
+
+
+const String StateViews::toString() const {
+	std::ostringstream outs;
+	outs <<"version = " <<version() <<"    "
+		<<"particles = " <<m_numParticles <<"    "
+		<<"contacts = " <<numContacts() <<"    "
+		<<"zero copy = " <<m_isRegular;
+	return outs.str();
+}
+
+} } // namespace YAMPE P
+
+
+// --------------------------------------------------------
+
+
+using YAMPE::P::StateViews;
+
+namespace {
+	inline const StateViews* views(const yampe_state* state) {
+		return reinterpret_cast<const StateViews*>(state);
+	}
+}
+
+extern "C" {
+
+const yampe_state* yampe_state_get(void) {
+	return reinterpret_cast<const yampe_state*>(StateViews::current());
+}
+
+uint64_t yampe_state_version(const yampe_state* state) {
+	return state ? views(state)->version() : 0;
+}
+
+size_t yampe_state_num_particles(const yampe_state* state) {
+	return state ? views(state)->numParticles() : 0;
+}
+
+size_t yampe_state_num_contacts(const yampe_state* state) {
+	return state ? views(state)->numContacts() : 0;
+}
+
+int yampe_state_view(const yampe_state* state, int field, yampe_view* view) {
+	if (state==NULL || view==NULL) return YAMPE_ERROR_NONE;
+	return views(state)->view(field, *view);
+}
+
+}
@@ -0,0 +1,100 @@
+/**
+	@file 		StateViews.h
+	@author		dgaffney
+	@practical
+	@brief		Publication of the engine state as read-only strided views (see yampe_state.h).
+	*/
+
+#ifndef PARTICLE_STATE_VIEWS_H
+#define PARTICLE_STATE_VIEWS_H
+
+#include <atomic>
+
+#include "../yampe_state.h"
+#include "ContactRegistry.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class StateViews
+
+	Engine side of the C interface in yampe_state.h. Each step:
+	- beginStep() before the step runs, invalidating the views,
+	- publishContacts() while the step's contacts still exist (before the
+	  contact registry is cleared),
+	- publish() after the step, making the views valid again.
+
+	When the particles lie at one regular stride (checked on every
+	publish) the particle views point into the particle objects
+	themselves; otherwise positions, velocities, forces and radii are
+	gathered into columns owned by this object. Contacts are gathered into
+	columns, with particle indices into the published registry (-1 for
+	scenery, -2 for a particle not in the registry).
+
+	The C functions read the StateViews made current by setCurrent().
+	*/
+class StateViews : public Printable {
+
+public:
+
+	typedef ofPtr<StateViews> Ref;
+
+	StateViews(const String label="StateViews");
+
+	/// The views yampe_state_get() returns, NULL for none.
+	static void setCurrent(StateViews* views);
+	static StateViews* current();
+
+	void beginStep() { m_isStepping.store(true, std::memory_order_release); }
+
+	/// Captures the contacts, particle indices refer to particles.
+	void publishContacts(const ContactRegistry& contacts, const ParticleRegistry& particles);
+
+	/// Publishes the particles (and the last captured contacts) and ends the step.
+	void publish(const ParticleRegistry& particles);
+
+	/// Fills view with a field, returns a yampe_status.
+	int view(int field, yampe_view& view) const;
+
+	uint64_t version() const { return m_version.load(std::memory_order_acquire); }
+	size_t numParticles() const { return m_numParticles; }
+	size_t numContacts() const { return m_contactA.size(); }
+	bool isZeroCopy() const { return m_isRegular; }
+
+	const String toString() const;
+
+protected:
+
+	std::atomic<bool> m_isStepping;
+	std::atomic<uint64_t> m_version;
+	size_t m_numParticles;
+
+	// particles at one stride: base, stride and field offsets
+	bool m_isRegular;
+	const char* m_base;
+	ptrdiff_t m_stride;
+	ptrdiff_t m_positionOffset, m_velocityOffset, m_forceOffset, m_radiusOffset;
+
+	// gathered particle columns, used when not regular
+	vector<float> m_position, m_velocity, m_force, m_radius;
+
+	// gathered contact columns
+	vector<int32_t> m_contactA, m_contactB;
+	vector<float> m_contactNormal, m_contactPenetration;
+
+	/// Sets base, stride and offsets, returns true if every particle lies at the stride.
+	bool analyse(const ParticleRegistry& particles);
+
+	/// Index of a particle in the analysed registry, -2 if not in it.
+	int32_t indexOf(const Particle* particle, const ParticleRegistry& particles);
+
+	std::unordered_map<const Particle*, int32_t> m_index;	///< index of irregular particles, built on demand.
+	bool m_isIndexed;
+
+	StateViews(const StateViews&);
+	StateViews& operator=(const StateViews&);
+};
+
+} } // namespace YAMPE P
+
+#endif
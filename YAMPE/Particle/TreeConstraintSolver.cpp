@@ -0,0 +1,322 @@
+/**
+	@file 		TreeConstraintSolver.cpp
+	@author		dgaffney
+	@practical
+	@brief		Direct linear time solver for acyclic equality constraints.
+	*/
+
+#include <cmath>
+
+#include "TreeConstraintSolver.h"
+#include "../Trace.h"
+
+namespace YAMPE { namespace P {
+
+TreeConstraintSolver::Symmetric TreeConstraintSolver::Symmetric::inverse() const {
+	// Adjugate over determinant.
+	Symmetric r;
+	r.xx = yy*zz - yz*yz;
+	r.xy = xz*yz - xy*zz;
+	r.xz = xy*yz - xz*yy;
+	r.yy = xx*zz - xz*xz;
+	r.yz = xy*xz - xx*yz;
+	r.zz = xx*yy - xy*xy;
+	float det = xx*r.xx + xy*r.xy + xz*r.xz;
+	float scale = det!=0.0f ? 1.0f/det : 0.0f;
+	r.xx *= scale; r.xy *= scale; r.xz *= scale;
+	r.yy *= scale; r.yz *= scale; r.zz *= scale;
+	return r;
+}
+
+
+TreeConstraintSolver::TreeConstraintSolver(unsigned maxIterations, float tolerance, const String label) :
+	Printable(label), maxIterations(maxIterations), tolerance(tolerance),
+	iterationUsed(0), maxError(0.0f), m_numCyclicRows(0) { }
+
+
+// --------------------------------------------------------
+
+namespace {
+
+	unsigned find(vector<unsigned>& parent, unsigned k) {
+		while (parent[k]!=k) {
+			parent[k] = parent[parent[k]];
+			k = parent[k];
+		}
+		return k;
+	}
+
+}	// namespace
+
+
+size_t TreeConstraintSolver::attach(const ParticleRegistry& particles, ConstraintTable& table) {
+
+	detach(table);
+	m_rows.clear();
+	m_rowA.clear();
+	m_rowB.clear();
+	m_nodes.clear();
+	m_numCyclicRows = 0;
+
+	const unsigned n = (unsigned) particles.size();
+	const unsigned rows = (unsigned) table.size();
+
+	// Equality rows with at least one movable end; fixed ends become ground.
+	vector<unsigned> candidates, endA, endB;
+	for (unsigned row=0; row<rows; ++row) {
+		if (table.type[row]!=ConstraintTable::EQUALITY) continue;
+		unsigned a = particles[table.a[row]]->hasFiniteMass() ? table.a[row] : NONE;
+		unsigned b = (!table.isAnchored(row) && particles[table.b[row]]->hasFiniteMass()) ? table.b[row] : NONE;
+		if ((a==NONE && b==NONE) || a==b) continue;
+		candidates.push_back(row);
+		endA.push_back(a);
+		endB.push_back(b);
+	}
+
+	// Components over the movable particles, a loop or a second path to
+	// ground makes the whole component cyclic.
+	vector<unsigned> parent(n);
+	for (unsigned k=0; k<n; ++k) parent[k] = k;
+	vector<unsigned> loops;
+	for (size_t k=0; k<candidates.size(); ++k) {
+		if (endA[k]==NONE || endB[k]==NONE) continue;
+		unsigned ra = find(parent, endA[k]);
+		unsigned rb = find(parent, endB[k]);
+		if (ra==rb) loops.push_back(endA[k]);
+		else parent[ra] = rb;
+	}
+	vector<uint8_t> cyclic(n, 0);
+	vector<unsigned> groundRows(n, 0);
+	for (auto && k: loops) cyclic[find(parent, k)] = 1;
+	for (size_t k=0; k<candidates.size(); ++k) {
+		if (endA[k]!=NONE && endB[k]!=NONE) continue;
+		unsigned root = find(parent, endA[k]!=NONE ? endA[k] : endB[k]);
+		if (++groundRows[root]>1) cyclic[root] = 1;
+	}
+
+	for (size_t k=0; k<candidates.size(); ++k) {
+		if (cyclic[find(parent, endA[k]!=NONE ? endA[k] : endB[k])]) {
+			++m_numCyclicRows;
+			continue;
+		}
+		table.direct[candidates[k]] = 1;
+		m_rows.push_back(candidates[k]);
+		m_rowA.push_back(endA[k]);
+		m_rowB.push_back(endB[k]);
+	}
+
+	// Rows incident on each particle (compressed).
+	const unsigned numRows = (unsigned) m_rows.size();
+	vector<unsigned> offsets(n+1, 0), incident;
+	for (unsigned k=0; k<numRows; ++k) {
+		if (m_rowA[k]!=NONE) ++offsets[m_rowA[k]+1];
+		if (m_rowB[k]!=NONE) ++offsets[m_rowB[k]+1];
+	}
+	for (unsigned k=0; k<n; ++k) offsets[k+1] += offsets[k];
+	incident.resize(offsets[n]);
+	vector<unsigned> fill(offsets.begin(), offsets.end()-1);
+	for (unsigned k=0; k<numRows; ++k) {
+		if (m_rowA[k]!=NONE) incident[fill[m_rowA[k]]++] = k;
+		if (m_rowB[k]!=NONE) incident[fill[m_rowB[k]]++] = k;
+	}
+
+	// Breadth first from a root per component (its ground row if it has
+	// one), giving parents before children.
+	vector<uint8_t> particleVisited(n, 0), rowVisited(numRows, 0);
+	vector<Node> order;
+	auto expand = [&](size_t head) {
+		for (; head<order.size(); ++head) {
+			Node node = order[head];
+			if (node.isRow) {
+				unsigned ends[2] = { m_rowA[node.item], m_rowB[node.item] };
+				for (unsigned e=0; e<2; ++e) {
+					unsigned p = ends[e];
+					if (p==NONE || particleVisited[p]) continue;
+					particleVisited[p] = 1;
+					Node child = { p, (unsigned) head, false, e==0 ? 1.0f : -1.0f };
+					order.push_back(child);
+				}
+			} else {
+				for (unsigned j=offsets[node.item]; j<offsets[node.item+1]; ++j) {
+					unsigned row = incident[j];
+					if (rowVisited[row]) continue;
+					rowVisited[row] = 1;
+					Node child = { row, (unsigned) head, true, m_rowA[row]==node.item ? 1.0f : -1.0f };
+					order.push_back(child);
+				}
+			}
+		}
+	};
+	for (unsigned k=0; k<numRows; ++k) {
+		if ((m_rowA[k]!=NONE && m_rowB[k]!=NONE) || rowVisited[k]) continue;
+		rowVisited[k] = 1;
+		Node root = { k, NONE, true, 1.0f };
+		order.push_back(root);
+		expand(order.size()-1);
+	}
+	for (unsigned k=0; k<numRows; ++k) {
+		if (rowVisited[k]) continue;
+		unsigned p = m_rowA[k];
+		particleVisited[p] = 1;
+		Node root = { p, NONE, false, 1.0f };
+		order.push_back(root);
+		expand(order.size()-1);
+	}
+
+	// Children before parents for elimination.
+	const unsigned numNodes = (unsigned) order.size();
+	m_nodes.resize(numNodes);
+	for (unsigned k=0; k<numNodes; ++k) {
+		Node node = order[k];
+		if (node.parent!=NONE) node.parent = numNodes-1-node.parent;
+		m_nodes[numNodes-1-k] = node;
+	}
+
+	m_particleInverse.resize(numNodes);
+	m_rowInverse.resize(numNodes);
+	m_factor.resize(numNodes);
+	m_x.resize(numNodes);
+	m_lambda.resize(numNodes);
+	m_normal.resize(numRows);
+	m_rhs.resize(numRows);
+
+	return m_rows.size();
+}
+
+
+void TreeConstraintSolver::detach(ConstraintTable& table) {
+	std::fill(table.direct.begin(), table.direct.end(), 0);
+}
+
+
+// --------------------------------------------------------
+
+ofVec3f TreeConstraintSolver::end(const ParticleRegistry& particles, const ConstraintTable& table, unsigned row, bool isB) const {
+	if (!isB) return particles[table.a[row]]->position;
+	return table.isAnchored(row) ? table.anchor(row) : particles[table.b[row]]->position;
+}
+
+
+float TreeConstraintSolver::linearise(const ParticleRegistry& particles, const ConstraintTable& table) {
+	float error = 0.0f;
+	for (size_t k=0; k<m_rows.size(); ++k) {
+		unsigned row = m_rows[k];
+		ofVec3f d = end(particles, table, row, false) - end(particles, table, row, true);
+		float length = d.length();
+		float c = length - table.targetLength[row];
+		m_normal[k] = length>0.0f ? d/length : ofVec3f(0.0f, 1.0f, 0.0f);
+		m_rhs[k] = -c;
+		error = std::max(error, std::fabs(c));
+	}
+	return error;
+}
+
+
+void TreeConstraintSolver::factor(const ParticleRegistry& particles) {
+
+	const size_t numNodes = m_nodes.size();
+	for (size_t i=0; i<numNodes; ++i) {
+		if (m_nodes[i].isRow) {
+			m_rowInverse[i] = 0.0f;
+		} else {
+			float m = particles[m_nodes[i].item]->mass();
+			Symmetric d = { m, 0.0f, 0.0f, m, 0.0f, m };
+			m_particleInverse[i] = d;
+		}
+	}
+
+	// D_i is complete once all children are eliminated, each node then
+	// updates its parent: D_p -= H_ip^T D_i^-1 H_ip.
+	for (size_t i=0; i<numNodes; ++i) {
+		const Node& node = m_nodes[i];
+		if (node.isRow) {
+			float inverse = m_rowInverse[i]!=0.0f ? 1.0f/m_rowInverse[i] : 0.0f;
+			m_rowInverse[i] = inverse;
+			if (node.parent==NONE) continue;
+			ofVec3f h = -node.sign*m_normal[node.item];
+			m_factor[i] = h*inverse;
+			Symmetric& d = m_particleInverse[node.parent];
+			d.xx -= inverse*h.x*h.x; d.xy -= inverse*h.x*h.y; d.xz -= inverse*h.x*h.z;
+			d.yy -= inverse*h.y*h.y; d.yz -= inverse*h.y*h.z; d.zz -= inverse*h.z*h.z;
+		} else {
+			m_particleInverse[i] = m_particleInverse[i].inverse();
+			if (node.parent==NONE) continue;
+			ofVec3f h = -node.sign*m_normal[m_nodes[node.parent].item];
+			m_factor[i] = m_particleInverse[i]*h;
+			m_rowInverse[node.parent] -= h.dot(m_factor[i]);
+		}
+	}
+}
+
+
+void TreeConstraintSolver::solveSystem() {
+
+	const size_t numNodes = m_nodes.size();
+	for (size_t i=0; i<numNodes; ++i) {
+		if (m_nodes[i].isRow) m_lambda[i] = -m_rhs[m_nodes[i].item];
+		else m_x[i] = ofVec3f::zero();
+	}
+
+	for (size_t i=0; i<numNodes; ++i) {
+		const Node& node = m_nodes[i];
+		if (node.parent==NONE) continue;
+		if (node.isRow) m_x[node.parent] -= m_factor[i]*m_lambda[i];
+		else m_lambda[node.parent] -= m_factor[i].dot(m_x[i]);
+	}
+	for (size_t i=0; i<numNodes; ++i) {
+		if (m_nodes[i].isRow) m_lambda[i] *= m_rowInverse[i];
+		else m_x[i] = m_particleInverse[i]*m_x[i];
+	}
+	for (size_t i=numNodes; i-->0; ) {
+		const Node& node = m_nodes[i];
+		if (node.parent==NONE) continue;
+		if (node.isRow) m_lambda[i] -= m_factor[i].dot(m_x[node.parent]);
+		else m_x[i] -= m_factor[i]*m_lambda[node.parent];
+	}
+}
+
+
+void TreeConstraintSolver::solve(ParticleRegistry& particles, const ConstraintTable& table) {
+
+	YAMPE_TRACE_SCOPE("TreeConstraintSolver::solve");
+	iterationUsed = 0;
+	maxError = 0.0f;
+	if (m_nodes.empty()) return;
+
+	// Positions, Newton iterations on the row lengths.
+	for (;;) {
+		maxError = linearise(particles, table);
+		if (maxError<=tolerance || iterationUsed==maxIterations) break;
+		factor(particles);
+		solveSystem();
+		for (size_t i=0; i<m_nodes.size(); ++i) {
+			if (!m_nodes[i].isRow) particles[m_nodes[i].item]->position += m_x[i];
+		}
+		++iterationUsed;
+	}
+
+	// Velocities, J v' = -restitution J v.
+	factor(particles);
+	for (size_t k=0; k<m_rows.size(); ++k) {
+		unsigned row = m_rows[k];
+		ofVec3f relative = particles[table.a[row]]->velocity;
+		if (!table.isAnchored(row)) relative -= particles[table.b[row]]->velocity;
+		m_rhs[k] = -(1.0f + table.restitution[row])*relative.dot(m_normal[k]);
+	}
+	solveSystem();
+	for (size_t i=0; i<m_nodes.size(); ++i) {
+		if (!m_nodes[i].isRow) particles[m_nodes[i].item]->velocity += m_x[i];
+	}
+}
+
+
+const String TreeConstraintSolver::toString() const {
+	std::ostringstream outs;
+	outs <<"rows = " <<m_rows.size() <<"    "
+		<<"cyclic rows = " <<m_numCyclicRows <<"    "
+		<<"iterationUsed = " <<iterationUsed <<"    "
+		<<"maxError = " <<maxError;
+	return outs.str();
+}
+
+} }	// namespace YAMPE::P
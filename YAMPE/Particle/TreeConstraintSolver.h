@@ -0,0 +1,116 @@
+/**
+	@file 		TreeConstraintSolver.h
+	@author		dgaffney
+	@practical
+	@brief		Direct linear time solver for acyclic equality constraints.
+	*/
+
+#ifndef PARTICLE_TREE_CONSTRAINT_SOLVER_H
+#define PARTICLE_TREE_CONSTRAINT_SOLVER_H
+
+#include "ConstraintTable.h"
+
+namespace YAMPE { namespace P {
+
+/**
+	\class TreeConstraintSolver
+
+	Solves the equality rows of a ConstraintTable exactly when they form
+	chains or trees (pendulum strings, ropes, hanging chains), following
+	Baraff, Linear-Time Dynamics using Lagrange Multipliers.
+
+	attach() builds the graph whose nodes are the movable particles and the
+	equality rows. Anchors and infinite mass particles are one "ground" node,
+	so a component is acyclic when its rows contain no loop and at most one
+	of them reaches the ground. Rows of acyclic components are flagged in
+	the table's direct column, so contact generation skips them; rows of
+	components with loops are left to the iterative ContactRegistry::resolve.
+
+	Each call to solve() then, for every component,
+	  - projects positions: Newton iterations on the lengths, each solving
+	    J M^-1 J^T for the corrections by sparse LDL^T factorisation of
+	        | M   -J^T |
+	        | -J   0   |
+	    eliminating nodes leaves first, which has no fill in and costs O(n);
+	  - removes the velocity along each row (scaled by its restitution) with
+	    one more solve of the same system.
+
+	attach() must be called again whenever rows are added or particles are
+	made fixed.
+	*/
+class TreeConstraintSolver : public Printable {
+
+public:
+
+	typedef ofPtr<TreeConstraintSolver> Ref;
+
+	unsigned maxIterations;			///< Newton iteration limit for the positions.
+	float tolerance;				///< largest length error accepted.
+
+	unsigned iterationUsed;			///< Newton iterations used by the last solve.
+	float maxError;					///< largest length error after the last solve.
+
+	TreeConstraintSolver(unsigned maxIterations=10, float tolerance=EPS,
+		const String label="TreeConstraintSolver");
+
+	/// Analyses the equality rows and flags those solved directly, returns their number.
+	size_t attach(const ParticleRegistry& particles, ConstraintTable& table);
+
+	/// Returns all rows to the iterative path.
+	void detach(ConstraintTable& table);
+
+	/// Satisfies the attached rows exactly (positions then velocities).
+	void solve(ParticleRegistry& particles, const ConstraintTable& table);
+
+	size_t numRows() const { return m_rows.size(); }
+	size_t numCyclicRows() const { return m_numCyclicRows; }
+
+	const String toString() const;
+
+protected:
+
+	static const unsigned NONE = ~0u;
+
+	/// Symmetric 3x3 matrix.
+	struct Symmetric {
+		float xx, xy, xz, yy, yz, zz;
+
+		ofVec3f operator*(const ofVec3f& v) const {
+			return ofVec3f(xx*v.x + xy*v.y + xz*v.z, xy*v.x + yy*v.y + yz*v.z, xz*v.x + yz*v.y + zz*v.z);
+		}
+		Symmetric inverse() const;
+	};
+
+	/// Node of the elimination order, a movable particle or a row.
+	struct Node {
+		unsigned item;				///< particle index or position in m_rows.
+		unsigned parent;			///< position of parent in m_nodes, NONE for a root.
+		bool isRow;
+		float sign;					///< +1 if the particle of the (node, parent) pair is the row's a end, -1 for b.
+	};
+
+	vector<unsigned> m_rows;		///< attached table rows.
+	vector<unsigned> m_rowA, m_rowB;	///< movable end particles of each attached row, or NONE.
+	vector<Node> m_nodes;			///< all components, children before parents.
+	size_t m_numCyclicRows;
+
+	// per node, reused between calls
+	vector<Symmetric> m_particleInverse;	///< particle nodes: D^-1.
+	vector<float> m_rowInverse;				///< row nodes: D^-1.
+	vector<ofVec3f> m_factor;				///< D^-1 H(node, parent).
+	vector<ofVec3f> m_x;					///< particle nodes: solution.
+	vector<float> m_lambda;					///< row nodes: multiplier.
+
+	// per attached row
+	vector<ofVec3f> m_normal;		///< unit vector from b to a.
+	vector<float> m_rhs;			///< right hand side, J x = rhs.
+
+	ofVec3f end(const ParticleRegistry& particles, const ConstraintTable& table, unsigned row, bool isB) const;
+	float linearise(const ParticleRegistry& particles, const ConstraintTable& table);
+	void factor(const ParticleRegistry& particles);
+	void solveSystem();
+};
+
+} } // namespace YAMPE P
+
+#endif
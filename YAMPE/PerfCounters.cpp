@@ -0,0 +1,234 @@
+/**
+	@file 		PerfCounters.cpp
+	@author		dgaffney
+	@practical
+	@brief		Hardware performance counters around engine phases (Linux only).
+	*/
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace YAMPE {
+
+namespace {
+
+#ifdef __linux__
+
+	/// Counter group of one thread, opened on first use and closed with the thread.
+	struct ThreadCounters {
+		int fd[PerfCounters::NUM_COUNTERS];
+		int slot[PerfCounters::NUM_COUNTERS];	///< position in the group read, -1 if not opened.
+		unsigned numOpen;
+		bool isOpened;
+
+		ThreadCounters() : numOpen(0), isOpened(false) {
+			for (unsigned k=0; k<PerfCounters::NUM_COUNTERS; ++k) fd[k] = slot[k] = -1;
+		}
+
+		~ThreadCounters() {
+			for (unsigned k=0; k<PerfCounters::NUM_COUNTERS; ++k) {
+				if (fd[k]>=0) close(fd[k]);
+			}
+		}
+
+		static int open(uint32_t type, uint64_t config, int leader) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = type;
+			attr.config = config;
+			attr.disabled = leader<0 ? 1 : 0;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			return (int) syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+		}
+
+		bool ensureOpen() {
+			if (isOpened) return fd[PerfCounters::CYCLES]>=0;
+			isOpened = true;
+
+			static const uint32_t TYPE[PerfCounters::NUM_COUNTERS] = {
+				PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+			};
+			static const uint64_t CONFIG[PerfCounters::NUM_COUNTERS] = {
+				PERF_COUNT_HW_CPU_CYCLES,
+				PERF_COUNT_HW_INSTRUCTIONS,
+				PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ<<8) | (PERF_COUNT_HW_CACHE_RESULT_MISS<<16),
+				PERF_COUNT_HW_CACHE_MISSES,
+				PERF_COUNT_HW_BRANCH_MISSES
+			};
+
+			// Cycles lead the group, the others are optional.
+			for (unsigned k=0; k<PerfCounters::NUM_COUNTERS; ++k) {
+				fd[k] = open(TYPE[k], CONFIG[k], k==0 ? -1 : fd[0]);
+				if (fd[k]<0) {
+					if (k==0) return false;
+					continue;
+				}
+				slot[k] = (int) numOpen++;
+			}
+			ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+			return true;
+		}
+
+		bool read(PerfCounters::Sample& sample) {
+			if (!ensureOpen()) return false;
+			uint64_t buffer[3+PerfCounters::NUM_COUNTERS];
+			ssize_t size = ::read(fd[0], buffer, sizeof(buffer));
+			if (size<(ssize_t) ((3+numOpen)*sizeof(uint64_t))) return false;
+
+			// Scale up if the kernel had to multiplex the counters.
+			double scale = buffer[2]>0 && buffer[2]<buffer[1] ? (double) buffer[1]/buffer[2] : 1.0;
+			for (unsigned k=0; k<PerfCounters::NUM_COUNTERS; ++k) {
+				sample.value[k] = slot[k]<0 ? 0 : (uint64_t) (buffer[3+slot[k]]*scale);
+			}
+			return true;
+		}
+	};
+
+	thread_local ThreadCounters threadCounters;
+
+#endif
+
+}	// namespace
+
+
+// --------------------------------------------------------
+
+PerfCounters& PerfCounters::instance() {
+	static PerfCounters perfCounters;
+	return perfCounters;
+}
+
+
+PerfCounters::PerfCounters() : m_numPhases(0), m_steps(0), m_enabled(false) {
+	for (unsigned k=0; k<MAX_PHASES; ++k) {
+		m_phases[k].label = "";
+		for (unsigned c=0; c<NUM_COUNTERS; ++c) m_phases[k].value[c].store(0);
+		m_phases[k].calls.store(0);
+		m_phases[k].items.store(0);
+	}
+}
+
+
+const char* PerfCounters::counterName(Counter counter) {
+	static const char* NAMES[NUM_COUNTERS] = { "cycles", "instructions", "L1D misses", "LLC misses", "branch misses" };
+	return NAMES[counter];
+}
+
+
+bool PerfCounters::isAvailable() {
+#ifdef __linux__
+	return threadCounters.ensureOpen();
+#else
+	return false;
+#endif
+}
+
+
+bool PerfCounters::read(Sample& sample) {
+#ifdef __linux__
+	if (!isEnabled()) return false;
+	return threadCounters.read(sample);
+#else
+	(void) sample;
+	return false;
+#endif
+}
+
+
+unsigned PerfCounters::addPhase(const char* label) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	unsigned n = m_numPhases.load();
+	for (unsigned k=0; k<n; ++k) {
+		if (strcmp(m_phases[k].label, label)==0) return k;
+	}
+	ASSERT(n<MAX_PHASES, "Too many PerfCounters phases.");
+	m_phases[n].label = label;
+	m_numPhases.store(n+1);
+	return n;
+}
+
+
+void PerfCounters::add(unsigned phase, const Sample& begin, const Sample& end, size_t items) {
+	Phase& p = m_phases[phase];
+	for (unsigned c=0; c<NUM_COUNTERS; ++c) {
+		p.value[c].fetch_add(end.value[c]>=begin.value[c] ? end.value[c]-begin.value[c] : 0);
+	}
+	p.calls.fetch_add(1);
+	p.items.fetch_add(items);
+}
+
+
+void PerfCounters::report(std::vector<Report>& reports) const {
+	double steps = (double) std::max<uint64_t>(1, m_steps.load());
+	unsigned n = m_numPhases.load();
+	reports.resize(n);
+	for (unsigned k=0; k<n; ++k) {
+		const Phase& p = m_phases[k];
+		Report& r = reports[k];
+		r.label = p.label;
+		r.calls = p.calls.load()/steps;
+		r.items = p.items.load()/steps;
+		for (unsigned c=0; c<NUM_COUNTERS; ++c) r.value[c] = p.value[c].load()/steps;
+	}
+}
+
+
+void PerfCounters::reset() {
+	unsigned n = m_numPhases.load();
+	for (unsigned k=0; k<n; ++k) {
+		for (unsigned c=0; c<NUM_COUNTERS; ++c) m_phases[k].value[c].store(0);
+		m_phases[k].calls.store(0);
+		m_phases[k].items.store(0);
+	}
+	m_steps.store(0);
+}
+
+
+const String PerfCounters::toString() const {
+	std::vector<Report> reports;
+	report(reports);
+	std::ostringstream outs;
+	outs <<std::fixed <<std::setprecision(2);
+	for (auto && r: reports) {
+		outs <<"\n" <<r.label <<"    "
+			<<"cycles = " <<r.value[CYCLES] <<"    "
+			<<"IPC = " <<r.ipc() <<"    "
+			<<"items = " <<r.items <<"    "
+			<<"L1D/item = " <<r.perItem(L1D_MISSES) <<"    "
+			<<"LLC/item = " <<r.perItem(LLC_MISSES) <<"    "
+			<<"branch/item = " <<r.perItem(BRANCH_MISSES);
+	}
+	return outs.str();
+}
+
+
+// --------------------------------------------------------
+
+PerfCounters::Scope::Scope(unsigned phase, size_t items) : m_phase(phase), m_items(items) {
+	m_active = PerfCounters::instance().read(m_begin);
+}
+
+
+PerfCounters::Scope::~Scope() {
+	Sample end;
+	if (m_active && PerfCounters::instance().read(end)) {
+		PerfCounters::instance().add(m_phase, m_begin, end, m_items);
+	}
+}
+
+}	// namespace YAMPE
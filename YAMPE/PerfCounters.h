@@ -0,0 +1,133 @@
+/**
+	@file 		PerfCounters.h
+	@author		dgaffney
+	@practical
+	@brief		Hardware performance counters around engine phases (Linux only).
+
+	Each thread that takes a reading opens its own group of counters with
+	perf_event_open: cycles, instructions, L1 data cache read misses, last
+	level cache misses and branch misses, user space only. A phase is
+	measured by reading the group of the calling thread before and after it
+	(see Scope), so a phase split into chunks over several threads is still
+	counted in full. The deltas are added to the phase totals, together with
+	the number of items (particles, contacts) the phase processed.
+
+	report() turns the totals into per step figures (endStep() marks a step)
+	with IPC and misses per item, e.g.
+
+	\code
+	static unsigned phase = PerfCounters::instance().addPhase("Resolve");
+	{
+		PerfCounters::Scope scope(phase, contacts->size());
+		contacts->resolve(dt);
+	}
+	PerfCounters::instance().endStep();
+	\endcode
+
+	Counting is off until setEnabled(true), and a Scope then costs two read
+	system calls. Elsewhere than Linux, or when the kernel refuses access
+	(see /proc/sys/kernel/perf_event_paranoid), isAvailable() is false and
+	nothing is counted. Counters the CPU does not support read as zero.
+	*/
+
+#ifndef YAMPE_PERF_COUNTERS_H
+#define YAMPE_PERF_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace YAMPE {
+
+class PerfCounters {
+
+public:
+
+	enum Counter { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, NUM_COUNTERS };
+
+	static const unsigned MAX_PHASES = 32;
+
+	/// Counter values of the calling thread at one instant.
+	struct Sample {
+		uint64_t value[NUM_COUNTERS];
+	};
+
+	/// Per step averages of one phase since the last reset().
+	struct Report {
+		String label;
+		double calls;				///< scopes per step.
+		double items;				///< items per step.
+		double value[NUM_COUNTERS];	///< counts per step.
+
+		double ipc() const { return value[CYCLES]>0.0 ? value[INSTRUCTIONS]/value[CYCLES] : 0.0; }
+		double perItem(Counter counter) const { return items>0.0 ? value[counter]/items : 0.0; }
+	};
+
+	/// Measures one phase on the calling thread for the lifetime of the scope.
+	class Scope {
+	public:
+		Scope(unsigned phase, size_t items=0);
+		~Scope();
+		void setItems(size_t items) { m_items = items; }
+	private:
+		unsigned m_phase;
+		size_t m_items;
+		bool m_active;
+		Sample m_begin;
+	};
+
+	static PerfCounters& instance();
+
+	static const char* counterName(Counter counter);
+
+	void setEnabled(bool enabled) { m_enabled.store(enabled); }
+	bool isEnabled() const { return m_enabled.load(); }
+
+	/// Whether counters can be opened on the calling thread.
+	bool isAvailable();
+
+	/// Reads the counters of the calling thread, false if disabled or unavailable.
+	bool read(Sample& sample);
+
+	/// Returns the phase with the given label, adding it if new.
+	unsigned addPhase(const char* label);
+
+	/// Adds the difference of two samples to a phase.
+	void add(unsigned phase, const Sample& begin, const Sample& end, size_t items);
+
+	/// Marks the end of a step, the unit of report().
+	void endStep() { m_steps.fetch_add(1); }
+
+	void report(std::vector<Report>& reports) const;
+	void reset();
+
+	const String toString() const;
+
+private:
+
+	struct Phase {
+		const char* label;
+		std::atomic<uint64_t> value[NUM_COUNTERS];
+		std::atomic<uint64_t> calls;
+		std::atomic<uint64_t> items;
+	};
+
+	Phase m_phases[MAX_PHASES];
+	std::atomic<unsigned> m_numPhases;
+	std::atomic<uint64_t> m_steps;
+	std::atomic<bool> m_enabled;
+	std::mutex m_mutex;
+
+	PerfCounters();
+	PerfCounters(const PerfCounters&);
+	PerfCounters& operator=(const PerfCounters&);
+};
+
+}	// namespace YAMPE
+
+#endif
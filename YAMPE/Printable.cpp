@@ -5,16 +5,44 @@
 	@brief		Utility class to simplify logging of entiies in a physical simuation.
 	*/
 
+#include "Memory.h"
 #include "Printable.h"
 
 namespace YAMPE {
 
-String Printable::label() const { return m_label; }
+namespace {
+
+	/// Estimated bytes of a string's heap storage, what it asked for; 0 if it is held inside the string (short strings).
+	size_t heapBytes(const String& s) {
+		const char* data = s.data();
+		const char* inside = reinterpret_cast<const char*>(&s);
+		return data>=inside && data<inside+sizeof(String) ? 0 : s.capacity()+1;
+	}
+
+}
+
+const String& Printable::label() const { return m_label; }
 Printable& Printable::setLabel(String label) {
+	const char* data = m_label.data();
+	size_t bytes = heapBytes(m_label);
 	m_label = label;
+	// assignment usually reuses the storage
+	if (m_label.data()!=data || heapBytes(m_label)!=bytes) {
+		TrackingResource& labels = MemoryTracker::instance().resource(MemoryTracker::LABELS);
+		if (bytes>0) labels.noteDeallocation(bytes);
+		noteLabel(true);
+	}
 	return *this;
 }
 
+void Printable::noteLabel(bool isAllocated) const {
+	size_t bytes = heapBytes(m_label);
+	if (bytes==0) return;
+	TrackingResource& labels = MemoryTracker::instance().resource(MemoryTracker::LABELS);
+	if (isAllocated) labels.noteAllocation(bytes);
+	else labels.noteDeallocation(bytes);
+}
+
 std::ostream& operator <<(std::ostream& outputStream, const Printable& p) {
 	outputStream <<"[" <<p.label() <<"] \t" <<p.toString();
 	return outputStream;
@@ -24,16 +24,30 @@ namespace YAMPE {
 	Java-like toString function which is used in the overloaded 
 	output stream operator.
 
+	Labels too long to be stored inside the string are counted as
+	allocations of MemoryTracker::LABELS. The label's allocator is not
+	tracked, so the count is inferred from the string: capacity()+1 bytes
+	whenever its data lies outside the string object. That is an estimate,
+	it misses any rounding up by the allocator and counts a label shared by
+	copy on write strings once per copy.
+
  */
 
 class Printable {
 	
 public:
 	
-	Printable(String label="") : m_label(label) { };
+	Printable(String label="") : m_label(label) { noteLabel(true); };
+	Printable(const Printable& other) : m_label(other.m_label) { noteLabel(true); }
+	/// Moving takes the label's storage, and so its count, leaving other an empty label.
+	Printable(Printable&& other) noexcept : m_label() { m_label.swap(other.m_label); }
+	~Printable() { noteLabel(false); }
+	Printable& operator=(const Printable& other) { return setLabel(other.m_label); }
+	/// Swaps labels, other's storage is counted as freed when other is destroyed or relabelled.
+	Printable& operator=(Printable&& other) noexcept { m_label.swap(other.m_label); return *this; }
 	
 	Printable& setLabel(String label);
-	String label() const;
+	const String& label() const;
 	
 	/// Java-like toString function for debugging/logging 
 	virtual const String toString() const = 0;
@@ -41,6 +55,9 @@ public:
 	
 private:	
 	String m_label;
+
+	/// Counts the label's heap storage (if any) as allocated or freed.
+	void noteLabel(bool isAllocated) const;
 		
 };
 
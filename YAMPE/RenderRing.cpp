@@ -0,0 +1,298 @@
+/**
+	@file 		RenderRing.cpp
+	@author		dgaffney
+	@practical
+	@brief		Render state published through a shared memory ring, for an out of process viewer.
+	*/
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Log.h"
+#include "RenderRing.h"
+
+namespace YAMPE {
+
+namespace {
+	const char MAGIC[8] = { 'Y', 'A', 'M', 'P', 'E', 'R', 'N', 'G' };
+	const size_t ALIGNMENT = 64;
+
+	inline size_t aligned(size_t size) { return (size+ALIGNMENT-1) & ~(ALIGNMENT-1); }
+
+	static_assert(sizeof(ofVec3f)==3*sizeof(float), "Frame copies points as packed x, y, z");
+}
+
+/// Start of the shared memory object, followed by numSlots slots of slotSize bytes.
+struct RenderRing::Header {
+	char magic[8];
+	uint32_t version;
+	uint32_t numSlots;
+	uint32_t maxParticles;
+	uint32_t maxLines;
+	uint64_t slotSize;
+	std::atomic<uint64_t> published;	///< frames published, the newest is in slot (published-1) % numSlots.
+};
+
+/// One frame, the arrays follow at 64 byte aligned offsets (see layout()).
+struct RenderRing::Slot {
+	std::atomic<uint64_t> sequence;		///< odd while being written.
+	uint64_t frame;
+	float time;
+	uint32_t numParticles;
+	uint32_t numLines;
+	uint32_t numAnchors;
+};
+
+namespace {
+	struct Layout {
+		size_t position, radius, color, lines, anchors, size;
+	};
+
+	Layout layout(size_t slotHeader, uint32_t maxParticles, uint32_t maxLines) {
+		Layout l;
+		l.position = aligned(slotHeader);
+		l.radius = aligned(l.position + 3*sizeof(float)*maxParticles);
+		l.color = aligned(l.radius + sizeof(float)*maxParticles);
+		l.lines = aligned(l.color + sizeof(uint32_t)*maxParticles);
+		l.anchors = aligned(l.lines + 6*sizeof(float)*maxLines);
+		l.size = aligned(l.anchors + 3*sizeof(float)*maxLines);
+		return l;
+	}
+}
+
+
+RenderRing::RenderRing(const String label) :
+	Printable(label), m_header(NULL), m_size(0), m_isWriter(false), m_device(0), m_inode(0), m_retries(0) { }
+
+
+RenderRing::~RenderRing() {
+	close();
+}
+
+
+RenderRing::Slot* RenderRing::slot(unsigned k) const {
+	char* base = reinterpret_cast<char*>(m_header) + aligned(sizeof(Header));
+	return reinterpret_cast<Slot*>(base + k*m_header->slotSize);
+}
+
+
+bool RenderRing::create(const String& name, unsigned maxParticles, unsigned maxLines, unsigned numSlots) {
+	close();
+#ifndef _WIN32
+	Layout l = layout(sizeof(Slot), maxParticles, maxLines);
+	size_t size = aligned(sizeof(Header)) + numSlots*l.size;
+
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd<0) {
+		YAMPE_LOG_WARNING("[RenderRing::create] Could not create shared memory object.");
+		return false;
+	}
+	void* mapping = ftruncate(fd, (off_t) size)==0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if (mapping==MAP_FAILED) {
+		shm_unlink(name.c_str());
+		YAMPE_LOG_WARNING("[RenderRing::create] Could not map shared memory object.");
+		return false;
+	}
+
+	// the new object is zero filled, so every slot starts with an even sequence
+	m_header = static_cast<Header*>(mapping);
+	m_header->version = VERSION;
+	m_header->numSlots = numSlots;
+	m_header->maxParticles = maxParticles;
+	m_header->maxLines = maxLines;
+	m_header->slotSize = l.size;
+	m_header->published.store(0, std::memory_order_relaxed);
+	std::memcpy(m_header->magic, MAGIC, sizeof(MAGIC));
+	std::atomic_thread_fence(std::memory_order_release);
+
+	m_size = size;
+	m_name = name;
+	m_isWriter = true;
+	return true;
+#else
+	YAMPE_LOG_WARNING("[RenderRing::create] Shared memory is not supported on this platform.");
+	return false;
+#endif
+}
+
+
+bool RenderRing::attach(const String& name) {
+	close();
+#ifndef _WIN32
+	// a reader only loads, the object is created 0644 for readers of other users
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd<0) return false;
+	struct stat info;
+	void* mapping = fstat(fd, &info)==0 && (size_t) info.st_size>=sizeof(Header)
+		? mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if (mapping==MAP_FAILED) return false;
+
+	const Header* header = static_cast<const Header*>(mapping);
+	Layout l = layout(sizeof(Slot), header->maxParticles, header->maxLines);
+	if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC))!=0 || header->version!=VERSION || header->numSlots==0
+			|| header->slotSize!=l.size || aligned(sizeof(Header)) + header->numSlots*l.size > (size_t) info.st_size) {
+		munmap(mapping, (size_t) info.st_size);
+		YAMPE_LOG_WARNING("[RenderRing::attach] Shared memory object is not a render ring of this version.");
+		return false;
+	}
+
+	m_header = static_cast<Header*>(mapping);
+	m_size = (size_t) info.st_size;
+	m_name = name;
+	m_isWriter = false;
+	m_device = (uint64_t) info.st_dev;
+	m_inode = (uint64_t) info.st_ino;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+bool RenderRing::isReplaced() const {
+#ifndef _WIN32
+	if (m_header==NULL || m_isWriter) return false;
+	int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+	if (fd<0) return true;
+	struct stat info;
+	bool isSame = fstat(fd, &info)==0 && (uint64_t) info.st_dev==m_device && (uint64_t) info.st_ino==m_inode;
+	::close(fd);
+	return !isSame;
+#else
+	return false;
+#endif
+}
+
+
+void RenderRing::close() {
+#ifndef _WIN32
+	if (m_header==NULL) return;
+	munmap(m_header, m_size);
+	if (m_isWriter) shm_unlink(m_name.c_str());
+#endif
+	m_header = NULL;
+	m_size = 0;
+	m_isWriter = false;
+}
+
+
+void RenderRing::publish(float time, const ParticleRegistry& particles, const vector<ofVec3f>& lines, const vector<ofVec3f>& anchors) {
+	if (m_header==NULL || !m_isWriter) return;
+
+	uint64_t frame = m_header->published.load(std::memory_order_relaxed);
+	Slot* s = slot((unsigned) (frame % m_header->numSlots));
+	Layout l = layout(sizeof(Slot), m_header->maxParticles, m_header->maxLines);
+	char* base = reinterpret_cast<char*>(s);
+	float* position = reinterpret_cast<float*>(base + l.position);
+	float* radius = reinterpret_cast<float*>(base + l.radius);
+	uint32_t* color = reinterpret_cast<uint32_t*>(base + l.color);
+	float* ends = reinterpret_cast<float*>(base + l.lines);
+	float* points = reinterpret_cast<float*>(base + l.anchors);
+
+	uint64_t sequence = s->sequence.load(std::memory_order_relaxed);
+	s->sequence.store(sequence+1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	uint32_t numParticles = (uint32_t) std::min(particles.size(), (size_t) m_header->maxParticles);
+	for (uint32_t k=0; k<numParticles; ++k) {
+		const Particle& p = *particles[k];
+		position[3*k] = p.position.x;
+		position[3*k+1] = p.position.y;
+		position[3*k+2] = p.position.z;
+		radius[k] = p.radius;
+		color[k] = (uint32_t(p.bodyColor.r)<<16) | (uint32_t(p.bodyColor.g)<<8) | uint32_t(p.bodyColor.b);
+	}
+	uint32_t numLines = (uint32_t) std::min(lines.size()/2, (size_t) m_header->maxLines);
+	for (uint32_t k=0; k<2*numLines; ++k) {
+		ends[3*k] = lines[k].x;
+		ends[3*k+1] = lines[k].y;
+		ends[3*k+2] = lines[k].z;
+	}
+	uint32_t numAnchors = (uint32_t) std::min(anchors.size(), (size_t) m_header->maxLines);
+	for (uint32_t k=0; k<numAnchors; ++k) {
+		points[3*k] = anchors[k].x;
+		points[3*k+1] = anchors[k].y;
+		points[3*k+2] = anchors[k].z;
+	}
+	s->frame = frame+1;
+	s->time = time;
+	s->numParticles = numParticles;
+	s->numLines = numLines;
+	s->numAnchors = numAnchors;
+
+	s->sequence.store(sequence+2, std::memory_order_release);
+	m_header->published.store(frame+1, std::memory_order_release);
+}
+
+
+bool RenderRing::read(Frame& frame) const {
+	if (m_header==NULL) return false;
+
+	const unsigned ATTEMPTS = 8;
+	Layout l = layout(sizeof(Slot), m_header->maxParticles, m_header->maxLines);
+	for (unsigned attempt=0; attempt<ATTEMPTS; ++attempt) {
+		uint64_t published = m_header->published.load(std::memory_order_acquire);
+		if (published==0 || published<=frame.frame) return false;
+
+		const Slot* s = slot((unsigned) ((published-1) % m_header->numSlots));
+		uint64_t before = s->sequence.load(std::memory_order_acquire);
+		if (before & 1) {
+			++m_retries;
+			continue;
+		}
+
+		uint64_t number = s->frame;
+		float time = s->time;
+		uint32_t numParticles = std::min(s->numParticles, m_header->maxParticles);
+		uint32_t numLines = std::min(s->numLines, m_header->maxLines);
+		uint32_t numAnchors = std::min(s->numAnchors, m_header->maxLines);
+		const char* base = reinterpret_cast<const char*>(s);
+		frame.position.resize(3*numParticles);
+		frame.radius.resize(numParticles);
+		frame.color.resize(numParticles);
+		frame.lines.resize(2*numLines);
+		frame.anchors.resize(numAnchors);
+		std::memcpy(frame.position.data(), base + l.position, 3*sizeof(float)*numParticles);
+		std::memcpy(frame.radius.data(), base + l.radius, sizeof(float)*numParticles);
+		std::memcpy(frame.color.data(), base + l.color, sizeof(uint32_t)*numParticles);
+		std::memcpy(frame.lines.data(), base + l.lines, 6*sizeof(float)*numLines);
+		std::memcpy(frame.anchors.data(), base + l.anchors, 3*sizeof(float)*numAnchors);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (s->sequence.load(std::memory_order_relaxed)!=before) {
+			++m_retries;
+			continue;
+		}
+		frame.frame = number;
+		frame.time = time;
+		return true;
+	}
+	return false;
+}
+
+
+uint64_t RenderRing::numPublished() const {
+	return m_header ? m_header->published.load(std::memory_order_acquire) : 0;
+}
+
+
+const String RenderRing::toString() const {
+	std::ostringstream outs;
+	outs <<"name = " <<m_name <<"    "
+		<<"writer = " <<m_isWriter <<"    "
+		<<"published = " <<numPublished() <<"    "
+		<<"retries = " <<m_retries;
+	return outs.str();
+}
+
+}	// namespace YAMPE
@@ -0,0 +1,128 @@
+/**
+	@file 		RenderRing.h
+	@author		dgaffney
+	@practical
+	@brief		Render state published through a shared memory ring, for an out of process viewer.
+
+	The simulation publishes each step's render state - particle positions,
+	radii and colours, line segments (strings) and anchor points - into a POSIX
+	shared memory object holding a few frame slots. Each slot is guarded by
+	a sequence lock: the writer makes the sequence odd, writes, then makes
+	it even again and advances the latest frame counter. The writer never
+	waits for anyone; a reader copies the newest slot and keeps the copy
+	only if the sequence was even and unchanged across the copy, otherwise
+	it retries (with the slot's successor written meanwhile). With several
+	slots the writer laps a reader only if the reader is slower than
+	(slots-1) steps per copy.
+
+	\code
+	RenderRing ring;							// simulation
+	ring.create("/yampe_render", 10000, 1000);
+	...
+	ring.publish(t, particles, lines, anchors);	// after each step
+
+	RenderRing ring;							// viewer
+	RenderRing::Frame frame;
+	if (ring.attach("/yampe_render") && ring.read(frame)) ...
+	\endcode
+
+	Particles, and lines and anchors, beyond the capacities given to
+	create() are not published. A reader maps the object read only; when
+	the writer closes and a new one creates the object again (the
+	simulation restarted), the reader keeps the old mapping, frozen, until
+	it sees isReplaced() and attaches again. Shared memory is not available
+	on Windows, where create() and attach() fail.
+	*/
+
+#ifndef YAMPE_RENDER_RING_H
+#define YAMPE_RENDER_RING_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "Particle.h"
+
+namespace YAMPE {
+
+class RenderRing : public Printable {
+
+public:
+
+	typedef ofPtr<RenderRing> Ref;
+
+	static const unsigned VERSION = 2;
+	static const unsigned DEFAULT_SLOTS = 4;
+
+	/// A reader's copy of one frame.
+	struct Frame {
+		uint64_t frame;					///< step number, 0 before the first read.
+		float time;
+		vector<float> position;			///< x, y, z per particle.
+		vector<float> radius;
+		vector<uint32_t> color;			///< 0xRRGGBB.
+		vector<ofVec3f> lines;			///< pairs of end points.
+		vector<ofVec3f> anchors;
+
+		Frame() : frame(0), time(0.0f) { }
+		size_t numParticles() const { return radius.size(); }
+		size_t numLines() const { return lines.size()/2; }
+	};
+
+	RenderRing(const String label="RenderRing");
+	~RenderRing();
+
+	/// Creates (or replaces) the shared memory object as the writer, with room for maxLines anchors.
+	bool create(const String& name, unsigned maxParticles, unsigned maxLines, unsigned numSlots=DEFAULT_SLOTS);
+
+	/// Maps an existing shared memory object, read only, as a reader.
+	bool attach(const String& name);
+
+	/**	True if the object this reader mapped has since been removed or
+		created again by a new writer, so attach() would find another (or
+		none). Costs an open and a stat, so is best asked only when no new
+		frame has come for a while.
+		*/
+	bool isReplaced() const;
+
+	/// Unmaps, and removes the object if this is the writer.
+	void close();
+
+	bool isOpen() const { return m_header!=NULL; }
+	bool isWriter() const { return m_isWriter; }
+
+	/**	Publishes a frame, lines holding pairs of end points. Never blocks.
+		*/
+	void publish(float time, const ParticleRegistry& particles, const vector<ofVec3f>& lines, const vector<ofVec3f>& anchors);
+
+	/**	Copies the newest frame if it is newer than frame.frame, returns
+		false if there is none (or no consistent copy could be made).
+		*/
+	bool read(Frame& frame) const;
+
+	uint64_t numPublished() const;
+	uint64_t numRetries() const { return m_retries; }
+
+	const String toString() const;
+
+protected:
+
+	struct Header;
+	struct Slot;
+
+	Header* m_header;
+	size_t m_size;
+	String m_name;
+	bool m_isWriter;
+	uint64_t m_device;					///< identity of a reader's object, for isReplaced().
+	uint64_t m_inode;
+	mutable uint64_t m_retries;			///< reads that had to be repeated.
+
+	Slot* slot(unsigned k) const;
+
+	RenderRing(const RenderRing&);
+	RenderRing& operator=(const RenderRing&);
+};
+
+}	// namespace YAMPE
+
+#endif
@@ -0,0 +1,260 @@
+/**
+	@file 		TaskGraph.cpp
+	@author		dgaffney
+	@practical
+	@brief		Chunked tasks with dependencies, run by work stealing threads.
+	*/
+
+#include <algorithm>
+#include <iomanip>
+
+#include "TaskGraph.h"
+
+namespace YAMPE {
+
+TaskGraph::TaskGraph(unsigned numThreads, const String label) :
+	Printable(label), m_busy(0), m_generation(0), m_stop(false),
+	m_signals(0), m_sleepers(0), m_remainingTasks(0), m_steals(0), m_lastRunMicros(0.0) {
+
+	if (numThreads==0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned k=0; k<numThreads; ++k) {
+		m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		m_queues.back()->head = 0;
+	}
+	for (unsigned k=1; k<numThreads; ++k) {
+		m_workers.push_back(std::thread(&TaskGraph::work, this, k));
+	}
+}
+
+
+TaskGraph::~TaskGraph() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto && worker: m_workers) worker.join();
+}
+
+
+TaskGraph::Id TaskGraph::add(const String& label, unsigned numChunks, Function function,
+	std::initializer_list<Id> after) {
+
+	ASSERT(numChunks>0, "Expected at least one chunk per task.");
+	Task* task = new Task();
+	task->label = label;
+	task->numChunks = numChunks;
+	task->function = function;
+	task->numDependencies = 0;
+	task->traceName = Trace::instance().intern(label);
+	task->chunkStart.resize(numChunks);
+	task->chunkEnd.resize(numChunks);
+	task->timing = Timing();
+	m_tasks.push_back(std::unique_ptr<Task>(task));
+
+	Id id = (Id) m_tasks.size()-1;
+	for (auto && dependency: after) addDependency(id, dependency);
+	return id;
+}
+
+
+void TaskGraph::addDependency(Id task, Id after) {
+	ASSERT(after<task, "Tasks may only depend on tasks added before them.");
+	m_tasks[after]->dependents.push_back(task);
+	++m_tasks[task]->numDependencies;
+}
+
+
+void TaskGraph::clear() {
+	m_tasks.clear();
+}
+
+
+// --------------------------------------------------------
+
+void TaskGraph::run() {
+
+	if (m_tasks.empty()) return;
+	YAMPE_TRACE_SCOPE("TaskGraph::run");
+
+	size_t totalChunks = 0;
+	for (auto && task: m_tasks) {
+		task->pending.store(task->numDependencies);
+		task->remaining.store(task->numChunks);
+		totalChunks += task->numChunks;
+	}
+	for (auto && queue: m_queues) {
+		queue->items.reserve(totalChunks);
+		queue->items.clear();
+		queue->head = 0;
+	}
+	m_remainingTasks.store((unsigned) m_tasks.size());
+	m_steals.store(0);
+	m_start = Clock::now();
+
+	// Tasks without dependencies start on the caller's queue, the workers steal from it.
+	for (Id k=0; k<m_tasks.size(); ++k) {
+		if (m_tasks[k]->numDependencies==0) push(0, k);
+	}
+
+	if (!m_workers.empty()) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_busy = (unsigned) m_workers.size();
+			++m_generation;
+		}
+		m_wake.notify_all();
+	}
+
+	drain(0);
+
+	if (!m_workers.empty()) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this]() { return m_busy==0; });
+	}
+	m_lastRunMicros = std::chrono::duration<double, std::micro>(Clock::now()-m_start).count();
+
+	for (auto && task: m_tasks) {
+		Timing& t = task->timing;
+		t.start = *std::min_element(task->chunkStart.begin(), task->chunkStart.end());
+		t.end = *std::max_element(task->chunkEnd.begin(), task->chunkEnd.end());
+		t.busy = t.maxChunk = 0.0;
+		for (unsigned k=0; k<task->numChunks; ++k) {
+			double duration = task->chunkEnd[k] - task->chunkStart[k];
+			t.busy += duration;
+			t.maxChunk = std::max(t.maxChunk, duration);
+		}
+	}
+}
+
+
+void TaskGraph::push(unsigned thread, Id task) {
+	Queue& queue = *m_queues[thread];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	// Highest chunk first so that the owner, working from the back, starts at chunk 0.
+	for (unsigned k=m_tasks[task]->numChunks; k-->0; ) {
+		Item item = { task, k };
+		queue.items.push_back(item);
+	}
+	signal();
+}
+
+
+void TaskGraph::signal() {
+	// a sleeper counted itself before checking m_signals, so either it sees
+	// this increment or it is counted here and woken (the lock orders the
+	// notification after its check)
+	m_signals.fetch_add(1);
+	if (m_sleepers.load()==0) return;
+	{
+		std::lock_guard<std::mutex> lock(m_idleMutex);
+	}
+	m_idle.notify_all();
+}
+
+
+bool TaskGraph::pop(unsigned thread, Item& item) {
+	{
+		Queue& queue = *m_queues[thread];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.items.size()>queue.head) {
+			item = queue.items.back();
+			queue.items.pop_back();
+			return true;
+		}
+	}
+
+	// Steal the oldest chunk of the next thread that has any.
+	const unsigned n = (unsigned) m_queues.size();
+	for (unsigned k=1; k<n; ++k) {
+		Queue& victim = *m_queues[(thread+k)%n];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.items.size()>victim.head) {
+			item = victim.items[victim.head++];
+			m_steals.fetch_add(1);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void TaskGraph::execute(unsigned thread, const Item& item) {
+
+	Task& task = *m_tasks[item.task];
+	task.chunkStart[item.chunk] = std::chrono::duration<double, std::micro>(Clock::now()-m_start).count();
+	{
+		Trace::Scope scope(task.traceName, item.chunk);
+		task.function(item.chunk, task.numChunks);
+	}
+	task.chunkEnd[item.chunk] = std::chrono::duration<double, std::micro>(Clock::now()-m_start).count();
+
+	if (task.remaining.fetch_sub(1)!=1) return;
+
+	// Last chunk of the task: release the dependents whose last dependency this was.
+	for (auto && dependent: task.dependents) {
+		if (m_tasks[dependent]->pending.fetch_sub(1)==1) push(thread, dependent);
+	}
+	if (m_remainingTasks.fetch_sub(1)==1) signal();
+}
+
+
+void TaskGraph::drain(unsigned thread) {
+	Item item;
+	unsigned failures = 0;
+	while (m_remainingTasks.load()>0) {
+		// read before looking, so chunks queued after the look are not missed
+		unsigned seen = m_signals.load();
+		if (pop(thread, item)) {
+			execute(thread, item);
+			failures = 0;
+			continue;
+		}
+		if (++failures<SPIN_ATTEMPTS) {
+			std::this_thread::yield();
+			continue;
+		}
+		failures = 0;
+		std::unique_lock<std::mutex> lock(m_idleMutex);
+		m_sleepers.fetch_add(1);
+		m_idle.wait(lock, [this, seen]() { return m_signals.load()!=seen || m_remainingTasks.load()==0; });
+		m_sleepers.fetch_sub(1);
+	}
+}
+
+
+void TaskGraph::work(unsigned thread) {
+	Trace::instance().setThreadName("worker " + YAMPE::toString(thread));
+	unsigned long long seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this, seen]() { return m_stop || m_generation!=seen; });
+			if (m_stop) return;
+			seen = m_generation;
+		}
+
+		drain(thread);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busy==0) m_done.notify_one();
+	}
+}
+
+
+const String TaskGraph::toString() const {
+	std::ostringstream outs;
+	outs <<std::fixed <<std::setprecision(1);
+	for (auto && task: m_tasks) {
+		const Timing& t = task->timing;
+		outs <<"\n" <<task->label <<"    "
+			<<"chunks = " <<task->numChunks <<"    "
+			<<"[" <<t.start <<", " <<t.end <<"] us    "
+			<<"busy = " <<t.busy <<" us    "
+			<<"imbalance = " <<t.imbalance(task->numChunks);
+	}
+	outs <<"\nrun = " <<m_lastRunMicros <<" us    threads = " <<numThreads() <<"    steals = " <<steals();
+	return outs.str();
+}
+
+}	// namespace YAMPE
@@ -0,0 +1,163 @@
+/**
+	@file 		TaskGraph.h
+	@author		dgaffney
+	@practical
+	@brief		Chunked tasks with dependencies, run by work stealing threads.
+	*/
+
+#ifndef YAMPE_TASK_GRAPH_H
+#define YAMPE_TASK_GRAPH_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Printable.h"
+#include "Trace.h"
+
+namespace YAMPE {
+
+/**
+	\class TaskGraph
+
+	A step pipeline expressed as tasks, each split into a fixed number of
+	chunks, with explicit "runs after" dependencies between tasks. run()
+	executes the whole graph once: a task's chunks become available when all
+	the tasks it depends on have finished, so independent tasks overlap.
+
+	Every thread (the workers and the caller of run()) owns a queue of
+	chunks. A thread takes its most recently queued chunk first and, when its
+	queue is empty, steals the oldest chunk from another thread's queue. The
+	chunks of a task that becomes ready are queued by the thread that
+	finished its last dependency. A thread that finds no chunk anywhere
+	retries a few times, then sleeps until chunks are queued or the run
+	ends, rather than spinning while a long chunk holds up the rest.
+
+	The start, end and duration of every chunk are recorded, so after run()
+	timing() shows how long each task took and how unevenly its chunks were
+	loaded. When tracing is on every chunk is also a Trace span named after
+	its task.
+
+	As with ThreadPool, which thread runs a chunk is not fixed, so chunks
+	must write only to their own outputs for the results to be repeatable.
+	*/
+class TaskGraph : public Printable {
+
+public:
+
+	typedef unsigned Id;
+	typedef std::function<void(unsigned chunk, unsigned numChunks)> Function;
+
+	/// Timing of one task in the last run, times in microseconds from its start.
+	struct Timing {
+		double start;				///< first chunk started.
+		double end;					///< last chunk finished.
+		double busy;				///< sum of chunk durations.
+		double maxChunk;			///< longest chunk.
+
+		double imbalance(unsigned numChunks) const {
+			return busy>0.0 ? maxChunk*numChunks/busy : 1.0;
+		}
+	};
+
+	/// numThreads counts the calling thread, zero means one per hardware thread.
+	TaskGraph(unsigned numThreads=0, const String label="TaskGraph");
+	~TaskGraph();
+
+	/// Adds a task of numChunks chunks that runs once every task in after has finished.
+	Id add(const String& label, unsigned numChunks, Function function,
+		std::initializer_list<Id> after=std::initializer_list<Id>());
+
+	/// Adds a dependency between existing tasks.
+	void addDependency(Id task, Id after);
+
+	/// Removes all tasks.
+	void clear();
+
+	/// Runs every task once, returns when all have finished.
+	void run();
+
+	unsigned numThreads() const { return (unsigned) m_workers.size()+1; }
+	size_t numTasks() const { return m_tasks.size(); }
+	const String& taskLabel(Id task) const { return m_tasks[task]->label; }
+	unsigned numChunks(Id task) const { return m_tasks[task]->numChunks; }
+	const Timing& timing(Id task) const { return m_tasks[task]->timing; }
+
+	double lastRunMicros() const { return m_lastRunMicros; }
+	unsigned steals() const { return m_steals.load(); }	///< chunks taken from another thread in the last run.
+
+	const String toString() const;
+
+protected:
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct Task {
+		String label;
+		unsigned numChunks;
+		Function function;
+		std::vector<Id> dependents;
+		unsigned numDependencies;
+		uint32_t traceName;
+
+		std::atomic<unsigned> pending;		///< dependencies not yet finished.
+		std::atomic<unsigned> remaining;	///< chunks not yet finished.
+		std::vector<double> chunkStart, chunkEnd;
+		Timing timing;
+	};
+
+	struct Item {
+		Id task;
+		unsigned chunk;
+	};
+
+	/// Per thread queue, the owner works at the back and thieves at the front.
+	struct Queue {
+		std::mutex mutex;
+		std::vector<Item> items;
+		size_t head;
+	};
+
+	std::vector<std::unique_ptr<Task>> m_tasks;
+	std::vector<std::unique_ptr<Queue>> m_queues;	///< queue 0 belongs to the caller of run().
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	unsigned m_busy;					///< workers still inside the current run.
+	unsigned long long m_generation;	///< incremented for every run.
+	bool m_stop;
+
+	static const unsigned SPIN_ATTEMPTS = 64;	///< failed pops before a thread sleeps.
+
+	std::mutex m_idleMutex;
+	std::condition_variable m_idle;		///< chunks queued or the run finished.
+	std::atomic<unsigned> m_signals;	///< incremented for every m_idle event.
+	std::atomic<unsigned> m_sleepers;	///< threads waiting on m_idle.
+
+	std::atomic<unsigned> m_remainingTasks;
+	std::atomic<unsigned> m_steals;
+	Clock::time_point m_start;
+	double m_lastRunMicros;
+
+	void push(unsigned thread, Id task);
+	void signal();
+	bool pop(unsigned thread, Item& item);
+	void execute(unsigned thread, const Item& item);
+	void drain(unsigned thread);
+	void work(unsigned thread);
+
+	TaskGraph(const TaskGraph&);
+	TaskGraph& operator=(const TaskGraph&);
+};
+
+}	// namespace YAMPE
+
+#endif
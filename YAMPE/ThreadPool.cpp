@@ -0,0 +1,87 @@
+/**
+	@file 		ThreadPool.cpp
+	@author		dgaffney
+	@practical
+	@brief		Fixed set of worker threads for data parallel loops.
+	*/
+
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+namespace YAMPE {
+
+ThreadPool::ThreadPool(unsigned numThreads) :
+	m_context(NULL), m_function(NULL), m_count(0), m_next(0), m_busy(0), m_generation(0), m_stop(false) {
+
+	if (numThreads==0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned k=1; k<numThreads; ++k) {
+		m_workers.push_back(std::thread(&ThreadPool::work, this));
+	}
+}
+
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto && worker: m_workers) worker.join();
+}
+
+
+void ThreadPool::run(unsigned count, void* context, Function function) {
+
+	if (count==0) return;
+
+	// Not worth waking anybody for a single index.
+	if (m_workers.empty() || count==1) {
+		for (unsigned k=0; k<count; ++k) function(context, k);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_context = context;
+		m_function = function;
+		m_count = count;
+		m_next.store(0);
+		m_busy = (unsigned) m_workers.size();
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	drain();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_busy==0; });
+	m_function = NULL;
+}
+
+
+void ThreadPool::drain() {
+	for (unsigned k=m_next.fetch_add(1); k<m_count; k=m_next.fetch_add(1)) {
+		m_function(m_context, k);
+	}
+}
+
+
+void ThreadPool::work() {
+	unsigned long long seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this, seen]() { return m_stop || m_generation!=seen; });
+			if (m_stop) return;
+			seen = m_generation;
+		}
+
+		drain();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busy==0) m_done.notify_one();
+	}
+}
+
+}	// namespace YAMPE
@@ -0,0 +1,78 @@
+/**
+	@file 		ThreadPool.h
+	@author		dgaffney
+	@practical
+	@brief		Fixed set of worker threads for data parallel loops.
+	*/
+
+#ifndef YAMPE_THREAD_POOL_H
+#define YAMPE_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace YAMPE {
+
+/**
+	\class ThreadPool
+
+	Runs parallelFor(count, f) by handing out indices 0..count-1 to the worker
+	threads and the calling thread; the call returns once every index has been
+	processed. The callable is passed by reference through a plain function
+	pointer, so dispatching a loop does not allocate.
+
+	Which thread runs an index is not fixed, so callers that need repeatable
+	results must make each index write only to its own output.
+	*/
+class ThreadPool {
+
+public:
+
+	/// numThreads counts the calling thread, zero means one per hardware thread.
+	ThreadPool(unsigned numThreads=0);
+	~ThreadPool();
+
+	/// Number of threads taking part in a loop (workers plus caller).
+	unsigned size() const { return (unsigned) m_workers.size()+1; }
+
+	template <typename F>
+	void parallelFor(unsigned count, F& f) {
+		run(count, &f, &invoke<F>);
+	}
+
+private:
+
+	typedef void (*Function)(void* context, unsigned index);
+
+	template <typename F>
+	static void invoke(void* context, unsigned index) {
+		(*static_cast<F*>(context))(index);
+	}
+
+	void run(unsigned count, void* context, Function function);
+	void work();
+	void drain();
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	void* m_context;
+	Function m_function;
+	unsigned m_count;
+	std::atomic<unsigned> m_next;
+	unsigned m_busy;				///< workers still inside the current loop.
+	unsigned long long m_generation;	///< incremented for every loop.
+	bool m_stop;
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+};
+
+}	// namespace YAMPE
+
+#endif
@@ -0,0 +1,147 @@
+/**
+	@file 		Trace.cpp
+	@author		dgaffney
+	@practical
+	@brief		Low overhead timeline tracing, written as Chrome trace event JSON.
+	*/
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include "Trace.h"
+
+namespace YAMPE {
+
+namespace {
+
+	// setThreadName() before the thread's first event, its ring is added then
+	thread_local String threadName;
+
+}	// namespace
+
+
+Trace& Trace::instance() {
+	static Trace trace;
+	return trace;
+}
+
+
+Trace::Trace() : m_start(Clock::now()), m_enabled(false) { }
+
+
+Trace::~Trace() {
+	if (!m_exitPath.empty()) write(m_exitPath);
+}
+
+
+uint32_t Trace::intern(const String& name) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<String>::iterator it = std::find(m_names.begin(), m_names.end(), name);
+	if (it!=m_names.end()) return (uint32_t) (it-m_names.begin());
+	m_names.push_back(name);
+	return (uint32_t) m_names.size()-1;
+}
+
+
+Trace::ThreadBuffer* Trace::addThread() {
+	ThreadBuffer* buffer = new ThreadBuffer();
+	buffer->events.resize(CAPACITY);
+	buffer->count.store(0, std::memory_order_relaxed);
+	buffer->name = threadName;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	buffer->thread = (unsigned) m_buffers.size();
+	m_buffers.push_back(std::unique_ptr<ThreadBuffer>(buffer));
+	return buffer;
+}
+
+
+void Trace::setThreadName(const String& name) {
+	threadName = name;
+	ThreadBuffer* buffer = localBuffer();
+	if (buffer==NULL) return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	buffer->name = name;
+}
+
+
+size_t Trace::size() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t n = 0;
+	for (auto && buffer: m_buffers) n += (size_t) std::min<uint64_t>(buffer->count.load(std::memory_order_acquire), CAPACITY);
+	return n;
+}
+
+
+void Trace::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto && buffer: m_buffers) buffer->count.store(0, std::memory_order_release);
+}
+
+
+void Trace::setExitPath(const String& path) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_exitPath = path;
+}
+
+
+namespace {
+
+	void writeEscaped(std::ostream& outs, const String& s) {
+		for (auto && c: s) {
+			if (c=='"' || c=='\\') outs <<'\\';
+			if ((unsigned char) c>=0x20) outs <<c;
+		}
+	}
+
+}	// namespace
+
+
+bool Trace::write(const String& path) const {
+
+	std::ofstream outs(path.c_str());
+	if (!outs) return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	outs <<"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool isFirst = true;
+	char time[32];
+	for (auto && buffer: m_buffers) {
+
+		// Name the thread, then its events oldest first.
+		outs <<(isFirst ? "" : ",")
+			<<"\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" <<buffer->thread
+			<<",\"args\":{\"name\":\"";
+		writeEscaped(outs, buffer->name.empty() ? "thread " + YAMPE::toString(buffer->thread) : buffer->name);
+		outs <<"\"}}";
+		isFirst = false;
+
+		uint64_t count = buffer->count.load(std::memory_order_acquire);
+		uint64_t begin = count>CAPACITY ? count-CAPACITY : 0;
+		unsigned depth = 0;
+		for (uint64_t k=begin; k<count; ++k) {
+			const Event& event = buffer->events[k & (CAPACITY-1)];
+			bool isEnd = (event.name & END)!=0;
+
+			// Ends whose begin was overwritten would unbalance the timeline.
+			if (isEnd) {
+				if (depth==0) continue;
+				--depth;
+			} else {
+				++depth;
+			}
+
+			snprintf(time, sizeof(time), "%.3f", event.nanos/1000.0);
+			outs <<",\n{\"name\":\"";
+			writeEscaped(outs, m_names[event.name & ~END]);
+			outs <<"\",\"ph\":\"" <<(isEnd ? 'E' : 'B') <<"\",\"ts\":" <<time
+				<<",\"pid\":1,\"tid\":" <<buffer->thread;
+			if (!isEnd && event.arg!=NO_ARG) outs <<",\"args\":{\"arg\":" <<event.arg <<"}";
+			outs <<"}";
+		}
+	}
+	outs <<"\n]}\n";
+	return (bool) outs;
+}
+
+}	// namespace YAMPE
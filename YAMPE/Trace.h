@@ -0,0 +1,162 @@
+/**
+	@file 		Trace.h
+	@author		dgaffney
+	@practical
+	@brief		Low overhead timeline tracing, written as Chrome trace event JSON.
+
+	Begin and end events are recorded into a preallocated ring buffer owned
+	by the recording thread, so recording takes no lock and never allocates:
+	one clock read and one 16 byte store per event. When a ring is full the
+	oldest events are overwritten, so a long (soak) run keeps its most recent
+	CAPACITY events per thread.
+
+	Event names are interned once (at the call site, or when a TaskGraph task
+	is added) and stored as small integers.
+
+	\code
+	void ContactRegistry::resolve(float dt) {
+		YAMPE_TRACE_SCOPE("ContactRegistry::resolve");
+		...
+	}
+	\endcode
+
+	write() produces a file for chrome://tracing or https://ui.perfetto.dev.
+	It reads the rings of all threads, so call it while no events are being
+	recorded (e.g. between steps). A path given to setExitPath() is written
+	when the program exits. Threads are named in the output by
+	setThreadName(), main() names itself "main" before starting any other.
+	*/
+
+#ifndef YAMPE_TRACE_H
+#define YAMPE_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace YAMPE {
+
+class Trace {
+
+public:
+
+	static const unsigned CAPACITY = 1u<<16;		///< events per thread (power of two).
+	static const uint32_t NO_ARG = ~0u;
+
+	struct Event {
+		uint64_t nanos;				///< time since the tracer was created.
+		uint32_t name;				///< interned name, top bit set for an end event.
+		uint32_t arg;				///< optional argument (chunk, island, ...), NO_ARG if none.
+	};
+
+	/// Records a begin event on construction and the matching end event on destruction.
+	class Scope {
+	public:
+		Scope(uint32_t name, uint32_t arg=NO_ARG) : m_name(name), m_active(Trace::instance().isEnabled()) {
+			if (m_active) Trace::instance().record(name, arg);
+		}
+		~Scope() {
+			if (m_active) Trace::instance().record(m_name | END, NO_ARG);
+		}
+	private:
+		uint32_t m_name;
+		bool m_active;
+	};
+
+	static Trace& instance();
+
+	void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+	bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+	/// Returns the id of a name, adding it if new. Takes a lock, not for use per event.
+	uint32_t intern(const String& name);
+
+	/// Records one event for the calling thread.
+	void record(uint32_t name, uint32_t arg) {
+		ThreadBuffer* buffer = threadBuffer();
+		uint64_t count = buffer->count.load(std::memory_order_relaxed);	// only this thread stores it
+		Event& event = buffer->events[count & (CAPACITY-1)];
+		event.nanos = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()-m_start).count();
+		event.name = name;
+		event.arg = arg;
+		buffer->count.store(count+1, std::memory_order_release);		// publishes the event to size() and write()
+	}
+
+	/// Names the calling thread in the output, "thread n" if never named.
+	void setThreadName(const String& name);
+
+	/// Number of events currently held, over all threads.
+	size_t size() const;
+
+	/// Discards all recorded events.
+	void clear();
+
+	/// Writes the recorded events as Chrome trace event JSON, returns false on failure.
+	bool write(const String& path) const;
+
+	/// Writes the trace to path when the program exits (empty for none).
+	void setExitPath(const String& path);
+
+private:
+
+	typedef std::chrono::steady_clock Clock;
+
+	static const uint32_t END = 0x80000000u;
+
+	struct ThreadBuffer {
+		std::vector<Event> events;
+		std::atomic<uint64_t> count;	///< events ever recorded, the ring holds the last CAPACITY.
+		unsigned thread;			///< sequential thread number used in the output.
+		String name;				///< from setThreadName(), empty if never named.
+	};
+
+	static ThreadBuffer*& localBuffer() {
+		static thread_local ThreadBuffer* buffer = NULL;
+		return buffer;
+	}
+
+	ThreadBuffer* threadBuffer() {
+		ThreadBuffer*& buffer = localBuffer();
+		if (buffer==NULL) buffer = addThread();
+		return buffer;
+	}
+
+	ThreadBuffer* addThread();
+
+	Clock::time_point m_start;
+	std::atomic<bool> m_enabled;
+	mutable std::mutex m_mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;	///< outlive their threads.
+	std::vector<String> m_names;
+	String m_exitPath;
+
+	Trace();
+	~Trace();
+	Trace(const Trace&);
+	Trace& operator=(const Trace&);
+};
+
+}	// namespace YAMPE
+
+
+#define YAMPE_TRACE_CONCAT2(a, b) a##b
+#define YAMPE_TRACE_CONCAT(a, b) YAMPE_TRACE_CONCAT2(a, b)
+
+/// Traces the rest of the enclosing block under a (literal) name.
+#define YAMPE_TRACE_SCOPE(name) \
+	static const uint32_t YAMPE_TRACE_CONCAT(yampeTraceName, __LINE__) = YAMPE::Trace::instance().intern(name); \
+	YAMPE::Trace::Scope YAMPE_TRACE_CONCAT(yampeTraceScope, __LINE__)(YAMPE_TRACE_CONCAT(yampeTraceName, __LINE__))
+
+/// As YAMPE_TRACE_SCOPE, with an integer argument shown with the event.
+#define YAMPE_TRACE_SCOPE_ARG(name, arg) \
+	static const uint32_t YAMPE_TRACE_CONCAT(yampeTraceName, __LINE__) = YAMPE::Trace::instance().intern(name); \
+	YAMPE::Trace::Scope YAMPE_TRACE_CONCAT(yampeTraceScope, __LINE__)(YAMPE_TRACE_CONCAT(yampeTraceName, __LINE__), (uint32_t) (arg))
+
+#endif
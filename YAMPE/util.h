@@ -16,6 +16,9 @@
 
 	*/
 
+#ifndef UTIL_H
+#define UTIL_H
+
 /**
   * Macro to handle unused parameter warning across multiple 
   * compilers
@@ -74,7 +77,8 @@ namespace YAMPE {
 
 typedef std::string String;
  
-// TODO - must convert over to FastFormat (http://www.fastformat.org/)
+// NOTE - builds a stream so not for use inside the simulation step, log there
+// with the YAMPE_LOG macros (see Log.h) which defer formatting.
 template <class T>
 inline String toString (const T& t)
 {
@@ -110,3 +114,5 @@ define foreach(var, container) \
       ++var)
 */
 }	// namespace YAMPE
+
+#endif
@@ -0,0 +1,95 @@
+/**
+	@file 		yampe_state.h
+	@author		dgaffney
+	@practical
+	@brief		C interface to read-only strided views of the engine state.
+
+	Plain C, so analysis tools and language bindings (ctypes, cffi, Julia,
+	...) can read the state in place: each view is a base pointer, a count,
+	a stride in bytes between elements and the type and number of the
+	components of an element, like a NumPy array interface. Element k,
+	component c is at
+
+	\code
+	(const float*) ((const char*) view.data + k*view.stride) + c
+	\endcode
+
+	for YAMPE_FLOAT32 (likewise for YAMPE_INT32).
+
+	Views are published by the engine after each step (see
+	YAMPE::P::StateViews) and stay valid until the next step begins; the
+	version increases with every publication, so a consumer can tell that
+	views it holds went stale. Particle views point straight into the
+	particle objects when they lie at a regular stride (one block, as
+	Scene and ParticlePool allocate); otherwise the engine gathers them
+	once per publication. Contact views are always gathered, as contacts
+	only live within a step.
+	*/
+
+#ifndef YAMPE_STATE_H
+#define YAMPE_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(YAMPE_SHARED)
+#define YAMPE_API __declspec(dllexport)
+#else
+#define YAMPE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	YAMPE_FLOAT32 = 1,
+	YAMPE_INT32 = 2
+} yampe_dtype;
+
+typedef enum {
+	YAMPE_POSITION = 0,				/* float32 x 3 per particle */
+	YAMPE_VELOCITY = 1,				/* float32 x 3 per particle */
+	YAMPE_FORCE = 2,				/* float32 x 3 per particle, total force of the last step */
+	YAMPE_RADIUS = 3,				/* float32 per particle */
+	YAMPE_CONTACT_A = 4,			/* int32 per contact, particle index */
+	YAMPE_CONTACT_B = 5,			/* int32 per contact, particle index, -1 for scenery */
+	YAMPE_CONTACT_NORMAL = 6,		/* float32 x 3 per contact, from b to a */
+	YAMPE_CONTACT_PENETRATION = 7,	/* float32 per contact */
+	YAMPE_NUM_FIELDS = 8
+} yampe_field;
+
+typedef enum {
+	YAMPE_OK = 0,
+	YAMPE_ERROR_FIELD = -1,			/* unknown field */
+	YAMPE_ERROR_STEPPING = -2,		/* a step is running, views are invalid */
+	YAMPE_ERROR_NONE = -3			/* nothing published yet */
+} yampe_status;
+
+typedef struct {
+	const void* data;
+	size_t count;
+	ptrdiff_t stride;				/* bytes between elements */
+	int32_t dtype;					/* yampe_dtype */
+	int32_t components;
+} yampe_view;
+
+typedef struct yampe_state yampe_state;
+
+/* The state the engine publishes to, NULL if it publishes none. */
+YAMPE_API const yampe_state* yampe_state_get(void);
+
+/* Number of publications so far, 0 if none. */
+YAMPE_API uint64_t yampe_state_version(const yampe_state* state);
+
+YAMPE_API size_t yampe_state_num_particles(const yampe_state* state);
+YAMPE_API size_t yampe_state_num_contacts(const yampe_state* state);
+
+/* Fills view with the given field, returns a yampe_status. */
+YAMPE_API int yampe_state_view(const yampe_state* state, int field, yampe_view* view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
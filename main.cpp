@@ -1,8 +1,52 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "YAMPE/Benchmark.h"
+#include "YAMPE/Memory.h"
+#include "YAMPE/Particle/Scene.h"
+#include "YAMPE/Trace.h"
 
 //========================================================================
-int main() {
+int main(int argc, char* argv[]) {
+
+	// named before any worker thread can record, whichever records first
+	YAMPE::Trace::instance().setThreadName("main");
+
+	// --trace records a timeline, written to yampe_trace.json on exit
+	for (int k=1; k<argc; ++k) {
+		if (string(argv[k])=="--trace") {
+			YAMPE::Trace::instance().setEnabled(true);
+			YAMPE::Trace::instance().setExitPath("yampe_trace.json");
+		}
+	}
+
+	// --compile-scene in.xml out.yampe writes the binary form of an authored scene
+	if (argc>3 && string(argv[1])=="--compile-scene") {
+		YAMPE::P::Scene scene;
+		if (!scene.loadXml(argv[2]) || !scene.saveBinary(argv[3])) {
+			cerr <<"Could not compile " <<argv[2] <<" to " <<argv[3] <<endl;
+			return 1;
+		}
+		cout <<scene <<endl;
+		return 0;
+	}
+
+	// headless runner - time the engine scenarios without opening a window
+	if (argc>1 && string(argv[1])=="--headless") {
+		YAMPE::PerfCounters::instance().setEnabled(true);	// hardware counters where available
+		YAMPE::Benchmark benchmark;
+		benchmark.runAll();
+		cout <<benchmark <<endl;
+		cout <<"\nMemory (peak over all scenarios)" <<YAMPE::MemoryTracker::instance().toString() <<endl;
+		return 0;
+	}
+
+	// --publish shares each step's render state, --viewer draws it from another process
+	ofApp* app = new ofApp();
+	for (int k=1; k<argc; ++k) {
+		if (string(argv[k])=="--publish") app->isPublishingRender = true;
+		if (string(argv[k])=="--viewer") app->isViewer = true;
+	}
+
 	ofSetupOpenGL(1024, 768, OF_WINDOW);
-    ofRunApp(new ofApp());
+    ofRunApp(app);
 }
@@ -2,6 +2,12 @@
 
 using namespace YAMPE;
 using namespace P;
+
+// share of count items in one of numChunks equal chunks (for per item counter figures)
+static size_t chunkSize(size_t count, unsigned chunk, unsigned numChunks) {
+    return count*(chunk+1)/numChunks - count*chunk/numChunks;
+}
+
 //--------------------------------------------------------------
 void ofApp::setup() {
     
@@ -21,6 +27,20 @@ void ofApp::setup() {
     // instantiate the ground
     ground.set(RANGE, RANGE);
     ground.rotate(90, 1,0,0);
+
+    // static scenery for ball collisions
+    if (!scenery.loadObj(ofToDataPath("scenery.obj"))) {
+        // the ground quad, wound to face up as faces are one sided
+        float half = RANGE/2;
+        ofMesh floor;
+        floor.addVertex(ofVec3f(-half, 0, -half));
+        floor.addVertex(ofVec3f(-half, 0, half));
+        floor.addVertex(ofVec3f(half, 0, half));
+        floor.addVertex(ofVec3f(half, 0, -half));
+        floor.addTriangle(0, 1, 2);
+        floor.addTriangle(0, 2, 3);
+        scenery.setMesh(floor);
+    }
     
     // lift camera to 'eye' level
     easyCam.setDistance(RANGE);
@@ -29,27 +49,94 @@ void ofApp::setup() {
     easyCam.setTarget(easyCamTarget);
 
     // TODO - simulation specific stuff goes here
-	gravity = GravityForceGenerator::Ref(new GravityForceGenerator(ofVec3f(0.0f, -9.81f, 0.0f), "Gravity Generator"));
+	// compiled scene (see main --compile-scene), otherwise the authored one
+	if (!scene.loadBinary(ofToDataPath("scene.yampe"))) scene.loadXml(ofToDataPath("scene.xml"));
+
+	gravity = GravityForceGenerator::Ref(new GravityForceGenerator(scene.numParticles()>0 ? scene.gravity : ofVec3f(0.0f, -9.81f, 0.0f), "Gravity Generator"));
 
 	contacts = ContactRegistry::Ref(new ContactRegistry());
+	contactGeneration.setLabel("Contacts");
+
+	fountainPool = ParticlePool::Ref(new ParticlePool(FOUNTAIN_CAPACITY, "Fountain Pool"));
+	fountainPool->setForceGeneratorRegistry(&forceGenerators);
+	fountainPool->addForceGenerator(gravity);
+	fountainPool->attach(&scenery.particles);
+	fountain = ParticleEmitter::Ref(new ParticleEmitter(fountainPool, "Fountain"));
+	fountain->rate = 1000.0f;
+	fountain->position = ofVec3f(0.0f, 0.5f, 2.0f);
+	fountain->velocity = ofVec3f(0.0f, 8.0f, 0.0f);
+	fountain->speedSpread = 1.0f;
+	fountain->lifetime = 3.0f;
+	fountain->lifetimeSpread = 1.0f;
+	fountain->color = ofColor(64, 128, 255);
+	fountain->isEnabled = false;
+
+	// multirate substeps generate the ball contacts of the due balls, met
+	// with the balls not due too, so those hit mid-step are promoted
+	multirate.forces = [this](const ParticleRegistry& due, float dt) {
+		for (auto && p: due) forceGenerators.applyForce(p, dt);
+	};
+	multirate.generate = [this](const ParticleRegistry& due, ContactRegistry::Ref buffer) {
+		constraints.generate(particles, buffer);
+		if (due.size()>=particles.size()) ppContactGenerator.generate(buffer);
+		else ppContactGenerator.generate(buffer, [this](const Particle* p) { return multirate.isDue(p); });
+		scenery.generate(buffer);
+	};
+	multirate.resolved = [this](const ContactRegistry& resolved) {
+		if (isPublishingState) stateViews.publishContacts(resolved, particles);
+	};
+
+	PerfCounters& perf = PerfCounters::instance();
+	perfForces = perf.addPhase("Forces");
+	perfIntegrate = perf.addPhase("Integrate");
+	perfConstraints = perf.addPhase("Constraints");
+	perfBalls = perf.addPhase("Balls");
+	perfScenery = perf.addPhase("Scenery");
+	perfResolve = perf.addPhase("Resolve");
     
     // finally start everything off by resetting the simulation
     reset();
+
+	if (isViewer) renderRing.attach(renderRingName);
+	if (isPublishingRender) isPublishingRender = renderRing.create(renderRingName, RENDER_MAX_PARTICLES, RENDER_MAX_LINES);
     
 }
 
 void ofApp::reset() {
     t = 0.0f;
     
+	fountainPool->clear();
+	mortonOrder.clear();
 	particles.clear();
 	forceGenerators.clear();
 	ppContactGenerator.particles.clear();
-	anchorConstraints.clear();
+	ppContactGenerator.filter.clear();
+	scenery.particles.clear();
+	constraints.clear();
+	springs.clear();
+
+	if (scene.numParticles()>0) {
+		scene.instantiate(particles, constraints, &springs, forceGenerators, gravity);
+		for (size_t k=0; k<particles.size(); ++k) {
+			if ((scene.columns().flags[k] & Scene::CONTACTS)==0) continue;
+			ppContactGenerator.particles.push_back(particles[k]);
+			scenery.particles.push_back(particles[k]);
+		}
+		// linked particles (ropes, cloth) touch by construction
+		if (isExcludingLinks) {
+			for (unsigned row=0; row<constraints.size(); ++row) {
+				if (!constraints.isAnchored(row)) ppContactGenerator.filter.exclude(particles[constraints.a[row]], particles[constraints.b[row]]);
+			}
+			for (auto && s: springs.springs) {
+				if (!springs.isAnchored(s)) ppContactGenerator.filter.exclude(particles[s.i], particles[s.j]);
+			}
+		}
+	}
 
 	startPosX = -(numOfBalls * (BALL_RADIUS * 2 + eps)) / 2;
 	float xPos = startPosX;
 
-	for (int k = 0; k < numOfBalls; ++k) {
+	for (int k = 0; k < numOfBalls && scene.numParticles()==0; ++k) {
 		//generate particles with rand position, and add to particles
 		Particle::Ref ball = Particle::Ref(new Particle());
 		ofVec3f anchorPos = ofVec3f(xPos, ANCHOR_HEIGHT, 0.0f);
@@ -71,33 +158,241 @@ void ofApp::reset() {
 			.acceleration = ofVec3f::zero();
 
 		//set up anchors first
-		EqualityAnchoredConstraint::Ref constraint = EqualityAnchoredConstraint::Ref(new EqualityAnchoredConstraint(ball, anchorPos, ANCHOR_LENGTH));
-		
-		anchorConstraints.push_back(constraint);
+		constraints.addAnchored(ConstraintTable::EQUALITY, (unsigned) particles.size(), anchorPos, ANCHOR_LENGTH);
+
 		particles.push_back(ball);
 		forceGenerators.add(ball, gravity);
 		ppContactGenerator.particles.push_back(ball);
+		scenery.particles.push_back(ball);
 
 		xPos += BALL_RADIUS * 2.0f + eps;
 	}
+
+	if (isTreeSolverEnabled) treeSolver.attach(particles, constraints);
+	if (isEventDriven) eventCradle.load(particles, constraints);
+
+	multirate.clear();
+	multirate.particles = particles;
+
+	// contact generation tasks, chunk counts depend only on scene size
+	unsigned chunks = 1 + (unsigned) particles.size()/PARTICLES_PER_CHUNK;
+	contactGeneration.clear();
+	contactGeneration.add("Constraints", chunks,
+		[this](ContactRegistry::Ref buffer, unsigned chunk, unsigned numChunks) {
+			PerfCounters::Scope scope(perfConstraints, chunkSize(constraints.size(), chunk, numChunks));
+			constraints.generate(particles, buffer, chunk, numChunks);
+		},
+		[this]() { constraints.prepare(particles); });
+	contactGeneration.add("Balls", chunks,
+		[this](ContactRegistry::Ref buffer, unsigned chunk, unsigned numChunks) {
+			PerfCounters::Scope scope(perfBalls, chunkSize(particles.size(), chunk, numChunks));
+			ppContactGenerator.generate(buffer, chunk, numChunks);
+		},
+		[this]() { ppContactGenerator.prepare(); });
+	contactGeneration.add("Scenery", chunks,
+		[this](ContactRegistry::Ref buffer, unsigned chunk, unsigned numChunks) {
+			PerfCounters::Scope scope(perfScenery, chunkSize(particles.size(), chunk, numChunks));
+			scenery.generate(buffer, chunk, numChunks);
+		});
+
+	// step pipeline, the contact generation tasks overlap each other
+	stepGraph.clear();
+	TaskGraph::Id forces = stepGraph.add("Forces", 1,
+		[this](unsigned, unsigned) {
+			PerfCounters::Scope scope(perfForces, particles.size());
+			forceGenerators.applyForce(stepDt);
+			if (springs.size()>0 && !isImplicit) springs.applyForce(particles, stepDt);
+		});
+	TaskGraph::Id integrate;
+	if (isImplicit && springs.size()>0) {
+		// one linear solve couples all the particles, so a single chunk applying the springs itself
+		integrate = stepGraph.add("Integrate (implicit)", 1,
+			[this](unsigned, unsigned) {
+				PerfCounters::Scope scope(perfIntegrate, particles.size());
+				implicitIntegrator.integrate(particles, springs, stepDt);
+			}, { forces });
+	}
+	else {
+		integrate = stepGraph.add("Integrate", chunks,
+			[this](unsigned chunk, unsigned numChunks) {
+				PerfCounters::Scope scope(perfIntegrate, chunkSize(particles.size(), chunk, numChunks));
+				size_t end = particles.size()*(chunk+1)/numChunks;
+				for (size_t k=particles.size()*chunk/numChunks; k<end; ++k) particles[k]->integrate(stepDt);
+			}, { forces });
+	}
+	TaskGraph::Id integrateFountain = stepGraph.add("Integrate fountain", FOUNTAIN_CHUNKS,
+		[this](unsigned chunk, unsigned numChunks) {
+			const ParticleRegistry& live = fountainPool->live();
+			size_t end = live.size()*(chunk+1)/numChunks;
+			for (size_t k=live.size()*chunk/numChunks; k<end; ++k) live[k]->integrate(stepDt);
+		}, { forces });
+	TaskGraph::Id generated = contactGeneration.schedule(stepGraph, contacts, { integrate, integrateFountain });
+	if (isDeterministic) {
+		TaskGraph::Id islands = stepGraph.add("Islands", 1,
+			[this](unsigned, unsigned) { numIslands = contacts->prepareIslands(); }, { generated });
+		TaskGraph::Id resolved = stepGraph.add("Resolve", RESOLVE_CHUNKS,
+			[this](unsigned chunk, unsigned numChunks) {
+				PerfCounters::Scope scope(perfResolve, chunkSize(numIslands, chunk, numChunks));
+				contacts->resolveIslands(stepDt, chunk, numChunks);
+			}, { islands });
+		stepGraph.add("Clear contacts", 1,
+			[this](unsigned, unsigned) {
+				if (isPublishingState) stateViews.publishContacts(*contacts, particles);
+				contacts->clear();
+			}, { resolved });
+	}
+	else {
+		stepGraph.add("Resolve", 1,
+			[this](unsigned, unsigned) {
+				PerfCounters::Scope scope(perfResolve, contacts->size());
+				contacts->setIterationLimit(std::max(MIN_ITERATION_LIMIT, unsigned(ITERATIONS_PER_CONTACT*contacts->size())));
+				contacts->resolve(stepDt);
+				if (isPublishingState) stateViews.publishContacts(*contacts, particles);
+				contacts->clear();
+			}, { generated });
+	}
+}
+
+// Z-order of the scene particles, everything naming them by index or Ref follows
+void ofApp::reorderParticles() {
+	YAMPE_TRACE_SCOPE("Reorder");
+	mortonOrder.reorder(particles);
+	auto remap = [this](const Particle::Ref& p) { return mortonOrder.remap(p); };
+	forceGenerators.remapParticles(remap);
+	contacts->remapParticles(remap);
+	mortonOrder.remap(ppContactGenerator.particles);
+	ppContactGenerator.filter.remapParticles(remap);
+	mortonOrder.remap(scenery.particles);
+	mortonOrder.remap(multirate.particles);
+	multirate.clear();
+	constraints.remapParticles(mortonOrder.rank());
+	springs.remapParticles(mortonOrder.rank());
+	if (isTreeSolverEnabled) treeSolver.attach(particles, constraints);
 }
 
 void ofApp::update() {
 
+	// viewer - the simulation runs in another process
+	if (isViewer) {
+		// a restarted simulation creates a new ring, the old one stops advancing
+		bool isStale = viewerIdleFrames>=VIEWER_RECHECK_FRAMES;
+		if (isStale) viewerIdleFrames = 0;
+		if (!renderRing.isOpen() || (isStale && renderRing.isReplaced())) {
+			if (renderRing.attach(renderRingName)) viewerFrame = RenderRing::Frame();
+		}
+		if (renderRing.read(viewerFrame)) viewerIdleFrames = 0;
+		else ++viewerIdleFrames;
+		return;
+	}
+
     float dt = ofClamp(ofGetLastFrameTime(), 0.0, 0.02);
     if (dt <= 0.0f || !isRunning) return;
     t += dt;
 
-	forceGenerators.applyForce(dt);
-	for (auto p : particles) p->integrate(dt);
-	
-	//loop and update constraints
-	for (auto c : anchorConstraints) c->generate(contacts);
+	// the state views are invalid from beginStep() to publish(), in either mode
+	YAMPE_TRACE_SCOPE("Step");
+	if (isPublishingState) stateViews.beginStep();
+	if (isEventDriven) {
+		// pendulums between impacts, impulse chains at impacts
+		eventCradle.advance(dt);
+		eventCradle.store(particles);
+		// impacts are not contacts, the registry (cleared by every step) publishes none
+		if (isPublishingState) stateViews.publishContacts(*contacts, particles);
+	}
+	else {
+		step(dt);
+	}
+
+	if (isDeterministic) stateHash = hashState(particles);
+	if (isPublishingState) stateViews.publish(particles);
+	if (isPublishingRender) {
+		collectGeometry(renderLines, renderAnchors);
+		renderRing.publish(t, particles, renderLines, renderAnchors);
+	}
+
+	// allocations per step, in either mode
+	MemoryTracker::instance().endStep();
+}
+
+// one impulse based step of the scene and the fountain
+void ofApp::step(float dt) {
+
+	// expired fountain particles are recycled before the step, new ones join it
+	fountainPool->update(dt);
+	fountain->update(dt);
+
+	// scenery contacts sweep the whole step, so fast particles cannot pass through
+	scenery.sweepDt = dt;
+
+	if (isMortonOrdered && scene.numParticles()>0 && mortonOrder.isDue(particles)) reorderParticles();
+
+	// forces, integration, string constraints, ball and scenery contacts, resolution
+	if (isMultirate && !isDeterministic && springs.size()==0) {
+		// the fountain at the coarse rate, its scenery contacts resolved at the end of the step
+		for (auto && p: fountainPool->live()) {
+			forceGenerators.applyForce(p, dt);
+			p->integrate(dt);
+		}
+		multirate.step(dt, contacts);
+	}
+	else {
+		stepDt = dt;
+		stepGraph.run();
+	}
+
+	PerfCounters& perf = PerfCounters::instance();
+	if (perf.isEnabled()) {
+		perf.endStep();
+		if (++perfSteps==PERF_REPORT_STEPS) {
+			perf.report(perfReports);
+			perf.reset();
+			perfSteps = 0;
+		}
+	}
+
+	// strings of acyclic constraint graphs are satisfied exactly
+	if (isTreeSolverEnabled) treeSolver.solve(particles, constraints);
+}
 
-	ppContactGenerator.generate(contacts);
+// strings, as pairs of end points, and the cradle's anchors - drawn by draw() and published to a viewer
+void ofApp::collectGeometry(vector<ofVec3f>& lines, vector<ofVec3f>& anchors) const {
+	lines.clear();
+	anchors.clear();
+	if (scene.numParticles()>0) {
+		// loaded scene - strings from the anchored rows of the constraint table
+		for (unsigned row = 0; row < constraints.size(); ++row) {
+			if (!constraints.isAnchored(row)) continue;
+			lines.push_back(constraints.anchor(row));
+			lines.push_back(particles[constraints.a[row]]->position);
+		}
+		return;
+	}
+	float xPos = startPosX;
+	for (auto p : particles) {
+		ofVec3f anchor(xPos, ANCHOR_HEIGHT, 0.0f);
+		lines.push_back(anchor);
+		lines.push_back(ofVec3f(p->position.x, p->position.y, 0.0f));
+		anchors.push_back(anchor);
+		xPos += BALL_RADIUS * 2.0f + eps;
+	}
+	float extent = particles.size() * (BALL_RADIUS * 2 + eps);
+	lines.push_back(ofVec3f(-extent, ANCHOR_HEIGHT, 0.0f));
+	lines.push_back(ofVec3f(extent, ANCHOR_HEIGHT, 0.0f));
+}
+
+void ofApp::drawGeometry(const vector<ofVec3f>& lines, const vector<ofVec3f>& anchors) {
+	ofSetColor(255, 255, 255);
+	for (size_t k = 0; k+1 < lines.size(); k += 2) ofDrawLine(lines[k], lines[k+1]);
+	for (auto && anchor : anchors) ofDrawSphere(anchor, 0.1f);
+}
 
-	contacts->resolve(dt);
-	contacts->clear();
+// a frame published by another process
+void ofApp::drawFrame(const RenderRing::Frame& frame) {
+	drawGeometry(frame.lines, frame.anchors);
+	for (size_t k = 0; k < frame.numParticles(); ++k) {
+		ofSetHexColor(frame.color[k]);
+		ofDrawSphere(ofVec3f(frame.position[3*k], frame.position[3*k+1], frame.position[3*k+2]), frame.radius[k]);
+	}
 }
 
 void ofApp::draw() {
@@ -120,16 +415,16 @@ void ofApp::draw() {
     }
 
 
-	float xPos = startPosX;
-	for (auto p : particles) {
-		ofSetColor(255, 255, 255);
-		ofDrawLine(xPos, ANCHOR_HEIGHT, p->position.x, p->position.y);
-		ofDrawSphere(xPos, ANCHOR_HEIGHT, 0.1f);
-		p->draw();
-		xPos += BALL_RADIUS * 2.0f + eps;
+	if (isViewer) {
+		drawFrame(viewerFrame);
+	}
+	else if (isSimulationDrawn) {
+		// not drawn when published to a viewer, GL kept off the simulation
+		collectGeometry(renderLines, renderAnchors);
+		drawGeometry(renderLines, renderAnchors);
+		for (auto p : particles) p->draw();
+		for (auto p : fountainPool->live()) p->draw();
 	}
-
-	ofDrawLine(-(particles.size() * (BALL_RADIUS * 2 + eps)), ANCHOR_HEIGHT, particles.size() * (BALL_RADIUS * 2 + eps), ANCHOR_HEIGHT);
 
     easyCam.end();
     ofPopStyle();
@@ -233,15 +528,166 @@ void ofApp::drawMainWindow() {
 		if (ImGui::SliderInt("Balls at an angle", &ballsAtAngle, MIN_BALLS, MAX_BALLS))reset();
 		if (ImGui::SliderFloat("Ball angle", &ballAngle, MIN_BALL_ANGLE, MAX_BALL_ANGLE)) reset();
 		if (ImGui::SliderFloat("Epsilon (spacing)", &eps, 0.0f, 1.0f)) reset();
+		if (ImGui::Checkbox("Direct tree solver", &isTreeSolverEnabled)) {
+			if (isTreeSolverEnabled) treeSolver.attach(particles, constraints);
+			else treeSolver.detach(constraints);
+		}
+		if (ImGui::Checkbox("Event driven", &isEventDriven)) {
+			if (isEventDriven) eventCradle.load(particles, constraints);
+		}
+		if (ImGui::Checkbox("Deterministic (islands)", &isDeterministic)) reset();
+		if (scene.numParticles()>0) {
+			ImGui::Checkbox("Morton order", &isMortonOrdered);
+			if (isMortonOrdered) ImGui::SliderFloat("Reorder at disorder", &mortonOrder.threshold, 0.01f, 0.5f);
+			if (ImGui::Checkbox("Exclude linked pairs", &isExcludingLinks)) reset();
+		}
+		if (ImGui::Checkbox("Neighbour lists", &ppContactGenerator.isNeighbourListEnabled)) {
+			ppContactGenerator.neighbourList.invalidate();
+			ppContactGenerator.neighbourList.resetStatistics();
+		}
+		if (ppContactGenerator.isNeighbourListEnabled) {
+			ImGui::SliderFloat("Neighbour skin", &ppContactGenerator.neighbourList.skin, 0.0f, 1.0f);
+		}
+		if (springs.size()>0 && ImGui::Checkbox("Implicit springs", &isImplicit)) reset();
+		if (!isDeterministic && springs.size()==0) {
+			if (ImGui::Checkbox("Multirate", &isMultirate)) multirate.clear();
+			if (isMultirate) {
+				int levels = (int) multirate.maxLevel;
+				if (ImGui::SliderInt("Multirate levels", &levels, 0, (int) MultirateStepper::MAX_LEVEL)) {
+					multirate.maxLevel = multirate.contactLevel = (unsigned) levels;
+				}
+				ImGui::SliderFloat("Travel per step (radii)", &multirate.maxTravel, 0.01f, 1.0f);
+			}
+		}
+		if (!isDeterministic && ImGui::SliderFloat("Resolve budget (ms)", &resolveBudget, 0.0f, 10.0f)) {
+			contacts->setTimeBudget(resolveBudget*1000.0);
+		}
+		if (ImGui::Checkbox("Publish to viewer", &isPublishingRender)) {
+			if (isPublishingRender) isPublishingRender = renderRing.create(renderRingName, RENDER_MAX_PARTICLES, RENDER_MAX_LINES);
+			else renderRing.close();
+		}
+		if (isPublishingRender) ImGui::Checkbox("Draw simulation", &isSimulationDrawn);
+		if (ImGui::Checkbox("Publish state (C API)", &isPublishingState)) {
+			StateViews::setCurrent(isPublishingState ? &stateViews : NULL);
+		}
+		ImGui::Checkbox("Fountain", &fountain->isEnabled);
+		if (fountain->isEnabled) ImGui::SliderFloat("Fountain rate", &fountain->rate, 0.0f, 5000.0f);
 
         
         if (ImGui::CollapsingHeader("Numerical Output")) {
-            
+            if (scene.numParticles()>0) {
+                ImGui::Text("Scene: %u particles, %u constraints, %u springs%s", (unsigned) scene.numParticles(),
+                    (unsigned) scene.columns().numConstraints, (unsigned) scene.columns().numSprings,
+                    scene.isMapped() ? " (compiled)" : "");
+            }
+            if (isImplicit && springs.size()>0) {
+                ImGui::Text("Implicit springs: %u CG iterations, residual %g",
+                    implicitIntegrator.iterationUsed, implicitIntegrator.residual);
+            }
+            if (isTreeSolverEnabled) {
+                ImGui::Text("Tree solver: %u rows (%u cyclic), %u iterations, error %g",
+                    (unsigned) treeSolver.numRows(), (unsigned) treeSolver.numCyclicRows(),
+                    treeSolver.iterationUsed, treeSolver.maxError);
+            }
+            if (!isDeterministic) {
+                const ContactRegistry::Residual& residual = contacts->residual();
+                ImGui::Text("Resolve: %u iterations in %.0f us%s", residual.iterations, residual.micros,
+                    residual.isOutOfTime ? " (out of time)" : residual.isLimitReached ? " (iteration limit)" : "");
+                if (residual.numUnresolved>0) {
+                    ImGui::Text("    %u unresolved, penetration max %.4f total %.4f, closing %.4f", residual.numUnresolved,
+                        residual.maxPenetration, residual.totalPenetration, residual.maxClosingVelocity);
+                }
+            }
+            if (isDeterministic) {
+                ImGui::Text("State hash %016llx, %u islands", (unsigned long long) stateHash, (unsigned) numIslands);
+            }
+            if (isViewer || isPublishingRender) {
+                ImGui::Text("Render ring %s: %llu frames%s", renderRingName.c_str(), (unsigned long long) renderRing.numPublished(),
+                    isViewer ? (renderRing.isOpen() ? "" : " (waiting for simulation)") : "");
+                if (isViewer) ImGui::Text("    showing frame %llu at t = %.2f", (unsigned long long) viewerFrame.frame, viewerFrame.time);
+            }
+            if (isPublishingState) {
+                ImGui::Text("Published state: version %llu, %u particles%s, %u contacts", (unsigned long long) stateViews.version(),
+                    (unsigned) stateViews.numParticles(), stateViews.isZeroCopy() ? " (in place)" : " (gathered)", (unsigned) stateViews.numContacts());
+            }
+            if (isMortonOrdered) {
+                ImGui::Text("Morton order: %u reorders, disorder %.3f", mortonOrder.numReorders(), mortonOrder.lastDisorder());
+            }
+            if (isMultirate) {
+                ImGui::Text("Multirate: %s, %u promotions", multirate.toString().c_str(), (unsigned) multirate.numPromotions());
+            }
+            if (ppContactGenerator.isNeighbourListEnabled) {
+                const NeighbourList& neighbours = ppContactGenerator.neighbourList;
+                ImGui::Text("Neighbour lists: %u pairs, %u builds in %u steps (%.1f%%), last %.0f us", (unsigned) neighbours.numPairs(),
+                    neighbours.numBuilds(), neighbours.numUpdates(), 100.0f*neighbours.rebuildRate(), neighbours.lastBuildMicros());
+            }
+            if (ppContactGenerator.filter.numExclusions()>0) {
+                ImGui::Text("Collision filter: %u excluded pairs", (unsigned) ppContactGenerator.filter.numExclusions());
+            }
+            if (fountainPool->numSpawned()>0) {
+                ImGui::Text("Fountain: %u live of %u, %u spawned, %u retired", (unsigned) fountainPool->size(),
+                    (unsigned) fountainPool->capacity(), (unsigned) fountainPool->numSpawned(), (unsigned) fountainPool->numRetired());
+            }
+            if (isEventDriven) {
+                ImGui::Text("Events: %u impacts, %u steps, energy %.6f",
+                    eventCradle.numImpacts, eventCradle.numSteps, eventCradle.energy());
+            }
         }
         
         if (ImGui::CollapsingHeader("Graphical Output")) {
             // TODO - graphical output goes here
         }
+
+        if (ImGui::CollapsingHeader("Step Tasks")) {
+            ImGui::Text("Step %.1f us on %u threads, %u steals", stepGraph.lastRunMicros(), stepGraph.numThreads(), stepGraph.steals());
+            for (TaskGraph::Id k=0; k<stepGraph.numTasks(); ++k) {
+                const TaskGraph::Timing& timing = stepGraph.timing(k);
+                ImGui::Text("%-20s x%-3u %7.1f - %7.1f us  busy %7.1f  imbalance %.2f",
+                    stepGraph.taskLabel(k).c_str(), stepGraph.numChunks(k), timing.start, timing.end,
+                    timing.busy, timing.imbalance(stepGraph.numChunks(k)));
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Performance Counters")) {
+            PerfCounters& perf = PerfCounters::instance();
+            bool isEnabled = perf.isEnabled();
+            if (ImGui::Checkbox("Count##PerfCounters", &isEnabled)) {
+                perf.setEnabled(isEnabled);
+                perf.reset();
+                perfReports.clear();
+                perfSteps = 0;
+            }
+            if (!perf.isAvailable()) {
+                ImGui::TextDisabled("Unavailable (Linux only, see perf_event_paranoid)");
+            }
+            for (auto && r: perfReports) {
+                ImGui::Text("%-12s %9.0f cycles  IPC %.2f  %6.0f items", r.label.c_str(), r.value[PerfCounters::CYCLES], r.ipc(), r.items);
+                ImGui::TextDisabled("    per item: L1D %.2f  LLC %.2f  branch %.2f",
+                    r.perItem(PerfCounters::L1D_MISSES), r.perItem(PerfCounters::LLC_MISSES), r.perItem(PerfCounters::BRANCH_MISSES));
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Memory")) {
+            MemoryTracker& memory = MemoryTracker::instance();
+            if (ImGui::Button("Reset peaks##Memory")) memory.reset();
+            memory.report(memoryReports);
+            for (auto && r: memoryReports) {
+                ImGui::Text("%-20s %9.1f kB  peak %9.1f kB  %6.1f allocs/step (last %u)", r.label, r.liveBytes/1024.0, r.peakBytes/1024.0,
+                    r.allocationsPerStep, (unsigned) r.lastStepAllocations);
+                if (r.budget>0) ImGui::TextDisabled("    budget %.1f kB, exceeded %u times", r.budget/1024.0, (unsigned) r.overBudget);
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Benchmarks")) {
+            if (ImGui::Button("Run##Benchmarks")) {
+                benchmark.clear();
+                benchmark.runAll();
+            }
+            for (auto && result: benchmark.results) {
+                ImGui::Text("%-32s %9.3f us  %6.1f allocs", result.label.c_str(), result.microsPerIteration, result.allocations);
+                if (!result.note.empty()) ImGui::TextDisabled("    %s", result.note.c_str());
+            }
+        }
     }
     
     // store window size so that camera can ignore mouse clicks
@@ -257,6 +703,40 @@ void ofApp::drawLoggingWindow() {
     ImGui::SetNextWindowPos(ImVec2(ofGetWindowWidth()-300,20), ImGuiSetCond_Always);
     
     if (ImGui::Begin("Logging")) {
+
+        // engine log records are formatted here, never on the simulation step
+        if (ImGui::Checkbox("Log to file", &isLogToFile)) {
+            if (isLogToFile) isLogToFile = Log::instance().startFileSink(ofToDataPath("yampe.log"));
+            else Log::instance().stopFileSink();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear##Logging")) logLines.clear();
+
+        // timeline of the step phases, for chrome://tracing or ui.perfetto.dev
+        isTracing = Trace::instance().isEnabled();
+        if (ImGui::Checkbox("Trace", &isTracing)) {
+            Trace::instance().setEnabled(isTracing);
+            Trace::instance().setExitPath(isTracing ? ofToDataPath("yampe_trace.json") : "");
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Write trace")) Trace::instance().write(ofToDataPath("yampe_trace.json"));
+        ImGui::SameLine();
+        ImGui::Text("%u events", (unsigned) Trace::instance().size());
+
+        if (!Log::instance().isFileSinkRunning()) {
+            char line[512];
+            Log::Record record;
+            while (Log::instance().pop(record)) {
+                Log::format(record, line, sizeof(line));
+                logLines.push_back(line);
+                if (logLines.size()>MAX_LOG_LINES) logLines.pop_front();
+            }
+        }
+        if (Log::instance().dropped()>0) ImGui::Text("Dropped records: %llu", (unsigned long long)Log::instance().dropped());
+
+        ImGui::BeginChild("LogLines");
+        for (auto && line: logLines) ImGui::TextUnformatted(line.c_str());
+        ImGui::EndChild();
     }
     // store window size so that camera can ignore mouse clicks
     loggingWindowRectangle.setPosition(ImGui::GetWindowPos().x,ImGui::GetWindowPos().y);
@@ -4,11 +4,31 @@
 #include "ofxImGui.h"
 
 #include "ofxXmlSettings.h"
+#include "YAMPE/Benchmark.h"
+#include "YAMPE/Determinism.h"
+#include "YAMPE/Log.h"
+#include "YAMPE/Memory.h"
+#include "YAMPE/PerfCounters.h"
+#include "YAMPE/RenderRing.h"
+#include "YAMPE/Trace.h"
 #include "YAMPE/Particle.h"
 #include "YAMPE/Particle/ForceGeneratorRegistry.h"
 #include "YAMPE/Particle/ContactRegistry.h"
 #include "YAMPE/Particle/ContactGenerators.h"
 #include "YAMPE\Particle\Constraints.h"
+#include "YAMPE/Particle/ConstraintTable.h"
+#include "YAMPE/Particle/EventCradle.h"
+#include "YAMPE/Particle/ImplicitIntegrator.h"
+#include "YAMPE/Particle/MeshContactGenerator.h"
+#include "YAMPE/Particle/MortonOrder.h"
+#include "YAMPE/Particle/MultirateStepper.h"
+#include "YAMPE/Particle/ParallelContactGenerator.h"
+#include "YAMPE/Particle/ParticlePool.h"
+#include "YAMPE/Particle/Scene.h"
+#include "YAMPE/Particle/SpringNetwork.h"
+#include "YAMPE/Particle/StateViews.h"
+#include "YAMPE/Particle/TreeConstraintSolver.h"
+#include "YAMPE/TaskGraph.h"
 
 
 class ofApp : public ofBaseApp {
@@ -45,9 +65,15 @@ public:
     void drawAppMenuBar();
     void drawMainWindow();
     void drawLoggingWindow();
+    deque<string> logLines;                 // formatted engine log records shown in logging window
+    const size_t MAX_LOG_LINES = 200;
+    bool isLogToFile = false;
+    bool isTracing = false;
     
     // simimulation (generic)
     void reset();
+    void step(float dt);
+    void reorderParticles();
     void quit();
     float t = 0.0f;
     bool isRunning = true;
@@ -67,14 +93,85 @@ public:
 	float ballAngle{ 45 };
 	float startPosX{ 0.0 };
 
-	vector<YAMPE::P::EqualityAnchoredConstraint::Ref> anchorConstraints;
+	YAMPE::P::ConstraintTable constraints;
+	YAMPE::P::TreeConstraintSolver treeSolver;			// exact solve of chain/tree strings, loops stay iterative
+	bool isTreeSolverEnabled = false;
+	YAMPE::P::EventCradle eventCradle;					// event driven alternative to the fixed step update
+	bool isEventDriven = false;
 
 	YAMPE::ParticleRegistry particles;
 	YAMPE::P::ForceGeneratorRegistry forceGenerators;
 	YAMPE::P::GravityForceGenerator::Ref gravity;
+	YAMPE::P::SpringNetwork springs;
+	YAMPE::P::ImplicitIntegrator implicitIntegrator;		// backward Euler over the springs, replaces Integrate in stepGraph
+	bool isImplicit = false;
+
+	// fountain of short-lived particles bouncing off the scenery, recycled through a pool
+	YAMPE::P::ParticlePool::Ref fountainPool;
+	YAMPE::P::ParticleEmitter::Ref fountain;
+	const size_t FOUNTAIN_CAPACITY = 5000;
+	const unsigned FOUNTAIN_CHUNKS = 4;
+
+	YAMPE::P::Scene scene;								// data/scene.yampe or data/scene.xml, replaces the cradle if present
+	YAMPE::P::MortonOrder mortonOrder;					// scene particles re-sorted into Z-order as they mix
+	bool isMortonOrdered = false;
 
 	YAMPE::P::ContactRegistry::Ref contacts;
+	float resolveBudget = 0.0f;							// ms per step for contact resolution, 0 for none
+
+	// render state shared with an out of process viewer (main --publish / --viewer)
+	YAMPE::RenderRing renderRing;
+	string renderRingName = "/yampe_render";
+	bool isPublishingRender = false;					// simulation side, publish every step
+	bool isViewer = false;								// viewer side, draw the latest published frame only
+	bool isSimulationDrawn = true;
+	YAMPE::RenderRing::Frame viewerFrame;
+	unsigned viewerIdleFrames = 0;						// viewer frames without a new simulation frame
+	const unsigned VIEWER_RECHECK_FRAMES = 60;			// idle frames before checking for a restarted simulation
+	vector<ofVec3f> renderLines;						// end point pairs of the strings, reused
+	vector<ofVec3f> renderAnchors;
+	const unsigned RENDER_MAX_PARTICLES = 100000;
+	const unsigned RENDER_MAX_LINES = 100000;
+	void collectGeometry(vector<ofVec3f>& lines, vector<ofVec3f>& anchors) const;
+	void drawGeometry(const vector<ofVec3f>& lines, const vector<ofVec3f>& anchors);
+	void drawFrame(const YAMPE::RenderRing::Frame& frame);
+
+	YAMPE::P::StateViews stateViews;					// state read in place through the C API (yampe_state.h)
+	bool isPublishingState = false;
 	YAMPE::P::ParticleParticleContactGenerator ppContactGenerator;
+	bool isExcludingLinks = true;						// no ball contacts between particles linked by a constraint or spring
+	YAMPE::P::MeshContactGenerator scenery;				// data/scenery.obj if present, otherwise the ground
+
+	YAMPE::P::ParallelContactGenerator contactGeneration;	// constraints, ball and scenery contacts, chunked
+	const unsigned PARTICLES_PER_CHUNK = 256;
+
+	// multirate mode - particles substepped by contact activity and velocity (not with springs)
+	YAMPE::P::MultirateStepper multirate;
+	bool isMultirate = false;
+
+	YAMPE::TaskGraph stepGraph;							// forces -> integrate -> contact generation -> resolve
+	float stepDt = 0.0f;								// time step of the step being run by stepGraph
+
+	// determinism mode - contacts resolved by islands over a fixed number of chunks,
+	// so the state is bitwise the same for any number of threads
+	bool isDeterministic = false;
+	const unsigned RESOLVE_CHUNKS = 16;
+
+	// the fountain landing on the scenery makes far more contacts than the
+	// registry's default limit, so resolve() gets this many per contact
+	const unsigned MIN_ITERATION_LIMIT = YAMPE::P::ContactRegistry::DEFAULT_ITERATION_LIMIT;
+	const unsigned ITERATIONS_PER_CONTACT = 2;
+	size_t numIslands = 0;
+	uint64_t stateHash = 0;
+
+	// hardware counters per step phase, averaged over PERF_REPORT_STEPS steps
+	unsigned perfForces, perfIntegrate, perfConstraints, perfBalls, perfScenery, perfResolve;
+	vector<YAMPE::PerfCounters::Report> perfReports;
+	vector<YAMPE::MemoryTracker::Report> memoryReports;
+	unsigned perfSteps = 0;
+	const unsigned PERF_REPORT_STEPS = 60;
+
+	YAMPE::Benchmark benchmark;
 
 	const int MAX_BALLS = 20;
 	const int MIN_BALLS = 0;